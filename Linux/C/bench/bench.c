@@ -0,0 +1,689 @@
+/************************************************************************
+
+Throughput benchmarks for the MultiHarp demo code paths
+
+Measures on synthetic data from ../common/tttrgen.c, without hardware
+and without the MHLib:
+
+  - records/s of the record decoders (ProcessT2/T3 with callbacks as in
+    the instant processing demos, and the batch decoders DecodeT2/T3)
+  - histogram increments/s of T3 instant histogramming
+  - bins/s of the histogram summary of histomode, the scalar integral
+    per channel it had before and the single pass statistics of
+    ../common/histstats.c
+  - bins/s of the pile-up and dead-time correction of
+    ../common/histcorrect.c
+  - bins/s of adding readouts into the 64 bit sums of
+    ../common/histaccum.c
+  - records/s of the software histograms of T2 data of
+    ../common/t2histo.c, sync against all inputs (start-stop) and
+    input pairs (multistop), including the decoding
+  - pixels/s of the lifetime fit of ../common/flimfit.c
+  - GB/s of the raw file writer as used by the tttrmode demo
+  - records/s of a complete T3 pipeline: generate, decode, histogram
+    and write
+  - events/s of the loop instrumentation in ../common/mhtrace.c
+
+Every benchmark is repeated and reported with median, 10th and 90th
+percentile, min and max of the rates. With -o the results are also
+written as CSV, one line per benchmark, so that results of different
+versions can be compared with any tool.
+
+Usage: mhbench [-r reps] [-n records] [-f tempfile] [-o results.csv] [name...]
+
+If names are given, only the benchmarks whose names start with one of
+them are run.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "tttrgen.h"
+#include "mhtrace.h"
+#include "histstats.h"
+#include "histsparse.h"
+#include "histanalysis.h"
+#include "flimfit.h"
+#include "histcorrect.h"
+#include "histaccum.h"
+#include "t2histo.h"
+#include "mhrt.h"
+
+
+#define DEFAULT_REPS     11
+#define DEFAULT_RECORDS  (16 * 1024 * 1024)
+#define MAXREPS          1000
+
+typedef struct
+{
+  const char* name;
+  const char* unit;
+  double scale;                // the unit in items/s
+  double (*run)(void);         // returns the number of items processed
+} Benchmark;
+
+static unsigned int* t2records;
+static unsigned int* t3records;
+static int nrecords;
+static TTTREvent* events;
+static unsigned int histogram[MAXINPCHAN + 1][T3HISTBINS];
+static uint32_t sparse[SPARSE_HEADWORDS + T3HISTBINS];
+static FlimCube cube;
+static unsigned int corrected[T3HISTBINS];
+static HistCorrector corrector;
+static HistAccum accum;
+static HistBlock readout;
+static T2Histo t2histo;
+static const char* tempfile = "mhbench.tmp";
+
+// results of the callbacks, so that the compiler cannot drop the work
+static uint64_t photons;
+static uint64_t markers;
+static uint64_t lasttime;
+static double integral;
+
+
+static int Compare(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+// nearest rank percentile of sorted values
+static double Percentile(const double* v, int n, double p)
+{
+  int i = (int)(p / 100.0 * n + 0.5) - 1;
+  return v[(i < 0) ? 0 : (i >= n) ? n - 1 : i];
+}
+
+
+static void GotPhoton(void* user, uint64_t time, int channel, int dtime)
+{
+  photons++;
+  lasttime = time;
+}
+
+
+static void GotMarker(void* user, uint64_t time, int m)
+{
+  markers++;
+}
+
+
+static void GotPhotonHisto(void* user, uint64_t time, int channel, int dtime)
+{
+  histogram[channel][dtime]++;
+}
+
+
+/* ------------------------------------------------------------------ */
+/* benchmarks, each works through the records in FIFO sized chunks     */
+
+static double BenchProcessT2(void)
+{
+  TTTRDecoder dec = { 0, GotPhoton, GotMarker, NULL };
+  int i;
+
+  for (i = 0; i < nrecords; i++)
+  {
+    ProcessT2(&dec, t2records[i]);
+  }
+  return nrecords;
+}
+
+
+static double BenchProcessT3(void)
+{
+  TTTRDecoder dec = { 0, GotPhoton, GotMarker, NULL };
+  int i;
+
+  for (i = 0; i < nrecords; i++)
+  {
+    ProcessT3(&dec, t3records[i]);
+  }
+  return nrecords;
+}
+
+
+static double BenchDecodeT2(void)
+{
+  TTTRDecoder dec = { 0 };
+  int i, n;
+
+  for (i = 0; i < nrecords; i += TTREADMAX)
+  {
+    n = DecodeT2(&dec, t2records + i, (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX, events);
+    photons += n;
+  }
+  return nrecords;
+}
+
+
+static double BenchDecodeT3(void)
+{
+  TTTRDecoder dec = { 0 };
+  int i, n;
+
+  for (i = 0; i < nrecords; i += TTREADMAX)
+  {
+    n = DecodeT3(&dec, t3records + i, (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX, events);
+    photons += n;
+  }
+  return nrecords;
+}
+
+
+// instant histogramming as in the t3mode_instant_histogramming demo
+static double BenchHistoProcessT3(void)
+{
+  TTTRDecoder dec = { 0, GotPhotonHisto, NULL, NULL };
+  uint64_t before = 0, after = 0;
+  int i, j;
+
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    for (j = 0; j < T3HISTBINS; j++)
+    {
+      before += histogram[i][j];
+    }
+  }
+  for (i = 0; i < nrecords; i++)
+  {
+    ProcessT3(&dec, t3records[i]);
+  }
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    for (j = 0; j < T3HISTBINS; j++)
+    {
+      after += histogram[i][j];
+    }
+  }
+  return (double)(after - before);
+}
+
+
+static double BenchHistoDecodeT3(void)
+{
+  TTTRDecoder dec = { 0 };
+  uint64_t increments = 0;
+  int i, j, n;
+
+  for (i = 0; i < nrecords; i += TTREADMAX)
+  {
+    n = DecodeT3(&dec, t3records + i, (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX, events);
+    for (j = 0; j < n; j++)
+    {
+      if (!(events[j].Channel & EVENT_MARKER))
+      {
+        histogram[events[j].Channel][events[j].DTime]++;
+        increments++;
+      }
+    }
+  }
+  return (double)increments;
+}
+
+
+// histomode summary as it was: a double sum per channel
+static double BenchHistSumScalar(void)
+{
+  double sum;
+  int i, j;
+
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    sum = 0;
+    for (j = 0; j < T3HISTBINS; j++)
+    {
+      sum += histogram[i][j];
+    }
+    integral += sum;
+  }
+  return (double)(MAXINPCHAN + 1) * T3HISTBINS;
+}
+
+
+// integral, peak and overflow in one pass, see histstats.h
+static double BenchHistStats(void)
+{
+  HistChannelStats s;
+  int i;
+
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    HistStatsOne(histogram[i], T3HISTBINS, 0xFFFFFFFF, &s);
+    integral += s.integral + s.peakbin;
+  }
+  return (double)(MAXINPCHAN + 1) * T3HISTBINS;
+}
+
+
+// centroid, FWHM, background and lifetime, see histanalysis.h
+static double BenchHistAnalyze(void)
+{
+  HistAnalysis a;
+  int i;
+
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    HistAnalyzeOne(histogram[i], T3HISTBINS, 0, &a);
+    integral += a.centroid + a.lifetime;
+  }
+  return (double)(MAXINPCHAN + 1) * T3HISTBINS;
+}
+
+
+// packing for HistFormat 3, see histsparse.h
+static double BenchHistSparse(void)
+{
+  int i;
+
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    integral += SparsePack(histogram[i], T3HISTBINS, (SparseHist*)sparse);
+  }
+  return (double)(MAXINPCHAN + 1) * T3HISTBINS;
+}
+
+
+// pile-up and dead-time correction at the intrinsic dead time, see histcorrect.h
+static double BenchHistCorrect(void)
+{
+  CorrSettings cs = { 5.0, T3HISTBINS, 80000000, 1, 0, 0 };
+  HistCorrection r;
+  int i;
+
+  CorrectorSetup(&corrector, &cs);  // derived once, then kept
+  for (i = 0; i <= MAXINPCHAN; i++)
+  {
+    memcpy(corrected, histogram[i], sizeof(corrected));
+    HistCorrectOne(&corrector, corrected, 1e6, &r);
+    integral += r.corrected;
+  }
+  return (double)(MAXINPCHAN + 1) * T3HISTBINS;
+}
+
+
+// a readout of the 8 generated inputs added as by Accumulate, with a
+// moving average, see histaccum.h
+static double BenchHistAccum(void)
+{
+  if (accum.partial == NULL)
+  {
+    readout.counts = histogram[1];
+    readout.numchannels = 8;
+    readout.histlen = T3HISTBINS;
+    HistStats(&readout, 0xFF, 0xFFFFFFFF);
+    if (AccumInit(&accum, 8, T3HISTBINS, 0xFF, 100, FLAG_OVERFLOW, 0) < 0)
+    {
+      return 0;
+    }
+  }
+  AccumAdd(&accum, &readout, 0, 1.0);
+  integral += (double)accum.added;
+  return 8.0 * T3HISTBINS;
+}
+
+
+// pixels/s of a monoexponential fit on all cores, see flimfit.h, the
+// photons of the T3 records dealt round over 64 x 64 pixels of 256 bins
+static double BenchFlimFit(void)
+{
+  TTTRDecoder dec = { 0 };
+  FlimOptions opt;
+  FlimResult res;
+  uint64_t k = 0;
+  int i, j, n;
+
+  if (cube.counts == NULL)
+  {
+    if (FlimCubeAlloc(&cube, 64, 64, 256) < 0)
+    {
+      return 0;
+    }
+    cube.binwidth = 80;
+    for (i = 0; i < nrecords; i += TTREADMAX)
+    {
+      n = DecodeT3(&dec, t3records + i, (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX, events);
+      for (j = 0; j < n; j++)
+      {
+        if (!(events[j].Channel & EVENT_MARKER) && ((events[j].DTime >> 4) < 256))
+        {
+          cube.counts[(k++ % 4096) * 256 + (events[j].DTime >> 4)]++;
+        }
+      }
+    }
+  }
+  if (FlimResultAlloc(&res, 64, 64) < 0)
+  {
+    return 0;
+  }
+  FlimDefaults(&opt);
+  FlimFit(&cube, &opt, &res, NULL);
+  integral += res.plane[FLIM_TAU1][0];
+  FlimResultFree(&res);
+  return 4096;
+}
+
+
+// the raw writer of the tttrmode demo: fwrite of every FIFO read
+static double BenchWriter(void)
+{
+  FILE* fp;
+  int i, n;
+
+  fp = fopen(tempfile, "wb");
+  if (fp == NULL)
+  {
+    printf("\ncannot open %s\n", tempfile);
+    return 0;
+  }
+  for (i = 0; i < nrecords; i += TTREADMAX)
+  {
+    n = (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX;
+    if (fwrite(t2records + i, 4, n, fp) != (unsigned)n)
+    {
+      printf("\nfile write error\n");
+      break;
+    }
+  }
+  fclose(fp);
+  unlink(tempfile);
+  return (double)nrecords * 4;
+}
+
+
+// generate, decode, histogram and write, as a T3 acquisition would
+static double BenchPipelineT3(void)
+{
+  static unsigned int buffer[TTREADMAX];
+  GenParams gp;
+  GenState* gen;
+  TTTRDecoder dec = { 0 };
+  FILE* fp;
+  double done = 0;
+  int j, n, nev;
+
+  GenDefaults(&gp);
+  gp.Mode = MODE_T3;
+  gp.CountRate = 1e6;
+  gen = GenCreate(&gp);
+  fp = fopen(tempfile, "wb");
+  if ((gen == NULL) || (fp == NULL))
+  {
+    printf("\ncannot set up the pipeline\n");
+    GenFree(gen);
+    if (fp)
+    {
+      fclose(fp);
+    }
+    return 0;
+  }
+  while (done < nrecords)
+  {
+    n = GenRead(gen, 1e30, buffer, TTREADMAX);
+    nev = DecodeT3(&dec, buffer, n, events);
+    for (j = 0; j < nev; j++)
+    {
+      if (!(events[j].Channel & EVENT_MARKER))
+      {
+        histogram[events[j].Channel][events[j].DTime]++;
+      }
+    }
+    if (fwrite(buffer, 4, n, fp) != (unsigned)n)
+    {
+      printf("\nfile write error\n");
+      break;
+    }
+    done += n;
+  }
+  fclose(fp);
+  unlink(tempfile);
+  GenFree(gen);
+  return done;
+}
+
+
+// decode and bin all T2 records, as tttrmode does with T2HistPairs
+static double T2Histogram(const char* pairs, int multistop, uint64_t binwidth, int histlen)
+{
+  TTTRDecoder dec = { 0 };
+  T2HistoSettings s;
+  int i, n;
+
+  T2HistoParsePairs(pairs, MAXINPCHAN, &s);
+  s.multistop = multistop;
+  s.binwidth = binwidth;
+  s.offset = 0;
+  s.histlen = histlen;
+  s.holdback = (uint64_t)(T2HISTO_HOLDBACK / 5.0);  // at the generator's base resolution
+  T2HistoFree(&t2histo);
+  if (T2HistoInit(&t2histo, &s, 0) < 0)
+  {
+    return 0;
+  }
+  for (i = 0; i < nrecords; i += TTREADMAX)
+  {
+    n = DecodeT2(&dec, t2records + i, (nrecords - i < TTREADMAX) ? nrecords - i : TTREADMAX, events);
+    T2HistoAdd(&t2histo, events, n);
+  }
+  T2HistoFinish(&t2histo);
+  photons += t2histo.binned;
+  return nrecords;
+}
+
+
+// lifetime histograms of all inputs at 5 ps over 20 ns
+static double BenchT2HistoSync(void)
+{
+  return T2Histogram("0:1,0:2,0:3,0:4,0:5,0:6,0:7,0:8", 0, 1, 4096);
+}
+
+
+// cross-correlations of four input pairs at 1 ns over 4 us
+static double BenchT2HistoMulti(void)
+{
+  return T2Histogram("1:2,3:4,5:6,7:8", 1, 200, 4096);
+}
+
+
+// one traced phase per record, far more than an acquisition loop records
+static double BenchTrace(void)
+{
+  uint64_t t;
+  int i;
+
+  TraceEnable(1);
+  for (i = 0; i < nrecords; i++)
+  {
+    t = TraceStart();
+    TraceEnd(TRACE_PROCESS, t, t2records[i]);
+  }
+  TraceEnable(0);
+  return nrecords;
+}
+
+
+static const Benchmark benchmarks[] =
+{
+  { "ProcessT2",       "Mrec/s",  1e6, BenchProcessT2 },
+  { "ProcessT3",       "Mrec/s",  1e6, BenchProcessT3 },
+  { "DecodeT2",        "Mrec/s",  1e6, BenchDecodeT2 },
+  { "DecodeT3",        "Mrec/s",  1e6, BenchDecodeT3 },
+  { "HistoProcessT3",  "Minc/s",  1e6, BenchHistoProcessT3 },
+  { "HistoDecodeT3",   "Minc/s",  1e6, BenchHistoDecodeT3 },
+  { "HistSumScalar",   "Gbin/s",  1e9, BenchHistSumScalar },
+  { "HistStats",       "Gbin/s",  1e9, BenchHistStats },
+  { "HistAnalyze",     "Gbin/s",  1e9, BenchHistAnalyze },
+  { "HistSparse",      "Gbin/s",  1e9, BenchHistSparse },
+  { "HistCorrect",     "Gbin/s",  1e9, BenchHistCorrect },
+  { "HistAccum",       "Gbin/s",  1e9, BenchHistAccum },
+  { "T2HistoSync",     "Mrec/s",  1e6, BenchT2HistoSync },
+  { "T2HistoMulti",    "Mrec/s",  1e6, BenchT2HistoMulti },
+  { "FlimFit",         "kpix/s",  1e3, BenchFlimFit },
+  { "Writer",          "GB/s",    1e9, BenchWriter },
+  { "PipelineT3",      "Mrec/s",  1e6, BenchPipelineT3 },
+  { "Trace",           "Mev/s",   1e6, BenchTrace },
+};
+
+
+static int Generate(int mode, unsigned int* records, int n)
+{
+  GenParams gp;
+  GenState* gen;
+  int got = 0;
+
+  GenDefaults(&gp);
+  gp.Mode = mode;
+  gp.CountRate = 1e6;  // 8 Mcps total, a busy but realistic load
+  gp.MarkerRate = 1e3;
+  gp.MarkerMask = 0xF;
+  gen = GenCreate(&gp);
+  if (gen == NULL)
+  {
+    return -1;
+  }
+  while (got < n)
+  {
+    got += GenRead(gen, 1e30, records + got, n - got);
+  }
+  GenFree(gen);
+  return 0;
+}
+
+
+static int Selected(const char* name, int argc, char* argv[], int first)
+{
+  int i;
+
+  if (first >= argc)
+  {
+    return 1;
+  }
+  for (i = first; i < argc; i++)
+  {
+    if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int reps = DEFAULT_REPS;
+  const char* csvname = NULL;
+  FILE* fpcsv = NULL;
+  double rates[MAXREPS];
+  double t0, items;
+  int opt, b, r;
+
+  nrecords = DEFAULT_RECORDS;
+  while ((opt = getopt(argc, argv, "r:n:f:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 'n':
+      nrecords = atoi(optarg);
+      break;
+    case 'f':
+      tempfile = optarg;
+      break;
+    case 'o':
+      csvname = optarg;
+      break;
+    default:
+      printf("usage: %s [-r reps] [-n records] [-f tempfile] [-o results.csv] [name...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if ((reps < 1) || (reps > MAXREPS) || (nrecords < 1))
+  {
+    printf("\ninvalid number of repetitions or records\n");
+    return 1;
+  }
+
+  t2records = (unsigned int*)malloc((size_t)nrecords * sizeof(unsigned int));
+  t3records = (unsigned int*)malloc((size_t)nrecords * sizeof(unsigned int));
+  events = (TTTREvent*)malloc((size_t)TTREADMAX * sizeof(TTTREvent));
+  if ((t2records == NULL) || (t3records == NULL) || (events == NULL))
+  {
+    printf("\nout of memory\n");
+    return 1;
+  }
+
+  printf("\nMultiHarp demo code benchmarks");
+  printf("\n~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
+  printf("\nGenerating %d T2 and T3 records...", nrecords);
+  fflush(stdout);
+  if ((Generate(MODE_T2, t2records, nrecords) < 0) || (Generate(MODE_T3, t3records, nrecords) < 0))
+  {
+    printf("\nout of memory\n");
+    return 1;
+  }
+
+  if (csvname)
+  {
+    fpcsv = fopen(csvname, "w");
+    if (fpcsv == NULL)
+    {
+      printf("\ncannot open %s\n", csvname);
+      return 1;
+    }
+    fprintf(fpcsv, "benchmark,unit,median,p10,p90,min,max,reps,records\n");
+  }
+
+  printf("\n\n%-16s %-7s %10s %10s %10s %10s %10s", "benchmark", "unit", "median", "p10", "p90", "min", "max");
+  for (b = 0; b < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); b++)
+  {
+    if (!Selected(benchmarks[b].name, argc, argv, optind))
+    {
+      continue;
+    }
+    benchmarks[b].run();  // warm up caches and page in buffers
+    for (r = 0; r < reps; r++)
+    {
+      t0 = RtNow();
+      items = benchmarks[b].run();
+      rates[r] = items / (RtNow() - t0) / benchmarks[b].scale;
+    }
+    qsort(rates, reps, sizeof(double), Compare);
+    printf("\n%-16s %-7s %10.3f %10.3f %10.3f %10.3f %10.3f", benchmarks[b].name, benchmarks[b].unit,
+      Percentile(rates, reps, 50), Percentile(rates, reps, 10), Percentile(rates, reps, 90),
+      rates[0], rates[reps - 1]);
+    fflush(stdout);
+    if (fpcsv)
+    {
+      fprintf(fpcsv, "%s,%s,%.6g,%.6g,%.6g,%.6g,%.6g,%d,%d\n", benchmarks[b].name, benchmarks[b].unit,
+        Percentile(rates, reps, 50), Percentile(rates, reps, 10), Percentile(rates, reps, 90),
+        rates[0], rates[reps - 1], reps, nrecords);
+    }
+  }
+  printf("\n");
+
+  if (fpcsv)
+  {
+    fclose(fpcsv);
+  }
+  free(t2records);
+  free(t3records);
+  free(events);
+  FlimCubeFree(&cube);
+  CorrectorFree(&corrector);
+  AccumFree(&accum);
+  T2HistoFree(&t2histo);
+  return 0;
+}
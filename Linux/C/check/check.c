@@ -0,0 +1,518 @@
+/************************************************************************
+
+Consistency checks of the MultiHarp demo code against slow references
+
+Runs on synthetic data, without hardware and without the MHLib:
+
+  - t2histo: the software histograms of T2 data of ../common/t2histo.c
+    against a brute force histogram over all event pairs, start-stop
+    and multistop, for random binning, random batches and events of
+    different channels slightly out of order
+  - segments: the time base across the segment blocks of a recovered
+    overrun, for a decoder that saw segment 0 (from the start times)
+    and for one that joined later (by a wraparound), which must not
+    jump by the epoch of the start times
+  - shmruns: ShmReadRun of ../common/mhshm.c against runs of random
+    length published between reads of random size by a consumer that
+    attached mid-run; every read must hold the records of one run, in
+    order, and report that run
+  - histcorrect: the pile-up and dead-time correction of
+    ../common/histcorrect.c against a Monte Carlo simulation of pulsed
+    excitation, Poisson photon numbers, an exponential decay and an
+    input dead time, also longer than the sync period; the corrected
+    total must come within 0.5% of the photons that arrived, and the
+    64 bit variant must agree with the 32 bit one
+
+Every check prints its failures and a summary line. The exit code is
+the number of failed checks.
+
+Usage: mhcheck [-n trials] [name...]
+
+If names are given, only the checks whose names start with one of them
+are run.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "t2histo.h"
+#include "histcorrect.h"
+#include "mhshm.h"
+
+
+#define DEFAULT_TRIALS  400
+
+#define MC_BINS         512
+#define MC_RESOLUTION   25.0      // ps
+#define MC_PERIOD       12500.0   // ps, 80 MHz
+#define MC_LIFETIME     2000.0    // ps
+#define MC_DELAY        1000.0    // ps, of the decay after the sync
+#define MC_CYCLES       2000000
+#define MC_MAXPHOTONS   64
+
+typedef struct
+{
+  const char* name;
+  int (*run)(int trials);  // failures
+} Check;
+
+static uint64_t rnd = 88172645463325252ULL;
+
+
+// xorshift, the same sequence on every run
+static uint64_t Random(void)
+{
+  rnd ^= rnd << 13;
+  rnd ^= rnd >> 7;
+  rnd ^= rnd << 17;
+  return rnd;
+}
+
+
+// random events on channels 0..3 and a few markers, with neighbours of
+// different channels close in time swapped now and then
+static void T2Events(TTTREvent* ev, int n)
+{
+  TTTREvent x;
+  uint64_t t = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    t += Random() % 40;
+    ev[i].Time = t;
+    ev[i].Channel = (Random() % 50 == 0) ? (EVENT_MARKER | 1) : (int)(Random() % 4);
+    ev[i].DTime = 0;
+  }
+  for (i = 1; i < n; i++)
+  {
+    if ((Random() % 10 == 0) && (ev[i].Channel != ev[i - 1].Channel)
+      && (ev[i].Time - ev[i - 1].Time < 20))
+    {
+      x = ev[i];
+      ev[i] = ev[i - 1];
+      ev[i - 1] = x;
+    }
+  }
+}
+
+
+// the histogram of pair p, every target against every reference
+static void T2Reference(const T2HistoSettings* s, int p, const TTTREvent* ev, int n,
+  unsigned int* counts)
+{
+  uint64_t d;
+  int i, j, last;
+
+  memset(counts, 0, s->histlen * sizeof(unsigned int));
+  for (i = 0; i < n; i++)
+  {
+    if (ev[i].Channel != s->target[p])
+    {
+      continue;
+    }
+    last = -1;
+    for (j = 0; j < n; j++)
+    {
+      if ((j == i) || (ev[j].Channel != s->ref[p]) || (ev[j].Time > ev[i].Time)
+        || ((s->ref[p] == s->target[p]) && (j > i)))
+      {
+        continue;
+      }
+      if (!s->multistop)
+      {
+        if ((last < 0) || (ev[j].Time >= ev[last].Time))
+        {
+          last = j;
+        }
+        continue;
+      }
+      d = ev[i].Time - ev[j].Time;
+      if ((d >= s->offset) && (d - s->offset < s->binwidth * s->histlen))
+      {
+        counts[(d - s->offset) / s->binwidth]++;
+      }
+    }
+    if (!s->multistop && (last >= 0))
+    {
+      d = ev[i].Time - ev[last].Time;
+      if ((d >= s->offset) && (d - s->offset < s->binwidth * s->histlen))
+      {
+        counts[(d - s->offset) / s->binwidth]++;
+      }
+    }
+  }
+}
+
+
+static int CheckT2Histo(int trials)
+{
+  static TTTREvent ev[5000];
+  static unsigned int counts[MAXHISTLEN];
+  T2HistoSettings s;
+  T2Histo h;
+  int trial, n, i, b, p, bad = 0;
+
+  for (trial = 0; trial < trials; trial++)
+  {
+    n = 2000 + Random() % 3000;
+    T2Events(ev, n);
+    memset(&s, 0, sizeof(s));
+    T2HistoParsePairs("0:1,0:2,1:2,2:1,3:3,1:1", 3, &s);
+    s.multistop = trial & 1;
+    s.binwidth = 1 + Random() % 5;
+    s.offset = Random() % 30;
+    s.histlen = 1 + Random() % 200;
+    s.holdback = 60;
+    if (T2HistoInit(&h, &s, 0) < 0)
+    {
+      printf("\nt2histo: out of memory");
+      return 1;
+    }
+    for (i = 0; i < n; i += b)
+    {
+      b = 1 + Random() % 700;
+      b = (i + b > n) ? n - i : b;
+      T2HistoAdd(&h, ev + i, b);
+    }
+    T2HistoFinish(&h);
+    for (p = 0; p < s.numpairs; p++)
+    {
+      T2Reference(&s, p, ev, n, counts);
+      if (memcmp(counts, HistChannel(&h.hist, p), s.histlen * sizeof(unsigned int)))
+      {
+        printf("\nt2histo: trial %d pair %d:%d %s differs", trial, s.ref[p], s.target[p],
+          s.multistop ? "multistop" : "start-stop");
+        bad++;
+      }
+    }
+    T2HistoFree(&h);
+  }
+  printf("\nt2histo    %d trials, %d pairs differ", trials, bad);
+  return bad > 0;
+}
+
+
+// T2 records of a segment starting at start ps: its block, then events
+// on channel 1 every 1000 tags for somewhat over two wraparounds
+static int SegmentRecords(unsigned int* rec, uint32_t segment, uint64_t start)
+{
+  SegmentInfo s;
+  uint64_t t;
+  int n = SEGMENT_WORDS;
+
+  memset(&s, 0, sizeof(s));
+  s.Segment = segment;
+  s.StartTime[0] = (uint32_t)start;
+  s.StartTime[1] = (uint32_t)(start >> 32);
+  SegmentEncode(&s, rec);
+  for (t = 1000; t < 2 * T2WRAPAROUND + 5000; t += 1000)
+  {
+    if ((t / T2WRAPAROUND) != ((t - 1000) / T2WRAPAROUND))
+    {
+      rec[n++] = 0xFE000001;  // one overflow
+    }
+    rec[n++] = (1u << 25) | (unsigned int)(t % T2WRAPAROUND);
+  }
+  return n;
+}
+
+
+static int CheckSegments(int trials)
+{
+  static unsigned int rec[3][SEGMENT_WORDS + 70000];
+  static TTTREvent ev[SEGMENT_WORDS + 70000];
+  const uint64_t epoch = 1700000000ULL * 1000000000000ULL;  // ps, the start times are absolute
+  const double unit = 5.0;
+  TTTRDecoder dec;
+  uint64_t last, expect;
+  int n[3], late, s, i, m, bad = 0;
+
+  for (s = 0; s < 3; s++)
+  {
+    n[s] = SegmentRecords(rec[s], s, epoch + s * 2000000000000ULL);  // 2 s apart
+  }
+  for (late = 0; late < 2; late++)
+  {
+    DecoderInit(&dec, MODE_T2, unit, 0);
+    last = 0;
+    for (s = late; s < 3; s++)
+    {
+      m = DecodeT2(&dec, rec[s], n[s], ev);
+      expect = (late || (s == 0)) ? 0 : (uint64_t)(s * 2e12 / unit);
+      if ((m < 1) || (ev[0].Time < last) || (ev[0].Time > (late ? last + 2 * T2WRAPAROUND : expect + 1000)))
+      {
+        printf("\nsegments: %s decoder, segment %d starts at %llu after %llu", late ? "late" : "full", s,
+          (unsigned long long)ev[0].Time, (unsigned long long)last);
+        bad++;
+      }
+      for (i = 1; i < m; i++)
+      {
+        if (ev[i].Time <= ev[i - 1].Time)
+        {
+          break;
+        }
+      }
+      if (i < m)
+      {
+        printf("\nsegments: %s decoder, segment %d goes back in time", late ? "late" : "full", s);
+        bad++;
+      }
+      last = (m > 0) ? ev[m - 1].Time : last;
+    }
+  }
+  printf("\nsegments   %d decoders, %d wrong", 2, bad);
+  return bad > 0;
+}
+
+
+static int CheckShmRuns(int trials)
+{
+  static unsigned int rec[3000], buf[5000];
+  char name[64];
+  ShmRing* prod;
+  ShmRing* cons;
+  uint64_t lost = 0;
+  uint32_t run = 1, r, lastrun = 0;
+  unsigned int next = 0, seq = 0;
+  int t, i, m, n, reads = 0, bad = 0;
+
+  snprintf(name, sizeof(name), "/mhcheck%d", (int)getpid());
+  prod = ShmCreate(name, 1 << 20);
+  if (prod == NULL)
+  {
+    printf("\nshmruns: cannot create %s", name);
+    return 1;
+  }
+  ShmNewRun(prod, MODE_T2, 5.0);
+  for (i = 0; i < 100; i++)
+  {
+    rec[i] = (run << 20) | (seq++ & 0xFFFFF);
+  }
+  ShmPublish(prod, rec, 100);
+  cons = ShmAttach(name);  // mid-run, at the head
+  if (cons == NULL)
+  {
+    printf("\nshmruns: cannot attach to %s", name);
+    ShmClose(prod);
+    return 1;
+  }
+  next = seq;
+
+  for (t = 0; t <= trials; t++)
+  {
+    if ((t < trials) && (Random() % 4 == 0))
+    {
+      ShmNewRun(prod, MODE_T2, 5.0);
+      run++;
+    }
+    m = (t < trials) ? 1 + (int)(Random() % 3000) : 0;
+    for (i = 0; i < m; i++)
+    {
+      rec[i] = (run << 20) | (seq++ & 0xFFFFF);
+    }
+    ShmPublish(prod, rec, m);
+    do  // all of it after the last trial
+    {
+      n = ShmReadRun(cons, buf, 1 + (int)(Random() % 5000), &lost, &r);
+      reads++;
+      for (i = 0; i < n; i++)
+      {
+        if ((buf[i] >> 20 != r) || ((buf[i] & 0xFFFFF) != (next & 0xFFFFF)))
+        {
+          printf("\nshmruns: read %d, record %d is %08x, expected run %u record %u", reads, i, buf[i], r,
+            next & 0xFFFFF);
+          bad++;
+          break;
+        }
+        next++;
+      }
+      if ((n > 0) && (r < lastrun))
+      {
+        printf("\nshmruns: read %d reports run %u after %u", reads, r, lastrun);
+        bad++;
+      }
+      lastrun = (n > 0) ? r : lastrun;
+    }
+    while ((bad == 0) && (n > 0) && ((t == trials) || (Random() % 2)));
+  }
+  if ((lost != 0) || (next != seq))
+  {
+    printf("\nshmruns: %llu lost, %u of %u records read", (unsigned long long)lost, next - 100, seq - 100);
+    bad++;
+  }
+  ShmDetach(cons);
+  ShmClose(prod);
+  printf("\nshmruns    %u runs, %d reads, %d wrong", run, reads, bad);
+  return bad > 0;
+}
+
+
+// uniform in (0, 1)
+static double Uniform(void)
+{
+  return ((Random() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+
+// histograms of MC_CYCLES sync periods with mu photons per period on
+// average, measured with dead ps of dead time, and of all photons
+static void Simulate(double mu, int dead, unsigned int* measured, double* truth)
+{
+  double t[MC_MAXPHOTONS], last = -1e18, v, p;
+  int64_t c;
+  int k, m, i, j;
+
+  memset(measured, 0, MC_BINS * sizeof(unsigned int));
+  memset(truth, 0, MC_BINS * sizeof(double));
+  for (c = 0; c < MC_CYCLES; c++)
+  {
+    for (k = 0, p = Uniform(); p > exp(-mu); k++)
+    {
+      p *= Uniform();
+    }
+    for (m = 0; (m < k) && (m < MC_MAXPHOTONS); m++)
+    {
+      t[m] = MC_DELAY - MC_LIFETIME * log(Uniform());
+    }
+    for (i = 1; i < m; i++) // in time order
+    {
+      v = t[i];
+      for (j = i - 1; (j >= 0) && (t[j] > v); j--)
+      {
+        t[j + 1] = t[j];
+      }
+      t[j + 1] = v;
+    }
+    for (i = 0; (i < m) && (t[i] < MC_PERIOD); i++)
+    {
+      truth[(int)(t[i] / MC_RESOLUTION)]++;
+      if (c * MC_PERIOD + t[i] - last >= dead)
+      {
+        measured[(int)(t[i] / MC_RESOLUTION)]++;
+        last = c * MC_PERIOD + t[i];
+      }
+    }
+  }
+}
+
+
+static int CheckHistCorrect(int trials)
+{
+  static const struct { double mu; int dead; } cases[] =
+  {
+    { 0.05, CORR_INTRINSICDEAD }, { 0.3, 5000 }, { 1.0, 20000 }, { 2.0, 20000 },
+  };
+  static unsigned int measured[MC_BINS], counts[MC_BINS];
+  static uint64_t counts64[MC_BINS];
+  static double truth[MC_BINS];
+  HistCorrector hc;
+  CorrSettings s;
+  HistCorrection r, r64;
+  double total, lost;
+  int i, k, bad = 0;
+
+  CorrectorInit(&hc);
+  for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++)
+  {
+    Simulate(cases[k].mu, cases[k].dead, measured, truth);
+    memset(&s, 0, sizeof(s));
+    s.resolution = MC_RESOLUTION;
+    s.histlen = MC_BINS;
+    s.syncrate = (int)(1e12 / MC_PERIOD);
+    s.syncdivider = 1;
+    s.inputdeadtime = cases[k].dead;
+    CorrectorSetup(&hc, &s);
+    total = 0;
+    for (i = 0; i < MC_BINS; i++)
+    {
+      total += truth[i];
+      counts[i] = measured[i];
+      counts64[i] = measured[i];
+    }
+    HistCorrectOne(&hc, counts, MC_CYCLES, &r);
+    HistCorrectOne64(&hc, counts64, MC_CYCLES, &r64);
+    lost = 100.0 * (1 - r.measured / total);
+    if ((fabs(r.corrected / total - 1) > 0.005) || r.saturated)
+    {
+      printf("\nhistcorrect: mu %.2f dead %d ps, %.1f%% lost, corrected %.0f of %.0f", cases[k].mu,
+        cases[k].dead, lost, r.corrected, total);
+      bad++;
+    }
+    for (i = 0; i < MC_BINS; i++)
+    {
+      if ((counts64[i] > counts[i] + 1ULL) || (counts64[i] + 1ULL < counts[i]))
+      {
+        break;
+      }
+    }
+    if ((i < MC_BINS) || (r64.measured != r.measured) || (fabs(r64.corrected / r.corrected - 1) > 1e-6))
+    {
+      printf("\nhistcorrect: mu %.2f dead %d ps, the 64 bit variant differs", cases[k].mu, cases[k].dead);
+      bad++;
+    }
+  }
+  CorrectorFree(&hc);
+  printf("\nhistcorrect %d cases, %d wrong", (int)(sizeof(cases) / sizeof(cases[0])), bad);
+  return bad > 0;
+}
+
+
+static const Check checks[] =
+{
+  { "t2histo", CheckT2Histo },
+  { "segments", CheckSegments },
+  { "shmruns", CheckShmRuns },
+  { "histcorrect", CheckHistCorrect },
+};
+
+
+int main(int argc, char* argv[])
+{
+  int trials = DEFAULT_TRIALS;
+  int c, i, k, selected, failed = 0;
+
+  while ((c = getopt(argc, argv, "n:")) != -1)
+  {
+    switch (c)
+    {
+    case 'n':
+      trials = atoi(optarg);
+      break;
+    default:
+      printf("\nUsage: mhcheck [-n trials] [name...]\n");
+      return 1;
+    }
+  }
+  if (trials < 1)
+  {
+    printf("\nInvalid number of trials\n");
+    return 1;
+  }
+
+  for (i = 0; i < (int)(sizeof(checks) / sizeof(checks[0])); i++)
+  {
+    selected = (optind == argc);
+    for (k = optind; k < argc; k++)
+    {
+      if (strncmp(checks[i].name, argv[k], strlen(argv[k])) == 0)
+      {
+        selected = 1;
+      }
+    }
+    if (selected)
+    {
+      failed += checks[i].run(trials);
+    }
+  }
+  printf("\n%s\n", failed ? "FAILED" : "passed");
+  return failed;
+}
@@ -0,0 +1,171 @@
+/************************************************************************
+
+Converter between raw and compressed MultiHarp T2/T3 record files
+
+Compresses a raw .out file of tttrmode into the block format of
+../common/tttrcodec.h, or restores the raw file from a compressed one,
+and reports the compression ratio and the throughput. tttrmode writes
+compressed files directly with Compress = 1.
+
+Usage: mhzip [-d] [-m mode] [-t threads] [-v] infile outfile
+
+  -d          decompress, the mode is taken from the file
+  -m mode     2 for T2 (default), 3 for T3 records
+  -t threads  worker threads, default 2, 0 = all in the main thread
+  -v          after compressing, decompress again and compare
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "tttrcodec.h"
+
+
+#define CHUNK  (4 * 1024 * 1024)
+
+static unsigned char buffer[CHUNK];
+static unsigned char check[CHUNK];
+
+
+static int Copy(FILE* in, FILE* out)
+{
+  size_t n;
+
+  while ((n = fread(buffer, 1, CHUNK, in)) > 0)
+  {
+    if (fwrite(buffer, 1, n, out) != n)
+    {
+      printf("\nfile write error\n");
+      return -1;
+    }
+  }
+  if (ferror(in))
+  {
+    printf("\nfile read error or corrupt data\n");
+    return -1;
+  }
+  return 0;
+}
+
+
+static int Verify(const char* raw, const char* packed, int threads)
+{
+  CodecStats stats;
+  FILE* fa;
+  FILE* fb;
+  size_t n, m;
+  int ret = -1;
+
+  fa = fopen(raw, "rb");
+  fb = CodecOpenRead(packed, threads, NULL, &stats);
+  if (fa && fb)
+  {
+    do
+    {
+      n = fread(buffer, 1, CHUNK, fa);
+      m = fread(check, 1, CHUNK, fb);
+    } while ((n == m) && (n > 0) && (memcmp(buffer, check, n) == 0));
+    ret = ((n == 0) && (m == 0) && !ferror(fb)) ? 0 : -1;
+  }
+  if (fa)
+  {
+    fclose(fa);
+  }
+  if (fb)
+  {
+    fclose(fb);
+    CodecPrintStats(&stats, "Verified", stdout);
+  }
+  return ret;
+}
+
+
+int main(int argc, char* argv[])
+{
+  CodecStats stats;
+  FILE* in;
+  FILE* out;
+  int decompress = 0, verify = 0, mode = MODE_T2, threads = 2;
+  int opt, ret;
+
+  while ((opt = getopt(argc, argv, "dm:t:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      decompress = 1;
+      break;
+    case 'm':
+      mode = atoi(optarg);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'v':
+      verify = 1;
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ((optind != argc - 2) || ((mode != MODE_T2) && (mode != MODE_T3)))
+  {
+    printf("usage: %s [-d] [-m 2|3] [-t threads] [-v] infile outfile\n", argv[0]);
+    return 1;
+  }
+
+  if (decompress)
+  {
+    in = CodecOpenRead(argv[optind], threads, &mode, &stats);
+    out = fopen(argv[optind + 1], "wb");
+  }
+  else
+  {
+    if (CodecIsCompressed(argv[optind]) == 1)
+    {
+      printf("\n%s is compressed already\n", argv[optind]);
+      return 1;
+    }
+    in = fopen(argv[optind], "rb");
+    out = CodecOpenWrite(argv[optind + 1], mode, threads, 0, &stats);
+  }
+  if ((in == NULL) || (out == NULL))
+  {
+    printf("\ncannot open %s\n", (in == NULL) ? argv[optind] : argv[optind + 1]);
+    if (in)
+    {
+      fclose(in);
+    }
+    if (out)
+    {
+      fclose(out);
+    }
+    return 1;
+  }
+
+  ret = Copy(in, out);
+  if (fclose(in) != 0)
+  {
+    ret = -1;
+  }
+  if (fclose(out) != 0)
+  {
+    printf("\nfile write error\n");
+    ret = -1;
+  }
+  CodecPrintStats(&stats, decompress ? "Decompressed" : "Compressed", stdout);
+
+  if ((ret == 0) && verify && !decompress)
+  {
+    ret = Verify(argv[optind], argv[optind + 1], threads);
+    printf(ret ? "\nVerification FAILED\n" : "\nVerified, identical\n");
+  }
+  return ret ? 1 : 0;
+}
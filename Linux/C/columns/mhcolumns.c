@@ -0,0 +1,232 @@
+/************************************************************************
+
+Columnar event archives of MultiHarp T2/T3 files
+
+Converts a raw .out file of tttrmode, or a compressed one (see
+../common/tttrcodec.h), into a columnar archive of decoded events (see
+../common/tttrcolumns.h), or queries an archive. tttrmode writes the
+archive directly with ColumnFile set.
+
+Usage: mhcolumns [-m mode] [-r ps] [-s ps] infile archive
+       mhcolumns [-t start,end] [-c channels] [-l] archive
+
+  -m mode         2 for T2 (default), 3 for T3, raw input only
+  -r ps           resolution to store, default 5
+  -s ps           T3 sync period to store, default unknown
+  -t start,end    rows with start <= time < end, in s
+  -c channels     mask of the channels, bit c = channel c, bit 63 =
+                  markers, default all
+  -l              list the rows, time in ps, channel, dtime, markers
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mhdefin.h"
+#include "tttrcodec.h"
+#include "tttrcolumns.h"
+#include "mhrt.h"
+
+
+#define CHUNK  (4 * 1024 * 1024)
+
+static unsigned char buffer[CHUNK];
+static uint64_t counts[256];
+
+
+static double FileMB(const char* path)
+{
+  struct stat st;
+  return (stat(path, &st) == 0) ? st.st_size / 1e6 : 0;
+}
+
+
+static int Convert(const char* inname, const char* outname, int mode, double resolution, double syncperiod)
+{
+  FILE* in;
+  FILE* out;
+  size_t n;
+  double t0 = RtNow();
+  int ret = 0;
+
+  in = (CodecIsCompressed(inname) == 1) ? CodecOpenRead(inname, 2, &mode, NULL) : fopen(inname, "rb");
+  if (in == NULL)
+  {
+    printf("\ncannot open %s\n", inname);
+    return -1;
+  }
+  out = ColumnOpen(NULL, outname, mode, resolution, syncperiod);
+  if (out == NULL)
+  {
+    printf("\ncannot open %s\n", outname);
+    fclose(in);
+    return -1;
+  }
+  while ((n = fread(buffer, 1, CHUNK, in)) > 0)
+  {
+    if (fwrite(buffer, 1, n, out) != n)
+    {
+      printf("\nfile write error\n");
+      ret = -1;
+      break;
+    }
+  }
+  if (ferror(in))
+  {
+    printf("\nfile read error or corrupt data\n");
+    ret = -1;
+  }
+  fclose(in);
+  if (fclose(out) != 0)
+  {
+    printf("\nfile write error\n");
+    ret = -1;
+  }
+  printf("\nConverted %.1f MB into %.1f MB in %.2f s", FileMB(inname), FileMB(outname), RtNow() - t0);
+  return ret;
+}
+
+
+static int Query(const char* name, double start, double end, uint64_t channels, int list)
+{
+  ColArchive* arch;
+  const ColFileHeader* h;
+  ColQuery q;
+  ColRows rows;
+  double unit, t0 = RtNow();
+  int64_t gi, n, i, scanned = 0, found = 0, total = 0;
+  int c;
+
+  arch = ColOpen(name);
+  if (arch == NULL)
+  {
+    printf("\ncannot open archive %s\n", name);
+    return -1;
+  }
+  h = ColHeader(arch);
+  unit = (h->mode == MODE_T2) ? h->resolution : h->syncperiod;
+  for (gi = 0; gi < ColNumGroups(arch); gi++)
+  {
+    total += ColGetGroup(arch, gi)->rows;
+  }
+  printf("\nMode T%d, %lld rows in %lld groups", (h->mode == MODE_T2) ? 2 : 3, (long long)total,
+    (long long)ColNumGroups(arch));
+
+  q.tmin = 0;
+  q.tmax = UINT64_MAX;
+  if (start >= 0)
+  {
+    if (unit <= 0)
+    {
+      printf("\nthe archive has no time unit\n");
+      ColClose(arch);
+      return -1;
+    }
+    q.tmin = (uint64_t)(start * 1e12 / unit);
+    q.tmax = (uint64_t)(end * 1e12 / unit);
+  }
+  q.channels = channels;
+  q.columns = COL_WANT(COL_CHANNEL) | (list ? COL_WANT(COL_TIME) | COL_WANT(COL_DTIME) | COL_WANT(COL_MARKERS) : 0);
+  if (ColAllocRows(&rows, q.columns) < 0)
+  {
+    ColClose(arch);
+    return -1;
+  }
+
+  for (gi = ColNextGroup(arch, &q, 0); gi >= 0; gi = ColNextGroup(arch, &q, gi + 1))
+  {
+    n = ColReadGroup(arch, &q, gi, &rows);
+    if (n < 0)
+    {
+      printf("\ngroup %lld is damaged", (long long)gi);
+      continue;
+    }
+    scanned++;
+    found += n;
+    for (i = 0; i < n; i++)
+    {
+      counts[rows.channel[i]]++;
+      if (list)
+      {
+        printf("\n%.0f %d %d %d", (h->mode == MODE_T2) ? rows.time[i] * h->resolution
+          : rows.time[i] * h->syncperiod + rows.dtime[i] * h->resolution,
+          rows.channel[i], rows.dtime[i], rows.markers[i]);
+      }
+    }
+  }
+
+  printf("\n\n%lld rows match, %lld of %lld groups read, %.3f s", (long long)found, (long long)scanned,
+    (long long)ColNumGroups(arch), RtNow() - t0);
+  for (c = 0; c < 255; c++)
+  {
+    if (counts[c])
+    {
+      printf("\n  %s %2d %12llu", c ? "input" : "sync ", c, (unsigned long long)counts[c]);
+    }
+  }
+  printf("\n  markers  %12llu\n", (unsigned long long)counts[COL_MARKERCHANNEL]);
+  ColFreeRows(&rows);
+  ColClose(arch);
+  return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int mode = MODE_T2, list = 0, opt, ret;
+  double resolution = 5, syncperiod = 0, start = -1, end = -1;
+  uint64_t channels = ~0ULL;
+
+  while ((opt = getopt(argc, argv, "m:r:s:t:c:l")) != -1)
+  {
+    switch (opt)
+    {
+    case 'm':
+      mode = atoi(optarg);
+      break;
+    case 'r':
+      resolution = atof(optarg);
+      break;
+    case 's':
+      syncperiod = atof(optarg);
+      break;
+    case 't':
+      if (sscanf(optarg, "%lf,%lf", &start, &end) != 2)
+      {
+        optind = argc + 1;
+      }
+      break;
+    case 'c':
+      channels = strtoull(optarg, NULL, 0);
+      break;
+    case 'l':
+      list = 1;
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ((optind == argc - 2) && ((mode == MODE_T2) || (mode == MODE_T3)))
+  {
+    ret = Convert(argv[optind], argv[optind + 1], mode, resolution, syncperiod);
+  }
+  else if (optind == argc - 1)
+  {
+    ret = Query(argv[optind], start, end, channels, list);
+  }
+  else
+  {
+    printf("usage: %s [-m 2|3] [-r ps] [-s ps] infile archive\n", argv[0]);
+    printf("       %s [-t start,end] [-c channels] [-l] archive\n", argv[0]);
+    return 1;
+  }
+  printf("\n");
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,681 @@
+/************************************************************************
+
+  Per pixel lifetime fitting of FLIM cubes, see flimfit.h
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "flimfit.h"
+#include "histanalysis.h"
+#include "mhrt.h"
+
+
+#define MAXPARAMS   5       // A1, tau1, A2, tau2, B
+#define CHUNK       64      // pixels taken at a time
+#define MAXTHREADS  256
+#define TAUMIN      0.05    // bins
+#define TAUMAX      1e6
+#define LAMBDAMAX   1e12
+
+typedef struct
+{
+  const uint32_t* y;
+  const double* irf;            // NULL = unit impulse at start
+  int start;                    // first bin fitted
+  int end;                      // after the last
+  int nc;                       // exponential components
+} Decay;
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  int64_t head;                 // chunks [head, tail) left to this thread
+  int64_t tail;
+  char pad[64];                 // keeps the queues on their own cache lines
+} Queue;
+
+typedef struct FlimJob FlimJob;
+
+typedef struct
+{
+  FlimJob* job;
+  int id;
+  pthread_t thread;
+  int64_t fitted, skipped, failed, iterations, steals;
+} Worker;
+
+struct FlimJob
+{
+  const FlimCube* cube;
+  const FlimOptions* opt;
+  FlimResult* res;
+  int64_t npixels;
+  Queue* queues;
+  Worker* workers;
+  int nthreads;
+};
+
+
+void FlimDefaults(FlimOptions* opt)
+{
+  memset(opt, 0, sizeof(FlimOptions));
+  opt->model = FLIM_MONO;
+  opt->mincounts = 100;
+  opt->maxiter = 50;
+}
+
+
+int FlimCubeAlloc(FlimCube* cube, int width, int height, int nbins)
+{
+  memset(cube, 0, sizeof(FlimCube));
+  cube->counts = (uint32_t*)calloc((size_t)width * height * nbins, sizeof(uint32_t));
+  if (cube->counts == NULL)
+  {
+    return -1;
+  }
+  cube->width = width;
+  cube->height = height;
+  cube->nbins = nbins;
+  return 0;
+}
+
+
+void FlimCubeFree(FlimCube* cube)
+{
+  free(cube->counts);
+  cube->counts = NULL;
+}
+
+
+int FlimResultAlloc(FlimResult* res, int width, int height)
+{
+  int i;
+
+  memset(res, 0, sizeof(FlimResult));
+  res->width = width;
+  res->height = height;
+  for (i = 0; i < FLIM_NPLANES; i++)
+  {
+    res->plane[i] = (float*)calloc((size_t)width * height, sizeof(float));
+    if (res->plane[i] == NULL)
+    {
+      FlimResultFree(res);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+void FlimResultFree(FlimResult* res)
+{
+  int i;
+
+  for (i = 0; i < FLIM_NPLANES; i++)
+  {
+    free(res->plane[i]);
+    res->plane[i] = NULL;
+  }
+}
+
+
+// Deviance of the model at p, with the gradient of the log likelihood
+// in g and the Fisher information in H, all in one pass over the bins.
+// The components run as c[i] = q c[i-1] + irf[i], q = exp(-1 / tau),
+// and their tau derivatives as d[i] = q d[i-1] + q / tau^2 c[i-1].
+static double Pass(const Decay* dc, const double* p, double* g, double* H)
+{
+  int np = 2 * dc->nc + 1, i, j, k;
+  int i0 = dc->irf ? 0 : dc->start;
+  double q[2] = { 0, 0 }, dq[2] = { 0, 0 };
+  double c[2], d[2], J[MAXPARAMS];
+  double m, x, y, r, dev = 0;
+#ifdef __SSE2__
+  __m128d vq, vdq, vc, vd;
+#endif
+
+  for (k = 0; k < dc->nc; k++)
+  {
+    q[k] = exp(-1.0 / p[2 * k + 1]);
+    dq[k] = q[k] / (p[2 * k + 1] * p[2 * k + 1]);
+  }
+  memset(g, 0, np * sizeof(double));
+  memset(H, 0, np * np * sizeof(double));
+  J[np - 1] = 1;
+#ifdef __SSE2__
+  vq = _mm_loadu_pd(q);
+  vdq = _mm_loadu_pd(dq);
+  vc = _mm_setzero_pd();
+  vd = vc;
+#else
+  c[0] = c[1] = d[0] = d[1] = 0;
+#endif
+
+  for (i = i0; i < dc->end; i++)
+  {
+    x = dc->irf ? dc->irf[i] : (i == dc->start);
+#ifdef __SSE2__
+    vd = _mm_add_pd(_mm_mul_pd(vq, vd), _mm_mul_pd(vdq, vc));
+    vc = _mm_add_pd(_mm_mul_pd(vq, vc), _mm_set1_pd(x));
+    if (i < dc->start)
+    {
+      continue;
+    }
+    _mm_storeu_pd(c, vc);
+    _mm_storeu_pd(d, vd);
+#else
+    for (k = 0; k < 2; k++)
+    {
+      d[k] = q[k] * d[k] + dq[k] * c[k];
+      c[k] = q[k] * c[k] + x;
+    }
+    if (i < dc->start)
+    {
+      continue;
+    }
+#endif
+    m = p[np - 1];
+    for (k = 0; k < dc->nc; k++)
+    {
+      m += p[2 * k] * c[k];
+      J[2 * k] = c[k];
+      J[2 * k + 1] = p[2 * k] * d[k];
+    }
+    m = (m > 1e-10) ? m : 1e-10;
+    y = dc->y[i];
+    dev += (y > 0) ? 2 * (y * log(y / m) - (y - m)) : 2 * m;
+    r = y / m - 1;
+    for (j = 0; j < np; j++)
+    {
+      g[j] += r * J[j];
+      x = J[j] / m;
+      for (k = j; k < np; k++)
+      {
+        H[j * np + k] += x * J[k];
+      }
+    }
+  }
+  for (j = 0; j < np; j++)
+  {
+    for (k = 0; k < j; k++)
+    {
+      H[j * np + k] = H[k * np + j];
+    }
+  }
+  return dev;
+}
+
+
+// solves A x = b for symmetric positive definite A (Cholesky), 0 or -1
+static int Solve(double* A, const double* b, double* x, int n)
+{
+  int i, j, k;
+  double s;
+
+  for (j = 0; j < n; j++)
+  {
+    s = A[j * n + j];
+    for (k = 0; k < j; k++)
+    {
+      s -= A[j * n + k] * A[j * n + k];
+    }
+    if (!(s > 0))
+    {
+      return -1;
+    }
+    A[j * n + j] = sqrt(s);
+    for (i = j + 1; i < n; i++)
+    {
+      s = A[i * n + j];
+      for (k = 0; k < j; k++)
+      {
+        s -= A[i * n + k] * A[j * n + k];
+      }
+      A[i * n + j] = s / A[j * n + j];
+    }
+  }
+  for (i = 0; i < n; i++)
+  {
+    s = b[i];
+    for (k = 0; k < i; k++)
+    {
+      s -= A[i * n + k] * x[k];
+    }
+    x[i] = s / A[i * n + i];
+  }
+  for (i = n - 1; i >= 0; i--)
+  {
+    s = x[i];
+    for (k = i + 1; k < n; k++)
+    {
+      s -= A[k * n + i] * x[k];
+    }
+    x[i] = s / A[i * n + i];
+  }
+  return 0;
+}
+
+
+int FlimFitPixel(const uint32_t* counts, int nbins, const FlimOptions* opt, float* values)
+{
+  HistAnalysis a;
+  Decay dc;
+  double p[MAXPARAMS], trial[MAXPARAMS], g[MAXPARAMS], H[MAXPARAMS * MAXPARAMS];
+  double tg[MAXPARAMS], tH[MAXPARAMS * MAXPARAMS], A[MAXPARAMS * MAXPARAMS], step[MAXPARAMS];
+  double dev, tdev, lambda = 1e-3, tau, net = 0, tail = 0, bg, t;
+  int np, nfit, ntail, i, k, iter, ok;
+
+  memset(values, 0, FLIM_NPLANES * sizeof(float));
+  HistAnalyzeOne(counts, nbins, 0, &a);
+  values[FLIM_COUNTS] = (float)a.total;
+  if (a.total < (uint64_t)opt->mincounts)
+  {
+    return 0;
+  }
+  values[FLIM_ITER] = -1;
+
+  dc.y = counts;
+  dc.irf = opt->irf;
+  dc.nc = (opt->model == FLIM_BI) ? 2 : 1;
+  dc.end = opt->last ? opt->last : nbins;
+  dc.start = opt->irf ? opt->first : ((a.peakbin > opt->first) ? a.peakbin : opt->first);
+  np = 2 * dc.nc + 1;
+  nfit = dc.end - dc.start;
+  if (nfit < np + 2)
+  {
+    return -1;
+  }
+
+  // start values: the background no higher than the end of the decay
+  ntail = (nfit >= 10) ? nfit / 10 : 1;
+  for (i = dc.start; i < dc.end; i++)
+  {
+    net += counts[i];
+    tail += (i >= dc.end - ntail) ? counts[i] : 0;
+  }
+  bg = (a.background < tail / ntail) ? a.background : tail / ntail;
+  net = (net - bg * nfit > 0) ? net - bg * nfit : net;
+  tau = (a.lifetime > TAUMIN) ? a.lifetime : nfit / 4.0;
+  for (k = 0; k < dc.nc; k++)
+  {
+    t = (dc.nc == 1) ? tau : ((k == 0) ? tau / 2 : tau * 2);
+    p[2 * k] = net / dc.nc * (1 - exp(-1.0 / t));
+    p[2 * k + 1] = t;
+  }
+  p[np - 1] = bg;
+
+  dev = Pass(&dc, p, g, H);
+  if (!isfinite(dev))
+  {
+    return -1;
+  }
+  for (iter = 1; iter <= opt->maxiter; iter++)
+  {
+    memcpy(A, H, np * np * sizeof(double));
+    memcpy(tg, g, np * sizeof(double));
+    for (k = 0; k < np; k++)
+    {
+      A[k * np + k] += lambda * H[k * np + k] + 1e-12;
+      if (((k == np - 1) || !(k & 1)) && (p[k] <= 0) && (g[k] < 0))
+      {
+        // held at its bound of 0, the step leaves it there
+        for (i = 0; i < np; i++)
+        {
+          A[k * np + i] = A[i * np + k] = 0;
+        }
+        A[k * np + k] = 1;
+        tg[k] = 0;
+      }
+    }
+    ok = (Solve(A, tg, step, np) == 0);
+    for (k = 0; ok && (k < np); k++)
+    {
+      trial[k] = p[k] + step[k];
+      if ((k < np - 1) && (k & 1))
+      {
+        ok = (trial[k] >= TAUMIN) && (trial[k] <= TAUMAX);
+      }
+      else if (trial[k] < 0)
+      {
+        trial[k] = 0;  // amplitudes and background stay physical
+      }
+    }
+    tdev = ok ? Pass(&dc, trial, tg, tH) : INFINITY;
+    if (ok && isfinite(tdev) && (tdev <= dev))
+    {
+      memcpy(p, trial, np * sizeof(double));
+      memcpy(g, tg, np * sizeof(double));
+      memcpy(H, tH, np * np * sizeof(double));
+      lambda = (lambda > 1e-9) ? lambda / 10 : lambda;
+      if (dev - tdev <= 1e-7 * dev + 1e-9)
+      {
+        dev = tdev;
+        break;  // converged
+      }
+      dev = tdev;
+    }
+    else
+    {
+      lambda *= 10;
+      if (lambda > LAMBDAMAX)
+      {
+        break;  // no step improves, at the minimum or on a bound
+      }
+    }
+  }
+  iter = (iter > opt->maxiter) ? opt->maxiter : iter;
+
+  if ((dc.nc == 2) && (p[3] < p[1])) // the shorter lifetime first
+  {
+    t = p[0]; p[0] = p[2]; p[2] = t;
+    t = p[1]; p[1] = p[3]; p[3] = t;
+  }
+  values[FLIM_TAU1] = (float)p[1];
+  values[FLIM_AMP1] = (float)p[0];
+  if (dc.nc == 2)
+  {
+    values[FLIM_TAU2] = (float)p[3];
+    values[FLIM_AMP2] = (float)p[2];
+  }
+  values[FLIM_BACKGROUND] = (float)p[np - 1];
+  values[FLIM_CHI2] = (float)(dev / (nfit - np));
+  values[FLIM_ITER] = (float)iter;
+  return iter;
+}
+
+
+static int Take(Queue* q, int64_t* chunk)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail)
+  {
+    *chunk = q->head++;
+    ret = 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return ret;
+}
+
+
+// moves the back half of the chunks of another thread to this one
+static int Steal(FlimJob* job, int self)
+{
+  Queue* victim;
+  int64_t mid, tail = 0;
+  int i;
+
+  for (i = 1; i < job->nthreads; i++)
+  {
+    victim = &job->queues[(self + i) % job->nthreads];
+    pthread_mutex_lock(&victim->lock);
+    if (victim->head < victim->tail)
+    {
+      mid = victim->head + (victim->tail - victim->head) / 2;
+      tail = victim->tail;
+      victim->tail = mid;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    if (tail > 0)
+    {
+      pthread_mutex_lock(&job->queues[self].lock);
+      job->queues[self].head = mid;
+      job->queues[self].tail = tail;
+      pthread_mutex_unlock(&job->queues[self].lock);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static void* Work(void* arg)
+{
+  Worker* w = (Worker*)arg;
+  FlimJob* job = w->job;
+  const FlimCube* cube = job->cube;
+  float values[FLIM_NPLANES];
+  int64_t chunk, px, end;
+  int k, iter;
+
+  for (;;)
+  {
+    if (!Take(&job->queues[w->id], &chunk))
+    {
+      if (!Steal(job, w->id))
+      {
+        break;  // nothing left anywhere
+      }
+      w->steals++;
+      continue;
+    }
+    end = (chunk + 1) * CHUNK;
+    end = (end < job->npixels) ? end : job->npixels;
+    for (px = chunk * CHUNK; px < end; px++)
+    {
+      iter = FlimFitPixel(cube->counts + px * cube->nbins, cube->nbins, job->opt, values);
+      values[FLIM_TAU1] *= cube->binwidth;
+      values[FLIM_TAU2] *= cube->binwidth;
+      for (k = 0; k < FLIM_NPLANES; k++)
+      {
+        job->res->plane[k][px] = values[k];
+      }
+      if (iter > 0)
+      {
+        w->fitted++;
+        w->iterations += iter;
+      }
+      else if (iter == 0)
+      {
+        w->skipped++;
+      }
+      else
+      {
+        w->failed++;
+      }
+    }
+  }
+  return NULL;
+}
+
+
+int FlimFit(const FlimCube* cube, const FlimOptions* opt, FlimResult* res, FlimStats* stats)
+{
+  FlimJob job;
+  int64_t nchunks;
+  double t0 = RtNow();
+  int i, started;
+
+  if ((cube->nbins < 1) || (cube->nbins > FLIM_MAXBINS) || (opt->first < 0)
+    || (opt->last > cube->nbins) || ((opt->last > 0) && (opt->last <= opt->first))
+    || (res->width != cube->width) || (res->height != cube->height))
+  {
+    return -1;
+  }
+  memset(&job, 0, sizeof(job));
+  job.cube = cube;
+  job.opt = opt;
+  job.res = res;
+  job.npixels = (int64_t)cube->width * cube->height;
+  nchunks = (job.npixels + CHUNK - 1) / CHUNK;
+  job.nthreads = opt->threads ? opt->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  job.nthreads = (job.nthreads < 1) ? 1 : ((job.nthreads > MAXTHREADS) ? MAXTHREADS : job.nthreads);
+  job.nthreads = (job.nthreads > nchunks) ? (int)((nchunks > 0) ? nchunks : 1) : job.nthreads;
+  job.queues = (Queue*)calloc(job.nthreads, sizeof(Queue));
+  job.workers = (Worker*)calloc(job.nthreads, sizeof(Worker));
+  if ((job.queues == NULL) || (job.workers == NULL))
+  {
+    free(job.queues);
+    free(job.workers);
+    return -1;
+  }
+  for (i = 0; i < job.nthreads; i++)
+  {
+    pthread_mutex_init(&job.queues[i].lock, NULL);
+    job.queues[i].head = nchunks * i / job.nthreads;
+    job.queues[i].tail = nchunks * (i + 1) / job.nthreads;
+    job.workers[i].job = &job;
+    job.workers[i].id = i;
+  }
+
+  // the calling thread is worker 0
+  for (started = 1; started < job.nthreads; started++)
+  {
+    if (pthread_create(&job.workers[started].thread, NULL, Work, &job.workers[started]) != 0)
+    {
+      break;  // the others steal the chunks of those that did not start
+    }
+  }
+  Work(&job.workers[0]);
+  for (i = 1; i < started; i++)
+  {
+    pthread_join(job.workers[i].thread, NULL);
+  }
+
+  if (stats)
+  {
+    memset(stats, 0, sizeof(FlimStats));
+    for (i = 0; i < job.nthreads; i++)
+    {
+      stats->fitted += job.workers[i].fitted;
+      stats->skipped += job.workers[i].skipped;
+      stats->failed += job.workers[i].failed;
+      stats->iterations += job.workers[i].iterations;
+      stats->steals += job.workers[i].steals;
+    }
+    stats->threads = started;
+    stats->seconds = RtNow() - t0;
+  }
+  for (i = 0; i < job.nthreads; i++)
+  {
+    pthread_mutex_destroy(&job.queues[i].lock);
+  }
+  free(job.queues);
+  free(job.workers);
+  return 0;
+}
+
+
+static int WriteFile(const char* path, const FlimFileHeader* hdr, const void* const* data, size_t bytes, int n)
+{
+  FILE* fp;
+  int i, ok;
+
+  fp = fopen(path, "wb");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  ok = (fwrite(hdr, sizeof(FlimFileHeader), 1, fp) == 1);
+  for (i = 0; ok && (i < n); i++)
+  {
+    ok = (fwrite(data[i], 1, bytes, fp) == bytes);
+  }
+  if ((fclose(fp) != 0) || !ok)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+int FlimCubeWrite(const char* path, const FlimCube* cube)
+{
+  FlimFileHeader hdr;
+  const void* data = cube->counts;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = FLIM_CUBEMAGIC;
+  hdr.version = FLIM_VERSION;
+  hdr.width = cube->width;
+  hdr.height = cube->height;
+  hdr.nbins = cube->nbins;
+  hdr.binwidth = cube->binwidth;
+  return WriteFile(path, &hdr, &data, (size_t)cube->width * cube->height * cube->nbins * sizeof(uint32_t), 1);
+}
+
+
+int FlimCubeRead(const char* path, FlimCube* cube)
+{
+  FlimFileHeader hdr;
+  FILE* fp;
+  uint64_t n, bytes;
+  off_t size;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) || (hdr.magic != FLIM_CUBEMAGIC) || (hdr.version != FLIM_VERSION)
+    || (hdr.nbins < 1) || (hdr.nbins > FLIM_MAXBINS) || (hdr.width < 1) || (hdr.width > INT_MAX)
+    || (hdr.height < 1) || (hdr.height > INT_MAX))
+  {
+    fclose(fp);
+    errno = EINVAL;
+    return -1;
+  }
+  // the header must describe exactly the data that follows it, checked
+  // before the product can overflow or a huge allocation is tried
+  n = (uint64_t)hdr.width * hdr.height;
+  if ((fseeko(fp, 0, SEEK_END) != 0) || ((size = ftello(fp)) < (off_t)sizeof(hdr))
+    || (fseeko(fp, sizeof(hdr), SEEK_SET) != 0))
+  {
+    fclose(fp);
+    errno = EINVAL;
+    return -1;
+  }
+  bytes = (uint64_t)size - sizeof(hdr);
+  if ((n > bytes / (hdr.nbins * sizeof(uint32_t))) || (n * hdr.nbins * sizeof(uint32_t) != bytes)
+    || (bytes > SIZE_MAX))
+  {
+    fclose(fp);
+    errno = EINVAL;
+    return -1;
+  }
+  if (FlimCubeAlloc(cube, hdr.width, hdr.height, hdr.nbins) < 0)
+  {
+    fclose(fp);
+    return -1;
+  }
+  cube->binwidth = hdr.binwidth;
+  n *= hdr.nbins;
+  if (fread(cube->counts, sizeof(uint32_t), (size_t)n, fp) != n)
+  {
+    FlimCubeFree(cube);
+    fclose(fp);
+    errno = EINVAL;
+    return -1;
+  }
+  fclose(fp);
+  return 0;
+}
+
+
+int FlimResultWrite(const char* path, const FlimResult* res, int model, double binwidth)
+{
+  FlimFileHeader hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = FLIM_RESULTMAGIC;
+  hdr.version = FLIM_VERSION;
+  hdr.width = res->width;
+  hdr.height = res->height;
+  hdr.nplanes = FLIM_NPLANES;
+  hdr.model = model;
+  hdr.binwidth = binwidth;
+  return WriteFile(path, &hdr, (const void* const*)res->plane, (size_t)res->width * res->height * sizeof(float),
+    FLIM_NPLANES);
+}
@@ -0,0 +1,140 @@
+/************************************************************************
+
+  Per pixel lifetime fitting of FLIM cubes
+
+  A cube holds one decay histogram per pixel, pixel (x, y) at
+  (y * width + x) * nbins, as ../flim/mhflim builds them from the
+  photons and line markers of T3 recordings. FlimFit fits every pixel
+  with enough counts:
+
+    FLIM_MONO   A1 * decay(tau1) + B
+    FLIM_BI     A1 * decay(tau1) + A2 * decay(tau2) + B
+
+  where decay is exp(-t / tau) from the peak on (tail fit), or with an
+  IRF given the IRF convolved with it (reconvolution). The convolution
+  of an exponential is a first order recursion over the bins, so the
+  model and its derivatives cost O(nbins) either way, with the two
+  components in the two lanes of an SSE2 register.
+
+  The fit maximizes the Poisson likelihood (minimizes the deviance)
+  with Levenberg-Marquardt steps; the deviance per degree of freedom
+  is reported as chi2. Start values come from histanalysis.h.
+
+  The pixels are cut into chunks, split evenly over the threads at the
+  start. A thread that runs out takes the back half of the remaining
+  chunks of another (work stealing), so bright regions that fit slowly
+  do not leave threads idle.
+
+  File formats, little endian, a FlimFileHeader then the data:
+
+    FLIM_CUBEMAGIC    the cube as uint32 counts
+    FLIM_RESULTMAGIC  FLIM_NPLANES float32 images of width x height,
+                      plane by plane in the order below
+
+  Loader: ../../Python/mhflim.py
+
+************************************************************************/
+
+#ifndef FLIMFIT_H
+#define FLIMFIT_H
+
+#include <stdint.h>
+
+#define FLIM_MONO         1
+#define FLIM_BI           2
+
+#define FLIM_MAXBINS      4096
+
+// planes of a result, times in ps
+#define FLIM_COUNTS       0
+#define FLIM_TAU1         1
+#define FLIM_AMP1         2     // counts per bin at the start of the decay
+#define FLIM_TAU2         3
+#define FLIM_AMP2         4
+#define FLIM_BACKGROUND   5     // counts per bin
+#define FLIM_CHI2         6     // deviance per degree of freedom, 0 if not fitted
+#define FLIM_ITER         7     // iterations, -1 if the fit failed
+#define FLIM_NPLANES      8
+
+#define FLIM_CUBEMAGIC    0x3143484D   // "MHC1"
+#define FLIM_RESULTMAGIC  0x3146484D   // "MHF1"
+#define FLIM_VERSION      1
+
+typedef struct
+{
+  uint32_t* counts;             // width * height pixels of nbins bins
+  int width;
+  int height;
+  int nbins;
+  double binwidth;              // ps
+} FlimCube;
+
+typedef struct
+{
+  int model;                    // FLIM_MONO or FLIM_BI
+  int first;                    // first bin fitted
+  int last;                     // bin after the last one fitted, 0 = nbins
+  const double* irf;            // nbins values summing to 1, NULL = tail fit from the peak
+  int mincounts;                // pixels with fewer are not fitted
+  int maxiter;
+  int threads;                  // 0 = one per core
+} FlimOptions;
+
+typedef struct
+{
+  float* plane[FLIM_NPLANES];   // width * height each
+  int width;
+  int height;
+} FlimResult;
+
+typedef struct
+{
+  int64_t fitted;
+  int64_t skipped;              // below mincounts
+  int64_t failed;
+  int64_t iterations;
+  int64_t steals;
+  int threads;
+  double seconds;
+} FlimStats;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t nbins;               // cube only
+  uint32_t nplanes;             // result only
+  uint32_t model;               // result only
+  uint32_t reserved0;
+  double binwidth;              // ps
+  uint8_t reserved[24];
+} FlimFileHeader;               // 64 bytes
+
+
+void FlimDefaults(FlimOptions* opt);
+
+// 0, or -1 if out of memory. The cube is zeroed.
+int FlimCubeAlloc(FlimCube* cube, int width, int height, int nbins);
+void FlimCubeFree(FlimCube* cube);
+
+int FlimResultAlloc(FlimResult* res, int width, int height);
+void FlimResultFree(FlimResult* res);
+
+// Fits the pixels of cube into res, allocated for its size. 0, or -1
+// if the options do not fit the cube or out of memory. Threads that
+// cannot start leave their pixels to the others, down to the caller.
+int FlimFit(const FlimCube* cube, const FlimOptions* opt, FlimResult* res, FlimStats* stats);
+
+// Fits one decay of nbins into FLIM_NPLANES values, as a pixel of FlimFit
+// but with the times in bins. Returns the iterations, 0 for a pixel
+// below mincounts, or -1 if the fit failed.
+int FlimFitPixel(const uint32_t* counts, int nbins, const FlimOptions* opt, float* values);
+
+// Files as described above. 0, or -1 with errno set.
+int FlimCubeWrite(const char* path, const FlimCube* cube);
+int FlimCubeRead(const char* path, FlimCube* cube);
+int FlimResultWrite(const char* path, const FlimResult* res, int model, double binwidth);
+
+#endif
@@ -0,0 +1,249 @@
+/************************************************************************
+
+  Accumulation of histograms over repeated acquisitions, see histaccum.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "histaccum.h"
+#include "mhrt.h"
+
+
+static size_t Bins(const HistAccum* a)
+{
+  return (size_t)a->kept * a->histlen;
+}
+
+
+int AccumInit(HistAccum* a, int numchannels, int histlen, uint64_t chanmask, int averagecycles,
+  int rejectflags, int lowlatency)
+{
+  int i;
+
+  memset(a, 0, sizeof(HistAccum));
+  a->numchannels = numchannels;
+  a->histlen = histlen;
+  a->rejectflags = rejectflags;
+  a->lowlatency = lowlatency;
+  for (i = 0; i < MAXINPCHAN; i++)
+  {
+    a->slot[i] = -1;
+    if ((i < numchannels) && ((chanmask >> i) & 1))
+    {
+      a->chanmask |= 1ULL << i;
+      a->slot[i] = a->kept++;
+    }
+  }
+  if (Bins(a) == 0)
+  {
+    return 0;
+  }
+  a->partial = (unsigned int*)RtAlloc(Bins(a) * sizeof(unsigned int), lowlatency);
+  a->totals = (uint64_t*)RtAlloc(Bins(a) * sizeof(uint64_t), lowlatency);
+  if (averagecycles > 0)
+  {
+    a->average = (float*)RtAlloc(Bins(a) * sizeof(float), lowlatency);
+    a->alpha = 1.0f / averagecycles;
+  }
+  if ((a->partial == NULL) || (a->totals == NULL) || ((averagecycles > 0) && (a->average == NULL)))
+  {
+    AccumFree(a);
+    return -1;
+  }
+  AccumClear(a);
+  return 0;
+}
+
+
+void AccumFree(HistAccum* a)
+{
+  if (a->partial)
+  {
+    RtFree(a->partial, Bins(a) * sizeof(unsigned int));
+  }
+  if (a->totals)
+  {
+    RtFree(a->totals, Bins(a) * sizeof(uint64_t));
+  }
+  if (a->average)
+  {
+    RtFree(a->average, Bins(a) * sizeof(float));
+  }
+  a->partial = NULL;
+  a->totals = NULL;
+  a->average = NULL;
+}
+
+
+void AccumClear(HistAccum* a)
+{
+  if (a->partial)
+  {
+    memset(a->partial, 0, Bins(a) * sizeof(unsigned int));
+    memset(a->totals, 0, Bins(a) * sizeof(uint64_t));
+  }
+  if (a->average)
+  {
+    memset(a->average, 0, Bins(a) * sizeof(float));
+  }
+  memset(a->bound, 0, sizeof(a->bound));
+  a->added = 0;
+  a->rejected = 0;
+  a->elapsed = 0;
+}
+
+
+void AccumCounts(unsigned int* dst, const unsigned int* src, size_t n)
+{
+  size_t k = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v0, v1;
+
+  for (; k + 8 <= n; k += 8)
+  {
+    v0 = _mm_loadu_si128((const __m128i*)(src + k));
+    v1 = _mm_loadu_si128((const __m128i*)(src + k + 4));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(v0, v1), zero)) == 0xFFFF)
+    {
+      continue;  // nothing to add, dst not even read
+    }
+    _mm_storeu_si128((__m128i*)(dst + k), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst + k)), v0));
+    _mm_storeu_si128((__m128i*)(dst + k + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst + k + 4)), v1));
+  }
+#endif
+  for (; k < n; k++)
+  {
+    dst[k] += src[k];
+  }
+}
+
+
+// the partial sums of slot k into its totals
+static void Flush(HistAccum* a, int k)
+{
+  unsigned int* p = a->partial + (size_t)k * a->histlen;
+  uint64_t* t = a->totals + (size_t)k * a->histlen;
+  int j = 0, n = a->histlen;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v;
+
+  for (; j + 4 <= n; j += 4)
+  {
+    v = _mm_loadu_si128((const __m128i*)(p + j));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, zero)) == 0xFFFF)
+    {
+      continue;
+    }
+    _mm_storeu_si128((__m128i*)(t + j),
+      _mm_add_epi64(_mm_loadu_si128((const __m128i*)(t + j)), _mm_unpacklo_epi32(v, zero)));
+    _mm_storeu_si128((__m128i*)(t + j + 2),
+      _mm_add_epi64(_mm_loadu_si128((const __m128i*)(t + j + 2)), _mm_unpackhi_epi32(v, zero)));
+    _mm_storeu_si128((__m128i*)(p + j), zero);
+  }
+#endif
+  for (; j < n; j++)
+  {
+    t[j] += p[j];
+    p[j] = 0;
+  }
+  a->bound[k] = 0;
+}
+
+
+// m += alpha (x - m) over n bins
+static void Average(float* m, const unsigned int* x, int n, float alpha)
+{
+  int j = 0;
+#ifdef __SSE2__
+  // unsigned to float from the 16 bit halves, SSE2 converts signed only
+  const __m128i low = _mm_set1_epi32(0xFFFF);
+  const __m128 high = _mm_set1_ps(65536.0f);
+  const __m128 w = _mm_set1_ps(alpha);
+  __m128i c;
+  __m128 v, mv;
+
+  for (; j + 4 <= n; j += 4)
+  {
+    c = _mm_loadu_si128((const __m128i*)(x + j));
+    v = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c, 16)), high), _mm_cvtepi32_ps(_mm_and_si128(c, low)));
+    mv = _mm_loadu_ps(m + j);
+    _mm_storeu_ps(m + j, _mm_add_ps(mv, _mm_mul_ps(w, _mm_sub_ps(v, mv))));
+  }
+#endif
+  for (; j < n; j++)
+  {
+    m[j] += alpha * (x[j] - m[j]);
+  }
+}
+
+
+int AccumAdd(HistAccum* a, const HistBlock* blk, int flags, double elapsed)
+{
+  const unsigned int* src;
+  int i, k;
+
+  if ((blk->numchannels != a->numchannels) || (blk->histlen != a->histlen))
+  {
+    return -1;
+  }
+  if (flags & a->rejectflags)
+  {
+    a->rejected++;
+    return 0;
+  }
+  for (i = 0; i < a->numchannels; i++)
+  {
+    k = a->slot[i];
+    if (k < 0)
+    {
+      continue;
+    }
+    src = HistChannel(blk, i);
+    if (a->bound[k] + blk->stats[i].peak > 0xFFFFFFFFULL)
+    {
+      Flush(a, k);
+    }
+    a->bound[k] += blk->stats[i].peak;
+    AccumCounts(a->partial + (size_t)k * a->histlen, src, a->histlen);
+    if (a->average)
+    {
+      // the first readout starts the average
+      Average(a->average + (size_t)k * a->histlen, src, a->histlen, a->added ? a->alpha : 1.0f);
+    }
+  }
+  a->added++;
+  a->elapsed += elapsed;
+  return 1;
+}
+
+
+const uint64_t* AccumTotals(HistAccum* a, int i)
+{
+  int k = ((i >= 0) && (i < MAXINPCHAN)) ? a->slot[i] : -1;
+
+  if ((k < 0) || (a->totals == NULL))
+  {
+    return NULL;
+  }
+  Flush(a, k);
+  return a->totals + (size_t)k * a->histlen;
+}
+
+
+const float* AccumAverage(const HistAccum* a, int i)
+{
+  int k = ((i >= 0) && (i < MAXINPCHAN)) ? a->slot[i] : -1;
+
+  if ((k < 0) || (a->average == NULL))
+  {
+    return NULL;
+  }
+  return a->average + (size_t)k * a->histlen;
+}
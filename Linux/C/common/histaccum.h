@@ -0,0 +1,75 @@
+/************************************************************************
+
+  Accumulation of histograms over repeated acquisitions
+
+  Averaging hundreds of short acquisitions sums readouts of up to
+  64 x 65536 bins. The accumulator keeps only the channels that are
+  enabled, at the histogram length of the run, and adds each readout
+  where it lies in the readout block, without a copy.
+
+  A readout is added with SSE2 into 32 bit partial sums, eight bins per
+  step and skipping steps of empty bins, which are most of a decay
+  histogram. The partial sums of a channel go into its 64 bit totals
+  before they could wrap, which the peaks of the readouts tell (their
+  statistics, see histstats.h), and when the totals are read. So the
+  totals never wrap, while most readouts touch 4 bytes per bin.
+
+  Optionally it keeps an exponential moving average per bin as well,
+  which follows drifts the totals hide. It changes in every bin, empty
+  or not, so it is kept in single precision to halve that traffic.
+  Readouts whose MH_GetFlags bits are among the reject flags, e.g.
+  FLAG_OVERFLOW, are left out of both.
+
+************************************************************************/
+
+#ifndef HISTACCUM_H
+#define HISTACCUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mhdefin.h"
+#include "histstats.h"
+
+typedef struct
+{
+  int numchannels;              // of the readouts
+  int histlen;
+  uint64_t chanmask;            // channels kept
+  int kept;                     // their number
+  int slot[MAXINPCHAN];         // place of channel i in the arrays, -1 = not kept
+  unsigned int* partial;        // kept x histlen, added since the totals were last updated
+  uint64_t* totals;             // kept x histlen
+  float* average;               // kept x histlen moving average, NULL without
+  float alpha;                  // weight of the newest readout in the average
+  uint64_t bound[MAXINPCHAN];   // highest possible partial sum per slot
+  int rejectflags;
+  int64_t added;                // readouts in the totals
+  int64_t rejected;
+  double elapsed;               // ms, of the readouts added
+  int lowlatency;
+} HistAccum;
+
+
+// Sized for the channels in chanmask of numchannels histograms of
+// histlen bins. averagecycles > 0 keeps a moving average with a time
+// constant of that many readouts. 0, or -1 if out of memory.
+int AccumInit(HistAccum* a, int numchannels, int histlen, uint64_t chanmask, int averagecycles,
+  int rejectflags, int lowlatency);
+void AccumFree(HistAccum* a);
+
+// Clears the totals, the average and the counters.
+void AccumClear(HistAccum* a);
+
+// Adds the readout blk with its statistics, unless flags has a reject
+// flag. 1 if added, 0 if rejected, -1 if blk has another layout.
+int AccumAdd(HistAccum* a, const HistBlock* blk, int flags, double elapsed);
+
+// Totals and moving average of channel i, NULL if not kept (or no average).
+const uint64_t* AccumTotals(HistAccum* a, int i);
+const float* AccumAverage(const HistAccum* a, int i);
+
+// dst[k] += src[k] for n counts, wrapping at 2^32 like the device counters.
+void AccumCounts(unsigned int* dst, const unsigned int* src, size_t n);
+
+#endif
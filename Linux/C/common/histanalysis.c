@@ -0,0 +1,192 @@
+/************************************************************************
+
+  Online analytics of decay histograms, see histanalysis.h
+
+************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "histanalysis.h"
+
+
+#define RLD_ROUNDS  4   // gate width adaptations at most
+
+
+// total, first moment and peak in one pass
+static void Moments(const unsigned int* counts, int n, HistAnalysis* a, uint64_t* moment)
+{
+  uint64_t sum = 0, mom = 0;
+  unsigned int peak = 0;
+  int peakbin = 0, i = 0;
+#ifdef __SSE2__
+  // as HistStatsOne, plus bin times count, even and odd lanes apart
+  // as _mm_mul_epu32 multiplies lanes 0 and 2
+  const __m128i sign = _mm_set1_epi32((int)0x80000000);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i four = _mm_set1_epi32(4);
+  __m128i vsum = zero, vmom = zero, vmax = sign, vbin = _mm_setr_epi32(0, 1, 2, 3), vidx = vbin;
+  __m128i v, b, gt;
+  unsigned int lmax[4];
+  int lbin[4], k;
+
+  for (; i + 4 <= n; i += 4)
+  {
+    v = _mm_loadu_si128((const __m128i*)(counts + i));
+    vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(v, zero));
+    vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(v, zero));
+    vmom = _mm_add_epi64(vmom, _mm_mul_epu32(v, vidx));
+    vmom = _mm_add_epi64(vmom, _mm_mul_epu32(_mm_srli_epi64(v, 32), _mm_srli_epi64(vidx, 32)));
+    b = _mm_xor_si128(v, sign);
+    gt = _mm_cmpgt_epi32(b, vmax);
+    vmax = _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, vmax));
+    vbin = _mm_or_si128(_mm_and_si128(gt, vidx), _mm_andnot_si128(gt, vbin));
+    vidx = _mm_add_epi32(vidx, four);
+  }
+  vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi64(vsum, vsum));
+  sum = (uint64_t)_mm_cvtsi128_si64(vsum);
+  vmom = _mm_add_epi64(vmom, _mm_unpackhi_epi64(vmom, vmom));
+  mom = (uint64_t)_mm_cvtsi128_si64(vmom);
+  _mm_storeu_si128((__m128i*)lmax, _mm_xor_si128(vmax, sign));
+  _mm_storeu_si128((__m128i*)lbin, vbin);
+  peakbin = lbin[0];
+  peak = lmax[0];
+  for (k = 1; k < 4; k++)
+  {
+    if ((lmax[k] > peak) || ((lmax[k] == peak) && (lbin[k] < peakbin)))
+    {
+      peak = lmax[k];
+      peakbin = lbin[k];
+    }
+  }
+#endif
+  for (; i < n; i++)
+  {
+    sum += counts[i];
+    mom += (uint64_t)i * counts[i];
+    if (counts[i] > peak)
+    {
+      peak = counts[i];
+      peakbin = i;
+    }
+  }
+  a->total = sum;
+  a->peak = peak;
+  a->peakbin = peakbin;
+  *moment = mom;
+}
+
+
+static double Sum(const unsigned int* counts, int n)
+{
+  HistChannelStats s;
+
+  HistStatsOne(counts, n, 0xFFFFFFFF, &s);
+  return (double)s.integral;
+}
+
+
+// where the counts fall to half going from the peak by step, interpolated
+static double Crossing(const unsigned int* counts, int n, int peakbin, int step, double half)
+{
+  int i = peakbin;
+
+  while ((i + step >= 0) && (i + step < n) && (counts[i + step] > half))
+  {
+    i += step;
+  }
+  if ((i + step < 0) || (i + step >= n))
+  {
+    return i;  // the edge of the histogram
+  }
+  return i + step * (counts[i] - half) / ((double)counts[i] - counts[i + step]);
+}
+
+
+// lifetime from the gates [start, start + w) and [start + w, start + 2w)
+static double Rld(const unsigned int* counts, int start, int w, double bg)
+{
+  double d0 = Sum(counts + start, w) - bg * w;
+  double d1 = Sum(counts + start + w, w) - bg * w;
+
+  if ((d1 <= 0) || (d0 <= d1))
+  {
+    return 0;
+  }
+  return w / log(d0 / d1);
+}
+
+
+void HistAnalyzeOne(const unsigned int* counts, int n, int bgbins, HistAnalysis* a)
+{
+  uint64_t moment;
+  double net, half, t, tau = 0;
+  int avail, w, next, k;
+
+  memset(a, 0, sizeof(HistAnalysis));
+  if (n <= 0)
+  {
+    return;
+  }
+  Moments(counts, n, a, &moment);
+
+  if (bgbins == 0)
+  {
+    bgbins = a->peakbin / 2;
+  }
+  bgbins = (bgbins < n) ? bgbins : n;
+  a->background = (bgbins > 0) ? Sum(counts, bgbins) / bgbins : 0;
+
+  // sum over i of (counts[i] - background) * i, and of counts[i] - background
+  net = a->total - a->background * n;
+  a->centroid = (net > 0) ? (moment - a->background * 0.5 * n * (n - 1.0)) / net : a->peakbin;
+
+  half = a->background + 0.5 * (a->peak - a->background);
+  if (a->peak > half)
+  {
+    a->fwhm = Crossing(counts, n, a->peakbin, 1, half) - Crossing(counts, n, a->peakbin, -1, half);
+  }
+
+  avail = (n - a->peakbin) / 2;
+  w = (int)(a->fwhm + 0.5);
+  w = (w < 2) ? 2 : w;
+  for (k = 0; (k < RLD_ROUNDS) && (avail >= 1); k++)
+  {
+    w = (w < avail) ? w : avail;
+    t = Rld(counts, a->peakbin, w, a->background);
+    if (t <= 0)
+    {
+      break;  // keeps the last estimate
+    }
+    tau = t;
+    next = (int)(2.5 * tau + 0.5);
+    next = (next < 1) ? 1 : next;
+    if ((next == w) || ((w == avail) && (next > avail)))
+    {
+      break;
+    }
+    w = next;
+  }
+  a->lifetime = tau;
+}
+
+
+void HistAnalyze(const HistBlock* blk, uint64_t chanmask, int bgbins, HistAnalysis* a)
+{
+  int i;
+
+  for (i = 0; i < blk->numchannels; i++)
+  {
+    if ((chanmask >> i) & 1)
+    {
+      HistAnalyzeOne(HistChannel(blk, i), blk->histlen, bgbins, &a[i]);
+    }
+    else
+    {
+      memset(&a[i], 0, sizeof(HistAnalysis));
+    }
+  }
+}
@@ -0,0 +1,53 @@
+/************************************************************************
+
+  Online analytics of decay histograms
+
+  Gives per histogram, right after the readout, what alignment and
+  monitoring loops otherwise get from external tools:
+
+    - total counts, peak and the first bin of the peak
+    - background: mean counts per bin before the rising edge, from the
+      first bgbins bins, or with bgbins 0 the first half of the bins
+      before the peak; bgbins -1 takes none, for decays that start at
+      the first bin
+    - centroid: background subtracted mean bin over the histogram
+    - FWHM: width at half the peak above background, with the crossings
+      interpolated between bins
+    - lifetime: rapid lifetime determination from two contiguous gates
+      of equal width after the peak, tau = width / ln(D0 / D1) on the
+      background subtracted gate sums, starting at the FWHM and adapted
+      to about 2.5 tau; 0 where the tail does not decay
+
+  The counts are read once for the total, the first moment and the
+  peak (four bins per step with SSE2); background and gates are sums
+  over parts of the histogram and the FWHM walks only the peak. All
+  results are in bins, multiply by the resolution for times.
+
+************************************************************************/
+
+#ifndef HISTANALYSIS_H
+#define HISTANALYSIS_H
+
+#include <stdint.h>
+
+#include "histstats.h"
+
+typedef struct
+{
+  uint64_t total;
+  unsigned int peak;            // highest count
+  int peakbin;                  // first bin with it
+  double background;            // counts per bin
+  double centroid;              // bin
+  double fwhm;                  // bins
+  double lifetime;              // bins, 0 if none
+} HistAnalysis;
+
+
+// Analysis of one histogram of n bins, background from the first bgbins.
+void HistAnalyzeOne(const unsigned int* counts, int n, int bgbins, HistAnalysis* a);
+
+// Analysis of the channels in chanmask into a[0..numchannels-1], cleared for the others.
+void HistAnalyze(const HistBlock* blk, uint64_t chanmask, int bgbins, HistAnalysis* a);
+
+#endif
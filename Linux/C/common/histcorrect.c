@@ -0,0 +1,262 @@
+/************************************************************************
+
+  Pile-up and dead-time correction of decay histograms, see histcorrect.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "histcorrect.h"
+
+
+#define SERIESMAX  (1.0 / 256)  // -ln(1 - x) from 4 terms of its series below this, error < 5e-11
+
+
+void CorrectorInit(HistCorrector* c)
+{
+  memset(c, 0, sizeof(HistCorrector));
+}
+
+
+void CorrectorFree(HistCorrector* c)
+{
+  free(c->sums);
+  CorrectorInit(c);
+}
+
+
+static int Same(const CorrSettings* a, const CorrSettings* b)
+{
+  return (a->resolution == b->resolution) && (a->histlen == b->histlen) && (a->syncrate == b->syncrate)
+    && (a->syncdivider == b->syncdivider) && (a->syncdeadtime == b->syncdeadtime)
+    && (a->inputdeadtime == b->inputdeadtime);
+}
+
+
+int CorrectorSetup(HistCorrector* c, const CorrSettings* s)
+{
+  double* sums;
+  double period, cycle;
+  int input, sync, skip;
+
+  if (c->valid && Same(&c->settings, s))
+  {
+    return 0;
+  }
+  c->valid = 0;
+  if ((s->resolution <= 0) || (s->histlen < 1))
+  {
+    return -1;
+  }
+  if (!c->sums || (s->histlen > c->settings.histlen))
+  {
+    sums = (double*)realloc(c->sums, (s->histlen + 1) * sizeof(double));
+    if (sums == NULL)
+    {
+      return -1;
+    }
+    c->sums = sums;
+  }
+  c->settings = *s;
+
+  input = s->inputdeadtime ? s->inputdeadtime : CORR_INTRINSICDEAD;
+  c->deadbins = (int)(input / s->resolution + 0.5);
+  c->cyclerate = 0;
+  c->periodbins = 0;
+  if (s->syncrate > 0)
+  {
+    // a sync pulse within the sync dead time is not seen
+    period = 1e12 / s->syncrate;
+    sync = s->syncdeadtime ? s->syncdeadtime : CORR_INTRINSICDEAD;
+    skip = (sync > period) ? (int)ceil(sync / period) : 1;
+    cycle = period * skip * ((s->syncdivider > 0) ? s->syncdivider : 1);
+    c->cyclerate = 1e12 / cycle;
+    c->periodbins = (int)(cycle / s->resolution + 0.5);
+  }
+  c->valid = 1;
+  c->updates++;
+  return 0;
+}
+
+
+// photons that arrived in a bin of h counts, live in live of cycles
+static double Coates(double h, double live, double cycles, int* saturated)
+{
+  if (h >= live)
+  {
+    (*saturated)++;
+    return h;
+  }
+  return -cycles * log1p(-h / live);
+}
+
+
+// counts in the dead window before bin i, from the prefix sums
+static double Window(const HistCorrector* c, int i, int n)
+{
+  const double* s = c->sums;
+  int lo = i - c->deadbins, p = c->periodbins, end, a;
+  double w;
+
+  if (lo >= 0)
+  {
+    return s[i] - s[lo];
+  }
+  w = s[i];
+  if (p > 0)
+  {
+    // whole cycles before this one, then the end of the one before them,
+    // as far as the histogram shows it
+    end = (p < n) ? p : n;
+    w += (double)(-lo / p) * s[end];
+    a = p - (-lo % p);
+    a = (a > n) ? n : a;
+    w += (end > a) ? s[end] - s[a] : 0;
+  }
+  return w;
+}
+
+
+static unsigned int Round(double v)
+{
+  return (v >= 4294967295.0) ? 0xFFFFFFFF : (unsigned int)(v + 0.5);
+}
+
+
+int HistCorrectOne(HistCorrector* c, unsigned int* counts, double cycles, HistCorrection* r)
+{
+  double* s = c->sums;
+  double total = 0, v;
+  int n = c->settings.histlen, d = c->deadbins, i, k;
+#ifdef __SSE2__
+  const __m128d e = _mm_set1_pd(cycles);
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d smax = _mm_set1_pd(SERIESMAX);
+  const __m128d imax = _mm_set1_pd(2147483647.0);
+  const __m128d half = _mm_set1_pd(0.5);
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d third = _mm_set1_pd(1.0 / 3);
+  const __m128d quarter = _mm_set1_pd(0.25);
+  __m128d h, x, x2, p, q, vt = zero;
+  double out[2];
+#endif
+
+  memset(r, 0, sizeof(HistCorrection));
+  if (!c->valid || !(cycles > 0))
+  {
+    return -1;
+  }
+  s[0] = 0;
+  for (i = 0; i < n; i++)
+  {
+    s[i + 1] = s[i] + counts[i];
+  }
+  r->measured = (uint64_t)s[n];
+
+  // the window reaches back into the previous cycle, or before bin 0
+  for (i = 0; (i < d) && (i < n); i++)
+  {
+    v = Coates(counts[i], cycles - Window(c, i, n), cycles, &r->saturated);
+    total += v;
+    counts[i] = Round(v);
+  }
+#ifdef __SSE2__
+  for (; i + 2 <= n; i += 2)
+  {
+    h = _mm_sub_pd(_mm_loadu_pd(s + i + 1), _mm_loadu_pd(s + i));
+    if (_mm_movemask_pd(_mm_cmpneq_pd(h, zero)) == 0)
+    {
+      continue;  // empty stays empty, as past the end of the sync period
+    }
+    x = _mm_div_pd(h, _mm_sub_pd(e, _mm_sub_pd(_mm_loadu_pd(s + i), _mm_loadu_pd(s + i - d))));
+    // x (1 + x / 2 + x^2 (1/3 + x / 4)), in two independent halves
+    x2 = _mm_mul_pd(x, x);
+    p = _mm_add_pd(one, _mm_mul_pd(x, half));
+    q = _mm_add_pd(third, _mm_mul_pd(x, quarter));
+    p = _mm_mul_pd(_mm_mul_pd(e, x), _mm_add_pd(p, _mm_mul_pd(x2, q)));
+    // saturated, near it, no live time at all (NaN) or counts beyond
+    // the int32 conversion go the scalar way
+    if (_mm_movemask_pd(_mm_or_pd(_mm_or_pd(_mm_cmpnlt_pd(x, smax), _mm_cmplt_pd(x, zero)),
+      _mm_cmpnlt_pd(p, imax))))
+    {
+      for (k = i; k < i + 2; k++)
+      {
+        v = Coates(counts[k], cycles - (s[k] - s[k - d]), cycles, &r->saturated);
+        total += v;
+        counts[k] = Round(v);
+      }
+      continue;
+    }
+    vt = _mm_add_pd(vt, p);
+    _mm_storel_epi64((__m128i*)(counts + i), _mm_cvttpd_epi32(_mm_add_pd(p, half)));
+  }
+  _mm_storeu_pd(out, vt);
+  total += out[0] + out[1];
+#endif
+  for (; i < n; i++)
+  {
+    v = Coates(counts[i], cycles - (s[i] - s[i - d]), cycles, &r->saturated);
+    total += v;
+    counts[i] = Round(v);
+  }
+  r->corrected = total;
+  return 0;
+}
+
+
+int HistCorrectOne64(HistCorrector* c, uint64_t* counts, double cycles, HistCorrection* r)
+{
+  double* s = c->sums;
+  double total = 0, v;
+  int n = c->settings.histlen, i;
+
+  memset(r, 0, sizeof(HistCorrection));
+  if (!c->valid || !(cycles > 0))
+  {
+    return -1;
+  }
+  s[0] = 0;
+  for (i = 0; i < n; i++)
+  {
+    s[i + 1] = s[i] + (double)counts[i];
+    r->measured += counts[i];
+  }
+  for (i = 0; i < n; i++)
+  {
+    if (counts[i] == 0)
+    {
+      continue;  // empty stays empty
+    }
+    v = Coates((double)counts[i], cycles - Window(c, i, n), cycles, &r->saturated);
+    total += v;
+    counts[i] = (uint64_t)(v + 0.5);
+  }
+  r->corrected = total;
+  return 0;
+}
+
+
+int HistCorrect(HistCorrector* c, HistBlock* blk, uint64_t chanmask, double elapsed, HistCorrection* r)
+{
+  double cycles = c->cyclerate * elapsed * 1e-3;
+  int i, ret = 0;
+
+  memset(r, 0, blk->numchannels * sizeof(HistCorrection));
+  if (!c->valid || (blk->histlen != c->settings.histlen) || !(cycles > 0))
+  {
+    return -1;
+  }
+  for (i = 0; i < blk->numchannels; i++)
+  {
+    if ((chanmask >> i) & 1)
+    {
+      ret |= HistCorrectOne(c, HistChannel(blk, i), cycles, &r[i]);
+    }
+  }
+  return ret;
+}
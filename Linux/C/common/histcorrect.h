@@ -0,0 +1,95 @@
+/************************************************************************
+
+  Pile-up and dead-time correction of decay histograms
+
+  After an input detects a photon it is blind for its dead time, the
+  intrinsic one or the longer one set with MH_SetInputDeadTime. At high
+  count to sync ratios a bin then loses the photons that arrive while
+  an earlier photon of the same or the previous sync cycle still holds
+  the input dead, and the decay comes out shortened and too flat.
+
+  The correction is that of Coates, generalized to a dead time shorter
+  than the cycle: of E cycles, bin i had the input live in E - W[i],
+  where W[i] are the counts in the dead window before it, the bins
+  within the dead time before i and, across the start of the cycle, the
+  last bins of the previous one. With the detection probability
+  h[i] / (E - W[i]) per live cycle, the photons that arrived are
+
+    N[i] = -E ln(1 - h[i] / (E - W[i]))
+
+  which for a dead time of the whole cycle is the classic Coates
+  correction. The ln also counts the photons in one bin that the bin
+  itself hides. Where h[i] reaches E - W[i] the bin is left as is and
+  reported as saturated.
+
+  E follows from the sync rate, the sync divider and the elapsed time;
+  a sync dead time longer than the sync period skips sync pulses and
+  lengthens the cycle the same way. The corrector derives these and the
+  dead window in bins once and keeps them while the settings stay the
+  same, so a readout costs a prefix sum and one pass over the bins,
+  two bins per step with SSE2, where steps of empty bins are skipped.
+  The ln comes from four terms of its series where both bins of a step
+  are below 1/256 of their live cycles, as they are unless the input is
+  close to saturation.
+
+  The corrected counts replace the measured ones in place, rounded.
+
+************************************************************************/
+
+#ifndef HISTCORRECT_H
+#define HISTCORRECT_H
+
+#include <stdint.h>
+
+#include "histstats.h"
+
+#define CORR_INTRINSICDEAD  650     // ps, dead time of the inputs without an extended one
+
+typedef struct
+{
+  double resolution;            // ps per bin
+  int histlen;
+  int syncrate;                 // /s at the sync input, 0 = cycles given per call
+  int syncdivider;
+  int syncdeadtime;             // ps, 0 = intrinsic
+  int inputdeadtime;            // ps, 0 = intrinsic
+} CorrSettings;
+
+typedef struct
+{
+  CorrSettings settings;        // what the factors below were derived for
+  int valid;
+  double cyclerate;             // histogram starts per second
+  int deadbins;                 // bins after a detection that the input misses
+  int periodbins;               // bins from one histogram start to the next, 0 = unknown
+  double* sums;                 // histlen + 1 prefix sums
+  int updates;                  // times the factors were derived
+} HistCorrector;
+
+typedef struct
+{
+  uint64_t measured;
+  double corrected;
+  int saturated;                // bins left uncorrected
+} HistCorrection;
+
+
+void CorrectorInit(HistCorrector* c);
+void CorrectorFree(HistCorrector* c);
+
+// Derives the factors for s unless they are those of the last call.
+// 0, or -1 if out of memory or s has no resolution or length.
+int CorrectorSetup(HistCorrector* c, const CorrSettings* s);
+
+// Corrects counts of histlen bins in place, for the given number of
+// cycles (histogram starts). 0, or -1 if not set up or without cycles.
+int HistCorrectOne(HistCorrector* c, unsigned int* counts, double cycles, HistCorrection* r);
+
+// The same for 64 bit counts, such as the totals of histaccum.h.
+int HistCorrectOne64(HistCorrector* c, uint64_t* counts, double cycles, HistCorrection* r);
+
+// Corrects the channels in chanmask of a readout of elapsed ms into
+// r[0..numchannels-1], cleared for the others. 0, or -1 as above.
+int HistCorrect(HistCorrector* c, HistBlock* blk, uint64_t chanmask, double elapsed, HistCorrection* r);
+
+#endif
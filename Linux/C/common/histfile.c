@@ -0,0 +1,190 @@
+/************************************************************************
+
+  Binary histogram files of the histogramming demos, see histfile.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "mhdefin.h"
+#include "histfile.h"
+#include "histsparse.h"
+#include "mhrt.h"
+
+
+void HistFileInit(HistFileHeader* hdr, int encoding, int numchannels, int histlen)
+{
+  memset(hdr, 0, sizeof(HistFileHeader));
+  hdr->magic = HISTFILE_MAGIC;
+  hdr->version = HISTFILE_VERSION;
+  hdr->encoding = (uint32_t)encoding;
+  hdr->numchannels = (uint32_t)numchannels;
+  hdr->histlen = (uint32_t)histlen;
+}
+
+
+void HistFileSettings(HistFileHeader* hdr, const MeasConfig* cfg)
+{
+  hdr->binning = cfg->Binning;
+  hdr->binwidth = 1u << cfg->Binning;
+  hdr->offset = cfg->Offset;
+  hdr->syncdivider = cfg->SyncDivider;
+  hdr->tacq = cfg->Tacq;
+  hdr->channelmask = cfg->ChannelMask;
+  hdr->syncdeadtime = cfg->SyncDeadTime;
+  hdr->inputdeadtime = cfg->InputDeadTime;
+  hdr->corrected = cfg->Correction;
+}
+
+
+static size_t Varints(const unsigned int* counts, int n, unsigned char* out)
+{
+  unsigned char* p = out;
+  uint64_t z;
+  int64_t d;
+  unsigned int prev = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    d = (int64_t)counts[i] - prev;
+    prev = counts[i];
+    z = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+    while (z >= 0x80)
+    {
+      *p++ = (unsigned char)(z | 0x80);
+      z >>= 7;
+    }
+    *p++ = (unsigned char)z;
+  }
+  return (size_t)(p - out);
+}
+
+
+static int WriteSparse(int fd, HistFileHeader* hdr, const unsigned int* counts, size_t stride,
+                       struct iovec* iov)
+{
+  uint64_t table[MAXINPCHAN + 1];
+  uint32_t* data;
+  size_t maxwords = SparseMaxWords((int)hdr->histlen);
+  uint32_t i;
+  int ret;
+
+  data = (uint32_t*)malloc((size_t)hdr->numchannels * maxwords * sizeof(uint32_t) + 1);
+  if (data == NULL)
+  {
+    return -1;
+  }
+  table[0] = 0;
+  for (i = 0; i < hdr->numchannels; i++)
+  {
+    table[i + 1] = table[i] + sizeof(uint32_t) *
+      SparsePack(counts + i * stride, (int)hdr->histlen, (SparseHist*)((char*)data + table[i]));
+  }
+  hdr->databytes = (hdr->numchannels + 1) * sizeof(uint64_t) + table[hdr->numchannels];
+  iov[1].iov_base = table;
+  iov[1].iov_len = (hdr->numchannels + 1) * sizeof(uint64_t);
+  iov[2].iov_base = data;
+  iov[2].iov_len = table[hdr->numchannels];
+  ret = RtWriteAll(fd, iov, 3);
+  free(data);
+  return ret;
+}
+
+
+int HistFileWrite64(int fd, HistFileHeader* hdr, const uint64_t* const* totals)
+{
+  struct iovec iov[MAXINPCHAN + 1];
+  uint64_t* zeros = NULL;
+  size_t bytes = (size_t)hdr->histlen * sizeof(uint64_t);
+  uint32_t i;
+  int ret;
+
+  if ((hdr->encoding != HISTFILE_RAW64) || (hdr->numchannels > MAXINPCHAN) || (hdr->histlen > MAXHISTLEN))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  hdr->databytes = (uint64_t)hdr->numchannels * bytes;
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(HistFileHeader);
+  for (i = 0; i < hdr->numchannels; i++)
+  {
+    if ((totals[i] == NULL) && (zeros == NULL))
+    {
+      zeros = (uint64_t*)calloc(1, bytes + 1);
+      if (zeros == NULL)
+      {
+        return -1;
+      }
+    }
+    iov[1 + i].iov_base = totals[i] ? (void*)totals[i] : (void*)zeros;
+    iov[1 + i].iov_len = bytes;
+  }
+  ret = RtWriteAll(fd, iov, 1 + hdr->numchannels);
+  free(zeros);
+  return ret;
+}
+
+
+int HistFileWrite(int fd, HistFileHeader* hdr, const unsigned int* counts, size_t stride)
+{
+  struct iovec iov[MAXINPCHAN + 3];
+  uint64_t table[MAXINPCHAN + 1];
+  unsigned char* data;
+  size_t bytes = (size_t)hdr->histlen * sizeof(unsigned int);
+  uint32_t i;
+  int ret;
+
+  if ((hdr->numchannels > MAXINPCHAN) || (hdr->histlen > MAXHISTLEN))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(HistFileHeader);
+
+  if (hdr->encoding == HISTFILE_RAW)
+  {
+    hdr->databytes = (uint64_t)hdr->numchannels * bytes;
+    for (i = 0; i < hdr->numchannels; i++)
+    {
+      iov[1 + i].iov_base = (void*)(counts + i * stride);
+      iov[1 + i].iov_len = bytes;
+    }
+    return RtWriteAll(fd, iov, 1 + hdr->numchannels);
+  }
+  if (hdr->encoding == HISTFILE_SPARSE)
+  {
+    return WriteSparse(fd, hdr, counts, stride, iov);
+  }
+  if (hdr->encoding != HISTFILE_VARINT)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // at most 5 bytes per bin, a 33 bit zigzag difference
+  data = (unsigned char*)malloc((size_t)hdr->numchannels * hdr->histlen * 5 + 1);
+  if (data == NULL)
+  {
+    return -1;
+  }
+  table[0] = 0;
+  for (i = 0; i < hdr->numchannels; i++)
+  {
+    table[i + 1] = table[i] + Varints(counts + i * stride, hdr->histlen, data + table[i]);
+  }
+  hdr->databytes = (hdr->numchannels + 1) * sizeof(uint64_t) + table[hdr->numchannels];
+  iov[1].iov_base = table;
+  iov[1].iov_len = (hdr->numchannels + 1) * sizeof(uint64_t);
+  iov[2].iov_base = data;
+  iov[2].iov_len = table[hdr->numchannels];
+  ret = RtWriteAll(fd, iov, 3);
+  free(data);
+  return ret;
+}
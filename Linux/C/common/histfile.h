@@ -0,0 +1,91 @@
+/************************************************************************
+
+  Binary histogram files of the histogramming demos
+
+  The text output of histomode takes seconds for 64 x 65536 bins and is
+  several times larger than the counts. With HistFormat set the demos
+  write this container instead: a fixed header with the settings and
+  the measurement, then the counts channel by channel, all with one
+  vectored write (writev, one piece per channel, no copy).
+
+    HISTFILE_RAW     numchannels x histlen uint32, channel major, which
+                     loaders map directly (numpy.memmap, memmapfile)
+    HISTFILE_VARINT  a table of numchannels + 1 uint64 byte offsets into
+                     the data, then per channel the zigzag coded
+                     differences of neighbouring bins as LEB128 varints,
+                     so long runs of empty or flat bins take a byte each
+    HISTFILE_SPARSE  a table of numchannels + 1 uint64 byte offsets, then
+                     per channel a SparseHist block (see histsparse.h),
+                     dense, runs or bin/count pairs by occupancy, which
+                     readers use without expanding
+    HISTFILE_RAW64   numchannels x histlen uint64, channel major, the
+                     totals of an accumulation (see histaccum.h), which
+                     is written so with any HistFormat
+
+  A kinetic series (see histseries.h) appends one header and its counts
+  per frame. All fields are little endian.
+
+  Loaders: ../../Python/mhhistfile.py, ../../Matlab/mhhistload.m
+
+************************************************************************/
+
+#ifndef HISTFILE_H
+#define HISTFILE_H
+
+#include <stdint.h>
+
+#include "mhconfig.h"
+
+#define HISTFILE_MAGIC    0x3148484D   // "MHH1"
+#define HISTFILE_VERSION  1
+
+// encodings, also the values of HistFormat (0 is the text output)
+#define HISTFILE_RAW      1
+#define HISTFILE_VARINT   2
+#define HISTFILE_SPARSE   3
+#define HISTFILE_RAW64    4
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t encoding;
+  uint32_t numchannels;
+  uint32_t histlen;
+  int32_t binning;              // MH_SetBinning code, 0 for the T2 histograms of tttrmode
+  int32_t offset;               // ns
+  int32_t syncdivider;
+  int32_t syncrate;             // /s, at the start
+  int32_t tacq;                 // ms, as set
+  uint64_t channelmask;         // enabled channels
+  uint64_t frame;               // index in a kinetic series, else 0
+  uint64_t databytes;           // following this header
+  double resolution;            // ps
+  double elapsed;               // ms, MH_GetElapsedMeasTime
+  double start;                 // s, start of a series frame, else 0
+  int32_t syncdeadtime;         // ps, extended dead times, 0 = off
+  int32_t inputdeadtime;
+  uint32_t corrected;           // 1 = pile-up and dead-time corrected, see histcorrect.h
+  uint32_t acquisitions;        // summed into the counts, 0 = a single one
+  uint32_t binwidth;            // base resolution steps (2^binning) or T2 time tags per bin,
+                                // 0 in files written before it was added
+  uint8_t reserved[20];
+} HistFileHeader;               // 128 bytes
+
+
+// Sets magic, version and the layout, zeros the rest.
+void HistFileInit(HistFileHeader* hdr, int encoding, int numchannels, int histlen);
+
+// Takes binning, offset, sync divider, Tacq, channel mask, dead times
+// and correction from cfg.
+void HistFileSettings(HistFileHeader* hdr, const MeasConfig* cfg);
+
+// Writes hdr and the histograms, channel i at counts + i * stride, to
+// fd in one writev. Sets hdr->databytes. 0, or -1 with errno set.
+int HistFileWrite(int fd, HistFileHeader* hdr, const unsigned int* counts, size_t stride);
+
+// Writes hdr, which must be HISTFILE_RAW64, and the totals of channel i
+// from totals[i], zeros where that is NULL. 0, or -1 with errno set.
+int HistFileWrite64(int fd, HistFileHeader* hdr, const uint64_t* const* totals);
+
+#endif
@@ -0,0 +1,226 @@
+/************************************************************************
+
+  Kinetic series of histograms with double buffered readout, see histseries.h
+
+************************************************************************/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "histseries.h"
+#include "mhrt.h"
+
+
+struct HistSeries
+{
+  HistFrame* frames;
+  int nframes;
+  unsigned int* counts;         // of all frames
+  size_t countsize;
+  SeriesFunc func;
+  void* user;
+  double t0;
+
+  pthread_mutex_t lock;
+  pthread_cond_t ready;         // a frame was submitted or the series ends
+  pthread_cond_t space;         // a frame was processed
+  pthread_t worker;
+  int64_t acquired;             // frames handed out
+  int64_t submitted;
+  int64_t processed;
+  int finish;
+  int failed;
+
+  // acquisition side only
+  int waits;                    // SeriesAcquire found the ring full
+  double waittime;
+  double firststart;
+  double lastend;
+  double deadmin, deadmax, deadsum;
+  double acqsum;
+};
+
+
+static void* Worker(void* arg)
+{
+  HistSeries* s = (HistSeries*)arg;
+  HistFrame* f;
+
+  RtLeave(); // not on the CPU of a LowLatency reader
+  pthread_mutex_lock(&s->lock);
+  for (;;)
+  {
+    while ((s->processed == s->submitted) && !s->finish)
+    {
+      pthread_cond_wait(&s->ready, &s->lock);
+    }
+    if (s->processed == s->submitted)
+    {
+      break;  // finished and nothing left
+    }
+    f = &s->frames[s->processed % s->nframes];
+    pthread_mutex_unlock(&s->lock);
+    if (s->func(s->user, f) < 0)
+    {
+      s->failed++;  // only the worker writes it, read after the join
+    }
+    pthread_mutex_lock(&s->lock);
+    s->processed++;
+    pthread_cond_signal(&s->space);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+
+HistSeries* SeriesCreate(int nframes, int numchannels, int histlen, int lowlatency,
+  SeriesFunc func, void* user)
+{
+  HistSeries* s;
+  size_t per = (size_t)numchannels * histlen;
+  int i;
+
+  if ((nframes < 2) || (nframes > SERIES_MAXFRAMES))
+  {
+    return NULL;
+  }
+  s = (HistSeries*)calloc(1, sizeof(HistSeries));
+  if (s == NULL)
+  {
+    return NULL;
+  }
+  s->nframes = nframes;
+  s->func = func;
+  s->user = user;
+  s->frames = (HistFrame*)calloc(nframes, sizeof(HistFrame));
+  s->countsize = per * nframes * sizeof(unsigned int);
+  s->counts = (unsigned int*)RtAlloc(s->countsize, lowlatency);
+  if ((s->frames == NULL) || (s->counts == NULL))
+  {
+    if (s->counts)
+    {
+      RtFree(s->counts, s->countsize);
+    }
+    free(s->frames);
+    free(s);
+    return NULL;
+  }
+  for (i = 0; i < nframes; i++)
+  {
+    s->frames[i].hist.counts = s->counts + per * i;
+    s->frames[i].hist.numchannels = numchannels;
+    s->frames[i].hist.histlen = histlen;
+    s->frames[i].hist.lowlatency = lowlatency;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->ready, NULL);
+  pthread_cond_init(&s->space, NULL);
+  if (pthread_create(&s->worker, NULL, Worker, s) != 0)
+  {
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->ready);
+    pthread_cond_destroy(&s->space);
+    RtFree(s->counts, s->countsize);
+    free(s->frames);
+    free(s);
+    return NULL;
+  }
+  s->deadmin = 1e30;
+  s->t0 = RtNow();
+  return s;
+}
+
+
+double SeriesTime(const HistSeries* s)
+{
+  return RtNow() - s->t0;
+}
+
+
+HistFrame* SeriesAcquire(HistSeries* s)
+{
+  HistFrame* f;
+  double t;
+
+  pthread_mutex_lock(&s->lock);
+  if (s->acquired - s->processed >= s->nframes)
+  {
+    s->waits++;
+    t = RtNow();
+    while (s->acquired - s->processed >= s->nframes)
+    {
+      pthread_cond_wait(&s->space, &s->lock);
+    }
+    s->waittime += RtNow() - t;
+  }
+  f = &s->frames[s->acquired % s->nframes];
+  memset(f, 0, offsetof(HistFrame, hist));
+  f->index = s->acquired++;
+  pthread_mutex_unlock(&s->lock);
+  return f;
+}
+
+
+void SeriesSubmit(HistSeries* s, HistFrame* f)
+{
+  f->dead = (f->index > 0) ? f->start - s->lastend : 0;
+  if (f->index == 0)
+  {
+    s->firststart = f->start;
+  }
+  else
+  {
+    s->deadmin = (f->dead < s->deadmin) ? f->dead : s->deadmin;
+    s->deadmax = (f->dead > s->deadmax) ? f->dead : s->deadmax;
+    s->deadsum += f->dead;
+  }
+  s->acqsum += f->end - f->start;
+  s->lastend = f->end;
+
+  pthread_mutex_lock(&s->lock);
+  s->submitted++;
+  pthread_cond_signal(&s->ready);
+  pthread_mutex_unlock(&s->lock);
+}
+
+
+int SeriesFinish(HistSeries* s, FILE* fp)
+{
+  int failed;
+  int64_t n = s->submitted;
+  double total = s->lastend - s->firststart;
+
+  pthread_mutex_lock(&s->lock);
+  s->finish = 1;
+  pthread_cond_signal(&s->ready);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->worker, NULL);
+
+  if (fp && (n > 0))
+  {
+    fprintf(fp, "\nKinetic series: %lld frames in %.3f s, %.1f%% of the time measuring", (long long)n,
+      total, (total > 0) ? 100.0 * s->acqsum / total : 0.0);
+    if (n > 1)
+    {
+      fprintf(fp, "\n  dead time between frames %.3f ms mean, %.3f min, %.3f max",
+        s->deadsum / (n - 1) * 1e3, s->deadmin * 1e3, s->deadmax * 1e3);
+    }
+    fprintf(fp, "\n  ring of %d frames full %d times, %.3f ms waited", s->nframes, s->waits, s->waittime * 1e3);
+    if (s->failed)
+    {
+      fprintf(fp, "\n  %d frames failed to process", s->failed);
+    }
+    fprintf(fp, "\n");
+  }
+
+  failed = s->failed;
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->ready);
+  pthread_cond_destroy(&s->space);
+  RtFree(s->counts, s->countsize);
+  free(s->frames);
+  free(s);
+  return failed;
+}
@@ -0,0 +1,67 @@
+/************************************************************************
+
+  Kinetic series of histograms with double buffered readout
+
+  A kinetic series runs back to back acquisitions of Tacq each. The
+  device has one histogram memory, so each frame has to be read before
+  the memory is cleared for the next one. The gap between two frames is
+  therefore stop, MH_GetAllHistograms into a free frame of the ring,
+  clear and start. Everything else (statistics, formatting, the file
+  write) runs on a worker thread while the next frame is acquired.
+
+    - SeriesCreate preallocates a ring of frames for the channels and
+      histogram length of the run and starts the worker.
+    - SeriesAcquire returns a free frame. It only waits if the worker
+      has fallen behind the whole ring, which is counted.
+    - SeriesSubmit hands a filled frame to the worker, which calls the
+      frame function on the frames in order.
+    - SeriesFinish waits until all frames are processed and prints
+      the dead times.
+
+  Each frame carries its start time on the host clock, the measurement
+  time from MH_GetElapsedMeasTime, and the dead time since the end of
+  the previous frame, which includes the whole MH_StartMeas call.
+
+************************************************************************/
+
+#ifndef HISTSERIES_H
+#define HISTSERIES_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "histstats.h"
+
+#define SERIES_MAXFRAMES  1024
+
+typedef struct
+{
+  int64_t index;
+  double start;                 // s since the series started, at MH_StartMeas
+  double end;                   // s, when the end of the measurement was seen
+  double elapsed;               // ms, from MH_GetElapsedMeasTime
+  double dead;                  // s since the end of the previous frame
+  int flags;                    // MH_GetFlags at the end, for triggered frames
+  HistBlock hist;               // counts and statistics
+} HistFrame;
+
+// Called on the worker thread, frame by frame in order. Returns 0, or
+// -1 to count the frame as failed.
+typedef int (*SeriesFunc)(void* user, HistFrame* frame);
+
+typedef struct HistSeries HistSeries;
+
+
+HistSeries* SeriesCreate(int nframes, int numchannels, int histlen, int lowlatency,
+  SeriesFunc func, void* user);
+
+// Seconds since the series was created, the clock of the frame times.
+double SeriesTime(const HistSeries* s);
+
+HistFrame* SeriesAcquire(HistSeries* s);
+void SeriesSubmit(HistSeries* s, HistFrame* frame);
+
+// Waits for the worker, frees everything. Returns the number of failed frames.
+int SeriesFinish(HistSeries* s, FILE* fp);
+
+#endif
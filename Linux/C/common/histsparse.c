@@ -0,0 +1,92 @@
+/************************************************************************
+
+  Sparse histograms for low count channels, see histsparse.h
+
+************************************************************************/
+
+#include <string.h>
+
+#include "histsparse.h"
+
+
+size_t SparseMaxWords(int histlen)
+{
+  return SPARSE_HEADWORDS + (size_t)histlen;  // no form is larger than dense
+}
+
+
+size_t SparseWords(const SparseHist* s)
+{
+  switch (s->form)
+  {
+  case SPARSE_RUNS:
+    return SPARSE_HEADWORDS + 2 * (size_t)s->nruns + s->nnz;
+  case SPARSE_PAIRS:
+    return SPARSE_HEADWORDS + 2 * (size_t)s->nnz;
+  default:
+    return SPARSE_HEADWORDS + s->histlen;
+  }
+}
+
+
+size_t SparsePack(const unsigned int* counts, int histlen, SparseHist* s)
+{
+  uint32_t nnz = 0, nruns = 0, *run, *val, *bin;
+  size_t dense = histlen, runs, pairs;
+  int i, prev = 0, nz;
+
+  for (i = 0; i < histlen; i++)
+  {
+    nz = (counts[i] != 0);
+    nnz += nz;
+    nruns += nz & !prev;
+    prev = nz;
+  }
+  runs = 2 * (size_t)nruns + nnz;
+  pairs = 2 * (size_t)nnz;
+
+  s->histlen = (uint32_t)histlen;
+  s->nnz = nnz;
+  s->nruns = 0;
+  if ((dense <= runs) && (dense <= pairs))
+  {
+    s->form = SPARSE_DENSE;
+    memcpy(s->data, counts, dense * sizeof(uint32_t));
+  }
+  else if (runs <= pairs)
+  {
+    s->form = SPARSE_RUNS;
+    s->nruns = nruns;
+    run = s->data;
+    val = s->data + 2 * nruns;
+    for (i = 0; i < histlen; i++)
+    {
+      if (counts[i] == 0)
+      {
+        continue;
+      }
+      run[0] = (uint32_t)i;
+      while ((i < histlen) && (counts[i] != 0))
+      {
+        *val++ = counts[i++];
+      }
+      run[1] = (uint32_t)i - run[0];
+      run += 2;
+    }
+  }
+  else
+  {
+    s->form = SPARSE_PAIRS;
+    bin = s->data;
+    val = s->data + nnz;
+    for (i = 0; i < histlen; i++)
+    {
+      if (counts[i] != 0)
+      {
+        *bin++ = (uint32_t)i;
+        *val++ = counts[i];
+      }
+    }
+  }
+  return SparseWords(s);
+}
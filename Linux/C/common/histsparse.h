@@ -0,0 +1,64 @@
+/************************************************************************
+
+  Sparse histograms for low count channels
+
+  At fine resolution and full length most bins of a histogram are
+  empty, more so on low rate channels and in short kinetic frames.
+  SparsePack stores each channel in whichever of three forms is the
+  smallest for its occupancy:
+
+    SPARSE_DENSE  histlen counts
+    SPARSE_RUNS   nruns (first bin, length) pairs of the runs of
+                  nonzero bins, then the nnz counts in order; suits
+                  decays and peaks, which are contiguous
+    SPARSE_PAIRS  the nnz nonzero bins, then their counts; suits
+                  scattered single counts
+
+  The form, histlen, nnz and nruns head the data, so a packed channel
+  is one block of uint32 words, in memory as in histfile.h files
+  (HistFormat 3). The loaders of those files expand the blocks again.
+
+  Only the files are sparse. In memory the demos keep dense counts:
+  MH_GetAllHistograms fills dense arrays, the kinetic ring holds a
+  fixed number of frames however long the series runs, and histaccum
+  sums into dense 64 bit totals. Packing (about 0.5 Gbin/s in mhbench)
+  is four times slower than the statistics or the accumulation of the
+  dense counts (about 2 Gbin/s), so packing every readout would cost
+  more time than the consumers save. What does grow with a long series
+  is the file, and that is where the sparse form pays.
+
+************************************************************************/
+
+#ifndef HISTSPARSE_H
+#define HISTSPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPARSE_DENSE  0
+#define SPARSE_RUNS   1
+#define SPARSE_PAIRS  2
+
+#define SPARSE_HEADWORDS  4
+
+typedef struct
+{
+  uint32_t form;
+  uint32_t histlen;
+  uint32_t nnz;                 // nonzero bins
+  uint32_t nruns;               // runs of nonzero bins, SPARSE_RUNS only
+  uint32_t data[];              // as described above
+} SparseHist;
+
+
+// The most words a packed histogram of histlen bins takes, head included.
+size_t SparseMaxWords(int histlen);
+
+// Packs counts into s, which has room for SparseMaxWords(histlen).
+// Returns the words used, head included.
+size_t SparsePack(const unsigned int* counts, int histlen, SparseHist* s);
+
+// The words s takes, head included.
+size_t SparseWords(const SparseHist* s);
+
+#endif
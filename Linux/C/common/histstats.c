@@ -0,0 +1,126 @@
+/************************************************************************
+
+  Bulk histogram block and single pass statistics, see histstats.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "histstats.h"
+#include "mhrt.h"
+
+
+int HistAlloc(HistBlock* blk, int numchannels, int histlen, int lowlatency)
+{
+  memset(blk, 0, sizeof(HistBlock));
+  if ((numchannels < 1) || (numchannels > MAXINPCHAN) || (histlen < 1) || (histlen > MAXHISTLEN))
+  {
+    return -1;
+  }
+  blk->size = (size_t)numchannels * histlen * sizeof(unsigned int);
+  blk->counts = (unsigned int*)RtAlloc(blk->size, lowlatency);
+  if (blk->counts == NULL)
+  {
+    return -1;
+  }
+  blk->numchannels = numchannels;
+  blk->histlen = histlen;
+  blk->lowlatency = lowlatency;
+  return 0;
+}
+
+
+void HistFree(HistBlock* blk)
+{
+  if (blk->counts)
+  {
+    RtFree(blk->counts, blk->size);
+  }
+  blk->counts = NULL;
+}
+
+
+unsigned int* HistChannel(const HistBlock* blk, int i)
+{
+  return blk->counts + (size_t)i * blk->histlen;
+}
+
+
+void HistStatsOne(const unsigned int* counts, int n, unsigned int limit, HistChannelStats* s)
+{
+  uint64_t sum = 0;
+  unsigned int peak = 0;
+  int peakbin = 0, i = 0;
+#ifdef __SSE2__
+  // counts are compared with the sign bit flipped, SSE2 has no unsigned
+  // 32 bit compare; every lane keeps its first maximum and where it was
+  const __m128i sign = _mm_set1_epi32((int)0x80000000);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i four = _mm_set1_epi32(4);
+  __m128i vsum = zero, vmax = sign, vbin = _mm_setr_epi32(0, 1, 2, 3), vidx = vbin;
+  __m128i v, b, gt;
+  unsigned int lmax[4];
+  int lbin[4], k;
+
+  for (; i + 4 <= n; i += 4)
+  {
+    v = _mm_loadu_si128((const __m128i*)(counts + i));
+    vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(v, zero));
+    vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(v, zero));
+    b = _mm_xor_si128(v, sign);
+    gt = _mm_cmpgt_epi32(b, vmax);
+    vmax = _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, vmax));
+    vbin = _mm_or_si128(_mm_and_si128(gt, vidx), _mm_andnot_si128(gt, vbin));
+    vidx = _mm_add_epi32(vidx, four);
+  }
+  vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi64(vsum, vsum));
+  sum = (uint64_t)_mm_cvtsi128_si64(vsum);
+  _mm_storeu_si128((__m128i*)lmax, _mm_xor_si128(vmax, sign));
+  _mm_storeu_si128((__m128i*)lbin, vbin);
+  peakbin = lbin[0];
+  peak = lmax[0];
+  for (k = 1; k < 4; k++)
+  {
+    if ((lmax[k] > peak) || ((lmax[k] == peak) && (lbin[k] < peakbin)))
+    {
+      peak = lmax[k];
+      peakbin = lbin[k];
+    }
+  }
+#endif
+  for (; i < n; i++)
+  {
+    sum += counts[i];
+    if (counts[i] > peak)
+    {
+      peak = counts[i];
+      peakbin = i;
+    }
+  }
+  s->integral = sum;
+  s->peak = peak;
+  s->peakbin = peakbin;
+  s->overflow = (n > 0) && (peak >= limit);
+}
+
+
+void HistStats(HistBlock* blk, uint64_t chanmask, unsigned int limit)
+{
+  int i;
+
+  for (i = 0; i < blk->numchannels; i++)
+  {
+    if ((chanmask >> i) & 1)
+    {
+      HistStatsOne(HistChannel(blk, i), blk->histlen, limit, &blk->stats[i]);
+    }
+    else
+    {
+      memset(&blk->stats[i], 0, sizeof(HistChannelStats));
+    }
+  }
+}
@@ -0,0 +1,59 @@
+/************************************************************************
+
+  Bulk histogram block and single pass statistics for histogramming mode
+
+  MH_GetAllHistograms delivers the histograms of all input channels in
+  one call, back to back, HistLen bins each. HistAlloc provides a page
+  aligned block for that, sized for the channels and the longest
+  HistLen of the measurement, once before it, so that nothing is
+  allocated between the cycles; with LowLatency it is prefaulted like
+  the other buffers (see mhrt.h).
+
+  HistStats then reads each enabled histogram once and yields its
+  integral, its peak and the first bin of the peak, and whether the
+  peak reached the overflow limit (StopCount with StopOverflow, the
+  32 bit counter range otherwise). With SSE2 four bins are processed
+  per step; the scalar code gives the same results elsewhere.
+
+************************************************************************/
+
+#ifndef HISTSTATS_H
+#define HISTSTATS_H
+
+#include <stdint.h>
+
+#include "mhdefin.h"
+
+typedef struct
+{
+  uint64_t integral;
+  unsigned int peak;            // highest count
+  int peakbin;                  // first bin with it
+  int overflow;                 // peak reached the limit
+} HistChannelStats;
+
+typedef struct
+{
+  unsigned int* counts;         // numchannels histograms of histlen bins
+  int numchannels;
+  int histlen;
+  int lowlatency;
+  size_t size;                  // bytes allocated, numchannels * histlen may shrink within
+  HistChannelStats stats[MAXINPCHAN];
+} HistBlock;
+
+
+// A block for numchannels histograms of up to histlen bins. 0 or -1.
+int HistAlloc(HistBlock* blk, int numchannels, int histlen, int lowlatency);
+void HistFree(HistBlock* blk);
+
+// The histogram of channel i, at histlen bins per channel.
+unsigned int* HistChannel(const HistBlock* blk, int i);
+
+// Statistics of one histogram of n bins.
+void HistStatsOne(const unsigned int* counts, int n, unsigned int limit, HistChannelStats* s);
+
+// Statistics of the channels in chanmask, cleared for the others.
+void HistStats(HistBlock* blk, uint64_t chanmask, unsigned int limit);
+
+#endif
@@ -0,0 +1,665 @@
+/************************************************************************
+
+  Measurement configuration for the MultiHarp 150/160 C demos
+  See mhconfig.h for the file format and the command line syntax.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stddef.h>
+
+#include "mhdefin.h"
+#include "mhconfig.h"
+
+
+#define CFG_INT   0
+#define CFG_UINT  1
+#define CFG_MASK  2
+#define CFG_STR   3
+
+typedef struct
+{
+  const char* name;
+  int type;
+  size_t offset;
+  long long min;    // limits from mhdefin.h, not used for CFG_STR
+  long long max;
+  int scannable;    // may be used in a scan list
+} CfgKey;
+
+#define F(member) offsetof(MeasConfig, member)
+
+static const CfgKey cfgkeys[] =
+{
+  { "Mode",               CFG_INT,  F(Mode),               MODE_HIST,      MODE_T3,        0 },
+  { "RefSource",          CFG_INT,  F(RefSource),          REFSRC_INTERNAL, REFSRC_WR_GRANDM_MHARP, 0 },
+  { "Binning",            CFG_INT,  F(Binning),            0,              BINSTEPSMAX-1,  1 },
+  { "Offset",             CFG_INT,  F(Offset),             OFFSETMIN,      OFFSETMAX,      1 },
+  { "Tacq",               CFG_INT,  F(Tacq),               ACQTMIN,        ACQTMAX,        1 },
+  { "SyncDivider",        CFG_INT,  F(SyncDivider),        SYNCDIVMIN,     SYNCDIVMAX,     1 },
+  { "SyncTriggerEdge",    CFG_INT,  F(SyncTriggerEdge),    EDGE_FALLING,   EDGE_RISING,    1 },
+  { "SyncTriggerLevel",   CFG_INT,  F(SyncTriggerLevel),   TRGLVLMIN,      TRGLVLMAX,      1 },
+  { "SyncChannelOffset",  CFG_INT,  F(SyncChannelOffset),  CHANOFFSMIN,    CHANOFFSMAX,    1 },
+  { "InputTriggerEdge",   CFG_INT,  F(InputTriggerEdge),   EDGE_FALLING,   EDGE_RISING,    1 },
+  { "InputTriggerLevel",  CFG_INT,  F(InputTriggerLevel),  TRGLVLMIN,      TRGLVLMAX,      1 },
+  { "InputChannelOffset", CFG_INT,  F(InputChannelOffset), CHANOFFSMIN,    CHANOFFSMAX,    1 },
+  { "SyncDeadTime",       CFG_INT,  F(SyncDeadTime),       0,              EXTDEADMAX,     1 },
+  { "InputDeadTime",      CFG_INT,  F(InputDeadTime),      0,              EXTDEADMAX,     1 },
+  { "ChannelMask",        CFG_MASK, F(ChannelMask),        0,              0,              0 },
+  { "MarkerEnable",       CFG_INT,  F(MarkerEnable),       0x0,            0xF,            0 },
+  { "MarkerEdges",        CFG_INT,  F(MarkerEdges),        0x0,            0xF,            0 },
+  { "MarkerHoldoff",      CFG_INT,  F(MarkerHoldoff),      HOLDOFFMIN,     HOLDOFFMAX,     1 },
+  { "HistLenCode",        CFG_INT,  F(HistLenCode),        MINLENCODE,     MAXLENCODE,     0 },
+  { "StopOverflow",       CFG_INT,  F(StopOverflow),       0,              1,              0 },
+  { "StopCount",          CFG_UINT, F(StopCount),          STOPCNTMIN,     STOPCNTMAX,     1 },
+  { "BulkReadout",        CFG_INT,  F(BulkReadout),        0,              1,              1 },
+  { "Analysis",           CFG_INT,  F(Analysis),           0,              1,              1 },
+  { "AnalysisBackground", CFG_INT,  F(AnalysisBackground), -1,             MAXHISTLEN,     1 },
+  { "Correction",         CFG_INT,  F(Correction),         0,              1,              1 },
+  { "KineticFrames",      CFG_INT,  F(KineticFrames),      0,              0x7FFFFFFF,     1 },
+  { "KineticRing",        CFG_INT,  F(KineticRing),        2,              1024,           0 },
+  { "Accumulate",         CFG_INT,  F(Accumulate),         0,              0x7FFFFFFF,     1 },
+  { "AccumAverage",       CFG_INT,  F(AccumAverage),       0,              0x7FFFFFFF,     1 },
+  { "AccumReject",        CFG_INT,  F(AccumReject),        0x0,            0xFFFF,         0 },
+  { "Triggers",           CFG_INT,  F(Triggers),           0,              0x7FFFFFFF,     1 },
+  { "TriggerGroup",       CFG_INT,  F(TriggerGroup),       0,              0x7FFFFFFF,     1 },
+  { "TriggerTimeout",     CFG_INT,  F(TriggerTimeout),     0,              0x7FFFFFFF,     1 },
+  { "TriggerLog",         CFG_STR,  F(TriggerLog),         0,              0,              0 },
+  { "HistFormat",         CFG_INT,  F(HistFormat),         0,              3,              1 },
+  { "MeasControl",        CFG_INT,  F(MeasControl),        MEASCTRL_SINGLESHOT_CTC, MEASCTRL_WR_S2M, 0 },
+  { "StartEdge",          CFG_INT,  F(StartEdge),          EDGE_FALLING,   EDGE_RISING,    0 },
+  { "StopEdge",           CFG_INT,  F(StopEdge),           EDGE_FALLING,   EDGE_RISING,    0 },
+  { "OutFile",            CFG_STR,  F(OutFile),            0,              0,              0 },
+  { "TraceFile",          CFG_STR,  F(TraceFile),          0,              0,              0 },
+  { "Polling",            CFG_INT,  F(Polling),            0,              1,              1 },
+  { "PollMaxSleep",       CFG_INT,  F(PollMaxSleep),       0,              1000000,        1 },
+  { "LowLatency",         CFG_INT,  F(LowLatency),         0,              1,              0 },
+  { "RtPriority",         CFG_INT,  F(RtPriority),         1,              99,             0 },
+  { "RtCpu",              CFG_INT,  F(RtCpu),              -1,             1023,           0 },
+  { "OverrunRecovery",    CFG_INT,  F(OverrunRecovery),    0,              1,              0 },
+  { "Throttle",           CFG_INT,  F(Throttle),           0,              1,              0 },
+  { "FifoSize",           CFG_INT,  F(FifoSize),           TTREADMAX,      0x7FFFFFFF,     0 },
+  { "LiveCounts",         CFG_INT,  F(LiveCounts),         0,              1,              0 },
+  { "ShmName",            CFG_STR,  F(ShmName),            0,              0,              0 },
+  { "ShmSize",            CFG_INT,  F(ShmSize),            1024,           0x40000000,     0 },
+  { "Compress",           CFG_INT,  F(Compress),           0,              1,              0 },
+  { "CompressThreads",    CFG_INT,  F(CompressThreads),    0,              64,             0 },
+  { "IndexInterval",      CFG_INT,  F(IndexInterval),      0,              0x7FFFFFFF,     0 },
+  { "IndexMarkers",       CFG_INT,  F(IndexMarkers),       0x0,            0xF,            0 },
+  { "ColumnFile",         CFG_STR,  F(ColumnFile),         0,              0,              0 },
+  { "T2HistPairs",        CFG_STR,  F(T2HistPairs),        0,              0,              0 },
+  { "T2HistMultistop",    CFG_INT,  F(T2HistMultistop),    0,              1,              1 },
+  { "T2HistBinWidth",     CFG_INT,  F(T2HistBinWidth),     0,              0x7FFFFFFF,     1 },
+  { "T2HistLen",          CFG_INT,  F(T2HistLen),          1,              MAXHISTLEN,     1 },
+  { "T2HistOffset",       CFG_INT,  F(T2HistOffset),       0,              0x7FFFFFFF,     1 },
+  { "T2HistFile",         CFG_STR,  F(T2HistFile),         0,              0,              0 },
+  { "Batch",              CFG_INT,  F(Batch),              0,              1,              0 },
+};
+
+#define NUMCFGKEYS (int)(sizeof(cfgkeys) / sizeof(cfgkeys[0]))
+
+#undef F
+
+
+static const CfgKey* FindKey(const char* name)
+{
+  int i;
+  for (i = 0; i < NUMCFGKEYS; i++)
+  {
+    if (strcasecmp(cfgkeys[i].name, name) == 0)
+    {
+      return &cfgkeys[i];
+    }
+  }
+  return NULL;
+}
+
+
+static char* Trim(char* s)
+{
+  char* e;
+  while (isspace((unsigned char)*s))
+  {
+    s++;
+  }
+  e = s + strlen(s);
+  while ((e > s) && isspace((unsigned char)e[-1]))
+  {
+    e--;
+  }
+  *e = 0;
+  return s;
+}
+
+
+static int ParseNumber(const char* text, long long* value)
+{
+  char* end;
+  *value = strtoll(text, &end, 0);
+  return ((end == text) || (*Trim(end) != 0)) ? -1 : 0;
+}
+
+
+// whether v fits the field of key, the range proper is left to ConfigValidate
+static int FitsField(const CfgKey* key, long long v)
+{
+  if (key->type == CFG_UINT)
+  {
+    return (v >= 0) && (v <= 4294967295LL);
+  }
+  return (v >= -2147483647LL - 1) && (v <= 2147483647LL);
+}
+
+
+static int ParseScan(MeasConfig* cfg, char* text)
+{
+  char* tok;
+  const CfgKey* key;
+  long long start, step, stop, v;
+  char* c1;
+  char* c2;
+
+  tok = strtok(text, " \t,");
+  if (tok == NULL)
+  {
+    return -1;
+  }
+  key = FindKey(tok);
+  if ((key == NULL) || !key->scannable)
+  {
+    printf("\n%s cannot be scanned", tok);
+    return -1;
+  }
+  strcpy(cfg->ScanParam, key->name);
+  cfg->NumScan = 0;
+
+  while ((tok = strtok(NULL, " \t,")) != NULL)
+  {
+    c1 = strchr(tok, ':');
+    if (c1 == NULL)  // single value
+    {
+      if (ParseNumber(tok, &v) < 0)
+      {
+        return -1;
+      }
+      if (!FitsField(key, v))
+      {
+        printf("\nScan value %s for %s is out of range", tok, key->name);
+        return -1;
+      }
+      if (cfg->NumScan >= CFG_MAXSCAN)
+      {
+        printf("\nScan list has more than %d points", CFG_MAXSCAN);
+        return -1;
+      }
+      cfg->ScanValues[cfg->NumScan++] = v;
+      continue;
+    }
+
+    // start:step:stop
+    c2 = strchr(c1 + 1, ':');
+    if (c2 == NULL)
+    {
+      return -1;
+    }
+    *c1 = 0;
+    *c2 = 0;
+    if ((ParseNumber(tok, &start) < 0) || (ParseNumber(c1 + 1, &step) < 0)
+      || (ParseNumber(c2 + 1, &stop) < 0) || (step == 0))
+    {
+      return -1;
+    }
+    if (!FitsField(key, start) || !FitsField(key, stop))
+    {
+      printf("\nScan range %s:%s:%s for %s is out of range", tok, c1 + 1, c2 + 1, key->name);
+      return -1;
+    }
+    for (v = start; (step > 0) ? (v <= stop) : (v >= stop); v += step)
+    {
+      if (cfg->NumScan >= CFG_MAXSCAN)
+      {
+        printf("\nScan list has more than %d points", CFG_MAXSCAN);
+        return -1;
+      }
+      cfg->ScanValues[cfg->NumScan++] = v;
+      // stop before the step passes stop, v += step could overflow; the
+      // distance to stop is exact in unsigned arithmetic
+      if ((step > 0) ? ((unsigned long long)stop - (unsigned long long)v < (unsigned long long)step)
+        : ((unsigned long long)v - (unsigned long long)stop < 0ULL - (unsigned long long)step))
+      {
+        break;
+      }
+    }
+  }
+  return (cfg->NumScan > 0) ? 0 : -1;
+}
+
+
+void ConfigDefaults(MeasConfig* cfg, int mode, const char* outfile)
+{
+  memset(cfg, 0, sizeof(MeasConfig));
+  cfg->Mode = mode;
+  cfg->RefSource = REFSRC_INTERNAL;
+  cfg->Binning = 0;
+  cfg->Offset = 0;
+  cfg->Tacq = 1000;
+  cfg->SyncDivider = 1;
+  cfg->SyncTriggerEdge = EDGE_FALLING;
+  cfg->SyncTriggerLevel = -50;
+  cfg->SyncChannelOffset = 0;
+  cfg->InputTriggerEdge = EDGE_FALLING;
+  cfg->InputTriggerLevel = -50;
+  cfg->InputChannelOffset = 0;
+  cfg->SyncDeadTime = 0;
+  cfg->InputDeadTime = 0;
+  cfg->ChannelMask = ~0ULL;  // all channels the device has
+  cfg->MarkerEnable = 0;
+  cfg->MarkerEdges = 0;
+  cfg->MarkerHoldoff = 0;
+  cfg->HistLenCode = MAXLENCODE;
+  cfg->StopOverflow = 0;
+  cfg->StopCount = 10000;
+  cfg->BulkReadout = 1;
+  cfg->Analysis = 0;
+  cfg->AnalysisBackground = 0;
+  cfg->Correction = 0;
+  cfg->KineticFrames = 0;
+  cfg->KineticRing = 8;
+  cfg->Accumulate = 0;
+  cfg->AccumAverage = 0;
+  cfg->AccumReject = FLAG_OVERFLOW;
+  cfg->Triggers = 0;
+  cfg->TriggerGroup = 1;
+  cfg->TriggerTimeout = 0;
+  cfg->TriggerLog[0] = 0;
+  cfg->HistFormat = 0;
+  cfg->MeasControl = MEASCTRL_SINGLESHOT_CTC;
+  cfg->StartEdge = EDGE_RISING;
+  cfg->StopEdge = EDGE_FALLING;
+  strncpy(cfg->OutFile, outfile, CFG_MAXPATH - 1);
+  cfg->TraceFile[0] = 0;
+  cfg->Polling = 1;
+  cfg->PollMaxSleep = 10000;
+  cfg->LowLatency = 0;
+  cfg->RtPriority = 80;
+  cfg->RtCpu = -1;
+  cfg->OverrunRecovery = 0;
+  cfg->Throttle = 0;
+  cfg->FifoSize = 67108864;
+  cfg->LiveCounts = 0;
+  cfg->ShmName[0] = 0;
+  cfg->ShmSize = 16 * 1024 * 1024;
+  cfg->Compress = 0;
+  cfg->CompressThreads = 2;
+  cfg->IndexInterval = 0;
+  cfg->IndexMarkers = 0xF;
+  cfg->ColumnFile[0] = 0;
+  cfg->T2HistPairs[0] = 0;
+  cfg->T2HistMultistop = 0;
+  cfg->T2HistBinWidth = 0;
+  cfg->T2HistLen = 4096;
+  cfg->T2HistOffset = 0;
+  strcpy(cfg->T2HistFile, "t2histo.out");
+  cfg->Batch = 0;
+  cfg->ScanParam[0] = 0;
+  cfg->NumScan = 0;
+}
+
+
+int ConfigSetValue(MeasConfig* cfg, const char* name, const char* value)
+{
+  const CfgKey* key;
+  long long v;
+  char* p;
+  char text[4096];
+
+  strncpy(text, value, sizeof(text) - 1);
+  text[sizeof(text) - 1] = 0;
+
+  if (strcasecmp(name, "Scan") == 0)
+  {
+    return ParseScan(cfg, text);
+  }
+
+  key = FindKey(name);
+  if (key == NULL)
+  {
+    printf("\nUnknown setting %s", name);
+    return -1;
+  }
+  p = (char*)cfg + key->offset;
+
+  if (key->type == CFG_STR) // all CFG_MAXPATH long
+  {
+    if (strlen(Trim(text)) >= CFG_MAXPATH)
+    {
+      printf("\nValue for %s is longer than %d characters", name, CFG_MAXPATH - 1);
+      return -1;
+    }
+    strcpy(p, Trim(text));
+    return 0;
+  }
+
+  if (key->type == CFG_MASK)
+  {
+    char* end;
+    *(unsigned long long*)p = strtoull(text, &end, 0);
+    if ((end == text) || (*Trim(end) != 0))
+    {
+      printf("\nInvalid value %s for %s", value, name);
+      return -1;
+    }
+    return 0;
+  }
+
+  if (ParseNumber(text, &v) < 0)
+  {
+    printf("\nInvalid value %s for %s", value, name);
+    return -1;
+  }
+  // range checks are left to ConfigValidate so that all problems
+  // are reported the same way, here we only keep the raw value
+  if (!FitsField(key, v))
+  {
+    printf("\nValue %s for %s is out of range", value, name);
+    return -1;
+  }
+  if (key->type == CFG_UINT)
+  {
+    *(unsigned int*)p = (unsigned int)v;
+  }
+  else
+  {
+    *(int*)p = (int)v;
+  }
+  return 0;
+}
+
+
+int ConfigLoadFile(MeasConfig* cfg, const char* filename)
+{
+  FILE* fp;
+  char line[4096];
+  char* s;
+  char* eq;
+  int lineno = 0;
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    printf("\ncannot open configuration file %s\n", filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    lineno++;
+    s = strpbrk(line, "#;");
+    if (s)
+    {
+      *s = 0;
+    }
+    s = Trim(line);
+    if (*s == 0)
+    {
+      continue;
+    }
+    eq = strchr(s, '=');
+    if (eq == NULL)
+    {
+      printf("\n%s line %d: expected key = value\n", filename, lineno);
+      fclose(fp);
+      return -1;
+    }
+    *eq = 0;
+    if (ConfigSetValue(cfg, Trim(s), Trim(eq + 1)) < 0)
+    {
+      printf("\n%s line %d: invalid setting\n", filename, lineno);
+      fclose(fp);
+      return -1;
+    }
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+
+int ConfigParseArgs(MeasConfig* cfg, int argc, char* argv[])
+{
+  int i;
+  char* eq;
+  char name[64];
+
+  // the file goes first so that overrides win regardless of their position
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-c") == 0)
+    {
+      if (i + 1 >= argc)
+      {
+        printf("\n-c requires a file name\n");
+        return -1;
+      }
+      if (ConfigLoadFile(cfg, argv[++i]) < 0)
+      {
+        return -1;
+      }
+    }
+  }
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-c") == 0)
+    {
+      i++;
+      continue;
+    }
+    if (strcmp(argv[i], "-b") == 0)
+    {
+      cfg->Batch = 1;
+      continue;
+    }
+    eq = strchr(argv[i], '=');
+    if ((eq == NULL) || (eq - argv[i] >= (int)sizeof(name)))
+    {
+      printf("\nusage: %s [-c file] [-b] [key=value ...]\n", argv[0]);
+      return -1;
+    }
+    memcpy(name, argv[i], eq - argv[i]);
+    name[eq - argv[i]] = 0;
+    if (ConfigSetValue(cfg, name, eq + 1) < 0)
+    {
+      printf("\ninvalid argument %s\n", argv[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+static int CheckRange(const MeasConfig* cfg, char* errtext, int errlen)
+{
+  int i;
+  long long v;
+  const char* p;
+
+  for (i = 0; i < NUMCFGKEYS; i++)
+  {
+    if ((cfgkeys[i].type == CFG_STR) || (cfgkeys[i].type == CFG_MASK))
+    {
+      continue;
+    }
+    p = (const char*)cfg + cfgkeys[i].offset;
+    if (cfgkeys[i].type == CFG_UINT)
+    {
+      v = *(const unsigned int*)p;
+    }
+    else
+    {
+      v = *(const int*)p;
+    }
+    if ((v < cfgkeys[i].min) || (v > cfgkeys[i].max))
+    {
+      snprintf(errtext, errlen, "%s = %lld is outside %lld..%lld",
+        cfgkeys[i].name, v, cfgkeys[i].min, cfgkeys[i].max);
+      return -1;
+    }
+  }
+
+  if ((cfg->Mode != MODE_HIST) && (cfg->Mode != MODE_T2) && (cfg->Mode != MODE_T3))
+  {
+    snprintf(errtext, errlen, "Mode = %d is not one of %d, %d, %d",
+      cfg->Mode, MODE_HIST, MODE_T2, MODE_T3);
+    return -1;
+  }
+  if (((cfg->SyncDeadTime > 0) && (cfg->SyncDeadTime < EXTDEADMIN))
+    || ((cfg->InputDeadTime > 0) && (cfg->InputDeadTime < EXTDEADMIN)))
+  {
+    snprintf(errtext, errlen, "SyncDeadTime and InputDeadTime are 0 (off) or at least %d", EXTDEADMIN);
+    return -1;
+  }
+  if ((cfg->Accumulate > 0) && (cfg->KineticFrames > 0))
+  {
+    snprintf(errtext, errlen, "Accumulate and KineticFrames exclude each other");
+    return -1;
+  }
+  if (cfg->T2HistPairs[0] && ((cfg->Mode != MODE_T2) || (cfg->T2HistFile[0] == 0)))
+  {
+    snprintf(errtext, errlen, "T2HistPairs needs Mode = %d and a T2HistFile", MODE_T2);
+    return -1;
+  }
+  if (cfg->ChannelMask == 0)
+  {
+    snprintf(errtext, errlen, "ChannelMask enables no channel");
+    return -1;
+  }
+  if (cfg->OutFile[0] == 0)
+  {
+    snprintf(errtext, errlen, "OutFile is empty");
+    return -1;
+  }
+  return 0;
+}
+
+
+int ConfigValidate(const MeasConfig* cfg, char* errtext, int errlen)
+{
+  MeasConfig run;
+  int i;
+  char runerr[200];
+
+  if (CheckRange(cfg, errtext, errlen) < 0)
+  {
+    return -1;
+  }
+  for (i = 0; i < cfg->NumScan; i++)
+  {
+    ConfigForRun(cfg, i, &run);
+    if (CheckRange(&run, runerr, sizeof(runerr)) < 0)
+    {
+      snprintf(errtext, errlen, "scan point %d: %s", i, runerr);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+int ConfigNumRuns(const MeasConfig* cfg)
+{
+  return (cfg->NumScan > 0) ? cfg->NumScan : 1;
+}
+
+
+// inserts suffix before the extension of a file name
+static void InsertSuffix(char* name, const char* suffix)
+{
+  char* dot;
+  char* slash;
+
+  dot = strrchr(name, '.');
+  slash = strrchr(name, '/');
+  if ((dot == NULL) || (slash && (dot < slash)))
+  {
+    dot = name + strlen(name);
+  }
+  if (strlen(name) + strlen(suffix) < CFG_MAXPATH)
+  {
+    memmove(dot + strlen(suffix), dot, strlen(dot) + 1);
+    memcpy(dot, suffix, strlen(suffix));
+  }
+}
+
+
+void ConfigForRun(const MeasConfig* base, int run, MeasConfig* cfg)
+{
+  const CfgKey* key;
+  char* p;
+  char suffix[16];
+  long long v;
+
+  memcpy(cfg, base, sizeof(MeasConfig));
+  if (base->NumScan == 0)
+  {
+    return;
+  }
+
+  key = FindKey(base->ScanParam);
+  p = (char*)cfg + key->offset;
+  v = base->ScanValues[run];
+  // ParseScan took only values the field holds, the range is up to ConfigValidate
+  if (key->type == CFG_UINT)
+  {
+    *(unsigned int*)p = (unsigned int)v;
+  }
+  else
+  {
+    *(int*)p = (int)v;
+  }
+
+  // histomode.out -> histomode_007.out
+  snprintf(suffix, sizeof(suffix), "_%03d", run);
+  InsertSuffix(cfg->OutFile, suffix);
+  if (cfg->TraceFile[0])
+  {
+    InsertSuffix(cfg->TraceFile, suffix);
+  }
+  if (cfg->ColumnFile[0])
+  {
+    InsertSuffix(cfg->ColumnFile, suffix);
+  }
+  if (cfg->T2HistFile[0])
+  {
+    InsertSuffix(cfg->T2HistFile, suffix);
+  }
+  if (cfg->TriggerLog[0])
+  {
+    InsertSuffix(cfg->TriggerLog, suffix);
+  }
+}
+
+
+void ConfigPrint(const MeasConfig* cfg, FILE* fp)
+{
+  fprintf(fp, "Mode              : %d\n", cfg->Mode);
+  fprintf(fp, "Binning           : %d\n", cfg->Binning);
+  fprintf(fp, "Offset            : %d\n", cfg->Offset);
+  fprintf(fp, "AcquisitionTime   : %d\n", cfg->Tacq);
+  fprintf(fp, "SyncDivider       : %d\n", cfg->SyncDivider);
+  fprintf(fp, "SyncTiggerEdge    : %d\n", cfg->SyncTriggerEdge);
+  fprintf(fp, "SyncTriggerLevel  : %d\n", cfg->SyncTriggerLevel);
+  fprintf(fp, "InputTriggerEdge  : %d\n", cfg->InputTriggerEdge);
+  fprintf(fp, "InputTriggerLevel : %d\n", cfg->InputTriggerLevel);
+  if (cfg->ChannelMask != ~0ULL)
+  {
+    fprintf(fp, "ChannelMask       : 0x%llX\n", cfg->ChannelMask);
+  }
+  if (cfg->NumScan > 0)
+  {
+    fprintf(fp, "Scan              : %s, %d points\n", cfg->ScanParam, cfg->NumScan);
+  }
+}
@@ -0,0 +1,137 @@
+/************************************************************************
+
+  Measurement configuration for the MultiHarp 150/160 C demos
+
+  The demos take their settings from an optional configuration file
+  and from key=value overrides on the command line, instead of using
+  hardcoded values. All values are checked against the limits given
+  in mhdefin.h before any device call is made.
+
+  Command line:  demo [-c file] [-b] [key=value ...]
+
+    -c file    read settings from file (lines of the form key = value,
+               everything after '#' or ';' is a comment)
+    -b         batch mode, never wait for keyboard input
+    key=value  override a single setting, applied after the file
+
+  A scan list runs the same measurement repeatedly with one parameter
+  stepped through a list of values, without closing the device:
+
+    Scan = Tacq 100 200 500 1000     (explicit list)
+    Scan = Binning 0:1:5             (start:step:stop)
+
+************************************************************************/
+
+#ifndef MHCONFIG_H
+#define MHCONFIG_H
+
+#include <stdio.h>
+
+#define CFG_MAXPATH     256
+#define CFG_MAXSCAN     1024    // max number of points in a scan list
+
+
+typedef struct
+{
+  int Mode;                     // MODE_HIST, MODE_T2 or MODE_T3
+  int RefSource;                // REFSRC_xxx, see MH_Initialize
+  int Binning;                  // meaningful only in histo and T3 mode
+  int Offset;                   // ns, meaningful only in histo and T3 mode
+  int Tacq;                     // measurement time in ms
+  int SyncDivider;
+  int SyncTriggerEdge;
+  int SyncTriggerLevel;         // mV
+  int SyncChannelOffset;        // ps
+  int InputTriggerEdge;         // same for all input channels
+  int InputTriggerLevel;        // mV
+  int InputChannelOffset;       // ps
+  int SyncDeadTime;             // ps, extended dead time of the sync input, 0 = off
+  int InputDeadTime;            // ps, extended dead time of all input channels, 0 = off
+  unsigned long long ChannelMask; // bit i enables input channel i
+  int MarkerEnable;             // bits 0..3 enable markers 1..4
+  int MarkerEdges;              // bits 0..3 select rising edge for markers 1..4
+  int MarkerHoldoff;            // ns
+  int HistLenCode;              // histo mode only
+  int StopOverflow;             // histo mode only
+  unsigned int StopCount;       // histo mode only
+  int BulkReadout;              // histo mode: 1 = all histograms in one call, see histstats.h, 0 = per channel
+  int Analysis;                 // histo mode: 1 = centroid, FWHM, background and lifetime per channel, see histanalysis.h
+  int AnalysisBackground;       // bins at the start that give the background, 0 = half of those before the peak, -1 = none
+  int Correction;               // histo mode: 1 = pile-up and dead-time correction of the histograms, see histcorrect.h
+  int KineticFrames;            // histo mode: frames of a kinetic series, see histseries.h, 0 = interactive
+  int KineticRing;              // frames buffered between acquisition and processing
+  int Accumulate;               // histo mode: acquisitions of a series summed into one output, see histaccum.h, 0 = off
+  int AccumAverage;             // readouts in the time constant of a moving average, 0 = none
+  int AccumReject;              // MH_GetFlags bits that keep an acquisition out of the sum
+  int Triggers;                 // histo mode extcontrol: triggered acquisitions to run unattended, 0 = interactive
+  int TriggerGroup;             // triggers summed per output frame, 1 = each separate, 0 = all in one
+  int TriggerTimeout;           // ms to wait for a trigger before ending the run, 0 = no limit
+  char TriggerLog[CFG_MAXPATH]; // per trigger start, measured and dead time, flags and integrals, empty = off
+  int HistFormat;               // histo mode and T2HistFile: 0 = text output, 1 = binary, 2 = binary varint coded, 3 = binary sparse, see histfile.h
+  int MeasControl;              // MEASCTRL_xxx
+  int StartEdge;                // for MH_SetMeasControl
+  int StopEdge;                 // for MH_SetMeasControl
+  char OutFile[CFG_MAXPATH];
+  char TraceFile[CFG_MAXPATH];  // Chrome trace of the acquisition loop, empty = off
+  int Polling;                  // TTTR mode: 1 = adaptive (see mhpoll.h), 0 = continuous
+  int PollMaxSleep;             // us, longest back off of adaptive polling
+  int LowLatency;               // 1 = locked, prefaulted memory and real time priority, see mhrt.h
+  int RtPriority;               // SCHED_FIFO priority with LowLatency
+  int RtCpu;                    // CPU to run on with LowLatency, -1 = any
+  int OverrunRecovery;          // TTTR mode: 1 = restart after a FIFO overrun, see mhrecover.h
+  int Throttle;                 // TTTR mode: 1 = shed optional stages under load, see mhthrottle.h
+  int FifoSize;                 // records, device FIFO capacity assumed by the throttle
+  int LiveCounts;               // TTTR mode: 1 = decode and count events per channel while measuring
+  char ShmName[CFG_MAXPATH];    // TTTR mode: publish the records in this shared memory ring, see mhshm.h
+  int ShmSize;                  // records in the shared memory ring
+  int Compress;                 // TTTR mode: 1 = write the output file block compressed, see tttrcodec.h
+  int CompressThreads;          // compression worker threads, 0 = in the acquisition loop, see tttrcodec.h for their rate
+  int IndexInterval;            // TTTR mode: records between time index entries, 0 = no index, see tttrindex.h
+  int IndexMarkers;             // bits 0..3: markers 1..4 that get an index entry
+  char ColumnFile[CFG_MAXPATH]; // TTTR mode: also write the decoded events to this archive, see tttrcolumns.h
+  char T2HistPairs[CFG_MAXPATH]; // T2 mode: histograms of these ref:target channel pairs while measuring, see t2histo.h, empty = off
+  int T2HistMultistop;          // 1 = every reference in range, 0 = the last one (start-stop)
+  int T2HistBinWidth;           // ps, rounded to time tags, 0 = the resolution
+  int T2HistLen;                // bins
+  int T2HistOffset;             // ps of delay before the first bin
+  char T2HistFile[CFG_MAXPATH]; // written in HistFormat
+  int Batch;                    // 1 = no keyboard interaction at all
+
+  char ScanParam[32];           // empty if no scan
+  int NumScan;
+  long long ScanValues[CFG_MAXSCAN];
+} MeasConfig;
+
+
+// Sets the defaults for the given measurement mode and output file.
+// The demos then override individual values to their own defaults.
+void ConfigDefaults(MeasConfig* cfg, int mode, const char* outfile);
+
+// Processes the command line (see above). Returns 0 on success or -1
+// after printing a message. Does not validate, see ConfigValidate.
+int ConfigParseArgs(MeasConfig* cfg, int argc, char* argv[]);
+
+// Reads a configuration file. Returns 0 on success or -1 after printing
+// a message naming the offending line.
+int ConfigLoadFile(MeasConfig* cfg, const char* filename);
+
+// Sets a single value given as text. Returns 0 on success, -1 if the key
+// is unknown or the value cannot be parsed.
+int ConfigSetValue(MeasConfig* cfg, const char* key, const char* value);
+
+// Checks all settings and every scan point against the mhdefin.h limits.
+// Returns 0 if valid, otherwise -1 with a description in errtext.
+int ConfigValidate(const MeasConfig* cfg, char* errtext, int errlen);
+
+// Number of runs to perform, 1 if there is no scan list.
+int ConfigNumRuns(const MeasConfig* cfg);
+
+// Derives the settings for scan point run from base (0..ConfigNumRuns-1)
+// and the output file names for that run (base name with _NNN inserted
+// before the extension when scanning).
+void ConfigForRun(const MeasConfig* base, int run, MeasConfig* cfg);
+
+// Prints the settings in the style of the demos.
+void ConfigPrint(const MeasConfig* cfg, FILE* fp);
+
+#endif
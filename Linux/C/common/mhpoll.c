@@ -0,0 +1,147 @@
+/************************************************************************
+
+  Adaptive FIFO polling for the MultiHarp TTTR acquisition loop,
+  see mhpoll.h
+
+************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "mhdefin.h"
+#include "mhtrace.h"
+#include "mhpoll.h"
+#include "mhrt.h"
+
+
+static double CpuTime(void)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+    + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+
+void PollInit(PollState* ps, int adaptive, int maxsleep)
+{
+  memset(ps, 0, sizeof(PollState));
+  ps->adaptive = adaptive;
+  ps->maxsleep = maxsleep * 1e-6;
+  ps->t0 = RtNow();
+  ps->cpu0 = CpuTime();
+  ps->lastread = ps->t0;
+  ps->lastflags = ps->t0 - PollFlagPeriod;
+  ps->lastctc = ps->t0 - PollCtcPeriod;
+}
+
+
+int PollFlagsDue(PollState* ps)
+{
+  double now;
+
+  if (ps->adaptive && ps->lastfull)
+  {
+    now = RtNow();
+    if (now - ps->lastflags < PollFlagPeriod)
+    {
+      return 0;
+    }
+    ps->lastflags = now;
+  }
+  ps->flagchecks++;
+  return 1;
+}
+
+
+void PollRead(PollState* ps, int nrecords)
+{
+  double now = RtNow();
+  double dt = now - ps->lastread;
+  double cap;
+  uint64_t t;
+
+  ps->reads++;
+  ps->records += nrecords;
+  if (nrecords == 0)
+  {
+    ps->emptyreads++;
+  }
+  if (dt > 0)
+  {
+    ps->rate += 0.25 * (nrecords / dt - ps->rate);
+  }
+  ps->lastread = now;
+  ps->lastfull = (nrecords >= TTREADMAX / 2);
+  if (!ps->adaptive)
+  {
+    return;
+  }
+
+  if (ps->lastfull)
+  {
+    ps->sleep = 0;  // the FIFO holds a backlog, read back to back
+  }
+  else if (nrecords < TTREADMAX / 64)
+  {
+    ps->sleep = (ps->sleep > 0) ? 2 * ps->sleep : PollMinSleep;
+  }
+  else
+  {
+    ps->sleep /= 2;
+  }
+
+  // the data arriving while we sleep must fit comfortably in one read
+  cap = (ps->rate > 0) ? 0.25 * TTREADMAX / ps->rate : ps->maxsleep;
+  if (ps->sleep > cap)
+  {
+    ps->sleep = cap;
+  }
+  if (ps->sleep > ps->maxsleep)
+  {
+    ps->sleep = ps->maxsleep;
+  }
+
+  if (ps->sleep >= PollMinSleep)
+  {
+    t = TraceStart();
+    usleep((useconds_t)(ps->sleep * 1e6));
+    TraceEnd(TRACE_IDLE, t, 0);
+    ps->sleeps++;
+    ps->slept += RtNow() - now;
+  }
+}
+
+
+int PollCtcDue(PollState* ps)
+{
+  double now;
+
+  if (ps->adaptive)
+  {
+    now = RtNow();
+    if (now - ps->lastctc < PollCtcPeriod)
+    {
+      return 0;
+    }
+    ps->lastctc = now;
+  }
+  ps->ctcchecks++;
+  return 1;
+}
+
+
+void PollPrintStats(const PollState* ps, FILE* fp)
+{
+  double wall = RtNow() - ps->t0;
+  double cpu = CpuTime() - ps->cpu0;
+
+  fprintf(fp, "\nPolling %s: %llu reads (%llu empty), %llu flag checks, %llu CTC checks",
+    ps->adaptive ? "adaptive" : "continuous", (unsigned long long)ps->reads,
+    (unsigned long long)ps->emptyreads, (unsigned long long)ps->flagchecks,
+    (unsigned long long)ps->ctcchecks);
+  fprintf(fp, "\n  %llu records, %.0f records/read, %llu sleeps (%.3f s), CPU load %.1f%%\n",
+    (unsigned long long)ps->records, ps->reads ? (double)ps->records / ps->reads : 0.0,
+    (unsigned long long)ps->sleeps, ps->slept, (wall > 0) ? 100.0 * cpu / wall : 0.0);
+}
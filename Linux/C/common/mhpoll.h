@@ -0,0 +1,91 @@
+/************************************************************************
+
+  Adaptive FIFO polling for the MultiHarp TTTR acquisition loop
+
+  The plain loop of the tttrmode demo calls MH_GetFlags before every
+  MH_ReadFiFo and MH_CTCStatus after every empty read. At low count rates
+  that spins a full core per device and costs a USB round trip per call.
+  The poll scheduler keeps the structure of that loop but decides
+
+    - whether the flags need checking before a read: after full reads
+      data is flowing and a check every PollFlagPeriod is enough,
+    - how long to sleep after a read: when reads return few records it
+      backs off exponentially up to MaxSleep, but never so long that the
+      next read would have to return more than a quarter of TTREADMAX
+      at the current rate, and not at all after reads of half a buffer,
+    - whether the CTC needs checking after an empty read, at most once
+      per PollCtcPeriod.
+
+  Use:
+
+    PollInit(&poll, cfg.Polling, cfg.PollMaxSleep);
+    while (1)
+    {
+      if (PollFlagsDue(&poll))
+      {
+        MH_GetFlags(...)  and check for FLAG_FIFOFULL
+      }
+      MH_ReadFiFo(...)
+      PollRead(&poll, nRecords);   // may sleep
+      ...
+      if ((nRecords == 0) && PollCtcDue(&poll))
+      {
+        MH_CTCStatus(...)
+      }
+    }
+    PollPrintStats(&poll, stdout);
+
+  With adaptive off every check is due and no sleeps happen, which is
+  the behaviour of the original demo, but the statistics are still kept
+  for comparison.
+
+************************************************************************/
+
+#ifndef MHPOLL_H
+#define MHPOLL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PollFlagPeriod  0.010   // s between flag checks while reads are full
+#define PollCtcPeriod   0.001   // s between CTC checks
+#define PollMinSleep    50e-6   // s, first step of the back off
+
+typedef struct
+{
+  int adaptive;
+  double maxsleep;      // s
+  double sleep;         // s, current back off
+  double rate;          // records/s, smoothed
+  double lastread;
+  double lastflags;
+  double lastctc;
+  int lastfull;         // last read returned at least half a buffer
+
+  // statistics
+  double t0;
+  double cpu0;
+  double slept;
+  uint64_t reads;
+  uint64_t emptyreads;
+  uint64_t records;
+  uint64_t flagchecks;
+  uint64_t ctcchecks;
+  uint64_t sleeps;
+} PollState;
+
+
+// maxsleep in microseconds
+void PollInit(PollState* ps, int adaptive, int maxsleep);
+
+int PollFlagsDue(PollState* ps);
+
+// Accounts for a read of nrecords and sleeps if the scheduler decides so.
+void PollRead(PollState* ps, int nrecords);
+
+int PollCtcDue(PollState* ps);
+
+// Prints the call counts and the CPU load of the process since PollInit.
+void PollPrintStats(const PollState* ps, FILE* fp);
+
+#endif
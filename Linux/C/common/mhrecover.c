@@ -0,0 +1,152 @@
+/************************************************************************
+
+  FIFO overrun recovery for the MultiHarp TTTR acquisition loop,
+  see mhrecover.h
+
+************************************************************************/
+
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhrecover.h"
+
+
+static unsigned __int128 StartPs(const SegmentInfo* s)
+{
+  return ((unsigned __int128)s->StartTime[2] << 64) | ((unsigned __int128)s->StartTime[1] << 32)
+    | s->StartTime[0];
+}
+
+
+// starts a segment of tacq ms
+static int StartSegment(Recovery* rc, int tacq)
+{
+  int retcode;
+
+  retcode = MH_StartMeas(rc->dev, tacq);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+  return MH_GetStartTime(rc->dev, &rc->segment.StartTime[2], &rc->segment.StartTime[1],
+    &rc->segment.StartTime[0]);
+}
+
+
+int RecoveryStart(Recovery* rc, int dev, int mode, int refsource, int tacq)
+{
+  int retcode;
+
+  memset(rc, 0, sizeof(Recovery));
+  rc->dev = dev;
+  rc->mode = mode;
+  rc->refsource = refsource;
+  rc->tacq = tacq;
+  rc->segment.RefSource = refsource;
+  retcode = StartSegment(rc, tacq);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+  SegmentEncode(&rc->segment, rc->block);
+  rc->blockready = 1;
+  return MH_ERROR_NONE;
+}
+
+
+int RecoveryTake(Recovery* rc, unsigned int* buffer)
+{
+  if (!rc->blockready)
+  {
+    return 0;
+  }
+  memcpy(buffer, rc->block, sizeof(rc->block));
+  rc->blockready = 0;
+  return SEGMENT_WORDS;
+}
+
+
+int RecoveryOverrun(Recovery* rc)
+{
+  int retcode;
+
+  // the hardware has stopped filling the FIFO, the segment ends here
+  retcode = MH_GetElapsedMeasTime(rc->dev, &rc->elapsed);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+  rc->overruns++;
+  rc->draining = 1;
+  return MH_ERROR_NONE;
+}
+
+
+int RecoveryDrain(Recovery* rc, int nrecords)
+{
+  SegmentInfo prev = rc->segment;
+  unsigned __int128 end, start;
+  int syncrate;
+  int rates[MAXINPCHAN] = { 0 };
+  double lost, rate;
+  int retcode, i, remaining;
+
+  if (nrecords > 0) // still what the FIFO held
+  {
+    rc->drained += nrecords;
+    return MH_ERROR_NONE;
+  }
+  rc->draining = 0;
+
+  retcode = MH_StopMeas(rc->dev);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+  rc->done += rc->elapsed;
+  remaining = (int)(rc->tacq - rc->done);
+  if (remaining < ACQTMIN)
+  {
+    return 1;
+  }
+
+  // rates from before the restart, the new ones take 100 ms to settle
+  retcode = MH_GetAllCountRates(rc->dev, &syncrate, rates);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+
+  rc->segment.Segment++;
+  retcode = StartSegment(rc, remaining);
+  if (retcode < 0)
+  {
+    return retcode;
+  }
+
+  end = StartPs(&prev) + (unsigned __int128)(rc->elapsed * 1e9);  // ms to ps
+  start = StartPs(&rc->segment);
+  lost = (start > end) ? (double)(start - end) : 0.0;
+  rate = (rc->mode == MODE_T2) ? syncrate : 0;
+  for (i = 0; i < MAXINPCHAN; i++)
+  {
+    rate += rates[i];
+  }
+  rc->segment.LostTime = (uint64_t)lost;
+  rc->segment.LostEvents = (uint64_t)(rate * lost * 1e-12);
+  rc->losttime += lost;
+  rc->lostevents += rc->segment.LostEvents;
+  SegmentEncode(&rc->segment, rc->block);
+  rc->blockready = 1;
+  return MH_ERROR_NONE;
+}
+
+
+void RecoveryPrint(const Recovery* rc, FILE* fp)
+{
+  fprintf(fp, "\nOverrun recovery: %d overruns, %u segments, %.3f ms lost, about %llu events lost",
+    rc->overruns, rc->segment.Segment + 1, rc->losttime * 1e-9, (unsigned long long)rc->lostevents);
+  fprintf(fp, "\n  %llu records drained after overruns\n", (unsigned long long)rc->drained);
+}
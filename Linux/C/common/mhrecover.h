@@ -0,0 +1,74 @@
+/************************************************************************
+
+  FIFO overrun recovery for the MultiHarp TTTR acquisition loop
+
+  Without recovery a FIFO overrun ends the measurement and the run is
+  lost. With the OverrunRecovery setting tttrmode instead
+
+    - notes the measurement time at the overrun, where the segment ends,
+    - reads what is left in the FIFO as usual, through all stages of
+      the loop,
+    - stops and immediately restarts the measurement for the remaining
+      acquisition time once the FIFO is empty,
+    - passes a segment block (see tttrdecode.h) carrying the new start
+      time, the length of the gap and an estimate of the events lost in
+      it, computed from the count rates, through the stages like the
+      records read,
+
+  and goes on. The first segment gets a block too, so that readers know
+  the absolute start of the file. The decoders in tttrdecode.c continue
+  the time base across the gaps, so downstream analysis sees one file
+  with a few short holes instead of a failed run.
+
+************************************************************************/
+
+#ifndef MHRECOVER_H
+#define MHRECOVER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tttrdecode.h"
+
+
+typedef struct
+{
+  int dev;
+  int mode;
+  int refsource;
+  double tacq;            // ms requested for the whole run
+  double done;            // ms of measurement time in finished segments
+  SegmentInfo segment;    // the current segment
+  int draining;           // an overrun was flagged, the FIFO is read empty
+  double elapsed;         // ms measured in the current segment up to its overrun
+  int blockready;         // the block of the current segment waits for RecoveryTake
+  unsigned int block[SEGMENT_WORDS];
+
+  int overruns;
+  double losttime;        // ps, sum over all gaps
+  uint64_t lostevents;
+  uint64_t drained;       // records read after an overrun was flagged
+} Recovery;
+
+
+// Starts the measurement of a run, with the block of segment 0 ready.
+// Returns 0 or an MH_ERROR_xxx code.
+int RecoveryStart(Recovery* rc, int dev, int mode, int refsource, int tacq);
+
+// Copies the block of a segment just started to buffer, to go through
+// the loop ahead of its records. The number of records, 0 if none.
+int RecoveryTake(Recovery* rc, unsigned int* buffer);
+
+// Handles an overrun flagged by MH_GetFlags: ends the segment at the
+// measurement time reached and starts draining. 0 or an MH_ERROR_xxx code.
+int RecoveryOverrun(Recovery* rc);
+
+// Called with every FIFO read while draining. After the first empty one
+// it restarts for the remaining time with the new block ready. Returns
+// 0 while draining or when running again, 1 if no acquisition time was
+// left, or an MH_ERROR_xxx code.
+int RecoveryDrain(Recovery* rc, int nrecords);
+
+void RecoveryPrint(const Recovery* rc, FILE* fp);
+
+#endif
@@ -0,0 +1,296 @@
+/************************************************************************
+
+  Low latency support for the MultiHarp acquisition loops, see mhrt.h
+
+************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "mhrt.h"
+
+
+#define HUGEPAGESIZE  (2 * 1024 * 1024)
+
+static cpu_set_t freecpus;  // the affinity before RtEnter pinned the thread
+static int pinned = 0;
+
+
+static double NowNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+void* RtAlloc(size_t size, int lowlatency)
+{
+  void* p = MAP_FAILED;
+  size_t i, page = (size_t)sysconf(_SC_PAGESIZE);
+
+  if (lowlatency)
+  {
+#ifdef MAP_HUGETLB
+    // explicit huge pages, only if the administrator has reserved some
+    p = mmap(NULL, (size + HUGEPAGESIZE - 1) & ~(size_t)(HUGEPAGESIZE - 1),
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  }
+  if (p == MAP_FAILED)
+  {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+      return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (lowlatency)
+    {
+      madvise(p, size, MADV_HUGEPAGE);  // transparent huge pages, if enabled
+    }
+#endif
+  }
+  if (lowlatency)
+  {
+    for (i = 0; i < size; i += page)
+    {
+      ((volatile char*)p)[i] = 0;
+    }
+  }
+  return p;
+}
+
+
+void RtFree(void* p, size_t size)
+{
+  if (p)
+  {
+    // a huge page mapping was rounded up, munmap needs the same length
+    if (munmap(p, size) != 0)
+    {
+      munmap(p, (size + HUGEPAGESIZE - 1) & ~(size_t)(HUGEPAGESIZE - 1));
+    }
+  }
+}
+
+
+int RtEnter(int priority, int cpu)
+{
+  struct sched_param sp;
+  cpu_set_t set;
+  int ret = 0;
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    printf("\nLowLatency: cannot lock memory (%s)", strerror(errno));
+    ret = -1;
+  }
+
+  if (cpu >= 0)
+  {
+    pinned = (sched_getaffinity(0, sizeof(freecpus), &freecpus) == 0);
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+      printf("\nLowLatency: cannot pin to CPU %d (%s)", cpu, strerror(errno));
+      ret = -1;
+    }
+  }
+
+  memset(&sp, 0, sizeof(sp));
+  sp.sched_priority = priority;
+  if (sched_setscheduler(0, SCHED_FIFO, &sp) != 0)
+  {
+    printf("\nLowLatency: cannot set SCHED_FIFO priority %d (%s)", priority, strerror(errno));
+    ret = -1;
+  }
+  return ret;
+}
+
+
+int RtLeave(void)
+{
+  struct sched_param sp;
+  int ret = 0;
+
+  if (sched_getscheduler(0) != SCHED_OTHER)
+  {
+    memset(&sp, 0, sizeof(sp));
+    ret |= sched_setscheduler(0, SCHED_OTHER, &sp);
+  }
+  if (pinned)
+  {
+    ret |= sched_setaffinity(0, sizeof(freecpus), &freecpus);
+  }
+  return ret ? -1 : 0;
+}
+
+
+void RtJitterReset(RtJitter* j)
+{
+  memset(j, 0, sizeof(RtJitter));
+}
+
+
+void RtJitterAdd(RtJitter* j, double ns)
+{
+  int b = 0;
+  int e;
+  double m;
+
+  if (ns >= 1.0)
+  {
+    // b = 8 * octave + position within the octave
+    m = frexp(ns, &e);  // ns = m * 2^e, 0.5 <= m < 1
+    b = (e - 1) * RTJ_SUBBUCKETS + (int)((m - 0.5) * 2 * RTJ_SUBBUCKETS);
+    if (b >= RTJ_BUCKETS)
+    {
+      b = RTJ_BUCKETS - 1;
+    }
+  }
+  j->bucket[b]++;
+  j->n++;
+  if (ns > j->max)
+  {
+    j->max = ns;
+  }
+}
+
+
+void RtJitterTick(RtJitter* j)
+{
+  double now = NowNs();
+
+  if (j->last > 0)
+  {
+    RtJitterAdd(j, now - j->last);
+  }
+  j->last = now;
+}
+
+
+void RtJitterProbe(RtJitter* j, int ms)
+{
+  struct timespec next;
+  double target;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (i = 0; i < ms; i++)
+  {
+    next.tv_nsec += 1000000;
+    if (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    target = next.tv_sec * 1e9 + next.tv_nsec;
+    RtJitterAdd(j, NowNs() - target);
+  }
+}
+
+
+// upper edge of bucket b in ns
+static double BucketEdge(int b)
+{
+  return ldexp(0.5 + (b % RTJ_SUBBUCKETS + 1) * 0.5 / RTJ_SUBBUCKETS, b / RTJ_SUBBUCKETS + 1);
+}
+
+
+static double Percentile(const RtJitter* j, double p)
+{
+  uint64_t want = (uint64_t)ceil(p / 100.0 * j->n);
+  uint64_t sum = 0;
+  int b;
+
+  for (b = 0; b < RTJ_BUCKETS; b++)
+  {
+    sum += j->bucket[b];
+    if (sum >= want)
+    {
+      return (BucketEdge(b) < j->max) ? BucketEdge(b) : j->max;
+    }
+  }
+  return j->max;
+}
+
+
+void RtJitterPrint(const RtJitter* j, const char* name, FILE* fp)
+{
+  if (j->n == 0)
+  {
+    fprintf(fp, "\n%-24s no samples", name);
+    return;
+  }
+  fprintf(fp, "\n%-24s n=%-9llu p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us",
+    name, (unsigned long long)j->n, Percentile(j, 50) * 1e-3, Percentile(j, 90) * 1e-3,
+    Percentile(j, 99) * 1e-3, Percentile(j, 99.9) * 1e-3, j->max * 1e-3);
+}
+
+
+int RtEnterMeasured(int priority, int cpu, FILE* fp)
+{
+  RtJitter j;
+  int ret;
+
+  fprintf(fp, "\nMeasuring timer latency...");
+  fflush(fp);
+  RtJitterReset(&j);
+  RtJitterProbe(&j, 1000);
+  RtJitterPrint(&j, "latency before", fp);
+  ret = RtEnter(priority, cpu);
+  RtJitterReset(&j);
+  RtJitterProbe(&j, 1000);
+  RtJitterPrint(&j, "latency after", fp);
+  fprintf(fp, "\n");
+  return ret;
+}
+
+
+double RtNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+int RtWriteAll(int fd, struct iovec* iov, int n)
+{
+  ssize_t done;
+
+  while (n > 0)
+  {
+    done = writev(fd, iov, n);
+    if (done < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    while ((n > 0) && ((size_t)done >= iov->iov_len))
+    {
+      done -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0)
+    {
+      iov->iov_base = (char*)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+  return 0;
+}
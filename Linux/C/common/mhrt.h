@@ -0,0 +1,93 @@
+/************************************************************************
+
+  Low latency support for the MultiHarp acquisition loops
+
+  Page faults on the large demo buffers and preemption of the FIFO
+  reader cause latency spikes that can end in FIFO overruns. With the
+  LowLatency setting the demos
+
+    - allocate their buffers with RtAlloc, which backs them with huge
+      pages where the system provides them and touches every page up
+      front, so that no fault happens during the measurement,
+    - call RtEnter, which locks all current and future memory and runs
+      the calling thread with SCHED_FIFO priority, optionally pinned to
+      one CPU (ideally one isolated with isolcpus= or a cpuset),
+    - measure the timer wakeup latency before and after RtEnter and the
+      period of the acquisition loop with RtJitter.
+
+  Threads inherit the priority and CPU of the thread that creates them.
+  Worker threads, which may be started after RtEnter, call RtLeave first
+  so that they neither compete with the acquisition loop on its CPU nor
+  preempt it.
+
+  Locking memory and real time priority need CAP_IPC_LOCK and
+  CAP_SYS_NICE (or suitable RLIMIT_MEMLOCK and RLIMIT_RTPRIO limits).
+  Without them RtEnter prints what failed and the demo continues.
+
+  The demos also take their monotonic clock (RtNow) and the writing of
+  iovecs in full (RtWriteAll) from here.
+
+************************************************************************/
+
+#ifndef MHRT_H
+#define MHRT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define RTJ_SUBBUCKETS  8     // per power of two, about 9% resolution
+#define RTJ_BUCKETS     (40 * RTJ_SUBBUCKETS)
+
+
+// Distribution of latencies or loop periods in ns. Fixed size, so that
+// recording never allocates or faults.
+typedef struct
+{
+  uint64_t bucket[RTJ_BUCKETS];
+  uint64_t n;
+  double max;
+  double last;   // time of the last RtJitterTick
+} RtJitter;
+
+
+// Returns zeroed, page aligned memory. With lowlatency the memory is
+// backed by huge pages if possible and prefaulted. NULL if out of memory.
+void* RtAlloc(size_t size, int lowlatency);
+void RtFree(void* p, size_t size);
+
+// Locks memory, sets SCHED_FIFO with the given priority (1..99) and pins
+// the thread to cpu unless it is -1. Returns 0 if everything succeeded,
+// -1 if some step failed (a message was printed).
+int RtEnter(int priority, int cpu);
+
+// Same as RtEnter, but measures and prints the timer wakeup latency for
+// one second before and after, to show what the settings achieved.
+int RtEnterMeasured(int priority, int cpu, FILE* fp);
+
+// Returns the calling thread to normal scheduling on the CPUs it had
+// before RtEnter. Does nothing in a thread that never had them changed.
+// 0, or -1 if some step failed.
+int RtLeave(void);
+
+void RtJitterReset(RtJitter* j);
+void RtJitterAdd(RtJitter* j, double ns);
+
+// Adds the time since the previous tick, call once per loop iteration.
+void RtJitterTick(RtJitter* j);
+
+// Measures the wakeup latency of a 1 ms periodic timer for ms milliseconds.
+void RtJitterProbe(RtJitter* j, int ms);
+
+// Prints count, percentiles and maximum in microseconds.
+void RtJitterPrint(const RtJitter* j, const char* name, FILE* fp);
+
+// Monotonic time in s, for timing loops and rates.
+double RtNow(void);
+
+// Writes all of iov, also after short writes and interrupts, which
+// moves the entries of iov. 0, or -1 on error.
+int RtWriteAll(int fd, struct iovec* iov, int n);
+
+#endif
@@ -0,0 +1,439 @@
+/************************************************************************
+
+  Shared memory ring of live TTTR records, see mhshm.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mhshm.h"
+
+
+#define SHM_MAGIC    0x4D485352  // "MHSR"
+#define SHM_VERSION  2
+#define SHM_DATA     4096        // offset of the records
+#define SHM_RUNS     8           // run starts kept for consumers behind
+
+// every slot on its own cache line, consumers update theirs often
+typedef struct
+{
+  _Atomic int pid;              // 0 = free
+  _Atomic uint64_t tail;        // position of the next record to read
+  _Atomic uint64_t lost;
+  _Atomic uint64_t lagged;      // publishes that found this consumer too far behind
+  char pad[32];
+} ShmSlot;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;            // records, a power of two
+  _Atomic int producer;         // pid, 0 after ShmClose
+  _Atomic uint32_t run;
+  _Atomic int mode;
+  _Atomic uint64_t resolution;  // bits of a double
+  char pad1[24];
+  _Atomic uint64_t reserve;     // records up to here may be being written
+  char pad2[56];
+  _Atomic uint64_t head;        // records up to here are complete
+  char pad3[56];
+  ShmSlot slot[SHM_MAXCONSUMERS];
+  _Atomic uint64_t runstart[SHM_RUNS];  // position of the first record of run r at r % SHM_RUNS
+} ShmHeader;
+
+struct ShmRing
+{
+  ShmHeader* hdr;
+  unsigned int* data;
+  size_t size;                  // of the mapping
+  int slot;                     // -1 for the producer
+  char name[256];
+};
+
+
+static size_t MapSize(uint64_t capacity)
+{
+  return SHM_DATA + capacity * sizeof(unsigned int);
+}
+
+
+static ShmRing* Map(const char* name, int fd, size_t size, int slot)
+{
+  ShmRing* ring;
+  void* p;
+
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+  {
+    return NULL;
+  }
+  ring = (ShmRing*)calloc(1, sizeof(ShmRing));
+  if (ring == NULL)
+  {
+    munmap(p, size);
+    return NULL;
+  }
+  ring->hdr = (ShmHeader*)p;
+  ring->data = (unsigned int*)((char*)p + SHM_DATA);
+  ring->size = size;
+  ring->slot = slot;
+  strncpy(ring->name, name, sizeof(ring->name) - 1);
+  return ring;
+}
+
+
+static int Alive(int pid)
+{
+  return (pid > 0) && ((kill(pid, 0) == 0) || (errno != ESRCH));
+}
+
+
+ShmRing* ShmCreate(const char* name, uint64_t capacity)
+{
+  ShmRing* ring;
+  ShmHeader* h;
+  uint64_t cap = 1024;
+  int fd;
+
+  while (cap < capacity)
+  {
+    cap *= 2;
+  }
+  shm_unlink(name);  // a stale object of a crashed producer
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  if (ftruncate(fd, MapSize(cap)) != 0)
+  {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  ring = Map(name, fd, MapSize(cap), -1);
+  close(fd);
+  if (ring == NULL)
+  {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  h = ring->hdr;  // zero filled by ftruncate
+  h->capacity = cap;
+  h->version = SHM_VERSION;
+  atomic_store(&h->producer, (int)getpid());
+  atomic_store(&h->run, 0);
+  atomic_thread_fence(memory_order_release);
+  h->magic = SHM_MAGIC;  // last, consumers check it
+  return ring;
+}
+
+
+void ShmNewRun(ShmRing* ring, int mode, double resolution)
+{
+  ShmHeader* h = ring->hdr;
+  uint64_t bits;
+  uint32_t run;
+
+  memcpy(&bits, &resolution, sizeof(bits));
+  run = atomic_load_explicit(&h->run, memory_order_relaxed) + 1;
+  atomic_store_explicit(&h->runstart[run % SHM_RUNS], atomic_load_explicit(&h->head, memory_order_relaxed),
+    memory_order_relaxed);
+  atomic_store_explicit(&h->mode, mode, memory_order_relaxed);
+  atomic_store_explicit(&h->resolution, bits, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->run, 1, memory_order_release);
+}
+
+
+void ShmPublish(ShmRing* ring, const unsigned int* records, int n)
+{
+  ShmHeader* h = ring->hdr;
+  uint64_t mask = h->capacity - 1;
+  uint64_t head = atomic_load_explicit(&h->head, memory_order_relaxed);
+  uint64_t pos, first, end;
+  int i, pid;
+
+  while (n > 0)
+  {
+    // never more than the ring in one go, so that reserve stays meaningful
+    first = ((uint64_t)n > h->capacity) ? h->capacity : (uint64_t)n;
+    end = head + first;
+    atomic_store_explicit(&h->reserve, end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);  // reserve visible before any record changes
+
+    pos = head & mask;
+    if (pos + first <= h->capacity)
+    {
+      memcpy(ring->data + pos, records, first * sizeof(unsigned int));
+    }
+    else
+    {
+      memcpy(ring->data + pos, records, (h->capacity - pos) * sizeof(unsigned int));
+      memcpy(ring->data, records + (h->capacity - pos), (pos + first - h->capacity) * sizeof(unsigned int));
+    }
+    atomic_store_explicit(&h->head, end, memory_order_release);
+
+    for (i = 0; i < SHM_MAXCONSUMERS; i++)
+    {
+      pid = atomic_load_explicit(&h->slot[i].pid, memory_order_relaxed);
+      if (pid && (end - atomic_load_explicit(&h->slot[i].tail, memory_order_relaxed) > h->capacity))
+      {
+        atomic_fetch_add_explicit(&h->slot[i].lagged, 1, memory_order_relaxed);
+      }
+    }
+    head = end;
+    records += first;
+    n -= (int)first;
+  }
+}
+
+
+void ShmPrintStats(const ShmRing* ring, FILE* fp)
+{
+  ShmHeader* h = ring->hdr;
+  uint64_t head = atomic_load(&h->head);
+  int i, pid;
+
+  fprintf(fp, "\nShared memory %s: %llu records published, ring of %llu records", ring->name,
+    (unsigned long long)head, (unsigned long long)h->capacity);
+  for (i = 0; i < SHM_MAXCONSUMERS; i++)
+  {
+    pid = atomic_load(&h->slot[i].pid);
+    if (pid)
+    {
+      fprintf(fp, "\n  consumer pid %-7d behind %12llu  lost %12llu  lagging at %llu publishes", pid,
+        (unsigned long long)(head - atomic_load(&h->slot[i].tail)),
+        (unsigned long long)atomic_load(&h->slot[i].lost),
+        (unsigned long long)atomic_load(&h->slot[i].lagged));
+    }
+  }
+  fprintf(fp, "\n");
+}
+
+
+void ShmClose(ShmRing* ring)
+{
+  if (ring)
+  {
+    atomic_store(&ring->hdr->producer, 0);
+    shm_unlink(ring->name);
+    munmap(ring->hdr, ring->size);
+    free(ring);
+  }
+}
+
+
+ShmRing* ShmAttach(const char* name)
+{
+  ShmRing* ring;
+  ShmHeader* h;
+  struct stat st;
+  int fd, i, pid, expected;
+
+  fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(ShmHeader)))
+  {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  ring = Map(name, fd, (size_t)st.st_size, -1);
+  close(fd);
+  if (ring == NULL)
+  {
+    return NULL;
+  }
+  h = ring->hdr;
+  if ((h->magic != SHM_MAGIC) || (h->version != SHM_VERSION) || (MapSize(h->capacity) != ring->size))
+  {
+    ShmDetach(ring);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (i = 0; i < SHM_MAXCONSUMERS; i++)
+  {
+    pid = atomic_load(&h->slot[i].pid);
+    if (pid && !Alive(pid))
+    {
+      atomic_compare_exchange_strong(&h->slot[i].pid, &pid, 0);  // its owner died
+    }
+    expected = 0;
+    if (atomic_compare_exchange_strong(&h->slot[i].pid, &expected, (int)getpid()))
+    {
+      atomic_store(&h->slot[i].tail, atomic_load(&h->head));
+      atomic_store(&h->slot[i].lost, 0);
+      atomic_store(&h->slot[i].lagged, 0);
+      ring->slot = i;
+      return ring;
+    }
+  }
+  ShmDetach(ring);
+  errno = EBUSY;
+  return NULL;
+}
+
+
+// the run the record at tail belongs to, and the position where the
+// next run starts (head if none)
+static uint32_t RunAt(const ShmHeader* h, uint64_t tail, uint64_t head, uint64_t* next)
+{
+  uint32_t newest, run;
+  uint64_t start;
+
+  // the run counter is bumped before the first record of a run is
+  // published, so a head that includes it comes with the new count
+  newest = atomic_load_explicit(&h->run, memory_order_acquire);
+  run = newest;
+  *next = head;
+  while ((run > 0) && (newest - run < SHM_RUNS - 1))
+  {
+    start = atomic_load_explicit(&h->runstart[run % SHM_RUNS], memory_order_relaxed);
+    if (start <= tail)
+    {
+      break;
+    }
+    *next = start;
+    run--;
+  }
+  return run;
+}
+
+
+static int Read(ShmRing* ring, unsigned int* buffer, int max, uint64_t* lost, uint32_t* run)
+{
+  ShmHeader* h = ring->hdr;
+  ShmSlot* s = &h->slot[ring->slot];
+  uint64_t mask = h->capacity - 1;
+  uint64_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+  uint64_t head, reserve, pos, n, skip = 0, over;
+
+  head = atomic_load_explicit(&h->head, memory_order_acquire);
+  if (head - tail > h->capacity)
+  {
+    skip = head - tail - h->capacity;  // fell out of the ring already
+    tail += skip;
+  }
+  if (run)
+  {
+    *run = RunAt(h, tail, head, &head);  // stop at the next run
+  }
+  n = head - tail;
+  if (n > (uint64_t)max)
+  {
+    n = max;
+  }
+
+  if (n > 0)
+  {
+    pos = tail & mask;
+    if (pos + n <= h->capacity)
+    {
+      memcpy(buffer, ring->data + pos, n * sizeof(unsigned int));
+    }
+    else
+    {
+      memcpy(buffer, ring->data + pos, (h->capacity - pos) * sizeof(unsigned int));
+      memcpy(buffer + (h->capacity - pos), ring->data, (pos + n - h->capacity) * sizeof(unsigned int));
+    }
+
+    // records below reserve - capacity may have been overwritten while copying
+    atomic_thread_fence(memory_order_acquire);
+    reserve = atomic_load_explicit(&h->reserve, memory_order_relaxed);
+    if (reserve - tail > h->capacity)
+    {
+      over = reserve - tail - h->capacity;
+      if (over >= n)
+      {
+        over = n;
+      }
+      else
+      {
+        memmove(buffer, buffer + over, (n - over) * sizeof(unsigned int));
+      }
+      skip += over;
+      tail += over;
+      n -= over;
+    }
+  }
+
+  atomic_store_explicit(&s->tail, tail + n, memory_order_release);
+  if (skip)
+  {
+    atomic_fetch_add_explicit(&s->lost, skip, memory_order_relaxed);
+    if (lost)
+    {
+      *lost += skip;
+    }
+  }
+  if ((n == 0) && !Alive(atomic_load_explicit(&h->producer, memory_order_acquire))
+    && (atomic_load(&h->head) == tail))
+  {
+    return -1;
+  }
+  return (int)n;
+}
+
+
+int ShmRead(ShmRing* ring, unsigned int* buffer, int max, uint64_t* lost)
+{
+  return Read(ring, buffer, max, lost, NULL);
+}
+
+
+int ShmReadRun(ShmRing* ring, unsigned int* buffer, int max, uint64_t* lost, uint32_t* run)
+{
+  return Read(ring, buffer, max, lost, run);
+}
+
+
+uint32_t ShmRun(const ShmRing* ring, int* mode, double* resolution)
+{
+  ShmHeader* h = ring->hdr;
+  uint32_t run = atomic_load_explicit(&h->run, memory_order_acquire);
+  uint64_t bits = atomic_load_explicit(&h->resolution, memory_order_relaxed);
+
+  if (mode)
+  {
+    *mode = atomic_load_explicit(&h->mode, memory_order_relaxed);
+  }
+  if (resolution)
+  {
+    memcpy(resolution, &bits, sizeof(bits));
+  }
+  return run;
+}
+
+
+uint64_t ShmTail(const ShmRing* ring)
+{
+  return atomic_load(&ring->hdr->slot[ring->slot].tail);
+}
+
+
+void ShmDetach(ShmRing* ring)
+{
+  if (ring)
+  {
+    if (ring->slot >= 0)
+    {
+      atomic_store(&ring->hdr->slot[ring->slot].pid, 0);
+    }
+    munmap(ring->hdr, ring->size);
+    free(ring);
+  }
+}
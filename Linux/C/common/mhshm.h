@@ -0,0 +1,84 @@
+/************************************************************************
+
+  Shared memory ring of live TTTR records for several consumers
+
+  The acquisition demo publishes every batch it reads from the FIFO
+  into a POSIX shared memory object (ShmName, e.g. /mharp0), so that
+  other processes on the host, such as a recorder, a live display or
+  an alignment optimizer, see the live stream without a copy through
+  a socket. Consumers attach and detach at any time.
+
+  The ring holds a power of two number of records and counts positions
+  in 64 bits, so they never wrap. The producer never waits for anyone:
+
+    - it announces the range it is about to overwrite (reserve), copies
+      the records, then advances head,
+    - each consumer owns a slot with its read position (tail). A read
+      copies up to head and checks reserve afterwards; whatever the
+      producer may have overwritten meanwhile is dropped and counted
+      as lost, as are records that fell out of the ring before the
+      consumer got to them. A slow consumer thus skips ahead instead
+      of blocking the producer,
+    - the producer counts the publishes that found a consumer lagging
+      by more than the ring size, so that its owner sees who is slow.
+
+  Slots of consumers that died without detaching are reclaimed by the
+  next ShmAttach. Each measurement run bumps a run counter and records
+  the mode and resolution, consumers that decode check it with ShmRun
+  and read with ShmReadRun, which does not mix the records of two runs.
+
+  Link with -lrt on systems with a glibc older than 2.34.
+
+************************************************************************/
+
+#ifndef MHSHM_H
+#define MHSHM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SHM_MAXCONSUMERS  16
+#define SHM_DEFAULTSIZE   (16 * 1024 * 1024)  // records, 64 MB
+
+
+typedef struct ShmRing ShmRing;
+
+
+// Producer side. ShmCreate makes the object (replacing a stale one of
+// the same name), capacity is rounded up to a power of two. NULL on
+// error, errno tells why.
+ShmRing* ShmCreate(const char* name, uint64_t capacity);
+void ShmNewRun(ShmRing* ring, int mode, double resolution);
+void ShmPublish(ShmRing* ring, const unsigned int* records, int n);
+// Prints per consumer statistics.
+void ShmPrintStats(const ShmRing* ring, FILE* fp);
+// Marks the stream as ended and removes the name, attached consumers
+// keep their mapping until they detach.
+void ShmClose(ShmRing* ring);
+
+// Consumer side. ShmAttach maps the object and takes a free slot,
+// starting at the current head. NULL on error (errno = EBUSY if all
+// slots are taken).
+ShmRing* ShmAttach(const char* name);
+
+// Copies up to max new records into buffer, never waits. Adds the
+// number of records skipped to *lost (may be NULL). Returns the number
+// of records copied, or -1 once the producer has closed the stream
+// (or died) and everything has been read.
+int ShmRead(ShmRing* ring, unsigned int* buffer, int max, uint64_t* lost);
+
+// Same, but stops at the start of the next run, so the records copied
+// are all of one run, and sets *run to it (of the next record if none
+// were copied). Runs more than a few behind the newest are not told
+// apart.
+int ShmReadRun(ShmRing* ring, unsigned int* buffer, int max, uint64_t* lost, uint32_t* run);
+
+// Run counter, mode and resolution (ps) of the current measurement.
+uint32_t ShmRun(const ShmRing* ring, int* mode, double* resolution);
+
+// Position of the next record to read, counted from the creation.
+uint64_t ShmTail(const ShmRing* ring);
+
+void ShmDetach(ShmRing* ring);
+
+#endif
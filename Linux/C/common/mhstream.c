@@ -0,0 +1,185 @@
+/************************************************************************
+
+  Frame protocol of the live TTTR stream server, see mhstream.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "mhstream.h"
+#include "mhrt.h"
+
+
+// fills in the socket address, returns its length or -1
+static int Address(const char* address, struct sockaddr_storage* sa)
+{
+  struct sockaddr_un* un = (struct sockaddr_un*)sa;
+  struct sockaddr_in* in = (struct sockaddr_in*)sa;
+
+  memset(sa, 0, sizeof(*sa));
+  if (strncmp(address, "unix:", 5) == 0)
+  {
+    if (strlen(address + 5) >= sizeof(un->sun_path))
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, address + 5);
+    return sizeof(struct sockaddr_un);
+  }
+  if (strncmp(address, "tcp:", 4) == 0)
+  {
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)atoi(address + 4));
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sizeof(struct sockaddr_in);
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+
+// large buffers, the stream is bulk data
+static void Tune(int fd, int family)
+{
+  int size = 8 * 1024 * 1024;
+  int one = 1;
+
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  if (family == AF_INET)
+  {
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+
+int StreamConnect(const char* address)
+{
+  struct sockaddr_storage sa;
+  int len, fd;
+
+  len = Address(address, &sa);
+  if (len < 0)
+  {
+    return -1;
+  }
+  fd = socket(sa.ss_family, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  Tune(fd, sa.ss_family);
+  if (connect(fd, (struct sockaddr*)&sa, len) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+int StreamListen(const char* address)
+{
+  struct sockaddr_storage sa;
+  int len, fd;
+  int one = 1;
+
+  len = Address(address, &sa);
+  if (len < 0)
+  {
+    return -1;
+  }
+  fd = socket(sa.ss_family, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (sa.ss_family == AF_UNIX)
+  {
+    unlink(((struct sockaddr_un*)&sa)->sun_path);  // left over from a previous server
+  }
+  else
+  {
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  if ((bind(fd, (struct sockaddr*)&sa, len) != 0) || (listen(fd, 16) != 0))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+int StreamSend(int fd, uint32_t type, const void* payload, uint32_t length)
+{
+  StreamHeader hdr;
+  struct iovec iov[2];
+
+  hdr.length = length;
+  hdr.type = type;
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = (void*)payload;
+  iov[1].iov_len = length;
+  return RtWriteAll(fd, iov, length ? 2 : 1);
+}
+
+
+static int ReadAll(int fd, void* p, size_t n)
+{
+  ssize_t got;
+
+  while (n > 0)
+  {
+    got = read(fd, p, n);
+    if (got <= 0)
+    {
+      if ((got < 0) && (errno == EINTR))
+      {
+        continue;
+      }
+      return -1;
+    }
+    p = (char*)p + got;
+    n -= got;
+  }
+  return 0;
+}
+
+
+int StreamRecv(int fd, StreamHeader* hdr, void* payload, uint32_t max)
+{
+  char discard[4096];
+  uint32_t n, part;
+
+  if (ReadAll(fd, hdr, sizeof(StreamHeader)) < 0)
+  {
+    return -1;
+  }
+  n = (hdr->length < max) ? hdr->length : max;
+  if (ReadAll(fd, payload, n) < 0)
+  {
+    return -1;
+  }
+  for (n = hdr->length - n; n > 0; n -= part)
+  {
+    part = (n < sizeof(discard)) ? n : sizeof(discard);
+    if (ReadAll(fd, discard, part) < 0)
+    {
+      return -1;
+    }
+  }
+  return (int)hdr->length;
+}
@@ -0,0 +1,135 @@
+/************************************************************************
+
+  Frame protocol of the live TTTR stream server (../serve/mhserve)
+
+  The server reads the shared memory ring of the acquisition demo (see
+  mhshm.h) and forwards the live data to local clients over a Unix
+  domain socket or a loopback TCP port. Everything on the socket is a
+  frame: a StreamHeader followed by length bytes of payload, in host
+  byte order, as both ends are on the same machine.
+
+  After connecting, the server sends STREAM_HELLO and again whenever a
+  new measurement run starts. The client sends STREAM_SUBSCRIBE, as
+  often as it likes, to select what it gets:
+
+    STREAM_RAW     the records as read from the FIFO
+    STREAM_EVENTS  decoded events (TTTREvent, see tttrdecode.h) of the
+                   inputs in channelmask, plus sync and markers, of
+                   which only every decimate-th is sent
+    STREAM_RATES   events/s per channel every period ms
+    STREAM_HISTO   T3 only: every period ms the dtime histograms of the
+                   inputs in channelmask since the start of the run,
+                   summed down to histbins bins each
+    STREAM_ANALYSIS T3 only: with each period the centroid, FWHM,
+                   background and lifetime of the same histograms at
+                   full resolution, see histanalysis.h
+
+  With STREAM_WANT_CORRECTED added the histograms and their analysis are
+  corrected for pile-up and dead-time losses over the sync periods of
+  the run so far, see histcorrect.h.
+
+  The server never waits for a client. When a client's queue is full
+  frames for it are dropped, and it is told so in the next STREAM_LOST.
+
+  Addresses are "unix:/path" or "tcp:port" (127.0.0.1 only).
+
+************************************************************************/
+
+#ifndef MHSTREAM_H
+#define MHSTREAM_H
+
+#include <stdint.h>
+
+#define STREAM_VERSION      1
+#define STREAM_DEFAULTADDR  "unix:/tmp/mhserve.sock"
+#define STREAM_MAXPAYLOAD   (64 * 1024 * 1024)
+
+// frame types
+#define STREAM_HELLO        1   // server, StreamHello
+#define STREAM_SUBSCRIBE    2   // client, StreamSubscribe
+#define STREAM_RAW          3   // server, unsigned int records[]
+#define STREAM_EVENTS       4   // server, TTTREvent events[]
+#define STREAM_RATES        5   // server, StreamRates
+#define STREAM_HISTO        6   // server, StreamHisto followed by nbins counts
+#define STREAM_LOST         7   // server, StreamLost
+#define STREAM_ANALYSIS     8   // server, StreamAnalysis
+
+// subscription bits
+#define STREAM_WANT_RAW     0x01
+#define STREAM_WANT_EVENTS  0x02
+#define STREAM_WANT_RATES   0x04
+#define STREAM_WANT_HISTO   0x08
+#define STREAM_WANT_ANALYSIS 0x10
+#define STREAM_WANT_CORRECTED 0x20  // histo and analysis of corrected histograms
+
+
+typedef struct
+{
+  uint32_t length;              // of the payload in bytes
+  uint32_t type;
+} StreamHeader;
+
+typedef struct
+{
+  uint32_t version;
+  int32_t mode;                 // MODE_T2 or MODE_T3
+  double resolution;            // ps
+  uint32_t run;                 // measurement run, from the producer
+  uint32_t reserved;
+} StreamHello;
+
+typedef struct
+{
+  uint32_t streams;             // STREAM_WANT_xxx
+  uint32_t decimate;            // events: send 1 of this many, 0 or 1 = all
+  uint64_t channelmask;         // bit i selects input channel i (0-based)
+  uint32_t period;              // ms between rates and histogram frames
+  uint32_t histbins;            // bins per histogram, a power of two
+} StreamSubscribe;
+
+typedef struct
+{
+  double elapsed;               // s since the start of the run
+  uint32_t nrates;              // entries in rate: sync, then inputs 1..N
+  uint32_t reserved;
+  double rate[65];              // events/s
+} StreamRates;
+
+typedef struct
+{
+  uint32_t channel;             // input 1..N
+  uint32_t nbins;
+  uint32_t binwidth;            // dtime units per bin
+  uint32_t reserved;
+  // followed by nbins uint32_t counts
+} StreamHisto;
+
+typedef struct
+{
+  uint32_t channel;             // input 1..N
+  uint32_t peakbin;             // dtime of the peak
+  uint64_t total;               // counts since the start of the run
+  double background;            // counts per dtime
+  double centroid;              // ps
+  double fwhm;                  // ps
+  double lifetime;              // ps, 0 if none
+} StreamAnalysis;
+
+typedef struct
+{
+  uint64_t records;             // lost in the shared memory ring, total
+  uint64_t frames;              // dropped for this client, total
+} StreamLost;
+
+
+// Return a connected or listening socket, or -1 with errno set.
+int StreamConnect(const char* address);
+int StreamListen(const char* address);
+
+// Blocking frame I/O for clients. StreamRecv returns the payload
+// length, or -1 on error or end of stream. Payloads longer than max
+// are read and discarded, the returned length tells.
+int StreamSend(int fd, uint32_t type, const void* payload, uint32_t length);
+int StreamRecv(int fd, StreamHeader* hdr, void* payload, uint32_t max);
+
+#endif
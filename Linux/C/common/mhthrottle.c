@@ -0,0 +1,197 @@
+/************************************************************************
+
+  Predictive load shedding for the MultiHarp TTTR acquisition loop,
+  see mhthrottle.h
+
+************************************************************************/
+
+#include <string.h>
+
+#include "mhdefin.h"
+#include "mhthrottle.h"
+#include "mhrt.h"
+
+
+void ThrottleInit(Throttle* th, double fifosize, int enabled)
+{
+  memset(th, 0, sizeof(Throttle));
+  th->enabled = enabled;
+  th->fifosize = fifosize;
+  th->lastread = RtNow();
+  th->lastrates = th->lastread - THR_RATEPERIOD;
+  th->lastchange = th->lastread - THR_HOLDOFF;
+}
+
+
+int ThrottleAddStage(Throttle* th, const char* name, int optional)
+{
+  ThrottleStage* st;
+
+  if (th->nstages >= THR_MAXSTAGES)
+  {
+    return -1;
+  }
+  st = &th->stage[th->nstages];
+  st->name = name;
+  st->optional = optional;
+  st->active = 1;
+  return th->nstages++;
+}
+
+
+int ThrottleRun(Throttle* th, int id, int nrecords)
+{
+  ThrottleStage* st = &th->stage[id];
+
+  if (!st->active)
+  {
+    st->skipped += nrecords;
+    return 0;
+  }
+  st->start = RtNow();
+  return 1;
+}
+
+
+void ThrottleDone(Throttle* th, int id, int nrecords)
+{
+  ThrottleStage* st = &th->stage[id];
+  double cost;
+
+  if (nrecords > 0)
+  {
+    cost = (RtNow() - st->start) / nrecords;
+    // small batches carry a large fixed overhead per record, weigh by size
+    st->cost += (cost - st->cost) * ((nrecords >= TTREADMAX / 16) ? 0.25 : 0.02);
+    st->records += nrecords;
+  }
+}
+
+
+void ThrottleSetRate(Throttle* th, double recordrate)
+{
+  th->countrate = recordrate;
+}
+
+
+int ThrottleRatesDue(Throttle* th)
+{
+  double now = RtNow();
+
+  if (now - th->lastrates < THR_RATEPERIOD)
+  {
+    return 0;
+  }
+  th->lastrates = now;
+  return 1;
+}
+
+
+// drain capacity in records/s with the active stages, plus extra s/record
+static double Capacity(const Throttle* th, double extra)
+{
+  double cost = extra;
+  int i;
+
+  for (i = 0; i < th->nstages; i++)
+  {
+    if (th->stage[i].active)
+    {
+      cost += th->stage[i].cost;
+    }
+  }
+  return (cost > 0) ? 1.0 / cost : 1e30;
+}
+
+
+int ThrottleRead(Throttle* th, int nrecords)
+{
+  double now = RtNow();
+  double dt = now - th->lastread;
+  double rate, projected;
+  int i;
+
+  if (dt > 0)
+  {
+    th->streamrate += 0.25 * (nrecords / dt - th->streamrate);
+  }
+  th->lastread = now;
+  rate = (th->countrate > th->streamrate) ? th->countrate : th->streamrate;
+
+  // a read that is not full has emptied the FIFO
+  if (nrecords < TTREADMAX)
+  {
+    th->backlog = 0;
+  }
+  else
+  {
+    th->backlog += rate * dt - nrecords;
+    if (th->backlog < TTREADMAX)
+    {
+      th->backlog = TTREADMAX;
+    }
+  }
+
+  projected = th->backlog + (rate - Capacity(th, 0)) * THR_HORIZON;
+  th->fill = (projected > 0) ? projected / th->fifosize : 0;
+  if (th->fill > th->peakfill)
+  {
+    th->peakfill = th->fill;
+  }
+  if (!th->enabled || (now - th->lastchange < THR_HOLDOFF))
+  {
+    return 0;
+  }
+
+  if (th->fill > THR_HIGH)
+  {
+    for (i = th->nstages - 1; i >= 0; i--)
+    {
+      if (th->stage[i].optional && th->stage[i].active)
+      {
+        th->stage[i].active = 0;
+        th->stage[i].sheds++;
+        th->lastchange = now;
+        return 1;
+      }
+    }
+  }
+  else if ((th->fill < THR_LOW) && (th->backlog == 0))
+  {
+    for (i = 0; i < th->nstages; i++)
+    {
+      if (!th->stage[i].active)
+      {
+        if (Capacity(th, th->stage[i].cost) > THR_MARGIN * rate)
+        {
+          th->stage[i].active = 1;
+          th->lastchange = now;
+          return 1;
+        }
+        break;  // restore in order only
+      }
+    }
+  }
+  return 0;
+}
+
+
+void ThrottlePrint(const Throttle* th, FILE* fp)
+{
+  const ThrottleStage* st;
+  int i;
+
+  fprintf(fp, "\nThrottle: peak projected fill %.1f%% of %.0f records", th->peakfill * 100, th->fifosize);
+  for (i = 0; i < th->nstages; i++)
+  {
+    st = &th->stage[i];
+    fprintf(fp, "\n  %-10s %8.1f ns/record  %12llu records", st->name, st->cost * 1e9,
+      (unsigned long long)st->records);
+    if (st->optional)
+    {
+      fprintf(fp, "  %12llu skipped  shed %d times%s", (unsigned long long)st->skipped, st->sheds,
+        st->active ? "" : ", off at the end");
+    }
+  }
+  fprintf(fp, "\n");
+}
@@ -0,0 +1,99 @@
+/************************************************************************
+
+  Predictive load shedding for the MultiHarp TTTR acquisition loop
+
+  A FIFO overrun is only flagged once the data is already lost. The
+  throttle instead compares the rate at which records arrive with the
+  rate the loop can drain them, and sheds optional processing stages
+  (live analysis, text output) before the FIFO fills, while the raw
+  data keeps going to disk. When the load drops, the stages come back.
+
+    - Every stage of the loop is registered with ThrottleAddStage, the
+      mandatory ones (read, write) as well as the optional ones. Stages
+      added later are shed first and restored last.
+    - Each stage runs inside ThrottleRun / ThrottleDone, which measure
+      its cost per record. ThrottleRun returns 0 for a shed stage and
+      counts the records it missed.
+    - ThrottleRead is called after every MH_ReadFiFo. It estimates the
+      arrival rate (from the reads and from ThrottleSetRate, which takes
+      the sum of MH_GetAllCountRates so that a backlog does not hide the
+      true rate) and the records left in the FIFO, and projects the fill
+      THR_HORIZON seconds ahead:
+
+        fill = backlog + (arrival rate - 1 / sum of active costs) * horizon
+
+      Above THR_HIGH of the FIFO the least important active stage is
+      shed. Below THR_LOW, and if the drain capacity with the next stage
+      restored exceeds the arrival rate by THR_MARGIN, that stage comes
+      back. Changes are at least THR_HOLDOFF apart to avoid flapping.
+
+************************************************************************/
+
+#ifndef MHTHROTTLE_H
+#define MHTHROTTLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define THR_MAXSTAGES  8
+#define THR_HORIZON    1.0    // s
+#define THR_HIGH       0.25   // of the FIFO size
+#define THR_LOW        0.05
+#define THR_MARGIN     1.25
+#define THR_HOLDOFF    1.0    // s
+#define THR_RATEPERIOD 0.1    // s, count rates update every 100 ms
+
+
+typedef struct
+{
+  const char* name;
+  int optional;
+  int active;
+  double cost;          // s per record, smoothed
+  double start;         // of the current ThrottleRun
+  uint64_t records;     // processed
+  uint64_t skipped;     // missed while shed
+  int sheds;
+} ThrottleStage;
+
+typedef struct
+{
+  int enabled;          // 0 = only measure, never shed
+  double fifosize;      // records
+  double streamrate;    // records/s read, smoothed
+  double countrate;     // records/s from the count rates, 0 = unknown
+  double backlog;       // records estimated in the FIFO
+  double fill;          // projected fill as a fraction of fifosize
+  double peakfill;
+  double lastread;
+  double lastrates;
+  double lastchange;
+  int nstages;
+  ThrottleStage stage[THR_MAXSTAGES];
+} Throttle;
+
+
+// Without enabled the costs are measured but no stage is ever shed.
+void ThrottleInit(Throttle* th, double fifosize, int enabled);
+
+// Registers a stage and returns its id, or -1 if there are too many.
+int ThrottleAddStage(Throttle* th, const char* name, int optional);
+
+// Returns 1 if the stage is to process nrecords now, 0 if it is shed.
+// nrecords may be 0 if not yet known, as before a read.
+int ThrottleRun(Throttle* th, int id, int nrecords);
+void ThrottleDone(Throttle* th, int id, int nrecords);
+
+// Sets the arrival rate in records/s, e.g. from MH_GetAllCountRates.
+void ThrottleSetRate(Throttle* th, double recordrate);
+
+// Returns 1 every THR_RATEPERIOD, when new count rates are worth reading.
+int ThrottleRatesDue(Throttle* th);
+
+// Updates the estimates after a read of nrecords and sheds or restores
+// stages. Returns 1 if a stage changed state.
+int ThrottleRead(Throttle* th, int nrecords);
+
+void ThrottlePrint(const Throttle* th, FILE* fp);
+
+#endif
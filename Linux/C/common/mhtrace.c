@@ -0,0 +1,301 @@
+/************************************************************************
+
+  Hot path instrumentation for the MultiHarp acquisition loops,
+  see mhtrace.h
+
+  Time stamps are raw TSC ticks on x86 and nanoseconds elsewhere. They
+  are converted to microseconds only on export, with the tick rate
+  measured between TraceEnable and the export. The histograms of time
+  per read are therefore kept in powers of two of ticks.
+
+  Each thread allocates its ring on first use and pushes it onto a
+  global list with a compare-and-swap. Only the owning thread writes to
+  a ring, the head index is published with release semantics.
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_TSC
+#endif
+
+#include "mhtrace.h"
+
+
+#define NREADBUCKETS  22    // 0 records, then 2^(i-1) .. 2^i - 1, up to TTREADMAX
+#define NTIMEBUCKETS  48    // log2 of ticks
+
+typedef struct
+{
+  uint64_t start;
+  uint64_t end;
+  uint32_t arg;
+  int32_t phase;
+} TraceEntry;
+
+typedef struct TraceRing
+{
+  TraceEntry entry[TRACE_RINGSIZE];
+  uint64_t head;                        // number of entries ever written
+  int tid;
+  uint64_t count[TRACE_NPHASES];
+  uint64_t ticks[TRACE_NPHASES];
+  uint64_t readhist[NREADBUCKETS];      // records per MH_ReadFiFo
+  uint64_t timehist[NTIMEBUCKETS];      // ticks per MH_ReadFiFo
+  struct TraceRing* next;
+} TraceRing;
+
+static const char* phasenames[TRACE_NPHASES] =
+{
+  "GetFlags", "ReadFiFo", "CTCStatus", "Process", "Write", "Idle", "Publish"
+};
+
+int trace_enabled = 0;
+
+static TraceRing* rings = NULL;
+static __thread TraceRing* myring = NULL;
+
+// calibration of the ticks against CLOCK_MONOTONIC
+static uint64_t calticks0, calticks1;
+static double calns0, calns1;
+
+
+static double MonotonicNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+uint64_t TraceTicks(void)
+{
+#ifdef TRACE_TSC
+  return __rdtsc();
+#else
+  return (uint64_t)MonotonicNs();
+#endif
+}
+
+
+static int Log2Bucket(uint64_t v, int nbuckets)
+{
+  int b = 0;
+
+  while (v && (b < nbuckets - 1))
+  {
+    v >>= 1;
+    b++;
+  }
+  return b;
+}
+
+
+static TraceRing* NewRing(void)
+{
+  TraceRing* r = (TraceRing*)calloc(1, sizeof(TraceRing));
+
+  if (r == NULL)
+  {
+    return NULL;
+  }
+  r->tid = (int)syscall(SYS_gettid);
+  r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&rings, &r->next, r, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+  }
+  return r;
+}
+
+
+void TraceEnable(int on)
+{
+  TraceRing* r;
+
+  if (on)
+  {
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+      r->head = 0;
+      memset(r->count, 0, sizeof(r->count));
+      memset(r->ticks, 0, sizeof(r->ticks));
+      memset(r->readhist, 0, sizeof(r->readhist));
+      memset(r->timehist, 0, sizeof(r->timehist));
+    }
+    calns0 = MonotonicNs();
+    calticks0 = TraceTicks();
+    calticks1 = 0;
+  }
+  else if (trace_enabled)
+  {
+    calns1 = MonotonicNs();
+    calticks1 = TraceTicks();
+  }
+  __atomic_store_n(&trace_enabled, on, __ATOMIC_RELEASE);
+}
+
+
+void TraceRecord(int phase, uint64_t start, uint32_t arg)
+{
+  TraceRing* r = myring;
+  TraceEntry* e;
+  uint64_t end = TraceTicks();
+
+  if (r == NULL)
+  {
+    r = myring = NewRing();
+    if (r == NULL)
+    {
+      return;
+    }
+  }
+  e = &r->entry[r->head & (TRACE_RINGSIZE - 1)];
+  e->start = start;
+  e->end = end;
+  e->arg = arg;
+  e->phase = phase;
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+
+  r->count[phase]++;
+  r->ticks[phase] += end - start;
+  if (phase == TRACE_READFIFO)
+  {
+    r->readhist[Log2Bucket(arg, NREADBUCKETS)]++;
+    r->timehist[Log2Bucket(end - start, NTIMEBUCKETS)]++;
+  }
+}
+
+
+// ticks per microsecond, measured over the whole trace
+static double TicksPerUs(void)
+{
+  uint64_t ticks1 = calticks1;
+  double ns1 = calns1;
+
+  if (trace_enabled || (ticks1 == 0))
+  {
+    ns1 = MonotonicNs();
+    ticks1 = TraceTicks();
+  }
+  if (ns1 <= calns0)
+  {
+    return 1e3;
+  }
+  return (ticks1 - calticks0) / ((ns1 - calns0) * 1e-3);
+}
+
+
+int TraceExport(const char* filename)
+{
+  TraceRing* r;
+  TraceEntry* e;
+  FILE* fp;
+  double tpus = TicksPerUs();
+  uint64_t i, first, head;
+  int comma = 0;
+  int pid = (int)getpid();
+
+  fp = fopen(filename, "w");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+  {
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    first = (head > TRACE_RINGSIZE) ? head - TRACE_RINGSIZE : 0;
+    for (i = first; i < head; i++)
+    {
+      e = &r->entry[i & (TRACE_RINGSIZE - 1)];
+      if (e->start < calticks0)
+      {
+        continue;  // from before the last TraceEnable
+      }
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"n\":%u}}",
+        comma ? ",\n" : "", phasenames[e->phase], pid, r->tid,
+        (e->start - calticks0) / tpus, (e->end - e->start) / tpus, e->arg);
+      comma = 1;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  if (fclose(fp) != 0)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+void TracePrintSummary(FILE* fp)
+{
+  TraceRing* r;
+  uint64_t count[TRACE_NPHASES] = { 0 };
+  uint64_t ticks[TRACE_NPHASES] = { 0 };
+  uint64_t readhist[NREADBUCKETS] = { 0 };
+  uint64_t timehist[NTIMEBUCKETS] = { 0 };
+  uint64_t alltime = 0;
+  double tpus = TicksPerUs();
+  int i;
+
+  for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+  {
+    for (i = 0; i < TRACE_NPHASES; i++)
+    {
+      count[i] += r->count[i];
+      ticks[i] += r->ticks[i];
+      alltime += r->ticks[i];
+    }
+    for (i = 0; i < NREADBUCKETS; i++)
+    {
+      readhist[i] += r->readhist[i];
+    }
+    for (i = 0; i < NTIMEBUCKETS; i++)
+    {
+      timehist[i] += r->timehist[i];
+    }
+  }
+
+  fprintf(fp, "\n%-10s %10s %12s %12s %7s", "phase", "calls", "total ms", "mean us", "share");
+  for (i = 0; i < TRACE_NPHASES; i++)
+  {
+    if (count[i])
+    {
+      fprintf(fp, "\n%-10s %10llu %12.3f %12.3f %6.1f%%", phasenames[i], (unsigned long long)count[i],
+        ticks[i] / tpus * 1e-3, ticks[i] / tpus / count[i], 100.0 * ticks[i] / (alltime ? alltime : 1));
+    }
+  }
+
+  fprintf(fp, "\n\nrecords per read");
+  for (i = 0; i < NREADBUCKETS; i++)
+  {
+    if (readhist[i])
+    {
+      if (i == 0)
+      {
+        fprintf(fp, "\n  %8d          %10llu", 0, (unsigned long long)readhist[i]);
+      }
+      else
+      {
+        fprintf(fp, "\n  %8lu..%-8lu %10llu", 1UL << (i - 1), (1UL << i) - 1, (unsigned long long)readhist[i]);
+      }
+    }
+  }
+
+  fprintf(fp, "\n\ntime per read (us)");
+  for (i = 0; i < NTIMEBUCKETS; i++)
+  {
+    if (timehist[i])
+    {
+      fprintf(fp, "\n  %10.3f..%-10.3f %10llu", (i ? (double)(1ULL << (i - 1)) : 0.0) / tpus,
+        (double)(1ULL << i) / tpus, (unsigned long long)timehist[i]);
+    }
+  }
+  fprintf(fp, "\n");
+}
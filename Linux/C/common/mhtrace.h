@@ -0,0 +1,79 @@
+/************************************************************************
+
+  Hot path instrumentation for the MultiHarp acquisition loops
+
+  Each phase of the acquisition loop (MH_GetFlags, MH_ReadFiFo, MH_CTCStatus,
+  processing, file writing, publishing to shared memory) can be timed
+  with a pair of calls:
+
+    t = TraceStart();
+    retcode = MH_ReadFiFo(dev[0], buffer, &nRecords);
+    TraceEnd(TRACE_READFIFO, t, nRecords);
+
+  While tracing is disabled both calls reduce to a test of one flag, so
+  they can stay in the code permanently. When enabled, every phase is
+  recorded with a time stamp counter into a ring buffer owned by the
+  calling thread. Writers never lock or wait, and when a ring is full
+  the oldest entries are overwritten.
+
+  TraceExport writes the rings as Chrome trace JSON (load it in
+  chrome://tracing or https://ui.perfetto.dev). TracePrintSummary prints
+  the time spent per phase and histograms of records per read and time
+  per read. Both are meant to be called after the measurement, when no
+  thread is recording any more.
+
+  In the demos tracing is enabled with the TraceFile setting.
+
+************************************************************************/
+
+#ifndef MHTRACE_H
+#define MHTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_GETFLAGS    0
+#define TRACE_READFIFO    1
+#define TRACE_CTCSTATUS   2
+#define TRACE_PROCESS     3
+#define TRACE_WRITE       4
+#define TRACE_IDLE        5   // sleeping or waiting on purpose
+#define TRACE_PUBLISH     6   // copying to the shared memory ring
+#define TRACE_NPHASES     7
+
+#define TRACE_RINGSIZE    (1 << 18)  // entries per thread, power of 2
+
+extern int trace_enabled;
+
+
+// Enables or disables recording. Enabling calibrates the time stamp
+// counter and discards everything recorded before.
+void TraceEnable(int on);
+
+uint64_t TraceTicks(void);
+
+static inline uint64_t TraceStart(void)
+{
+  return trace_enabled ? TraceTicks() : 0;
+}
+
+// Records the phase that began at start. arg is the number of records
+// for TRACE_READFIFO, TRACE_PROCESS, TRACE_WRITE and TRACE_PUBLISH,
+// otherwise free.
+void TraceRecord(int phase, uint64_t start, uint32_t arg);
+
+static inline void TraceEnd(int phase, uint64_t start, uint32_t arg)
+{
+  if (trace_enabled)
+  {
+    TraceRecord(phase, start, arg);
+  }
+}
+
+// Writes all recorded entries as Chrome trace JSON. Returns 0 on success
+// or -1 if the file cannot be written.
+int TraceExport(const char* filename);
+
+void TracePrintSummary(FILE* fp);
+
+#endif
@@ -0,0 +1,390 @@
+/************************************************************************
+
+  Software histogramming of T2 event data, see t2histo.h
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "t2histo.h"
+
+#define INITIALSIZE  4096   // events per channel array, grown as needed
+
+
+int T2HistoParsePairs(const char* text, int maxchannel, T2HistoSettings* s)
+{
+  const char* p = text;
+  char* end;
+  long ref, target;
+
+  s->numpairs = 0;
+  while (*p)
+  {
+    ref = strtol(p, &end, 10);
+    if ((end == p) || (*end != ':'))
+    {
+      return -1;
+    }
+    p = end + 1;
+    target = strtol(p, &end, 10);
+    if ((end == p) || ((*end != ',') && (*end != 0)))
+    {
+      return -1;
+    }
+    p = (*end == ',') ? end + 1 : end;
+    if ((ref < 0) || (ref > maxchannel) || (target < 0) || (target > maxchannel)
+      || (s->numpairs == T2HISTO_MAXPAIRS))
+    {
+      return -1;
+    }
+    s->ref[s->numpairs] = (int)ref;
+    s->target[s->numpairs] = (int)target;
+    s->numpairs++;
+  }
+  return (s->numpairs > 0) ? 0 : -1;
+}
+
+
+int T2HistoInit(T2Histo* h, const T2HistoSettings* s, int lowlatency)
+{
+  int i, c;
+
+  memset(h, 0, sizeof(T2Histo));
+  if ((s->numpairs < 1) || (s->numpairs > T2HISTO_MAXPAIRS) || (s->binwidth < 1)
+    || (s->histlen < 1) || (s->histlen > MAXHISTLEN))
+  {
+    return -1;
+  }
+  for (i = 0; i < s->numpairs; i++)
+  {
+    if ((s->ref[i] < 0) || (s->ref[i] >= T2HISTO_CHANNELS)
+      || (s->target[i] < 0) || (s->target[i] >= T2HISTO_CHANNELS))
+    {
+      return -1;
+    }
+  }
+  memcpy(&h->s, s, sizeof(T2HistoSettings));
+  if (HistAlloc(&h->hist, s->numpairs, s->histlen, lowlatency) < 0)
+  {
+    return -1;
+  }
+  for (i = 0; i < s->numpairs; i++)
+  {
+    h->used[s->ref[i]]++;
+    h->used[s->target[i]]++;
+  }
+  for (c = 0; c < T2HISTO_CHANNELS; c++)
+  {
+    if (h->used[c])
+    {
+      h->chan[c].time = (uint64_t*)malloc(INITIALSIZE * sizeof(uint64_t));
+      if (h->chan[c].time == NULL)
+      {
+        T2HistoFree(h);
+        return -1;
+      }
+      h->chan[c].size = INITIALSIZE;
+    }
+  }
+  h->shift = -1;
+  for (i = 0; i < 64; i++)
+  {
+    if (s->binwidth == (1ULL << i))
+    {
+      h->shift = i;
+    }
+  }
+  h->span = s->binwidth * (uint64_t)s->histlen;
+  T2HistoClear(h);
+  return 0;
+}
+
+
+void T2HistoFree(T2Histo* h)
+{
+  int c;
+
+  HistFree(&h->hist);
+  for (c = 0; c < T2HISTO_CHANNELS; c++)
+  {
+    free(h->chan[c].time);
+    h->chan[c].time = NULL;
+  }
+}
+
+
+// forgets the events kept
+static void Drop(T2Histo* h)
+{
+  int c;
+
+  for (c = 0; c < T2HISTO_CHANNELS; c++)
+  {
+    h->chan[c].n = 0;
+  }
+  memset(h->next, 0, sizeof(h->next));
+  memset(h->lo, 0, sizeof(h->lo));
+  memset(h->hi, 0, sizeof(h->hi));
+}
+
+
+void T2HistoClear(T2Histo* h)
+{
+  memset(h->hist.counts, 0, (size_t)h->s.numpairs * h->s.histlen * sizeof(unsigned int));
+  memset(h->hist.stats, 0, sizeof(h->hist.stats));
+  Drop(h);
+  h->events = 0;
+  h->binned = 0;
+}
+
+
+// start-stop: targets i.. up to horizon against the last reference at
+// or before them, ref[hi - 1]. Returns the next target.
+static int StartStop(T2Histo* h, unsigned int* counts, const uint64_t* ref, const uint64_t* target,
+  int ntarget, int self, int i, int* phi, uint64_t horizon)
+{
+  const uint64_t offset = h->s.offset, span = h->span, binwidth = h->s.binwidth;
+  const int shift = h->shift;
+  uint64_t tg, d, binned = 0;
+  int hi = *phi;
+
+  for (; (i < ntarget) && (target[i] <= horizon); i++)
+  {
+    tg = target[i];
+    if (self) // the events before this one
+    {
+      hi = i;
+    }
+    else
+    {
+      // mostly a step or two, taken without branches
+      hi += (ref[hi] <= tg);
+      hi += (ref[hi] <= tg);
+      while (ref[hi] <= tg)
+      {
+        hi++;
+      }
+    }
+    if (hi == 0)
+    {
+      continue;
+    }
+    d = tg - ref[hi - 1] - offset;
+    if (d < span) // also before the offset, as d wrapped then
+    {
+      counts[(shift >= 0) ? (d >> shift) : (d / binwidth)]++;
+      binned++;
+    }
+  }
+  *phi = hi;
+  h->binned += binned;
+  return i;
+}
+
+
+// multistop: targets i.. up to horizon against every reference in
+// ref[lo..hi-1] at or before them within range. Returns the next target.
+static int Multistop(T2Histo* h, unsigned int* counts, const uint64_t* ref, const uint64_t* target,
+  int ntarget, int self, int i, int* plo, int* phi, uint64_t horizon)
+{
+  const uint64_t offset = h->s.offset, span = h->span, binwidth = h->s.binwidth;
+  const int shift = h->shift;
+  uint64_t tg, d, binned = 0;
+  int lo = *plo, hi = *phi, k;
+
+  for (; (i < ntarget) && (target[i] <= horizon); i++)
+  {
+    tg = target[i];
+    if (self)
+    {
+      hi = i;
+    }
+    else
+    {
+      while (ref[hi] <= tg)
+      {
+        hi++;
+      }
+    }
+    while ((lo < hi) && (ref[lo] + offset + span <= tg))
+    {
+      lo++;
+    }
+    for (k = hi - 1; (k >= lo) && (tg - ref[k] < offset); k--)
+    {
+    }
+    for (; k >= lo; k--)
+    {
+      d = tg - ref[k] - offset;
+      counts[(shift >= 0) ? (d >> shift) : (d / binwidth)]++;
+      binned++;
+    }
+  }
+  *plo = lo;
+  *phi = hi;
+  h->binned += binned;
+  return i;
+}
+
+
+// the targets of pair p up to horizon
+static void BinPair(T2Histo* h, int p, uint64_t horizon)
+{
+  const uint64_t* ref = h->chan[h->s.ref[p]].time;
+  const uint64_t* target = h->chan[h->s.target[p]].time;
+  int nref = h->chan[h->s.ref[p]].n;
+  int ntarget = h->chan[h->s.target[p]].n;
+  int self = (h->s.ref[p] == h->s.target[p]);
+  unsigned int* counts = HistChannel(&h->hist, p);
+  int i, lo = h->lo[p], hi = h->hi[p];
+
+  if (h->s.multistop)
+  {
+    i = Multistop(h, counts, ref, target, ntarget, self, h->next[p], &lo, &hi, horizon);
+  }
+  else
+  {
+    i = StartStop(h, counts, ref, target, ntarget, self, h->next[p], &hi, horizon);
+  }
+  if (self)
+  {
+    hi = i;
+  }
+
+  // the targets left are after horizon, so are those of later batches
+  if (h->s.multistop)
+  {
+    while ((lo < nref) && (ref[lo] + h->s.offset + h->span <= horizon))
+    {
+      lo++;
+    }
+    if (hi < lo)
+    {
+      hi = lo;
+    }
+  }
+  else if (!self)
+  {
+    while ((hi < nref) && (ref[hi] <= horizon))
+    {
+      hi++;
+    }
+  }
+  h->next[p] = i;
+  h->lo[p] = lo;
+  h->hi[p] = hi;
+}
+
+
+// drops the events of channel c that no pair needs any more
+static void Compact(T2Histo* h, int c)
+{
+  T2HistoChannel* ch = &h->chan[c];
+  int keep = ch->n, need, p;
+
+  for (p = 0; p < h->s.numpairs; p++)
+  {
+    if (h->s.target[p] == c)
+    {
+      need = h->next[p];
+      keep = (need < keep) ? need : keep;
+    }
+    if (h->s.ref[p] == c)
+    {
+      need = h->s.multistop ? h->lo[p] : h->hi[p] - 1; // the last reference binned against
+      need = (need < 0) ? 0 : need;
+      keep = (need < keep) ? need : keep;
+    }
+  }
+  if (keep == 0)
+  {
+    return;
+  }
+  memmove(ch->time, ch->time + keep, (size_t)(ch->n - keep) * sizeof(uint64_t));
+  ch->n -= keep;
+  for (p = 0; p < h->s.numpairs; p++)
+  {
+    if (h->s.target[p] == c)
+    {
+      h->next[p] -= keep;
+    }
+    if (h->s.ref[p] == c)
+    {
+      h->hi[p] -= keep;
+      if (h->s.multistop)
+      {
+        h->lo[p] -= keep;
+      }
+    }
+  }
+}
+
+
+static void BinAll(T2Histo* h, uint64_t horizon)
+{
+  int p, c;
+
+  for (c = 0; c < T2HISTO_CHANNELS; c++) // ends the scans of the references
+  {
+    if (h->used[c])
+    {
+      h->chan[c].time[h->chan[c].n] = UINT64_MAX;
+    }
+  }
+  for (p = 0; p < h->s.numpairs; p++)
+  {
+    BinPair(h, p, horizon);
+  }
+  for (c = 0; c < T2HISTO_CHANNELS; c++)
+  {
+    if (h->used[c])
+    {
+      Compact(h, c);
+    }
+  }
+}
+
+
+int T2HistoAdd(T2Histo* h, const TTTREvent* events, int n)
+{
+  T2HistoChannel* ch;
+  uint64_t newest = 0;
+  uint64_t* grown;
+  int j, c;
+
+  for (j = 0; j < n; j++)
+  {
+    c = events[j].Channel;
+    if ((c >= T2HISTO_CHANNELS) || !h->used[c]) // also the markers
+    {
+      continue;
+    }
+    ch = &h->chan[c];
+    if (ch->n + 1 == ch->size) // room for the end mark, see BinAll
+    {
+      grown = (uint64_t*)realloc(ch->time, 2 * (size_t)ch->size * sizeof(uint64_t));
+      if (grown == NULL)
+      {
+        return -1;
+      }
+      ch->time = grown;
+      ch->size *= 2;
+    }
+    ch->time[ch->n++] = events[j].Time;
+    newest = (events[j].Time > newest) ? events[j].Time : newest;
+    h->events++;
+  }
+  if (newest > h->s.holdback)
+  {
+    BinAll(h, newest - h->s.holdback);
+  }
+  return 0;
+}
+
+
+void T2HistoFinish(T2Histo* h)
+{
+  BinAll(h, UINT64_MAX);
+  Drop(h);
+}
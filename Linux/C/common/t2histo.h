@@ -0,0 +1,105 @@
+/************************************************************************
+
+  Software histogramming of T2 event data
+
+  In histogramming mode the hardware bins the time of every input event
+  after the last sync. From T2 data the same histograms can be formed in
+  software, with any channel as the reference: between two detectors
+  (start-stop, lifetimes against a detector that sees the excitation)
+  or as a correlation of all pairs of events within a range (multistop,
+  antibunching and cross-correlations).
+
+  A pair names a reference and a target channel, numbered as decoded
+  (0 = sync, 1..N = inputs, see tttrdecode.h). Every target event is
+  binned against
+
+    start-stop   the last reference event at or before it, as the
+                 hardware does with the sync as the reference
+    multistop    every reference event at or before it within the range
+
+  by its delay less the offset, in bins of binwidth time tags. The
+  histograms of all pairs are one HistBlock, pair i as channel i, so
+  HistStats, HistAnalyze and the histogram files (histfile.h) take them
+  like a readout of the hardware.
+
+  Events come in batches as DecodeT2 delivers them. The events of each
+  channel in use are appended to an array of their own, in stream order,
+  which is time order as every channel reports its events in order. Then
+  every pair walks its reference and target arrays once. Channels and pairs share the
+  arrays, so many pairs on a few channels cost little more than one.
+  Records of different channels may reach the stream slightly out of
+  order; targets within holdback of the newest event of a batch are
+  kept for the next one, so that a late reference still counts. Of the
+  older events only those a later target can still need are kept.
+
+************************************************************************/
+
+#ifndef T2HISTO_H
+#define T2HISTO_H
+
+#include <stdint.h>
+
+#include "mhdefin.h"
+#include "histstats.h"
+#include "tttrdecode.h"
+
+#define T2HISTO_MAXPAIRS  MAXINPCHAN
+#define T2HISTO_CHANNELS  (MAXINPCHAN + 1)   // sync, then the inputs
+
+typedef struct
+{
+  int numpairs;
+  int ref[T2HISTO_MAXPAIRS];
+  int target[T2HISTO_MAXPAIRS];
+  int multistop;                // 0 = start-stop, 1 = multistop
+  uint64_t binwidth;            // time tags
+  uint64_t offset;              // time tags of delay before bin 0
+  int histlen;                  // bins, up to MAXHISTLEN
+  uint64_t holdback;            // time tags, see above
+} T2HistoSettings;
+
+#define T2HISTO_HOLDBACK  1000000.0  // ps, a holdback well beyond the reordering
+
+typedef struct
+{
+  uint64_t* time;
+  int n;
+  int size;
+} T2HistoChannel;
+
+typedef struct
+{
+  T2HistoSettings s;
+  HistBlock hist;               // pair i as channel i
+  T2HistoChannel chan[T2HISTO_CHANNELS];
+  int used[T2HISTO_CHANNELS];   // pairs on the channel
+  int next[T2HISTO_MAXPAIRS];   // first target not yet binned
+  int lo[T2HISTO_MAXPAIRS];     // first reference still in range (multistop)
+  int hi[T2HISTO_MAXPAIRS];     // references at or before the last target binned
+  int shift;                    // log2 of binwidth, -1 if not a power of 2
+  uint64_t span;                // binwidth * histlen
+  uint64_t events;              // of the pairs' channels
+  uint64_t binned;              // increments, all pairs
+} T2Histo;
+
+
+// Reads pairs as "ref:target,ref:target,..." into s. 0, or -1 if the
+// text is malformed or names a channel above maxchannel.
+int T2HistoParsePairs(const char* text, int maxchannel, T2HistoSettings* s);
+
+// Sets up for the pairs and binning in s. 0, or -1 if out of memory or
+// s is invalid.
+int T2HistoInit(T2Histo* h, const T2HistoSettings* s, int lowlatency);
+void T2HistoFree(T2Histo* h);
+
+// Clears the histograms and the events kept, for a new measurement.
+void T2HistoClear(T2Histo* h);
+
+// Bins a batch of n events from DecodeT2. 0, or -1 if out of memory.
+int T2HistoAdd(T2Histo* h, const TTTREvent* events, int n);
+
+// Bins the targets held back and drops all events kept, at the end of
+// the measurement or at a gap in the events (later ones start afresh).
+void T2HistoFinish(T2Histo* h);
+
+#endif
@@ -0,0 +1,1277 @@
+/************************************************************************
+
+  Lossless block compression of MultiHarp T2/T3 record files
+  See tttrcodec.h for the record model and the file layout.
+
+************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mhdefin.h"
+#include "tttrcodec.h"
+#include "mhrt.h"
+
+
+#define NCHAN       128       // channel codes, special bit and 6 bit channel
+#define NNUM        65        // bit length classes of 64 bit numbers
+#define NDT         16        // bit length classes of 15 bit dtimes
+#define MAXCODELEN  12        // Huffman code length limit, decode table index
+#define TABLEBYTES  ((NCHAN + NNUM + NDT + 1) / 2)  // code lengths, 4 bits each
+#define OVERFLOWCH  0x7F      // channel code of overflow records
+
+#define SLOT_FREE   0
+#define SLOT_READY  1
+#define SLOT_BUSY   2
+#define SLOT_DONE   3
+
+
+typedef struct
+{
+  uint8_t len[NCHAN];
+  uint16_t code[NCHAN];       // bit reversed, the stream is LSB first
+  uint16_t table[1 << MAXCODELEN];  // symbol << 4 | length, 0 = invalid
+} Huffman;
+
+typedef struct
+{
+  uint64_t base;              // overflow correction so far
+  uint64_t prev;              // time of the previous record
+} Model;
+
+typedef struct
+{
+  uint64_t acc;
+  int n;
+  unsigned char* p;
+} BitWriter;
+
+typedef struct
+{
+  uint64_t acc;
+  int n;
+  const unsigned char* p;
+  const unsigned char* end;
+  size_t pad;                 // zero bytes supplied beyond the end
+} BitReader;
+
+
+//
+// bit I/O
+//
+
+static inline uint32_t Load32(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+
+static inline void Store32(unsigned char* p, uint32_t v)
+{
+  memcpy(p, &v, 4);
+}
+
+
+// len <= 32, bits must not have bits at or above len
+static inline void Put(BitWriter* w, uint64_t bits, int len)
+{
+  w->acc |= bits << w->n;
+  w->n += len;
+  if (w->n >= 32)
+  {
+    Store32(w->p, (uint32_t)w->acc);
+    w->p += 4;
+    w->acc >>= 32;
+    w->n -= 32;
+  }
+}
+
+
+static void PutFlush(BitWriter* w)
+{
+  while (w->n > 0)
+  {
+    *w->p++ = (unsigned char)w->acc;
+    w->acc >>= 8;
+    w->n -= 8;
+  }
+  w->n = 0;
+}
+
+
+static inline void Refill(BitReader* r)
+{
+  int i;
+
+  if (r->end - r->p >= 4)
+  {
+    r->acc |= (uint64_t)Load32(r->p) << r->n;
+    r->p += 4;
+  }
+  else
+  {
+    for (i = 0; i < 4; i++)
+    {
+      if (r->p < r->end)
+      {
+        r->acc |= (uint64_t)*r->p++ << (r->n + 8 * i);
+      }
+      else
+      {
+        r->pad++;
+      }
+    }
+  }
+  r->n += 32;
+}
+
+
+// len <= 32
+static inline uint64_t Get(BitReader* r, int len)
+{
+  uint64_t v;
+
+  if (r->n < len)
+  {
+    Refill(r);
+  }
+  v = r->acc & ((1ULL << len) - 1);
+  r->acc >>= len;
+  r->n -= len;
+  return v;
+}
+
+
+// -1 for a code that is not in the table
+static inline int GetSymbol(BitReader* r, const Huffman* h)
+{
+  unsigned e;
+
+  if (r->n < MAXCODELEN)
+  {
+    Refill(r);
+  }
+  e = h->table[r->acc & ((1 << MAXCODELEN) - 1)];
+  if ((e & 15) == 0)
+  {
+    return -1;
+  }
+  r->acc >>= (e & 15);
+  r->n -= (e & 15);
+  return (int)(e >> 4);
+}
+
+
+//
+// Huffman tables
+//
+
+// code lengths of at most MAXCODELEN; rare symbols are made less rare
+// until the tree is flat enough
+static void BuildLengths(const uint32_t* count, int nsym, uint8_t* len)
+{
+  uint64_t weight[2 * NCHAN];
+  int parent[2 * NCHAN];
+  int alive[2 * NCHAN];
+  uint32_t freq[NCHAN];
+  int i, j, a, b, nodes, used, maxlen, depth;
+
+  used = 0;
+  for (i = 0; i < nsym; i++)
+  {
+    freq[i] = count[i];
+    len[i] = 0;
+    used += (count[i] != 0);
+  }
+  if (used == 0)
+  {
+    return;
+  }
+  if (used == 1)
+  {
+    for (i = 0; i < nsym; i++)
+    {
+      len[i] = (count[i] != 0);
+    }
+    return;
+  }
+
+  for (;;)
+  {
+    nodes = nsym;
+    for (i = 0; i < nsym; i++)
+    {
+      weight[i] = freq[i];
+      parent[i] = -1;
+      alive[i] = (freq[i] != 0);
+    }
+    for (j = 1; j < used; j++)
+    {
+      a = b = -1;
+      for (i = 0; i < nodes; i++)
+      {
+        if (alive[i])
+        {
+          if ((a < 0) || (weight[i] < weight[a]))
+          {
+            b = a;
+            a = i;
+          }
+          else if ((b < 0) || (weight[i] < weight[b]))
+          {
+            b = i;
+          }
+        }
+      }
+      weight[nodes] = weight[a] + weight[b];
+      parent[nodes] = -1;
+      alive[nodes] = 1;
+      parent[a] = parent[b] = nodes;
+      alive[a] = alive[b] = 0;
+      nodes++;
+    }
+
+    maxlen = 0;
+    for (i = 0; i < nsym; i++)
+    {
+      if (freq[i])
+      {
+        depth = 0;
+        for (j = i; parent[j] >= 0; j = parent[j])
+        {
+          depth++;
+        }
+        len[i] = (uint8_t)((depth > 15) ? 15 : depth);
+        if (depth > maxlen)
+        {
+          maxlen = depth;
+        }
+      }
+    }
+    if (maxlen <= MAXCODELEN)
+    {
+      return;
+    }
+    for (i = 0; i < nsym; i++)
+    {
+      if (freq[i])
+      {
+        freq[i] = (freq[i] >> 1) | 1;
+      }
+    }
+  }
+}
+
+
+// canonical codes from the lengths, and the decode table;
+// -1 if the lengths do not form a prefix code
+static int MakeCodes(Huffman* h, int nsym)
+{
+  int count[MAXCODELEN + 1] = { 0 };
+  int next[MAXCODELEN + 2];
+  int i, l, code, r, kraft = 0;
+
+  for (i = 0; i < nsym; i++)
+  {
+    if (h->len[i] > MAXCODELEN)
+    {
+      return -1;
+    }
+    count[h->len[i]]++;
+    if (h->len[i])
+    {
+      kraft += 1 << (MAXCODELEN - h->len[i]);
+    }
+  }
+  if (kraft > (1 << MAXCODELEN))
+  {
+    return -1;
+  }
+  code = 0;
+  count[0] = 0;
+  for (l = 1; l <= MAXCODELEN; l++)
+  {
+    code = (code + count[l - 1]) << 1;
+    next[l] = code;
+  }
+
+  memset(h->table, 0, sizeof(h->table));
+  for (i = 0; i < nsym; i++)
+  {
+    l = h->len[i];
+    if (l)
+    {
+      code = next[l]++;
+      for (r = 0; l > 0; l--)
+      {
+        r = (r << 1) | (code & 1);
+        code >>= 1;
+      }
+      h->code[i] = (uint16_t)r;
+      for (code = r; code < (1 << MAXCODELEN); code += 1 << h->len[i])
+      {
+        h->table[code] = (uint16_t)((i << 4) | h->len[i]);
+      }
+    }
+  }
+  return 0;
+}
+
+
+//
+// record model
+//
+
+static inline int NumClass(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+
+static inline uint64_t ZigZag(uint64_t d)
+{
+  return (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+}
+
+
+static inline uint64_t UnZigZag(uint64_t z)
+{
+  return (z >> 1) ^ (0 - (z & 1));
+}
+
+
+// splits a record into channel code, number and dtime (T3, else -1)
+static inline void Split(Model* m, int mode, uint32_t rec, int* ch, uint64_t* num, int* dt)
+{
+  uint64_t t;
+
+  *ch = (int)(rec >> 25);
+  if (mode == MODE_T2)
+  {
+    t = rec & 0x1FFFFFF;
+    *dt = -1;
+    if (*ch == OVERFLOWCH)
+    {
+      *num = t;
+      m->base += t << 25;
+      return;
+    }
+  }
+  else
+  {
+    t = rec & 0x3FF;
+    *dt = (int)((rec >> 10) & 0x7FFF);
+    if (*ch == OVERFLOWCH)
+    {
+      *num = t;
+      m->base += t << 10;
+      return;
+    }
+  }
+  t += m->base;
+  *num = ZigZag(t - m->prev);
+  m->prev = t;
+}
+
+
+static inline void PutNumber(BitWriter* w, const Huffman* h, uint64_t v)
+{
+  int c = NumClass(v);
+
+  Put(w, h->code[c], h->len[c]);
+  if (c > 33)
+  {
+    Put(w, v & 0xFFFFFFFF, 32);
+    Put(w, (v >> 32) & ((1ULL << (c - 33)) - 1), c - 33);
+  }
+  else if (c > 1)
+  {
+    Put(w, v & ((1ULL << (c - 1)) - 1), c - 1);
+  }
+}
+
+
+static inline int GetNumber(BitReader* r, const Huffman* h, uint64_t* v)
+{
+  int c = GetSymbol(r, h);
+
+  if (c < 0)
+  {
+    return -1;
+  }
+  if (c <= 1)
+  {
+    *v = (uint64_t)c;
+  }
+  else if (c > 33)
+  {
+    *v = Get(r, 32);
+    *v |= (Get(r, c - 33) << 32) | (1ULL << (c - 1));
+  }
+  else
+  {
+    *v = Get(r, c - 1) | (1ULL << (c - 1));
+  }
+  return 0;
+}
+
+
+//
+// blocks
+//
+
+size_t CodecPackBound(size_t rawbytes)
+{
+  // at most 12 + 12 + 63 + 12 + 14 bits per record, or stored
+  return TABLEBYTES + (rawbytes / 4) * 15 + rawbytes + 16;
+}
+
+
+uint32_t CodecChecksum(const unsigned char* raw, size_t rawbytes)
+{
+  uint32_t a = 1, b = 0;
+  size_t i;
+
+  for (i = 0; i + 4 <= rawbytes; i += 4)
+  {
+    a += Load32(raw + i);
+    b += a;
+  }
+  for (; i < rawbytes; i++)
+  {
+    a += raw[i];
+    b += a;
+  }
+  return b ^ ((a << 16) | (a >> 16));
+}
+
+
+static size_t Store(const unsigned char* raw, size_t rawbytes, unsigned char* packed, uint32_t* type)
+{
+  memcpy(packed, raw, rawbytes);
+  *type = CODEC_STORED;
+  return rawbytes;
+}
+
+
+size_t CodecPack(const unsigned char* raw, size_t rawbytes, int mode, unsigned char* packed, uint32_t* type)
+{
+  uint32_t cchan[NCHAN] = { 0 }, cnum[NNUM] = { 0 }, cdt[NDT] = { 0 };
+  Huffman hch, hnum, hdt;
+  BitWriter w;
+  Model m;
+  uint64_t num;
+  size_t i, n = rawbytes / 4, size;
+  int ch, dt;
+
+  if ((rawbytes == 0) || (rawbytes % 4) || ((mode != MODE_T2) && (mode != MODE_T3)))
+  {
+    return Store(raw, rawbytes, packed, type);
+  }
+
+  memset(&m, 0, sizeof(m));
+  for (i = 0; i < n; i++)
+  {
+    Split(&m, mode, Load32(raw + 4 * i), &ch, &num, &dt);
+    cchan[ch]++;
+    cnum[NumClass(num)]++;
+    if (dt >= 0)
+    {
+      cdt[NumClass((uint64_t)dt)]++;
+    }
+  }
+  BuildLengths(cchan, NCHAN, hch.len);
+  BuildLengths(cnum, NNUM, hnum.len);
+  BuildLengths(cdt, NDT, hdt.len);
+  MakeCodes(&hch, NCHAN);
+  MakeCodes(&hnum, NNUM);
+  MakeCodes(&hdt, NDT);
+
+  memset(packed, 0, TABLEBYTES);
+  for (i = 0; i < NCHAN + NNUM + NDT; i++)
+  {
+    ch = (i < NCHAN) ? hch.len[i] : (i < NCHAN + NNUM) ? hnum.len[i - NCHAN] : hdt.len[i - NCHAN - NNUM];
+    packed[i / 2] |= (unsigned char)(ch << (4 * (i & 1)));
+  }
+
+  memset(&m, 0, sizeof(m));
+  w.acc = 0;
+  w.n = 0;
+  w.p = packed + TABLEBYTES;
+  for (i = 0; i < n; i++)
+  {
+    Split(&m, mode, Load32(raw + 4 * i), &ch, &num, &dt);
+    Put(&w, hch.code[ch], hch.len[ch]);
+    PutNumber(&w, &hnum, num);
+    if (dt >= 0)
+    {
+      ch = NumClass((uint64_t)dt);
+      Put(&w, hdt.code[ch], hdt.len[ch]);
+      if (ch > 1)
+      {
+        Put(&w, (uint64_t)dt & ((1U << (ch - 1)) - 1), ch - 1);
+      }
+    }
+  }
+  PutFlush(&w);
+
+  size = (size_t)(w.p - packed);
+  if (size >= rawbytes)
+  {
+    return Store(raw, rawbytes, packed, type);
+  }
+  *type = CODEC_HUFFMAN;
+  return size;
+}
+
+
+int CodecUnpack(const unsigned char* packed, size_t packedbytes, uint32_t type, int mode,
+  unsigned char* raw, size_t rawbytes)
+{
+  Huffman hch, hnum, hdt;
+  BitReader r;
+  Model m;
+  uint64_t num, t;
+  uint32_t rec;
+  size_t i, n = rawbytes / 4;
+  int ch, dt, c;
+
+  if (type == CODEC_STORED)
+  {
+    if (packedbytes != rawbytes)
+    {
+      return -1;
+    }
+    memcpy(raw, packed, rawbytes);
+    return 0;
+  }
+  if ((type != CODEC_HUFFMAN) || (rawbytes % 4) || (packedbytes < TABLEBYTES)
+    || ((mode != MODE_T2) && (mode != MODE_T3)))
+  {
+    return -1;
+  }
+
+  for (i = 0; i < NCHAN + NNUM + NDT; i++)
+  {
+    c = (packed[i / 2] >> (4 * (i & 1))) & 15;
+    if (i < NCHAN)
+    {
+      hch.len[i] = (uint8_t)c;
+    }
+    else if (i < NCHAN + NNUM)
+    {
+      hnum.len[i - NCHAN] = (uint8_t)c;
+    }
+    else
+    {
+      hdt.len[i - NCHAN - NNUM] = (uint8_t)c;
+    }
+  }
+  if ((MakeCodes(&hch, NCHAN) < 0) || (MakeCodes(&hnum, NNUM) < 0) || (MakeCodes(&hdt, NDT) < 0))
+  {
+    return -1;
+  }
+
+  memset(&m, 0, sizeof(m));
+  r.acc = 0;
+  r.n = 0;
+  r.p = packed + TABLEBYTES;
+  r.end = packed + packedbytes;
+  r.pad = 0;
+  for (i = 0; i < n; i++)
+  {
+    ch = GetSymbol(&r, &hch);
+    if ((ch < 0) || (GetNumber(&r, &hnum, &num) < 0))
+    {
+      return -1;
+    }
+    dt = 0;
+    if (mode == MODE_T3)
+    {
+      c = GetSymbol(&r, &hdt);
+      if (c < 0)
+      {
+        return -1;
+      }
+      dt = (c <= 1) ? c : (int)(Get(&r, c - 1) | (1U << (c - 1)));
+    }
+
+    if (ch == OVERFLOWCH)
+    {
+      t = num;
+      m.base += (mode == MODE_T2) ? num << 25 : num << 10;
+    }
+    else
+    {
+      m.prev += UnZigZag(num);
+      t = m.prev - m.base;
+    }
+    if (t >= ((mode == MODE_T2) ? 0x2000000ULL : 0x400ULL))
+    {
+      return -1;
+    }
+    rec = ((uint32_t)ch << 25) | (uint32_t)t;
+    if (mode == MODE_T3)
+    {
+      rec |= (uint32_t)dt << 10;
+    }
+    Store32(raw + 4 * i, rec);
+  }
+
+  // more bits used than there were
+  if ((size_t)(r.end - packed - TABLEBYTES) * 8 < (size_t)(r.p - packed - TABLEBYTES + r.pad) * 8 - (size_t)r.n)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+//
+// streams
+//
+
+typedef struct
+{
+  int state;                  // SLOT_xxx
+  uint64_t seq;               // blocks are taken up in order
+  CodecBlockHeader hdr;
+  unsigned char* raw;
+  size_t rawlen;              // filled (writing) or decoded (reading)
+  size_t pos;                 // reading: consumed
+  unsigned char* packed;
+  int store;                  // writing: store it, the threads fall behind
+  int error;
+} Slot;
+
+typedef struct
+{
+  FILE* fp;
+  int writing;
+  int live;                   // writing: store blocks rather than wait for the threads
+  int mode;
+  size_t blockbytes;
+  int threads;
+  int nslots;
+  Slot* slot;
+  int cur;                    // slot being filled or consumed
+  uint64_t seq;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  pthread_t tid[CODEC_MAXTHREADS];
+  int quit;
+  int failed;
+  CodecStats own;
+  CodecStats* stats;
+  double t0;
+  uint64_t rawpos;            // reading: bytes delivered
+  int64_t nblocks;            // reading: block table, built by the first seek, -1 = not yet
+  off_t* blockoff;            // file offset of each block header
+  uint64_t* blockstart;       // raw offset of each block, nblocks + 1 entries
+} Codec;
+
+
+// codes a block, returns the time it took
+static double Work(Codec* c, Slot* s)
+{
+  double t0 = RtNow();
+  uint32_t type;
+
+  if (c->writing)
+  {
+    s->hdr.magic = CODEC_BLOCKMAGIC;
+    s->hdr.rawbytes = (uint32_t)s->rawlen;
+    s->hdr.checksum = CodecChecksum(s->raw, s->rawlen);
+    s->hdr.packedbytes = (uint32_t)(s->store ? Store(s->raw, s->rawlen, s->packed, &type)
+      : CodecPack(s->raw, s->rawlen, c->mode, s->packed, &type));
+    s->hdr.type = type;
+  }
+  else
+  {
+    s->rawlen = s->hdr.rawbytes;
+    s->error = (CodecUnpack(s->packed, s->hdr.packedbytes, s->hdr.type, c->mode, s->raw, s->rawlen) < 0)
+      || (CodecChecksum(s->raw, s->rawlen) != s->hdr.checksum);
+  }
+  return RtNow() - t0;
+}
+
+
+static void* Worker(void* arg)
+{
+  Codec* c = (Codec*)arg;
+  Slot* s;
+  double t;
+  int i;
+
+  RtLeave(); // not on the CPU of a LowLatency reader
+  pthread_mutex_lock(&c->lock);
+  while (!c->quit)
+  {
+    s = NULL;
+    for (i = 0; i < c->nslots; i++)
+    {
+      if ((c->slot[i].state == SLOT_READY) && ((s == NULL) || (c->slot[i].seq < s->seq)))
+      {
+        s = &c->slot[i];
+      }
+    }
+    if (s == NULL)
+    {
+      pthread_cond_wait(&c->work, &c->lock);
+      continue;
+    }
+    s->state = SLOT_BUSY;
+    pthread_mutex_unlock(&c->lock);
+    t = Work(c, s);
+    pthread_mutex_lock(&c->lock);
+    c->own.coding += t;
+    s->state = SLOT_DONE;
+    pthread_cond_broadcast(&c->done);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+
+static void Submit(Codec* c, Slot* s)
+{
+  int i, queued = 0;
+
+  if (c->threads == 0)
+  {
+    c->own.coding += Work(c, s);
+    s->state = SLOT_DONE;
+    return;
+  }
+  pthread_mutex_lock(&c->lock);
+  for (i = 0; i < c->nslots; i++)
+  {
+    queued += (c->slot[i].state == SLOT_READY);
+  }
+  // a live writer with a round of blocks still waiting for the
+  // threads: store this one, a copy keeps up with any rate
+  s->store = c->live && (queued >= c->threads);
+  s->seq = c->seq++;
+  s->state = SLOT_READY;
+  pthread_cond_signal(&c->work);
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+static void Wait(Codec* c, Slot* s)
+{
+  if (c->threads == 0)
+  {
+    return;
+  }
+  pthread_mutex_lock(&c->lock);
+  while (s->state != SLOT_DONE)
+  {
+    pthread_cond_wait(&c->done, &c->lock);
+  }
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+// writes a coded block out and frees its slot
+static void Flush(Codec* c, Slot* s)
+{
+  Wait(c, s);
+  if ((fwrite(&s->hdr, sizeof(s->hdr), 1, c->fp) != 1)
+    || (fwrite(s->packed, 1, s->hdr.packedbytes, c->fp) != s->hdr.packedbytes))
+  {
+    c->failed = 1;
+  }
+  c->own.rawbytes += s->hdr.rawbytes;
+  c->own.packedbytes += sizeof(s->hdr) + s->hdr.packedbytes;
+  c->own.blocks++;
+  c->own.stored += s->store;
+  s->store = 0;
+  s->rawlen = 0;
+  s->state = SLOT_FREE;
+}
+
+
+// reads the next block into a free slot and submits it; 0 at the end
+// of the file
+static int Load(Codec* c, Slot* s)
+{
+  if (fread(&s->hdr, sizeof(s->hdr), 1, c->fp) != 1)
+  {
+    return 0;
+  }
+  if ((s->hdr.magic != CODEC_BLOCKMAGIC) || (s->hdr.rawbytes > c->blockbytes)
+    || (s->hdr.packedbytes > CodecPackBound(c->blockbytes))
+    || (fread(s->packed, 1, s->hdr.packedbytes, c->fp) != s->hdr.packedbytes))
+  {
+    c->failed = 1;
+    return 0;
+  }
+  c->own.rawbytes += s->hdr.rawbytes;
+  c->own.packedbytes += sizeof(s->hdr) + s->hdr.packedbytes;
+  c->own.blocks++;
+  s->pos = 0;
+  Submit(c, s);
+  return 1;
+}
+
+
+static ssize_t CookieWrite(void* cookie, const char* buf, size_t size)
+{
+  Codec* c = (Codec*)cookie;
+  Slot* s;
+  size_t part, left = size;
+
+  while (left > 0)
+  {
+    s = &c->slot[c->cur];
+    part = c->blockbytes - s->rawlen;
+    if (part > left)
+    {
+      part = left;
+    }
+    memcpy(s->raw + s->rawlen, buf, part);
+    s->rawlen += part;
+    buf += part;
+    left -= part;
+    if (s->rawlen == c->blockbytes)
+    {
+      Submit(c, s);
+      c->cur = (c->cur + 1) % c->nslots;
+      if (c->slot[c->cur].state != SLOT_FREE)
+      {
+        Flush(c, &c->slot[c->cur]);  // all taken, only if even writing falls behind
+      }
+    }
+  }
+  return c->failed ? 0 : (ssize_t)size;
+}
+
+
+static ssize_t CookieRead(void* cookie, char* buf, size_t size)
+{
+  Codec* c = (Codec*)cookie;
+  Slot* s;
+  size_t part, done = 0;
+
+  while (done < size)
+  {
+    s = &c->slot[c->cur];
+    if (s->state == SLOT_FREE)
+    {
+      if (c->failed && (done == 0))
+      {
+        return -1;  // a damaged block header or a truncated file
+      }
+      break;  // end of file
+    }
+    Wait(c, s);
+    if (s->error)
+    {
+      c->own.errors++;
+      s->error = 0;
+      s->state = SLOT_FREE;  // the stream ends here
+      return -1;
+    }
+    part = s->rawlen - s->pos;
+    if (part > size - done)
+    {
+      part = size - done;
+    }
+    memcpy(buf + done, s->raw + s->pos, part);
+    s->pos += part;
+    done += part;
+    if (s->pos == s->rawlen)
+    {
+      s->state = SLOT_FREE;
+      Load(c, s);
+      c->cur = (c->cur + 1) % c->nslots;
+    }
+  }
+  c->rawpos += done;
+  return (ssize_t)done;
+}
+
+
+// the file offsets and raw offsets of all blocks, from their headers
+static int BuildTable(Codec* c)
+{
+  CodecBlockHeader hdr;
+  off_t pos = sizeof(CodecFileHeader);
+  int64_t n = 0, cap = 0;
+  void* p;
+
+  while ((fseeko(c->fp, pos, SEEK_SET) == 0) && (fread(&hdr, sizeof(hdr), 1, c->fp) == 1))
+  {
+    if ((hdr.magic != CODEC_BLOCKMAGIC) || (hdr.rawbytes > c->blockbytes))
+    {
+      return -1;
+    }
+    if (n + 1 >= cap)
+    {
+      cap = cap ? 2 * cap : 1024;
+      p = realloc(c->blockoff, cap * sizeof(off_t));
+      if (p == NULL)
+      {
+        return -1;
+      }
+      c->blockoff = (off_t*)p;
+      p = realloc(c->blockstart, cap * sizeof(uint64_t));
+      if (p == NULL)
+      {
+        return -1;
+      }
+      c->blockstart = (uint64_t*)p;
+      c->blockstart[0] = 0;
+    }
+    c->blockoff[n] = pos;
+    c->blockstart[n + 1] = c->blockstart[n] + hdr.rawbytes;
+    pos += sizeof(hdr) + hdr.packedbytes;
+    n++;
+  }
+  if (n == 0)
+  {
+    c->blockstart = (uint64_t*)calloc(1, sizeof(uint64_t));
+    if (c->blockstart == NULL)
+    {
+      return -1;
+    }
+  }
+  c->nblocks = n;
+  return 0;
+}
+
+
+// reading only: the block table is built once, then a seek is a binary
+// search and a restart of the decoding pipeline at the block
+static int CookieSeek(void* cookie, off64_t* offset, int whence)
+{
+  Codec* c = (Codec*)cookie;
+  uint64_t target;
+  int64_t lo, hi, mid;
+  int i;
+
+  if (c->writing)
+  {
+    return -1;
+  }
+  if ((whence == SEEK_CUR) && (*offset == 0))
+  {
+    *offset = (off64_t)c->rawpos;  // ftell
+    return 0;
+  }
+
+  // stop the pipeline, blocks being coded are finished and dropped
+  pthread_mutex_lock(&c->lock);
+  for (i = 0; i < c->nslots; i++)
+  {
+    if (c->slot[i].state == SLOT_READY)
+    {
+      c->slot[i].state = SLOT_FREE;
+    }
+  }
+  pthread_mutex_unlock(&c->lock);
+  for (i = 0; i < c->nslots; i++)
+  {
+    if (c->slot[i].state != SLOT_FREE)
+    {
+      Wait(c, &c->slot[i]);
+      c->slot[i].state = SLOT_FREE;
+    }
+    c->slot[i].error = 0;
+  }
+  if ((c->nblocks < 0) && (BuildTable(c) < 0))
+  {
+    c->failed = 1;
+    return -1;
+  }
+
+  target = (whence == SEEK_SET) ? 0 : (whence == SEEK_CUR) ? c->rawpos : c->blockstart[c->nblocks];
+  target += *offset;
+  if (target > c->blockstart[c->nblocks])
+  {
+    return -1;
+  }
+  lo = 0;
+  hi = c->nblocks;  // blockstart[lo] <= target < blockstart[hi]
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (c->blockstart[mid] <= target)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  c->cur = 0;
+  c->rawpos = target;
+  if (target < c->blockstart[c->nblocks])
+  {
+    fseeko(c->fp, c->blockoff[lo], SEEK_SET);
+    for (i = 0; (i < c->nslots) && Load(c, &c->slot[i]); i++)
+    {
+    }
+    c->slot[0].pos = target - c->blockstart[lo];
+  }
+  *offset = (off64_t)target;
+  return 0;
+}
+
+
+static void Destroy(Codec* c)
+{
+  int i;
+
+  if (c->threads > 0)
+  {
+    pthread_mutex_lock(&c->lock);
+    c->quit = 1;
+    pthread_cond_broadcast(&c->work);
+    pthread_mutex_unlock(&c->lock);
+    for (i = 0; i < c->threads; i++)
+    {
+      pthread_join(c->tid[i], NULL);
+    }
+  }
+  pthread_mutex_destroy(&c->lock);
+  pthread_cond_destroy(&c->work);
+  pthread_cond_destroy(&c->done);
+  if (c->slot)
+  {
+    for (i = 0; i < c->nslots; i++)
+    {
+      free(c->slot[i].raw);
+      free(c->slot[i].packed);
+    }
+    free(c->slot);
+  }
+  free(c->blockoff);
+  free(c->blockstart);
+  free(c);
+}
+
+
+static int CookieClose(void* cookie)
+{
+  Codec* c = (Codec*)cookie;
+  int i, ret;
+
+  if (c->writing)
+  {
+    if (c->slot[c->cur].rawlen > 0)
+    {
+      Submit(c, &c->slot[c->cur]);
+    }
+    for (i = 1; i <= c->nslots; i++)  // oldest first
+    {
+      if (c->slot[(c->cur + i) % c->nslots].state != SLOT_FREE)
+      {
+        Flush(c, &c->slot[(c->cur + i) % c->nslots]);
+      }
+    }
+  }
+  ret = ((fclose(c->fp) != 0) || c->failed) ? EOF : 0;
+
+  c->own.seconds = RtNow() - c->t0;
+  c->own.errors += c->failed;
+  if (c->stats)
+  {
+    *c->stats = c->own;
+  }
+  Destroy(c);
+  return ret;
+}
+
+
+static Codec* Create(FILE* fp, int writing, int mode, size_t blockbytes, int threads, CodecStats* stats)
+{
+  Codec* c;
+  int i;
+
+  c = (Codec*)calloc(1, sizeof(Codec));
+  if (c == NULL)
+  {
+    return NULL;
+  }
+  c->fp = fp;
+  c->writing = writing;
+  c->mode = mode;
+  c->blockbytes = blockbytes;
+  c->threads = (threads < 0) ? 0 : (threads > CODEC_MAXTHREADS) ? CODEC_MAXTHREADS : threads;
+  c->nslots = c->threads ? 4 * c->threads : 1;  // one being filled or read while the rest are coded
+  c->stats = stats;
+  c->t0 = RtNow();
+  c->nblocks = -1;
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->work, NULL);
+  pthread_cond_init(&c->done, NULL);
+
+  c->slot = (Slot*)calloc(c->nslots, sizeof(Slot));
+  if (c->slot == NULL)
+  {
+    c->threads = 0;
+    Destroy(c);
+    return NULL;
+  }
+  for (i = 0; i < c->nslots; i++)
+  {
+    c->slot[i].raw = (unsigned char*)malloc(blockbytes);
+    c->slot[i].packed = (unsigned char*)malloc(CodecPackBound(blockbytes));
+    if ((c->slot[i].raw == NULL) || (c->slot[i].packed == NULL))
+    {
+      c->threads = 0;
+      Destroy(c);
+      return NULL;
+    }
+  }
+  for (i = 0; i < c->threads; i++)
+  {
+    if (pthread_create(&c->tid[i], NULL, Worker, c) != 0)
+    {
+      c->threads = i;  // make do with fewer, 0 codes in the caller
+      break;
+    }
+  }
+  return c;
+}
+
+
+static FILE* Cookie(Codec* c, const char* how)
+{
+  cookie_io_functions_t io = { CookieRead, CookieWrite, CookieSeek, CookieClose };
+  FILE* fp;
+
+  fp = fopencookie(c, how, io);
+  if (fp == NULL)
+  {
+    fclose(c->fp);
+    Destroy(c);
+    return NULL;
+  }
+  // unbuffered, fwrite hands whole buffers to the codec; fread of an
+  // unbuffered stream would ask for one byte at a time
+  if (c->writing)
+  {
+    setvbuf(fp, NULL, _IONBF, 0);
+  }
+  else
+  {
+    setvbuf(fp, NULL, _IOFBF, 65536);
+  }
+  return fp;
+}
+
+
+FILE* CodecOpenWrite(const char* path, int mode, int threads, int live, CodecStats* stats)
+{
+  CodecFileHeader fh;
+  Codec* c;
+  FILE* fp;
+
+  if ((mode != MODE_T2) && (mode != MODE_T3))
+  {
+    return NULL;
+  }
+  fp = fopen(path, "wb");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  fh.magic = CODEC_MAGIC;
+  fh.version = CODEC_VERSION;
+  fh.mode = mode;
+  fh.blockrecords = CODEC_BLOCKRECORDS;
+  c = (fwrite(&fh, sizeof(fh), 1, fp) == 1)
+    ? Create(fp, 1, mode, CODEC_BLOCKRECORDS * sizeof(uint32_t), threads, stats) : NULL;
+  if (c == NULL)
+  {
+    fclose(fp);
+    return NULL;
+  }
+  c->live = live;
+  c->own.packedbytes = sizeof(fh);
+  return Cookie(c, "w");
+}
+
+
+FILE* CodecOpenRead(const char* path, int threads, int* mode, CodecStats* stats)
+{
+  CodecFileHeader fh;
+  Codec* c;
+  FILE* fp;
+  int i;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  if ((fread(&fh, sizeof(fh), 1, fp) != 1) || (fh.magic != CODEC_MAGIC) || (fh.version != CODEC_VERSION)
+    || ((fh.mode != MODE_T2) && (fh.mode != MODE_T3)) || (fh.blockrecords == 0) || (fh.blockrecords > (1 << 26)))
+  {
+    fclose(fp);
+    return NULL;
+  }
+  c = Create(fp, 0, fh.mode, fh.blockrecords * sizeof(uint32_t), threads, stats);
+  if (c == NULL)
+  {
+    fclose(fp);
+    return NULL;
+  }
+  c->own.packedbytes = sizeof(fh);
+  for (i = 0; (i < c->nslots) && Load(c, &c->slot[i]); i++)
+  {
+  }
+  if (mode)
+  {
+    *mode = fh.mode;
+  }
+  return Cookie(c, "r");
+}
+
+
+int CodecIsCompressed(const char* path)
+{
+  FILE* fp;
+  uint32_t magic;
+  int ret;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  ret = (fread(&magic, sizeof(magic), 1, fp) == 1) && (magic == CODEC_MAGIC);
+  fclose(fp);
+  return ret;
+}
+
+
+void CodecPrintStats(const CodecStats* stats, const char* what, FILE* fp)
+{
+  double mb = stats->rawbytes / 1e6;
+
+  fprintf(fp, "\n%s %.1f MB as %.1f MB in %llu blocks, ratio %.2f, %.1f MB/s, coding %.1f MB/s per thread",
+    what, mb, stats->packedbytes / 1e6, (unsigned long long)stats->blocks,
+    stats->packedbytes ? (double)stats->rawbytes / stats->packedbytes : 0.0,
+    (stats->seconds > 0) ? mb / stats->seconds : 0.0, (stats->coding > 0) ? mb / stats->coding : 0.0);
+  if (stats->stored)
+  {
+    fprintf(fp, ", %llu stored to keep up", (unsigned long long)stats->stored);
+  }
+  if (stats->errors)
+  {
+    fprintf(fp, ", %d errors", stats->errors);
+  }
+  fprintf(fp, "\n");
+}
@@ -0,0 +1,115 @@
+/************************************************************************
+
+  Lossless block compression of MultiHarp T2/T3 record files
+
+  Raw TTTR files grow by 4 bytes per event. The records compress well:
+  time tags mostly increase by small steps and only a few channels
+  occur. The codec splits the stream into independent blocks of
+  CODEC_BLOCKRECORDS records and codes each record as
+
+    - its channel code (special bit and channel, 7 bits),
+    - for overflow records the overflow count, otherwise the difference
+      of its overflow corrected time tag (T2) or nsync (T3) to the
+      previous record of the block, zigzag coded so that out of order
+      records cost little more,
+    - in T3 its dtime,
+
+  where every number is sent as a bit length class, Huffman coded with
+  tables made for the block, followed by the bits below the leading
+  one. Blocks that do not get smaller, and a trailing partial record,
+  are stored as they are. Every block carries a checksum of its raw
+  data.
+
+  Blocks are independent, so a pool of threads compresses and
+  decompresses several at a time. The coding rate of a thread depends
+  on the data and the CPU: with mhzip -t 0 on simulated files it was
+  110-140 MB/s for T3 and 150-240 MB/s for T2 on one core of a virtual
+  Xeon, and 47-62 MB/s on another, slower host. That is below the
+  peak rate of the MultiHarp, so measure it with mhzip on your own
+  recordings. A writer queues up to four blocks per thread. A live
+  writer (acquisition) stores the next blocks instead of coding them
+  once a round of them waits for the threads (stats.stored), so fwrite
+  only waits when the disk cannot keep up with the raw data; other
+  writers wait for the threads. Without threads the caller codes every
+  block itself. The codec plugs in as a stdio stream (fopencookie), so
+  writers and readers use fwrite and fread as with a raw file:
+
+    fp = CodecOpenWrite("run.mhz", MODE_T2, 2, 0, &stats);  ... fwrite ...  fclose(fp);
+    fp = CodecOpenRead("run.mhz", 2, &mode, &stats);        ... fread ...   fclose(fp);
+
+  A stats structure passed to the open call is filled in by fclose and
+  must live until then. Read streams can seek (fseeko to a raw byte
+  offset); the first seek reads all block headers, later ones start
+  decoding at the block that holds the offset.
+
+  File layout: CodecFileHeader, then blocks of CodecBlockHeader and
+  packed bytes.
+
+************************************************************************/
+
+#ifndef TTTRCODEC_H
+#define TTTRCODEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CODEC_MAGIC         0x315A484D   // "MHZ1"
+#define CODEC_BLOCKMAGIC    0x4B4C424D   // "MBLK"
+#define CODEC_VERSION       1
+#define CODEC_BLOCKRECORDS  (256 * 1024)
+#define CODEC_MAXTHREADS    64
+
+#define CODEC_STORED        0
+#define CODEC_HUFFMAN       1
+
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t mode;               // MODE_T2 or MODE_T3
+  uint32_t blockrecords;
+} CodecFileHeader;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t rawbytes;
+  uint32_t packedbytes;       // following this header
+  uint32_t checksum;          // of the raw bytes
+  uint32_t type;              // CODEC_STORED or CODEC_HUFFMAN
+} CodecBlockHeader;
+
+typedef struct
+{
+  uint64_t rawbytes;
+  uint64_t packedbytes;       // including all headers
+  uint64_t blocks;
+  double seconds;             // from open to close
+  double coding;              // s spent coding, summed over the threads
+  uint64_t stored;            // writing: blocks stored because the threads fell behind
+  int errors;                 // blocks that failed to decode or verify
+} CodecStats;
+
+
+// Open a compressed file as a stdio stream. threads is the number of
+// worker threads, 0 codes in the calling thread. live = 1 stores blocks
+// rather than wait for the threads. NULL on error.
+FILE* CodecOpenWrite(const char* path, int mode, int threads, int live, CodecStats* stats);
+FILE* CodecOpenRead(const char* path, int threads, int* mode, CodecStats* stats);
+
+// 1 if the file starts with the codec magic, 0 if not, -1 if unreadable.
+int CodecIsCompressed(const char* path);
+
+// Block level coding. CodecPack needs CodecPackBound(rawbytes) bytes of
+// room, returns the packed size and the block type. CodecUnpack returns
+// 0, or -1 if the data is corrupt.
+size_t CodecPackBound(size_t rawbytes);
+size_t CodecPack(const unsigned char* raw, size_t rawbytes, int mode, unsigned char* packed, uint32_t* type);
+int CodecUnpack(const unsigned char* packed, size_t packedbytes, uint32_t type, int mode,
+  unsigned char* raw, size_t rawbytes);
+uint32_t CodecChecksum(const unsigned char* raw, size_t rawbytes);
+
+void CodecPrintStats(const CodecStats* stats, const char* what, FILE* fp);
+
+#endif
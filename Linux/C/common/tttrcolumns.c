@@ -0,0 +1,632 @@
+/************************************************************************
+
+  Columnar archive of decoded MultiHarp T2/T3 events, see tttrcolumns.h
+
+************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mhdefin.h"
+#include "tttrcolumns.h"
+
+
+#define CHUNK  65536   // records decoded at a time
+
+
+typedef struct
+{
+  FILE* out;                    // raw records go on here, may be NULL
+  FILE* fp;                     // the archive
+  ColFileHeader hdr;
+  TTTRDecoder dec;
+  TTTREvent* events;
+  uint64_t* val[COL_NUMCOLUMNS];  // the group being filled
+  uint64_t rows;
+  uint64_t channels;
+  uint64_t* packed;
+  ColGroup* groups;
+  uint64_t ngroups;
+  uint64_t capacity;
+  uint64_t offset;              // where the next chunk goes
+  uint64_t total;
+  unsigned char partial[4];
+  int npartial;
+  int failed;
+} ColWriter;
+
+struct ColArchive
+{
+  unsigned char* map;
+  size_t size;
+  const ColFileHeader* hdr;
+  const ColGroup* groups;
+  int64_t ngroups;
+  uint64_t* scratch[COL_NUMCOLUMNS];
+};
+
+
+static int Width(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+
+static uint64_t Words(uint64_t rows, int width)
+{
+  return (rows * width + 63) / 64;
+}
+
+
+static void Pack(const uint64_t* v, uint64_t n, int width, uint64_t* words)
+{
+  uint64_t i, pos;
+  int sh;
+
+  memset(words, 0, Words(n, width) * sizeof(uint64_t));
+  if (width == 0)
+  {
+    return;
+  }
+  for (i = 0, pos = 0; i < n; i++, pos += width)
+  {
+    sh = (int)(pos & 63);
+    words[pos >> 6] |= v[i] << sh;
+    if (sh + width > 64)
+    {
+      words[(pos >> 6) + 1] |= v[i] >> (64 - sh);
+    }
+  }
+}
+
+
+static void Unpack(const uint64_t* words, uint64_t n, int width, uint64_t* v)
+{
+  uint64_t i, pos, mask = (width == 64) ? ~0ULL : (1ULL << width) - 1;
+  int sh;
+
+  if (width == 0)
+  {
+    memset(v, 0, n * sizeof(uint64_t));
+    return;
+  }
+  for (i = 0, pos = 0; i < n; i++, pos += width)
+  {
+    sh = (int)(pos & 63);
+    v[i] = words[pos >> 6] >> sh;
+    if (sh + width > 64)
+    {
+      v[i] |= words[(pos >> 6) + 1] << (64 - sh);
+    }
+    v[i] &= mask;
+  }
+}
+
+
+//
+// writing
+//
+
+// encodes one column of the group in place and writes it
+static void WriteChunk(ColWriter* w, uint64_t* v, ColChunk* c)
+{
+  uint64_t i, n = w->rows, min, max, d, dmax = 0;
+  int wfor, wdelta;
+
+  memset(c, 0, sizeof(ColChunk));
+  min = max = v[0];
+  for (i = 1; i < n; i++)
+  {
+    min = (v[i] < min) ? v[i] : min;
+    max = (v[i] > max) ? v[i] : max;
+    d = v[i] - v[i - 1];
+    d = (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+    dmax = (d > dmax) ? d : dmax;
+  }
+  wfor = Width(max - min);
+  wdelta = Width(dmax);
+
+  c->min = min;
+  c->max = max;
+  if (wdelta < wfor)
+  {
+    c->encoding = COL_DELTA;
+    c->width = (uint8_t)wdelta;
+    c->base = v[0];
+    for (i = n - 1; i > 0; i--)
+    {
+      d = v[i] - v[i - 1];
+      v[i] = (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+    }
+    v[0] = 0;
+  }
+  else
+  {
+    c->encoding = COL_FOR;
+    c->width = (uint8_t)wfor;
+    c->base = min;
+    for (i = 0; i < n; i++)
+    {
+      v[i] -= min;
+    }
+  }
+
+  Pack(v, n, c->width, w->packed);
+  c->offset = w->offset;
+  c->bytes = Words(n, c->width) * sizeof(uint64_t);
+  if (fwrite(w->packed, 1, c->bytes, w->fp) != c->bytes)
+  {
+    w->failed = 1;
+  }
+  w->offset += c->bytes;
+}
+
+
+static void FlushGroup(ColWriter* w)
+{
+  ColGroup* g;
+  void* p;
+  int k;
+
+  if (w->rows == 0)
+  {
+    return;
+  }
+  if (w->ngroups == w->capacity)
+  {
+    w->capacity = w->capacity ? 2 * w->capacity : 256;
+    p = realloc(w->groups, w->capacity * sizeof(ColGroup));
+    if (p == NULL)
+    {
+      w->failed = 1;
+      w->rows = 0;
+      return;
+    }
+    w->groups = (ColGroup*)p;
+  }
+  g = &w->groups[w->ngroups++];
+  g->rows = w->rows;
+  g->channels = w->channels;
+  for (k = 0; k < COL_NUMCOLUMNS; k++)
+  {
+    WriteChunk(w, w->val[k], &g->col[k]);
+  }
+  w->total += w->rows;
+  w->rows = 0;
+  w->channels = 0;
+}
+
+
+static void Append(ColWriter* w, const TTTREvent* e, int n)
+{
+  uint64_t r;
+  int i, ch;
+
+  for (i = 0; i < n; i++)
+  {
+    r = w->rows;
+    ch = (e[i].Channel & EVENT_MARKER) ? COL_MARKERCHANNEL : e[i].Channel;
+    w->val[COL_TIME][r] = e[i].Time;
+    w->val[COL_DTIME][r] = (uint64_t)e[i].DTime;
+    w->val[COL_CHANNEL][r] = (uint64_t)ch;
+    w->val[COL_MARKERS][r] = (e[i].Channel & EVENT_MARKER) ? (uint64_t)(e[i].Channel & 0xFF) : 0;
+    w->channels |= (ch == COL_MARKERCHANNEL) ? (1ULL << 63) : (ch < 63) ? (1ULL << ch) : 0;
+    if (++w->rows == w->hdr.grouprows)
+    {
+      FlushGroup(w);
+    }
+  }
+}
+
+
+static void Decode(ColWriter* w, const unsigned int* records, size_t n)
+{
+  int m, nev;
+
+  while (n > 0)
+  {
+    m = (n < CHUNK) ? (int)n : CHUNK;
+    nev = (w->hdr.mode == MODE_T2) ? DecodeT2(&w->dec, records, m, w->events)
+      : DecodeT3(&w->dec, records, m, w->events);
+    Append(w, w->events, nev);
+    records += m;
+    n -= m;
+  }
+}
+
+
+static ssize_t ColumnWrite(void* cookie, const char* buf, size_t size)
+{
+  ColWriter* w = (ColWriter*)cookie;
+  unsigned int rec;
+  size_t i, n, left = size;
+
+  if (w->out && (fwrite(buf, 1, size, w->out) != size))
+  {
+    return 0;
+  }
+  while ((w->npartial > 0) && (left > 0))
+  {
+    w->partial[w->npartial++] = (unsigned char)*buf++;
+    left--;
+    if (w->npartial == 4)
+    {
+      memcpy(&rec, w->partial, 4);
+      Decode(w, &rec, 1);
+      w->npartial = 0;
+    }
+  }
+  n = left / 4;
+  if (((uintptr_t)buf & 3) == 0)
+  {
+    Decode(w, (const unsigned int*)buf, n);
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      memcpy(&rec, buf + 4 * i, 4);
+      Decode(w, &rec, 1);
+    }
+  }
+  buf += 4 * n;
+  left -= 4 * n;
+  while (left > 0)
+  {
+    w->partial[w->npartial++] = (unsigned char)*buf++;
+    left--;
+  }
+  return w->failed ? 0 : (ssize_t)size;
+}
+
+
+static void FreeWriter(ColWriter* w)
+{
+  int k;
+
+  for (k = 0; k < COL_NUMCOLUMNS; k++)
+  {
+    free(w->val[k]);
+  }
+  free(w->events);
+  free(w->packed);
+  free(w->groups);
+  free(w);
+}
+
+
+static int ColumnClose(void* cookie)
+{
+  ColWriter* w = (ColWriter*)cookie;
+  ColTrailer t;
+  int ret = 0;
+
+  FlushGroup(w);
+  t.footer = w->offset;
+  t.ngroups = w->ngroups;
+  t.rows = w->total;
+  t.magic = COL_MAGIC;
+  t.version = COL_VERSION;
+  if ((fwrite(w->groups, sizeof(ColGroup), w->ngroups, w->fp) != w->ngroups)
+    || (fwrite(&t, sizeof(t), 1, w->fp) != 1))
+  {
+    w->failed = 1;
+  }
+  if ((fclose(w->fp) != 0) || w->failed)
+  {
+    ret = EOF;
+  }
+  if (w->out && (fclose(w->out) != 0))
+  {
+    ret = EOF;
+  }
+  FreeWriter(w);
+  return ret;
+}
+
+
+FILE* ColumnOpen(FILE* out, const char* path, int mode, double resolution, double syncperiod)
+{
+  cookie_io_functions_t io = { NULL, ColumnWrite, NULL, ColumnClose };
+  ColWriter* w;
+  FILE* fp;
+  int k, ok;
+
+  w = (ColWriter*)calloc(1, sizeof(ColWriter));
+  if (w == NULL)
+  {
+    return NULL;
+  }
+  w->out = out;
+  w->hdr.magic = COL_MAGIC;
+  w->hdr.version = COL_VERSION;
+  w->hdr.mode = mode;
+  w->hdr.grouprows = COL_GROUPROWS;
+  w->hdr.resolution = resolution;
+  w->hdr.syncperiod = syncperiod;
+  DecoderInit(&w->dec, mode, resolution, syncperiod);
+  w->offset = sizeof(ColFileHeader);
+  w->events = (TTTREvent*)malloc(CHUNK * sizeof(TTTREvent));
+  w->packed = (uint64_t*)malloc((COL_GROUPROWS + 1) * sizeof(uint64_t));
+  ok = (w->events != NULL) && (w->packed != NULL);
+  for (k = 0; k < COL_NUMCOLUMNS; k++)
+  {
+    w->val[k] = (uint64_t*)malloc(COL_GROUPROWS * sizeof(uint64_t));
+    ok = ok && (w->val[k] != NULL);
+  }
+  if (ok)
+  {
+    w->fp = fopen(path, "wb");
+  }
+  if ((w->fp == NULL) || (fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1))
+  {
+    if (w->fp)
+    {
+      fclose(w->fp);
+    }
+    FreeWriter(w);
+    return NULL;
+  }
+  fp = fopencookie(w, "w", io);
+  if (fp == NULL)
+  {
+    fclose(w->fp);
+    FreeWriter(w);
+    return NULL;
+  }
+  setvbuf(fp, NULL, _IONBF, 0);  // the writes pass on as they come
+  return fp;
+}
+
+
+//
+// reading
+//
+
+ColArchive* ColOpen(const char* path)
+{
+  ColArchive* arch;
+  const ColTrailer* t;
+  struct stat st;
+  void* p;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)(sizeof(ColFileHeader) + sizeof(ColTrailer))))
+  {
+    close(fd);
+    return NULL;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+  {
+    return NULL;
+  }
+  arch = (ColArchive*)calloc(1, sizeof(ColArchive));
+  if (arch == NULL)
+  {
+    munmap(p, st.st_size);
+    return NULL;
+  }
+  arch->map = (unsigned char*)p;
+  arch->size = st.st_size;
+  arch->hdr = (const ColFileHeader*)p;
+  t = (const ColTrailer*)(arch->map + arch->size - sizeof(ColTrailer));
+  if ((arch->hdr->magic != COL_MAGIC) || (arch->hdr->version != COL_VERSION) || (t->magic != COL_MAGIC)
+    || (arch->hdr->grouprows == 0) || (arch->hdr->grouprows > COL_GROUPROWS)
+    || (t->footer > arch->size) || (t->ngroups > (arch->size - t->footer) / sizeof(ColGroup))
+    || (t->footer + t->ngroups * sizeof(ColGroup) + sizeof(ColTrailer) != arch->size))
+  {
+    ColClose(arch);
+    return NULL;  // not an archive, or its writer did not finish
+  }
+  arch->groups = (const ColGroup*)(arch->map + t->footer);
+  arch->ngroups = (int64_t)t->ngroups;
+  madvise(arch->map, arch->size, MADV_RANDOM);  // groups are skipped, read ahead would not help
+  return arch;
+}
+
+
+void ColClose(ColArchive* arch)
+{
+  int k;
+
+  if (arch)
+  {
+    for (k = 0; k < COL_NUMCOLUMNS; k++)
+    {
+      free(arch->scratch[k]);
+    }
+    munmap(arch->map, arch->size);
+    free(arch);
+  }
+}
+
+
+const ColFileHeader* ColHeader(const ColArchive* arch)
+{
+  return arch->hdr;
+}
+
+
+int64_t ColNumGroups(const ColArchive* arch)
+{
+  return arch->ngroups;
+}
+
+
+const ColGroup* ColGetGroup(const ColArchive* arch, int64_t g)
+{
+  return &arch->groups[g];
+}
+
+
+int64_t ColNextGroup(const ColArchive* arch, const ColQuery* q, int64_t g)
+{
+  const ColGroup* grp;
+
+  for (; g < arch->ngroups; g++)
+  {
+    grp = &arch->groups[g];
+    if ((grp->col[COL_TIME].max >= q->tmin) && (grp->col[COL_TIME].min < q->tmax)
+      && (grp->channels & q->channels))
+    {
+      return g;
+    }
+  }
+  return -1;
+}
+
+
+static int ReadChunk(ColArchive* arch, const ColGroup* grp, int col)
+{
+  const ColChunk* c = &grp->col[col];
+  uint64_t* v;
+  uint64_t i;
+
+  if (arch->scratch[col] == NULL)
+  {
+    arch->scratch[col] = (uint64_t*)malloc(arch->hdr->grouprows * sizeof(uint64_t));
+    if (arch->scratch[col] == NULL)
+    {
+      return -1;
+    }
+  }
+  v = arch->scratch[col];
+  if ((c->width > 64) || (c->offset % 8) || (c->offset > arch->size) || (c->bytes > arch->size - c->offset)
+    || (c->bytes < Words(grp->rows, c->width) * sizeof(uint64_t)))
+  {
+    return -1;
+  }
+  Unpack((const uint64_t*)(arch->map + c->offset), grp->rows, c->width, v);
+  if (c->encoding == COL_DELTA)
+  {
+    v[0] = c->base;
+    for (i = 1; i < grp->rows; i++)
+    {
+      v[i] = v[i - 1] + ((v[i] >> 1) ^ (0 - (v[i] & 1)));
+    }
+  }
+  else
+  {
+    for (i = 0; i < grp->rows; i++)
+    {
+      v[i] += c->base;
+    }
+  }
+  return 0;
+}
+
+
+int64_t ColReadGroup(ColArchive* arch, const ColQuery* q, int64_t g, ColRows* rows)
+{
+  const ColGroup* grp = &arch->groups[g];
+  uint64_t* time;
+  uint64_t* chan;
+  uint64_t i, bit;
+  unsigned need = q->columns;
+  int64_t n = 0;
+  int k, usetime, usechan;
+
+  if (grp->rows > arch->hdr->grouprows)
+  {
+    return -1;
+  }
+  // the filter columns are decoded only if the filter can reject rows of this group
+  usetime = (grp->col[COL_TIME].min < q->tmin) || (grp->col[COL_TIME].max >= q->tmax);
+  usechan = (grp->channels & ~q->channels) != 0;
+  need |= (usetime ? COL_WANT(COL_TIME) : 0) | (usechan ? COL_WANT(COL_CHANNEL) : 0);
+  for (k = 0; k < COL_NUMCOLUMNS; k++)
+  {
+    if ((need & COL_WANT(k)) && (ReadChunk(arch, grp, k) < 0))
+    {
+      return -1;
+    }
+  }
+
+  time = arch->scratch[COL_TIME];
+  chan = arch->scratch[COL_CHANNEL];
+  for (i = 0; i < grp->rows; i++)
+  {
+    if (usetime && ((time[i] < q->tmin) || (time[i] >= q->tmax)))
+    {
+      continue;
+    }
+    if (usechan)
+    {
+      bit = (chan[i] == COL_MARKERCHANNEL) ? (1ULL << 63) : (chan[i] < 63) ? (1ULL << chan[i]) : 0;
+      if (!(bit & q->channels))
+      {
+        continue;
+      }
+    }
+    if (q->columns & COL_WANT(COL_TIME))
+    {
+      rows->time[n] = arch->scratch[COL_TIME][i];
+    }
+    if (q->columns & COL_WANT(COL_DTIME))
+    {
+      rows->dtime[n] = (uint16_t)arch->scratch[COL_DTIME][i];
+    }
+    if (q->columns & COL_WANT(COL_CHANNEL))
+    {
+      rows->channel[n] = (uint8_t)arch->scratch[COL_CHANNEL][i];
+    }
+    if (q->columns & COL_WANT(COL_MARKERS))
+    {
+      rows->markers[n] = (uint8_t)arch->scratch[COL_MARKERS][i];
+    }
+    n++;
+  }
+  return n;
+}
+
+
+int ColAllocRows(ColRows* rows, unsigned columns)
+{
+  memset(rows, 0, sizeof(ColRows));
+  if (columns & COL_WANT(COL_TIME))
+  {
+    rows->time = (uint64_t*)malloc(COL_GROUPROWS * sizeof(uint64_t));
+  }
+  if (columns & COL_WANT(COL_DTIME))
+  {
+    rows->dtime = (uint16_t*)malloc(COL_GROUPROWS * sizeof(uint16_t));
+  }
+  if (columns & COL_WANT(COL_CHANNEL))
+  {
+    rows->channel = (uint8_t*)malloc(COL_GROUPROWS);
+  }
+  if (columns & COL_WANT(COL_MARKERS))
+  {
+    rows->markers = (uint8_t*)malloc(COL_GROUPROWS);
+  }
+  if (((columns & COL_WANT(COL_TIME)) && !rows->time) || ((columns & COL_WANT(COL_DTIME)) && !rows->dtime)
+    || ((columns & COL_WANT(COL_CHANNEL)) && !rows->channel) || ((columns & COL_WANT(COL_MARKERS)) && !rows->markers))
+  {
+    ColFreeRows(rows);
+    return -1;
+  }
+  return 0;
+}
+
+
+void ColFreeRows(ColRows* rows)
+{
+  free(rows->time);
+  free(rows->dtime);
+  free(rows->channel);
+  free(rows->markers);
+  memset(rows, 0, sizeof(ColRows));
+}
@@ -0,0 +1,144 @@
+/************************************************************************
+
+  Columnar archive of decoded MultiHarp T2/T3 events
+
+  Analysis mostly wants a few fields of the events in some time range.
+  The archive stores the decoded events column by column, in row
+  groups of COL_GROUPROWS events:
+
+    COL_TIME     overflow corrected time tag (T2) or nsync (T3)
+    COL_DTIME    T3 dtime, 0 in T2
+    COL_CHANNEL  0 = sync (T2), 1..N = inputs, COL_MARKERCHANNEL for markers
+    COL_MARKERS  marker bits, 0 for photons
+
+  Each column of a group is stored as bit-packed offsets from a base:
+  either frame of reference (value - min) or, if smaller, zigzag coded
+  differences to the previous value, as suits the time column. Every
+  column chunk carries its min and max, and every group a bitmap of the
+  channels in it, so readers skip groups that cannot match a query
+  (predicate pushdown) and decode only the columns they ask for. The
+  reader maps the file, nothing is read that is not needed.
+
+  The writer is a stdio stream of raw records, like the index in
+  tttrindex.h: ColumnOpen stacks it on the output stream of tttrmode
+  (ColumnFile), or takes NULL to convert files offline (../columns).
+  ../../Python/mhcolumns.py reads the archive with numpy,
+  ../../Matlab/mhcolumnsload.m with plain Matlab.
+
+  File layout, all little endian, chunks 8 byte aligned:
+
+    ColFileHeader
+    column chunks of the groups, ceil(rows * width / 64) uint64 words each
+    ColGroup[ngroups]
+    ColTrailer
+
+************************************************************************/
+
+#ifndef TTTRCOLUMNS_H
+#define TTTRCOLUMNS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tttrdecode.h"
+
+#define COL_MAGIC         0x4143484D   // "MHCA"
+#define COL_VERSION       1
+#define COL_GROUPROWS     131072
+#define COL_MARKERCHANNEL 255
+
+// columns
+#define COL_TIME          0
+#define COL_DTIME         1
+#define COL_CHANNEL       2
+#define COL_MARKERS       3
+#define COL_NUMCOLUMNS    4
+#define COL_WANT(col)     (1u << (col))
+
+// chunk encodings
+#define COL_FOR           0   // value = base + packed
+#define COL_DELTA         1   // value[0] = base, value[i] = value[i-1] + unzigzag(packed[i])
+
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t mode;                 // MODE_T2 or MODE_T3
+  uint32_t grouprows;
+  double resolution;            // ps per T2 time tag or T3 dtime bin
+  double syncperiod;            // ps, T3 only, 0 if unknown
+} ColFileHeader;
+
+typedef struct
+{
+  uint64_t offset;              // in the file
+  uint64_t bytes;
+  uint64_t min;
+  uint64_t max;
+  uint64_t base;
+  uint8_t encoding;             // COL_FOR or COL_DELTA
+  uint8_t width;                // bits per value, 0 = all equal to base
+  uint8_t reserved[6];
+} ColChunk;
+
+typedef struct
+{
+  uint64_t rows;
+  uint64_t channels;            // bit c: channel c (c < 63) occurs, bit 63: markers occur
+  ColChunk col[COL_NUMCOLUMNS];
+} ColGroup;
+
+typedef struct
+{
+  uint64_t footer;              // offset of ColGroup[0]
+  uint64_t ngroups;
+  uint64_t rows;
+  uint32_t magic;
+  uint32_t version;
+} ColTrailer;
+
+// what to read: rows with tmin <= time < tmax on channels in the mask
+typedef struct
+{
+  uint64_t tmin;
+  uint64_t tmax;
+  uint64_t channels;            // as ColGroup.channels
+  unsigned columns;             // COL_WANT(col) bits
+} ColQuery;
+
+// rows read, arrays of COL_GROUPROWS entries for the wanted columns
+typedef struct
+{
+  uint64_t* time;
+  uint16_t* dtime;
+  uint8_t* channel;
+  uint8_t* markers;
+} ColRows;
+
+typedef struct ColArchive ColArchive;
+
+
+// Stacks an archive writer on out, or writes only the archive if out
+// is NULL. fclose finishes the archive and closes out. NULL on error.
+FILE* ColumnOpen(FILE* out, const char* path, int mode, double resolution, double syncperiod);
+
+// Maps an archive for reading. NULL on error.
+ColArchive* ColOpen(const char* path);
+void ColClose(ColArchive* arch);
+const ColFileHeader* ColHeader(const ColArchive* arch);
+int64_t ColNumGroups(const ColArchive* arch);
+const ColGroup* ColGetGroup(const ColArchive* arch, int64_t g);
+
+// The first group from g on whose statistics allow a match, or -1.
+int64_t ColNextGroup(const ColArchive* arch, const ColQuery* q, int64_t g);
+
+// Decodes the rows of group g that match into rows, only the wanted
+// columns. Returns the number of rows, or -1 if the group is damaged.
+int64_t ColReadGroup(ColArchive* arch, const ColQuery* q, int64_t g, ColRows* rows);
+
+// Allocates or frees arrays for the columns in the mask.
+int ColAllocRows(ColRows* rows, unsigned columns);
+void ColFreeRows(ColRows* rows);
+
+#endif
@@ -0,0 +1,328 @@
+/************************************************************************
+
+  MultiHarp T2/T3 event record decoding, see tttrdecode.h
+
+  Record layout (bit 31 first):
+
+    T2:  special:1  channel:6  timetag:25
+    T3:  special:1  channel:6  dtime:15  nsync:10
+
+  Special records with channel 0x3F are overflows, the number of
+  overflows is stored in the timetag (T2) or nsync (T3) field. Special
+  records with channel 1..15 are markers, in T2 channel 0 is the sync.
+  Channel 0x3E carries segment blocks, see tttrdecode.h.
+
+  The batch decoders use shifts and masks instead of bitfields, which
+  gives the compiler a loop it can keep entirely in registers.
+
+************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+
+
+void DecoderInit(TTTRDecoder* dec, int mode, double resolution, double syncperiod)
+{
+  memset(dec, 0, sizeof(TTTRDecoder));
+  dec->TimeUnit = (mode == MODE_T2) ? resolution : syncperiod;
+}
+
+
+void DecoderReset(TTTRDecoder* dec)
+{
+  dec->OflCorrection = 0;
+  dec->SegFill = 0;
+  dec->HaveFirst = 0;
+  memset(&dec->First, 0, sizeof(SegmentInfo));
+}
+
+
+void SegmentEncode(const SegmentInfo* segment, unsigned int* records)
+{
+  uint16_t w[SEGMENT_WORDS];
+  int i;
+
+  w[0] = SEGMENT_MAGIC;
+  w[1] = (uint16_t)segment->Segment;
+  w[2] = (uint16_t)(segment->Segment >> 16);
+  w[3] = (uint16_t)segment->RefSource;
+  for (i = 0; i < 3; i++)
+  {
+    w[4 + 2 * i] = (uint16_t)segment->StartTime[i];
+    w[5 + 2 * i] = (uint16_t)(segment->StartTime[i] >> 16);
+  }
+  for (i = 0; i < 4; i++)
+  {
+    w[10 + i] = (uint16_t)(segment->LostTime >> (16 * i));
+    w[14 + i] = (uint16_t)(segment->LostEvents >> (16 * i));
+  }
+  for (i = 0; i < SEGMENT_WORDS; i++)
+  {
+    records[i] = 0x80000000u | (SEGMENT_CHANNEL << 25) | ((unsigned int)i << 16) | w[i];
+  }
+}
+
+
+static unsigned __int128 StartPs(const SegmentInfo* s)
+{
+  return ((unsigned __int128)s->StartTime[2] << 64) | ((unsigned __int128)s->StartTime[1] << 32)
+    | s->StartTime[0];
+}
+
+
+// collects one word of a segment block, returns the new overflow
+// correction once the block is complete
+static uint64_t SegmentWord(TTTRDecoder* dec, unsigned int record, uint64_t ofl, uint64_t wrap)
+{
+  int i = (record >> 16) & 0x1FF;
+  uint16_t* w = dec->SegWords;
+  SegmentInfo s;
+  unsigned __int128 start, first;
+  double steps;
+  int k;
+
+  if ((i != dec->SegFill) || (i >= SEGMENT_WORDS))
+  {
+    dec->SegFill = 0;  // out of sequence, drop the block
+    return ofl;
+  }
+  w[i] = (uint16_t)record;
+  dec->SegFill++;
+  if ((dec->SegFill < SEGMENT_WORDS) || (w[0] != SEGMENT_MAGIC))
+  {
+    return ofl;
+  }
+  dec->SegFill = 0;
+
+  s.Segment = w[1] | ((uint32_t)w[2] << 16);
+  s.RefSource = (int16_t)w[3];
+  s.LostTime = 0;
+  s.LostEvents = 0;
+  for (k = 0; k < 3; k++)
+  {
+    s.StartTime[k] = w[4 + 2 * k] | ((uint32_t)w[5 + 2 * k] << 16);
+  }
+  for (k = 0; k < 4; k++)
+  {
+    s.LostTime |= (uint64_t)w[10 + k] << (16 * k);
+    s.LostEvents |= (uint64_t)w[14 + k] << (16 * k);
+  }
+
+  if (s.Segment == 0)
+  {
+    dec->First = s;
+    dec->HaveFirst = 1;
+  }
+  else
+  {
+    // the start times only count from segment 0 of the same run, a
+    // decoder that joined later has no reference for them
+    steps = 0;
+    if (dec->HaveFirst && (dec->TimeUnit > 0))
+    {
+      start = StartPs(&s);
+      first = StartPs(&dec->First);
+      steps = (start > first) ? (double)(start - first) / dec->TimeUnit : 0;
+    }
+    // never behind the records of the last segment
+    ofl = ((steps > ofl + wrap) && (steps < 1.8e19)) ? (uint64_t)steps : ofl + wrap;
+  }
+  if (dec->GotSegment)
+  {
+    dec->GotSegment(dec->User, &s);
+  }
+  return ofl;
+}
+
+
+void ProcessT2(TTTRDecoder* dec, unsigned int record)
+{
+  int ch;
+  uint64_t truetime;
+
+  union
+  {
+    unsigned allbits;
+    struct
+    {
+      unsigned timetag  :25;
+      unsigned channel  :6;
+      unsigned special  :1; // or sync, if channel==0
+    } bits;
+  } T2Rec;
+
+  T2Rec.allbits = record;
+
+  if (T2Rec.bits.special == 1)
+  {
+    if (T2Rec.bits.channel == 0x3F) //an overflow record
+    {
+      //number of overflows is stored in timetag
+      dec->OflCorrection += (uint64_t)T2WRAPAROUND * T2Rec.bits.timetag;
+    }
+    if ((T2Rec.bits.channel >= 1) && (T2Rec.bits.channel <= 15)) //markers
+    {
+      truetime = dec->OflCorrection + T2Rec.bits.timetag;
+      //Note that actual marker tagging accuracy is only some ns.
+      if (dec->GotMarker)
+      {
+        dec->GotMarker(dec->User, truetime, T2Rec.bits.channel);
+      }
+    }
+    if (T2Rec.bits.channel == SEGMENT_CHANNEL) //a new measurement segment
+    {
+      dec->OflCorrection = SegmentWord(dec, record, dec->OflCorrection, T2WRAPAROUND);
+    }
+    if (T2Rec.bits.channel == 0) //sync
+    {
+      truetime = dec->OflCorrection + T2Rec.bits.timetag;
+      ch = 0; //we encode the Sync channel as 0
+      dec->GotPhoton(dec->User, truetime, ch, 0);
+    }
+  }
+  else //regular input channel
+  {
+    truetime = dec->OflCorrection + T2Rec.bits.timetag;
+    ch = T2Rec.bits.channel + 1; //we encode the regular channels as 1..N
+    dec->GotPhoton(dec->User, truetime, ch, 0);
+  }
+}
+
+
+void ProcessT3(TTTRDecoder* dec, unsigned int record)
+{
+  int ch, dt;
+  uint64_t truensync;
+
+  union
+  {
+    unsigned allbits;
+    struct
+    {
+      unsigned nsync    :10;  // number of sync period
+      unsigned dtime    :15;  // delay from last sync in units of chosen resolution
+      unsigned channel  :6;
+      unsigned special  :1;
+    } bits;
+  } T3Rec;
+
+  T3Rec.allbits = record;
+
+  if (T3Rec.bits.special == 1)
+  {
+    if (T3Rec.bits.channel == 0x3F) //overflow
+    {
+      //number of overflows is stored in nsync
+      dec->OflCorrection += (uint64_t)T3WRAPAROUND * T3Rec.bits.nsync;
+    }
+    if ((T3Rec.bits.channel >= 1) && (T3Rec.bits.channel <= 15)) //markers
+    {
+      truensync = dec->OflCorrection + T3Rec.bits.nsync;
+      //the time unit depends on sync period
+      if (dec->GotMarker)
+      {
+        dec->GotMarker(dec->User, truensync, T3Rec.bits.channel);
+      }
+    }
+    if (T3Rec.bits.channel == SEGMENT_CHANNEL) //a new measurement segment
+    {
+      dec->OflCorrection = SegmentWord(dec, record, dec->OflCorrection, T3WRAPAROUND);
+    }
+  }
+  else //regular input channel
+  {
+    truensync = dec->OflCorrection + T3Rec.bits.nsync;
+    ch = T3Rec.bits.channel + 1; //we encode the input channels as 1..N
+    dt = T3Rec.bits.dtime;
+    //truensync indicates the number of the sync period this event was in
+    //the dtime unit depends on the chosen resolution (binning)
+    dec->GotPhoton(dec->User, truensync, ch, dt);
+  }
+}
+
+
+int DecodeT2(TTTRDecoder* dec, const unsigned int* records, int n, TTTREvent* events)
+{
+  uint64_t ofl = dec->OflCorrection;
+  TTTREvent* ev = events;
+  unsigned int rec, ch;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    rec = records[i];
+    ch = (rec >> 25) & 0x3F;
+    if (rec & 0x80000000)
+    {
+      if (ch == 0x3F)
+      {
+        ofl += (uint64_t)T2WRAPAROUND * (rec & 0x1FFFFFF);
+        continue;
+      }
+      if (ch > 15)
+      {
+        if (ch == SEGMENT_CHANNEL)
+        {
+          ofl = SegmentWord(dec, rec, ofl, T2WRAPAROUND);
+        }
+        continue;
+      }
+      ch = ch ? (EVENT_MARKER | ch) : 0;
+    }
+    else
+    {
+      ch++;
+    }
+    ev->Time = ofl + (rec & 0x1FFFFFF);
+    ev->Channel = ch;
+    ev->DTime = 0;
+    ev++;
+  }
+  dec->OflCorrection = ofl;
+  return (int)(ev - events);
+}
+
+
+int DecodeT3(TTTRDecoder* dec, const unsigned int* records, int n, TTTREvent* events)
+{
+  uint64_t ofl = dec->OflCorrection;
+  TTTREvent* ev = events;
+  unsigned int rec, ch;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    rec = records[i];
+    ch = (rec >> 25) & 0x3F;
+    if (rec & 0x80000000)
+    {
+      if (ch == 0x3F)
+      {
+        ofl += (uint64_t)T3WRAPAROUND * (rec & 0x3FF);
+        continue;
+      }
+      if ((ch == 0) || (ch > 15))
+      {
+        if (ch == SEGMENT_CHANNEL)
+        {
+          ofl = SegmentWord(dec, rec, ofl, T3WRAPAROUND);
+        }
+        continue;
+      }
+      ev->Channel = EVENT_MARKER | ch;
+      ev->DTime = 0;
+    }
+    else
+    {
+      ev->Channel = ch + 1;
+      ev->DTime = (rec >> 10) & 0x7FFF;
+    }
+    ev->Time = ofl + (rec & 0x3FF);
+    ev++;
+  }
+  dec->OflCorrection = ofl;
+  return (int)(ev - events);
+}
@@ -0,0 +1,101 @@
+/************************************************************************
+
+  MultiHarp T2/T3 event record decoding
+
+  ProcessT2 and ProcessT3 dissect one record at a time and report photons
+  and markers through callbacks, as in the instant processing demos of
+  the Windows distribution. DecodeT2 and DecodeT3 do the same for a whole
+  buffer of records into an array of events, which is considerably faster
+  and what the processing stages in this directory build on.
+
+  Channel numbering follows the demos: 0 is the sync channel (T2 only),
+  1..N are the regular input channels, corresponding to the front panel
+  labelling. Marker events carry the marker bits ORed with EVENT_MARKER.
+
+  Segment blocks: when tttrmode recovers from a FIFO overrun it restarts
+  the measurement, and the device time tags start again from zero. So
+  that the file stays usable, every measurement segment begins with a
+  block of SEGMENT_WORDS special records on channel SEGMENT_CHANNEL,
+  which the hardware never uses and older decoders skip. Each record
+  carries a word index in bits 16..24 and 16 bits of a SegmentInfo in
+  bits 0..15. The decoders report complete blocks through GotSegment
+  and continue the time base across the gap: from the start times if
+  TimeUnit is set and the decoder saw the block of segment 0, otherwise
+  by one wraparound. Either way the times keep increasing.
+
+************************************************************************/
+
+#ifndef TTTRDECODE_H
+#define TTTRDECODE_H
+
+#include <stdint.h>
+
+#define T2WRAPAROUND    33554432  // 2^25, timetag range in T2 mode
+#define T3WRAPAROUND    1024      // 2^10, nsync range in T3 mode
+#define T3MAXDTIME      32767     // dtime has 15 bits
+#define T3HISTBINS      32768     // all possible dtime values
+
+#define EVENT_MARKER    0x100     // Channel flag of marker events
+
+#define SEGMENT_CHANNEL 0x3E      // special records carrying a segment block
+#define SEGMENT_WORDS   18
+#define SEGMENT_MAGIC   0x5347
+
+
+// one decoded event
+typedef struct
+{
+  uint64_t Time;    // T2: overflow corrected time tag, T3: overflow corrected nsync
+  int Channel;      // 0 = sync, 1..N = input, EVENT_MARKER | markers
+  int DTime;        // T3 only, in units of the resolution
+} TTTREvent;
+
+// start of a measurement segment
+typedef struct
+{
+  uint32_t Segment;       // 0 for the first, then one per recovered overrun
+  int32_t RefSource;      // REFSRC_xxx the device was initialized with
+  uint32_t StartTime[3];  // ps, as from MH_GetStartTime, [0] is timedw0
+  uint64_t LostTime;      // ps between the end of the last segment and this start
+  uint64_t LostEvents;    // estimated from the count rates
+} SegmentInfo;
+
+typedef struct
+{
+  uint64_t OflCorrection;
+  // called for every photon, and for sync events in T2 (dtime is 0 in T2)
+  void (*GotPhoton)(void* user, uint64_t time, int channel, int dtime);
+  // called for every marker record, may be NULL
+  void (*GotMarker)(void* user, uint64_t time, int markers);
+  void* User;
+  // called for every segment block, may be NULL
+  void (*GotSegment)(void* user, const SegmentInfo* segment);
+  double TimeUnit;        // ps per T2 time tag or T3 sync period, 0 = unknown
+  SegmentInfo First;      // the block of segment 0
+  int HaveFirst;          // First is valid
+  uint16_t SegWords[SEGMENT_WORDS];
+  int SegFill;
+} TTTRDecoder;
+
+
+// Clears dec for a measurement in mode (MODE_T2 or MODE_T3) and sets
+// TimeUnit from the resolution or the sync period in ps, 0 if unknown.
+// Set the callbacks afterwards.
+void DecoderInit(TTTRDecoder* dec, int mode, double resolution, double syncperiod);
+
+// Resets the overflow correction, for a new measurement with the same
+// TimeUnit.
+void DecoderReset(TTTRDecoder* dec);
+
+void ProcessT2(TTTRDecoder* dec, unsigned int record);
+void ProcessT3(TTTRDecoder* dec, unsigned int record);
+
+// Decode n records into events and return the number of events. Overflow
+// records produce no event, so events needs room for n entries at most.
+int DecodeT2(TTTRDecoder* dec, const unsigned int* records, int n, TTTREvent* events);
+int DecodeT3(TTTRDecoder* dec, const unsigned int* records, int n, TTTREvent* events);
+
+// Encodes a segment block into SEGMENT_WORDS records.
+void SegmentEncode(const SegmentInfo* segment, unsigned int* records);
+
+#endif
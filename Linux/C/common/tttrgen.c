@@ -0,0 +1,635 @@
+/************************************************************************
+
+  Synthetic MultiHarp event record generator, see tttrgen.h
+
+  Events are produced in time slices of roughly GEN_SLICEEVENTS records.
+  Within a slice the photons are sorted (decay times and pair delays can
+  reorder them), merged with the sync and marker events and encoded into
+  records. Photons that fall behind the end of a slice are carried over
+  to the next one, so the record stream is always in time order.
+
+************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mhdefin.h"
+#include "tttrgen.h"
+
+
+#define GEN_SLICEEVENTS 16384
+#define GEN_MAXEVENTS   (4 * GEN_SLICEEVENTS)
+#define GEN_MAXOUT      (4 * GEN_MAXEVENTS)
+
+#define EXPTABBITS      12
+#define EXPTABSIZE      (1 << EXPTABBITS)
+
+#define NOEVENT         0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  uint64_t t;     // base resolution units
+  int ch;         // 1..MAXINPCHAN, API channel number + 1
+} GenEvent;
+
+struct GenState
+{
+  GenParams p;
+  uint64_t rng;
+  int nchan;                  // number of enabled channels
+  int chanmap[MAXINPCHAN];    // their numbers, 1..N
+  double syncperiod;          // at the sync input, base units
+  double divperiod;           // after the divider, base units
+  double binunit;             // T3 dtime unit in base units
+  double photonrate;          // all channels, per base unit
+  double recordrate;          // all records, per base unit
+  uint64_t slicelen;
+
+  uint64_t slicestart;        // everything before this has been encoded
+  uint64_t prevstart;         // start of the slice being delivered
+  double nextphoton;          // origin of the next photon
+  double nextpair;            // origin of the next photon pair
+  uint64_t nextsync;          // index of the next divided sync, T2 only
+  double nextmarker;
+  int markerbits;
+  uint64_t ofl;               // overflows encoded so far
+
+  GenEvent* ev;
+  GenEvent* carry;
+  int ncarry;
+  unsigned int* out;
+  int nout;
+  int outpos;
+
+  uint64_t photons;
+  uint64_t dropped;
+  double exptab[EXPTABSIZE + 1];
+};
+
+
+static inline uint64_t Rand64(GenState* g)
+{
+  // xorshift64*
+  g->rng ^= g->rng >> 12;
+  g->rng ^= g->rng << 25;
+  g->rng ^= g->rng >> 27;
+  return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+
+static inline double RandUniform(GenState* g)
+{
+  return (Rand64(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+// standard exponential deviate by table lookup, much cheaper than log()
+static inline double RandExp(GenState* g)
+{
+  uint64_t r = Rand64(g);
+  unsigned int i = (unsigned int)(r >> (64 - EXPTABBITS));
+  double frac = (double)(r & 0xFFFFFFFF) * (1.0 / 4294967296.0);
+  return g->exptab[i] + (g->exptab[i + 1] - g->exptab[i]) * frac;
+}
+
+
+// approximately gaussian deviate, sigma 1 (Irwin-Hall with 4 terms)
+static inline double RandGauss(GenState* g)
+{
+  uint64_t r = Rand64(g);
+  double s = (double)(r & 0xFFFF) + (double)((r >> 16) & 0xFFFF)
+    + (double)((r >> 32) & 0xFFFF) + (double)(r >> 48);
+  return (s * (1.0 / 65536.0) - 2.0) * 1.7320508075688772;
+}
+
+
+void GenDefaults(GenParams* p)
+{
+  memset(p, 0, sizeof(GenParams));
+  p->Mode = MODE_T2;
+  p->Source = GEN_PULSED;
+  p->NumChannels = 8;
+  p->ChannelMask = ~0ULL;
+  p->BaseResolution = 5.0;
+  p->Binning = 0;
+  p->SyncRate = 1e6;
+  p->SyncDivider = 1;
+  p->CountRate = 1e5;
+  p->Lifetime = 2000.0;
+  p->IrfWidth = 50.0;
+  p->CorrDelay = 0.0;
+  p->MarkerRate = 0.0;
+  p->MarkerMask = 0;
+  p->Seed = 0x5EED5EED12345678ULL;
+}
+
+
+int GenActiveChannels(const GenParams* p)
+{
+  int i, n = 0;
+  for (i = 0; (i < p->NumChannels) && (i < MAXINPCHAN); i++)
+  {
+    if ((p->ChannelMask >> i) & 1)
+    {
+      n++;
+    }
+  }
+  return n;
+}
+
+
+double GenRecordRate(const GenParams* p)
+{
+  double r = p->CountRate * GenActiveChannels(p);
+  double syncrate = p->SyncRate / p->SyncDivider;
+
+  if (p->Mode == MODE_T2)
+  {
+    r += syncrate;
+    r += 1e12 / (p->BaseResolution * T2WRAPAROUND);
+  }
+  else
+  {
+    r += syncrate / T3WRAPAROUND;
+  }
+  if (p->MarkerMask)
+  {
+    r += p->MarkerRate;
+  }
+  return r;
+}
+
+
+GenState* GenCreate(const GenParams* p)
+{
+  GenState* g;
+  int i;
+
+  g = (GenState*)calloc(1, sizeof(GenState));
+  if (g == NULL)
+  {
+    return NULL;
+  }
+  g->ev = (GenEvent*)malloc(GEN_MAXEVENTS * sizeof(GenEvent));
+  g->carry = (GenEvent*)malloc(GEN_MAXEVENTS * sizeof(GenEvent));
+  g->out = (unsigned int*)malloc(GEN_MAXOUT * sizeof(unsigned int));
+  if ((g->ev == NULL) || (g->carry == NULL) || (g->out == NULL))
+  {
+    GenFree(g);
+    return NULL;
+  }
+
+  g->p = *p;
+  if (g->p.SyncDivider < 1)
+  {
+    g->p.SyncDivider = 1;
+  }
+  g->rng = p->Seed ? p->Seed : 1;
+
+  for (i = 0; i < EXPTABSIZE; i++)
+  {
+    g->exptab[i] = -log(1.0 - (double)i / EXPTABSIZE);
+  }
+  g->exptab[EXPTABSIZE] = g->exptab[EXPTABSIZE - 1] + 1.0;  // tail cut off
+
+  for (i = 0; (i < p->NumChannels) && (i < MAXINPCHAN); i++)
+  {
+    if ((p->ChannelMask >> i) & 1)
+    {
+      g->chanmap[g->nchan++] = i + 1;
+    }
+  }
+
+  g->syncperiod = (p->SyncRate > 0) ? 1e12 / (p->SyncRate * p->BaseResolution) : 1e18;
+  g->divperiod = g->syncperiod * g->p.SyncDivider;
+  g->binunit = (double)(1 << p->Binning);
+  g->photonrate = p->CountRate * g->nchan * p->BaseResolution * 1e-12;
+  g->recordrate = GenRecordRate(&g->p) * p->BaseResolution * 1e-12;
+
+  // a slice holds about GEN_SLICEEVENTS records of all kinds
+  g->slicelen = (uint64_t)(GEN_SLICEEVENTS / g->recordrate);
+  if (g->slicelen < 1)
+  {
+    g->slicelen = 1;
+  }
+
+  g->nextphoton = (g->photonrate > 0) ? RandExp(g) / g->photonrate : 1e300;
+  g->nextpair = (g->photonrate > 0) ? RandExp(g) / g->photonrate : 1e300;
+  g->nextsync = 0;
+  g->markerbits = 0;
+  for (i = 0; i < 4; i++)
+  {
+    if ((p->MarkerMask >> i) & 1)
+    {
+      g->markerbits = 1 << i;  // the lowest enabled marker is used
+      break;
+    }
+  }
+  g->nextmarker = ((p->MarkerRate > 0) && g->markerbits)
+    ? 1e12 / (p->MarkerRate * p->BaseResolution) : 1e300;
+
+  return g;
+}
+
+
+void GenFree(GenState* g)
+{
+  if (g)
+  {
+    free(g->ev);
+    free(g->carry);
+    free(g->out);
+    free(g);
+  }
+}
+
+
+static inline void PutOverflows(GenState* g, uint64_t wrap)
+{
+  uint64_t n;
+  unsigned int maxcnt = (g->p.Mode == MODE_T2) ? (T2WRAPAROUND - 1) : (T3WRAPAROUND - 1);
+
+  while (wrap > g->ofl)
+  {
+    n = wrap - g->ofl;
+    if (n > maxcnt)
+    {
+      n = maxcnt;
+    }
+    g->out[g->nout++] = 0xFE000000u | (unsigned int)n;  // special, channel 0x3F
+    g->ofl += n;
+  }
+}
+
+
+// encodes one event, ch: 1..N photon, 0 sync, <0 marker bits
+static inline void PutEvent(GenState* g, uint64_t t, int ch)
+{
+  uint64_t nsync;
+  double dt;
+
+  if (g->p.Mode == MODE_T2)
+  {
+    PutOverflows(g, t / T2WRAPAROUND);
+    if (ch > 0)
+    {
+      g->out[g->nout++] = ((unsigned int)(ch - 1) << 25) | (unsigned int)(t % T2WRAPAROUND);
+    }
+    else
+    {
+      g->out[g->nout++] = 0x80000000u | ((unsigned int)(-ch) << 25)
+        | (unsigned int)(t % T2WRAPAROUND);
+    }
+    return;
+  }
+
+  // T3: the time is expressed as sync count and delay after that sync
+  nsync = (uint64_t)(t / g->divperiod);
+  PutOverflows(g, nsync / T3WRAPAROUND);
+  if (ch > 0)
+  {
+    dt = (t - nsync * g->divperiod) / g->binunit;
+    if (dt < 0)
+    {
+      dt = 0;  // rounding at the sync boundary
+    }
+    if (dt > T3MAXDTIME)
+    {
+      g->dropped++;
+      return;
+    }
+    g->out[g->nout++] = ((unsigned int)(ch - 1) << 25) | ((unsigned int)dt << 10)
+      | (unsigned int)(nsync % T3WRAPAROUND);
+  }
+  else
+  {
+    g->out[g->nout++] = 0x80000000u | ((unsigned int)(-ch) << 25)
+      | (unsigned int)(nsync % T3WRAPAROUND);
+  }
+}
+
+
+static void GenSlice(GenState* g, uint64_t tend)
+{
+  uint64_t start = g->slicestart;
+  uint64_t end = start + g->slicelen;
+  double origin, t, next;
+  GenEvent e;
+  int n, i, j, m;
+  int syncs = (g->p.Mode == MODE_T2) && (g->p.SyncRate > 0);
+  uint64_t ts, tm;
+
+  if (end > tend)
+  {
+    end = tend;
+  }
+
+  // photons carried over from the previous slice come first
+  memcpy(g->ev, g->carry, g->ncarry * sizeof(GenEvent));
+  n = g->ncarry;
+  g->ncarry = 0;
+
+  if (g->nchan > 0)
+  {
+    switch (g->p.Source)
+    {
+    case GEN_PULSED:
+      while ((g->nextphoton < end) && (n < GEN_MAXEVENTS))
+      {
+        // excited by the next laser pulse, then decay plus IRF jitter
+        origin = ceil(g->nextphoton / g->syncperiod) * g->syncperiod;
+        t = origin + (g->p.Lifetime * RandExp(g) + g->p.IrfWidth * RandGauss(g))
+          / g->p.BaseResolution;
+        g->ev[n].t = (t > start) ? (uint64_t)t : start;
+        g->ev[n].ch = g->chanmap[Rand64(g) % g->nchan];
+        n++;
+        g->nextphoton += RandExp(g) / g->photonrate;
+      }
+      break;
+
+    case GEN_CORRELATED:
+      while (((g->nextphoton < end) || (g->nextpair < end)) && (n < GEN_MAXEVENTS - 1))
+      {
+        if (g->nextphoton < g->nextpair)
+        {
+          // uncorrelated background, half of the rate
+          g->ev[n].t = (uint64_t)g->nextphoton;
+          g->ev[n].ch = g->chanmap[Rand64(g) % g->nchan];
+          n++;
+          g->nextphoton += 2.0 * RandExp(g) / g->photonrate;
+        }
+        else
+        {
+          // a pair on the first two enabled channels, the other half
+          g->ev[n].t = (uint64_t)g->nextpair;
+          g->ev[n].ch = g->chanmap[0];
+          n++;
+          if (g->nchan > 1)
+          {
+            t = g->nextpair + (g->p.CorrDelay + g->p.IrfWidth * RandGauss(g))
+              / g->p.BaseResolution;
+            g->ev[n].t = (t > start) ? (uint64_t)t : start;
+            g->ev[n].ch = g->chanmap[1];
+            n++;
+          }
+          g->nextpair += 2.0 * g->nchan * RandExp(g) / g->photonrate;
+        }
+      }
+      break;
+
+    default:  // GEN_POISSON
+      while ((g->nextphoton < end) && (n < GEN_MAXEVENTS))
+      {
+        g->ev[n].t = (uint64_t)g->nextphoton;
+        g->ev[n].ch = g->chanmap[Rand64(g) % g->nchan];
+        n++;
+        g->nextphoton += RandExp(g) / g->photonrate;
+      }
+      break;
+    }
+
+    if (n >= GEN_MAXEVENTS - 1)
+    {
+      // rate fluctuation filled the event buffer, end the slice early
+      next = (g->nextphoton < g->nextpair) ? g->nextphoton : g->nextpair;
+      if ((uint64_t)next < end)
+      {
+        end = (uint64_t)next;
+      }
+      if (end <= start)
+      {
+        end = start + 1;
+      }
+    }
+  }
+
+  // insertion sort, the photons are almost in order
+  for (i = 1; i < n; i++)
+  {
+    e = g->ev[i];
+    j = i - 1;
+    while ((j >= 0) && (g->ev[j].t > e.t))
+    {
+      g->ev[j + 1] = g->ev[j];
+      j--;
+    }
+    g->ev[j + 1] = e;
+  }
+
+  // photons at or after the slice end belong to the next slice
+  m = n;
+  while ((m > 0) && (g->ev[m - 1].t >= end))
+  {
+    m--;
+  }
+  memcpy(g->carry, g->ev + m, (n - m) * sizeof(GenEvent));
+  g->ncarry = n - m;
+
+  // merge photons, syncs and markers in time order and encode them
+  g->nout = 0;
+  g->outpos = 0;
+  i = 0;
+  while (1)
+  {
+    ts = NOEVENT;
+    if (syncs)
+    {
+      ts = (uint64_t)(g->nextsync * g->divperiod);
+      if (ts >= end)
+      {
+        ts = NOEVENT;
+      }
+    }
+    tm = (g->nextmarker < end) ? (uint64_t)g->nextmarker : NOEVENT;
+
+    if ((i < m) && (g->ev[i].t <= ts) && (g->ev[i].t <= tm))
+    {
+      PutEvent(g, g->ev[i].t, g->ev[i].ch);
+      g->photons++;
+      i++;
+    }
+    else if ((ts != NOEVENT) && (ts <= tm))
+    {
+      PutEvent(g, ts, 0);
+      g->nextsync++;
+    }
+    else if (tm != NOEVENT)
+    {
+      PutEvent(g, tm, -g->markerbits);
+      g->nextmarker += 1e12 / (g->p.MarkerRate * g->p.BaseResolution);
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  // let the consumer see time passing even without events
+  if (g->p.Mode == MODE_T2)
+  {
+    PutOverflows(g, end / T2WRAPAROUND);
+  }
+  else
+  {
+    PutOverflows(g, (uint64_t)(end / g->divperiod) / T3WRAPAROUND);
+  }
+
+  g->prevstart = start;
+  g->slicestart = end;
+}
+
+
+int GenRead(GenState* g, double tend, unsigned int* buffer, int maxrec)
+{
+  uint64_t tendunits;
+  int total = 0;
+  int n;
+
+  // far future (as fast as possible) must not overflow the conversion
+  tend /= g->p.BaseResolution;
+  tendunits = (tend < 9e18) ? (uint64_t)tend : 9000000000000000000ULL;
+
+  while (total < maxrec)
+  {
+    if (g->outpos == g->nout)
+    {
+      if (g->slicestart >= tendunits)
+      {
+        break;
+      }
+      GenSlice(g, tendunits);
+      continue;
+    }
+    n = g->nout - g->outpos;
+    if (n > maxrec - total)
+    {
+      n = maxrec - total;
+    }
+    memcpy(buffer + total, g->out + g->outpos, n * sizeof(unsigned int));
+    g->outpos += n;
+    total += n;
+  }
+  return total;
+}
+
+
+double GenTime(const GenState* g)
+{
+  double t = (double)g->slicestart;
+
+  if (g->outpos < g->nout)  // part of the last slice is still pending
+  {
+    t = g->prevstart + (double)(g->slicestart - g->prevstart) * g->outpos / g->nout;
+  }
+  return t * g->p.BaseResolution;
+}
+
+
+uint64_t GenPhotons(const GenState* g)
+{
+  return g->photons;
+}
+
+
+uint64_t GenDropped(const GenState* g)
+{
+  return g->dropped;
+}
+
+
+static unsigned int RandPoisson(GenState* g, double mu)
+{
+  double l, p, x;
+  unsigned int k;
+
+  if (mu <= 0)
+  {
+    return 0;
+  }
+  if (mu < 30)
+  {
+    l = exp(-mu);
+    k = 0;
+    p = RandUniform(g);
+    while (p > l)
+    {
+      k++;
+      p *= RandUniform(g);
+    }
+    return k;
+  }
+  x = mu + sqrt(mu) * RandGauss(g) + 0.5;
+  if (x < 0)
+  {
+    return 0;
+  }
+  return (x > 4294967295.0) ? 0xFFFFFFFF : (unsigned int)x;
+}
+
+
+// probability density of the photon delay after a laser pulse, per ps
+static double DecayDensity(const GenParams* p, double t)
+{
+  double tau = p->Lifetime;
+  double s = p->IrfWidth;
+
+  if (tau <= 0)
+  {
+    return (s > 0) ? exp(-0.5 * t * t / (s * s)) / (s * 2.5066282746310002) : 0;
+  }
+  if (s <= 0)
+  {
+    return (t < 0) ? 0 : exp(-t / tau) / tau;
+  }
+  // exponential decay convolved with a gaussian IRF
+  return 0.5 / tau * exp((s * s) / (2 * tau * tau) - t / tau)
+    * erfc((s / tau - t / s) / 1.4142135623730951);
+}
+
+
+void GenHistogram(GenState* g, int channel, double seconds, int offset,
+  unsigned int* counts, int histlen)
+{
+  const GenParams* p = &g->p;
+  double binwidth = p->BaseResolution * (1 << p->Binning);  // ps
+  double laserperiod = (p->SyncRate > 0) ? 1e12 / p->SyncRate : 1e12;
+  double syncperiod = laserperiod * p->SyncDivider;
+  double nphotons = p->CountRate * seconds;
+  double t, d, mass, sum;
+  long k, kmin;
+  unsigned int c;
+  int j;
+
+  if ((channel < 0) || (channel >= p->NumChannels) || !((p->ChannelMask >> channel) & 1))
+  {
+    return;
+  }
+
+  for (j = 0; j < histlen; j++)
+  {
+    t = offset * 1000.0 + (j + 0.5) * binwidth;  // bin center after the sync
+    if (t >= syncperiod)
+    {
+      break;  // nothing beyond the next sync
+    }
+    if (p->Source == GEN_PULSED)
+    {
+      // contributions of all laser pulses, including decay tails of earlier ones
+      sum = 0;
+      kmin = (long)floor((t - 20 * p->Lifetime - 10 * p->IrfWidth) / laserperiod);
+      for (k = (long)floor((t + 10 * p->IrfWidth) / laserperiod); k >= kmin; k--)
+      {
+        d = DecayDensity(p, t - k * laserperiod);
+        sum += d;
+      }
+      mass = sum * binwidth / p->SyncDivider;
+    }
+    else
+    {
+      mass = binwidth / syncperiod;  // flat
+    }
+    c = RandPoisson(g, nphotons * mass);
+    counts[j] = (counts[j] > 0xFFFFFFFF - c) ? 0xFFFFFFFF : counts[j] + c;
+  }
+}
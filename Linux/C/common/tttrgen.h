@@ -0,0 +1,94 @@
+/************************************************************************
+
+  Synthetic MultiHarp event record generator
+
+  Produces bit-exact T2 and T3 records (including overflow, sync and
+  marker records) from simple photon source models. It is used by the
+  simulated device library (../mhsim) and by the benchmark and stress
+  tools, so that the demo code paths can be exercised without hardware.
+
+  Source models:
+
+    GEN_POISSON     uncorrelated photons at a constant rate on all
+                    enabled channels
+    GEN_PULSED      pulsed laser excitation at the sync rate, photons
+                    arrive with an exponential decay convolved with a
+                    gaussian IRF
+    GEN_CORRELATED  uncorrelated background at half the count rate on
+                    all channels, plus photon pairs at half the count
+                    rate on the first two enabled channels, separated
+                    by CorrDelay
+
+  All times inside the generator are in units of the base resolution.
+
+************************************************************************/
+
+#ifndef TTTRGEN_H
+#define TTTRGEN_H
+
+#include <stdint.h>
+
+#include "tttrdecode.h"
+
+#define GEN_POISSON     0
+#define GEN_PULSED      1
+#define GEN_CORRELATED  2
+
+
+typedef struct
+{
+  int Mode;               // MODE_T2 or MODE_T3
+  int Source;             // GEN_xxx
+  int NumChannels;        // photons are spread evenly over channels 1..N
+  uint64_t ChannelMask;   // bit i enables input channel i (API numbering)
+  double BaseResolution;  // ps, the unit of T2 timetags
+  int Binning;            // T3 dtime unit is BaseResolution * 2^Binning
+  double SyncRate;        // Hz at the sync input
+  int SyncDivider;
+  double CountRate;       // cps per enabled channel
+  double Lifetime;        // ps, pulsed source
+  double IrfWidth;        // ps (sigma), pulsed and correlated source
+  double CorrDelay;       // ps, channel 2 after channel 1, correlated source
+  double MarkerRate;      // Hz, 0 = no markers
+  int MarkerMask;         // enabled markers, bits 0..3, see MH_SetMarkerEnable
+  uint64_t Seed;
+} GenParams;
+
+typedef struct GenState GenState;
+
+
+// Fills in sensible defaults (T2, pulsed source, 8 channels).
+void GenDefaults(GenParams* p);
+
+// Creates a generator at time 0. Returns NULL if out of memory.
+GenState* GenCreate(const GenParams* p);
+void GenFree(GenState* g);
+
+// Writes the records of all events up to tend (ps since the start), but at
+// most maxrec of them. Returns the number of records written. If less than
+// maxrec are returned, all records up to tend have been delivered.
+int GenRead(GenState* g, double tend, unsigned int* buffer, int maxrec);
+
+// Time in ps up to which records have been delivered by GenRead.
+double GenTime(const GenState* g);
+
+// Number of photon events (excluding sync, marker and overflow records)
+// delivered so far, and the number of events dropped because their dtime
+// was out of range in T3 mode.
+uint64_t GenPhotons(const GenState* g);
+uint64_t GenDropped(const GenState* g);
+
+// Expected number of records per second for these parameters, including
+// sync records in T2 mode, markers and overflow records.
+double GenRecordRate(const GenParams* p);
+
+// Number of enabled channels with photons.
+int GenActiveChannels(const GenParams* p);
+
+// Adds a histogram of the photons of input channel (0..N-1) measured for
+// the given time to counts, as the device would in histogramming mode.
+// Bin width is BaseResolution * 2^Binning, offset in ns as in MH_SetOffset.
+void GenHistogram(GenState* g, int channel, double seconds, int offset,
+  unsigned int* counts, int histlen);
+
+#endif
@@ -0,0 +1,372 @@
+/************************************************************************
+
+  Time index of recorded MultiHarp T2/T3 files, see tttrindex.h
+
+************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mhdefin.h"
+#include "tttrindex.h"
+
+
+#define CHUNK  4096   // records decoded at a time between entries
+
+
+typedef struct
+{
+  FILE* out;
+  FILE* idx;
+  IndexHeader hdr;
+  TTTRDecoder dec;
+  uint64_t record;              // records indexed so far
+  uint64_t next;                // record of the next regular entry
+  uint64_t lasttime;
+  uint64_t* counts;
+  TTTREvent* events;
+  unsigned char partial[4];     // a record split across two writes
+  int npartial;
+  int failed;
+} IndexWriter;
+
+
+static void Count(IndexWriter* w, const unsigned int* records, int n)
+{
+  int i, m, nev;
+
+  while (n > 0)
+  {
+    m = (n < CHUNK) ? n : CHUNK;
+    nev = (w->hdr.mode == MODE_T2) ? DecodeT2(&w->dec, records, m, w->events)
+      : DecodeT3(&w->dec, records, m, w->events);
+    for (i = 0; i < nev; i++)
+    {
+      if (w->events[i].Channel & EVENT_MARKER)
+      {
+        w->counts[w->hdr.ncounts - 1]++;
+      }
+      else if ((unsigned)w->events[i].Channel < w->hdr.ncounts - 1)
+      {
+        w->counts[w->events[i].Channel]++;
+      }
+    }
+    if (nev > 0)
+    {
+      w->lasttime = w->events[nev - 1].Time;
+    }
+    records += m;
+    n -= m;
+  }
+}
+
+
+static void Entry(IndexWriter* w, uint64_t record, uint32_t flags, uint32_t markers)
+{
+  IndexEntry e;
+
+  memset(&e, 0, sizeof(e));
+  e.record = record;
+  e.oflcorrection = w->dec.OflCorrection;
+  e.time = w->lasttime;
+  e.flags = flags;
+  e.markers = markers;
+  if ((fwrite(&e, sizeof(e), 1, w->idx) != 1)
+    || (fwrite(w->counts, sizeof(uint64_t), w->hdr.ncounts, w->idx) != w->hdr.ncounts))
+  {
+    w->failed = 1;
+  }
+}
+
+
+// the per record work is a compare and a bit test, records are decoded
+// in runs between entries
+static void Index(IndexWriter* w, const unsigned int* records, int n)
+{
+  unsigned int ch;
+  uint32_t flags, markers;
+  int i, start = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    flags = (w->record + i >= w->next) ? INDEX_INTERVAL : 0;
+    ch = (records[i] >> 25) & 0x3F;
+    markers = 0;
+    if ((records[i] & 0x80000000u) && (ch >= 1) && (ch <= 15) && (ch & w->hdr.markermask))
+    {
+      flags |= INDEX_MARKER;
+      markers = ch;
+    }
+    if (flags)
+    {
+      Count(w, records + start, i - start);
+      start = i;
+      if (w->dec.SegFill && !(flags & INDEX_MARKER))
+      {
+        continue;  // inside a segment block, try the next record
+      }
+      Entry(w, w->record + i, flags, markers);
+      if (flags & INDEX_INTERVAL)
+      {
+        w->next = w->record + i + w->hdr.interval;
+      }
+    }
+  }
+  Count(w, records + start, n - start);
+  w->record += n;
+}
+
+
+static ssize_t IndexWrite(void* cookie, const char* buf, size_t size)
+{
+  IndexWriter* w = (IndexWriter*)cookie;
+  unsigned int rec;
+  size_t i, n, left = size;
+
+  if (fwrite(buf, 1, size, w->out) != size)
+  {
+    return 0;
+  }
+  while ((w->npartial > 0) && (left > 0))
+  {
+    w->partial[w->npartial++] = (unsigned char)*buf++;
+    left--;
+    if (w->npartial == 4)
+    {
+      memcpy(&rec, w->partial, 4);
+      Index(w, &rec, 1);
+      w->npartial = 0;
+    }
+  }
+  n = left / 4;
+  if (((uintptr_t)buf & 3) == 0)
+  {
+    Index(w, (const unsigned int*)buf, (int)n);
+  }
+  else
+  {
+    for (i = 0; i < n; i++)
+    {
+      memcpy(&rec, buf + 4 * i, 4);
+      Index(w, &rec, 1);
+    }
+  }
+  buf += 4 * n;
+  left -= 4 * n;
+  while (left > 0)
+  {
+    w->partial[w->npartial++] = (unsigned char)*buf++;
+    left--;
+  }
+  return (ssize_t)size;
+}
+
+
+static int IndexClose(void* cookie)
+{
+  IndexWriter* w = (IndexWriter*)cookie;
+  int ret = 0;
+
+  Entry(w, w->record, INDEX_END, 0);
+  if ((fclose(w->idx) != 0) || w->failed)
+  {
+    ret = EOF;
+  }
+  if (fclose(w->out) != 0)
+  {
+    ret = EOF;
+  }
+  free(w->counts);
+  free(w->events);
+  free(w);
+  return ret;
+}
+
+
+FILE* IndexOpen(FILE* out, const char* idxpath, int mode, int ninputs, uint32_t interval,
+  uint32_t markermask, double resolution, double syncperiod)
+{
+  cookie_io_functions_t io = { NULL, IndexWrite, NULL, IndexClose };
+  IndexWriter* w;
+  FILE* fp;
+
+  w = (IndexWriter*)calloc(1, sizeof(IndexWriter));
+  if (w == NULL)
+  {
+    return NULL;
+  }
+  w->out = out;
+  w->hdr.magic = INDEX_MAGIC;
+  w->hdr.version = INDEX_VERSION;
+  w->hdr.mode = mode;
+  w->hdr.ncounts = ninputs + 2;
+  w->hdr.interval = interval ? interval : 0xFFFFFFFF;
+  w->hdr.markermask = markermask;
+  w->hdr.resolution = resolution;
+  w->hdr.syncperiod = syncperiod;
+  DecoderInit(&w->dec, mode, resolution, syncperiod);
+  w->counts = (uint64_t*)calloc(w->hdr.ncounts, sizeof(uint64_t));
+  w->events = (TTTREvent*)malloc(CHUNK * sizeof(TTTREvent));
+  w->idx = fopen(idxpath, "wb");
+  if ((w->counts == NULL) || (w->events == NULL) || (w->idx == NULL)
+    || (fwrite(&w->hdr, sizeof(w->hdr), 1, w->idx) != 1))
+  {
+    if (w->idx)
+    {
+      fclose(w->idx);
+    }
+    free(w->counts);
+    free(w->events);
+    free(w);
+    return NULL;
+  }
+  fp = fopencookie(w, "w", io);
+  if (fp == NULL)
+  {
+    fclose(w->idx);
+    free(w->counts);
+    free(w->events);
+    free(w);
+    return NULL;
+  }
+  setvbuf(fp, NULL, _IONBF, 0);  // the writes pass on as they come
+  return fp;
+}
+
+
+TTTRIndex* IndexLoad(const char* idxpath)
+{
+  TTTRIndex* idx;
+  FILE* fp;
+  long size;
+
+  fp = fopen(idxpath, "rb");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  idx = (TTTRIndex*)calloc(1, sizeof(TTTRIndex));
+  if ((idx == NULL) || (fread(&idx->hdr, sizeof(IndexHeader), 1, fp) != 1)
+    || (idx->hdr.magic != INDEX_MAGIC) || (idx->hdr.version != INDEX_VERSION)
+    || (idx->hdr.ncounts < 2) || (idx->hdr.ncounts > MAXINPCHAN + 2)
+    || (fseek(fp, 0, SEEK_END) != 0) || ((size = ftell(fp)) < 0))
+  {
+    fclose(fp);
+    free(idx);
+    return NULL;
+  }
+  idx->stride = sizeof(IndexEntry) + idx->hdr.ncounts * sizeof(uint64_t);
+  idx->n = (size - (long)sizeof(IndexHeader)) / (long)idx->stride;  // a cut off last entry is dropped
+  idx->entries = (unsigned char*)malloc(idx->n * idx->stride + 1);
+  if ((idx->n == 0) || (idx->entries == NULL) || (fseek(fp, sizeof(IndexHeader), SEEK_SET) != 0)
+    || (fread(idx->entries, idx->stride, idx->n, fp) != (size_t)idx->n))
+  {
+    fclose(fp);
+    IndexFree(idx);
+    return NULL;
+  }
+  fclose(fp);
+  return idx;
+}
+
+
+void IndexFree(TTTRIndex* idx)
+{
+  if (idx)
+  {
+    free(idx->entries);
+    free(idx);
+  }
+}
+
+
+const IndexEntry* IndexGet(const TTTRIndex* idx, int64_t i)
+{
+  return (const IndexEntry*)(idx->entries + i * idx->stride);
+}
+
+
+const uint64_t* IndexCounts(const TTTRIndex* idx, int64_t i)
+{
+  return (const uint64_t*)(idx->entries + i * idx->stride + sizeof(IndexEntry));
+}
+
+
+int64_t IndexFindTime(const TTTRIndex* idx, uint64_t time)
+{
+  int64_t lo = 0, hi = idx->n, mid;
+
+  // the last entry whose preceding event is before time; an event
+  // exactly at time may be the one just before the next entry
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (IndexGet(idx, mid)->time < time)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+int64_t IndexFindMarker(const TTTRIndex* idx, uint64_t k)
+{
+  int64_t lo = 0, hi = idx->n, mid;
+  int m = idx->hdr.ncounts - 1;
+
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if (IndexCounts(idx, mid)[m] <= k)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+int IndexSeek(const TTTRIndex* idx, int64_t i, FILE* fp, TTTRDecoder* dec)
+{
+  const IndexEntry* e = IndexGet(idx, i);
+  unsigned int block[SEGMENT_WORDS];
+  TTTREvent events[SEGMENT_WORDS];
+  TTTRDecoder first;
+
+  DecoderInit(dec, idx->hdr.mode, idx->hdr.resolution, idx->hdr.syncperiod);
+
+  // later segments continue from the start time of the first
+  if ((e->record > 0) && (fseeko(fp, 0, SEEK_SET) == 0)
+    && (fread(block, 4, SEGMENT_WORDS, fp) == SEGMENT_WORDS))
+  {
+    memset(&first, 0, sizeof(first));
+    if (idx->hdr.mode == MODE_T2)
+    {
+      DecodeT2(&first, block, SEGMENT_WORDS, events);
+    }
+    else
+    {
+      DecodeT3(&first, block, SEGMENT_WORDS, events);
+    }
+    dec->First = first.First;
+    dec->HaveFirst = first.HaveFirst;
+  }
+
+  if (fseeko(fp, (off_t)(e->record * 4), SEEK_SET) != 0)
+  {
+    return -1;
+  }
+  dec->OflCorrection = e->oflcorrection;
+  return 0;
+}
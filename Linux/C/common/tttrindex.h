@@ -0,0 +1,104 @@
+/************************************************************************
+
+  Time index of recorded MultiHarp T2/T3 files
+
+  Overflow correction is cumulative, so finding the events at some time
+  in a raw record file means decoding it from the start. tttrmode can
+  write a sparse index next to the output file (IndexInterval, the file
+  name with ".idx" appended) that records the decoder state every
+  interval records and at every marker in a mask:
+
+    - the record number, so the byte offset in a raw file is 4 * record,
+    - the overflow correction to continue decoding with,
+    - the time of the last event before it, a lower bound of the times
+      that follow,
+    - cumulative counts of the events per channel and of the markers.
+
+  The index is a stdio stream stacked on the output stream (IndexOpen),
+  so it sees every record written, also those of overrun recovery, and
+  works the same for raw and compressed output. Finding an entry for a
+  time or a marker is a binary search, IndexSeek then positions the
+  data file and a decoder there.
+
+  File layout: IndexHeader, then entries of IndexEntry followed by
+  ncounts uint64_t counts: sync (T2 only), inputs 1..N, markers. The
+  last entry, flagged INDEX_END, holds the totals.
+
+************************************************************************/
+
+#ifndef TTTRINDEX_H
+#define TTTRINDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tttrdecode.h"
+
+#define INDEX_MAGIC      0x5849484D   // "MHIX"
+#define INDEX_VERSION    1
+#define INDEX_SUFFIX     ".idx"
+
+// entry flags
+#define INDEX_INTERVAL   0x01
+#define INDEX_MARKER     0x02         // the record at the entry is a marker in the mask
+#define INDEX_END        0x04
+
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t mode;                 // MODE_T2 or MODE_T3
+  uint32_t ncounts;             // counts per entry, inputs + 2
+  uint32_t interval;            // records between regular entries
+  uint32_t markermask;          // markers that get an entry
+  double resolution;            // ps per T2 time tag or T3 dtime bin
+  double syncperiod;            // ps, T3 only, 0 if unknown
+} IndexHeader;
+
+typedef struct
+{
+  uint64_t record;              // records before this point
+  uint64_t oflcorrection;       // decoder state at this point
+  uint64_t time;                // of the last event before, time tag (T2) or nsync (T3) units
+  uint32_t flags;               // INDEX_xxx
+  uint32_t markers;             // marker bits of the record, with INDEX_MARKER
+  // followed by uint64_t counts[ncounts]
+} IndexEntry;
+
+typedef struct
+{
+  IndexHeader hdr;
+  unsigned char* entries;       // of stride bytes each
+  size_t stride;
+  int64_t n;
+} TTTRIndex;
+
+
+// Stacks an index writer on out: everything written to the returned
+// stream goes on to out and is indexed into idxpath. fclose closes
+// both and out. NULL on error, out is left open then. ninputs is the
+// number of input channels of the device.
+FILE* IndexOpen(FILE* out, const char* idxpath, int mode, int ninputs, uint32_t interval,
+  uint32_t markermask, double resolution, double syncperiod);
+
+// Reads a whole index, which is small. NULL on error.
+TTTRIndex* IndexLoad(const char* idxpath);
+void IndexFree(TTTRIndex* idx);
+
+// Entry i, and its counts.
+const IndexEntry* IndexGet(const TTTRIndex* idx, int64_t i);
+const uint64_t* IndexCounts(const TTTRIndex* idx, int64_t i);
+
+// The last entry from which decoding reaches every event at or after
+// time (time tag or nsync units), or the k-th marker (0-based, in file
+// order). Binary searches, never -1 for a valid index.
+int64_t IndexFindTime(const TTTRIndex* idx, uint64_t time);
+int64_t IndexFindMarker(const TTTRIndex* idx, uint64_t k);
+
+// Positions fp (raw or a codec stream, see tttrcodec.h) at entry i and
+// sets up dec to decode from there, including the segment information
+// of the file start. Set the callbacks of dec afterwards. Returns 0 or -1.
+int IndexSeek(const TTTRIndex* idx, int64_t i, FILE* fp, TTTRDecoder* dec);
+
+#endif
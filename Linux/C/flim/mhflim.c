@@ -0,0 +1,440 @@
+/************************************************************************
+
+Lifetime images from MultiHarp T3 files of scanned samples
+
+Sorts the photons of a raw or compressed T3 file of tttrmode into a
+FLIM cube, one decay histogram per pixel, by the line and frame markers
+of the scanner, and fits every pixel (see ../common/flimfit.h). The
+cube can be kept and fitted again with other options, a cube file is
+recognized as input by its header.
+
+A line runs from its start marker to its end marker, or without one to
+the next start marker, and the pixels divide it evenly. Lines count
+from the frame marker, or without one wrap at the image height; the
+frames add up.
+
+Usage: mhflim [options] infile result
+
+  -x width        pixels per line, default 256
+  -y height       lines per frame, default 256
+  -l bit          marker bit of line starts, default 1
+  -e bit          marker bit of line ends, default none
+  -f bit          marker bit of frame starts, default none
+  -c channels     mask of the input channels, bit c = channel c,
+                  default all
+  -s shift        dtime bins per cube bin as a power of 2, default 4
+  -n bins         cube bins, default 256
+  -r ps           resolution of the recording, default 5
+  -g ps           sync period of the recording, places the segments
+                  after a recovered overrun exactly, default unknown
+  -k cube         also write the cube
+  -m model        1 mono-, 2 biexponential, default 1
+  -t first,last   bins fitted, default all from the peak
+  -i irf          IRF to reconvolve with, a text file of one value
+                  per cube bin
+  -p counts       pixels with fewer are not fitted, default 100
+  -j threads      default one per core
+
+The result holds the planes of flimfit.h, ../../Python/mhflim.py loads
+it.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "tttrcodec.h"
+#include "flimfit.h"
+#include "mhrt.h"
+
+
+#define CHUNK  65536
+
+typedef struct
+{
+  uint64_t time;
+  int bin;
+} LinePhoton;
+
+typedef struct
+{
+  FlimCube* cube;
+  int shift;
+  uint64_t channels;
+  int linebit;
+  int endbit;
+  int framebit;
+  int inline_;
+  uint64_t tstart;
+  int line;
+  LinePhoton* photons;
+  size_t nphotons;
+  size_t room;
+  uint64_t lines;
+  uint64_t frames;
+  uint64_t sorted;
+} Scan;
+
+static unsigned int buffer[CHUNK];
+static TTTREvent events[CHUNK];
+
+
+// bins the photons of the current line, now that its end is known
+static void EndLine(Scan* s, uint64_t tend)
+{
+  FlimCube* cube = s->cube;
+  uint32_t* row;
+  uint64_t span = tend - s->tstart;
+  size_t i;
+  int x;
+
+  if (s->inline_ && (span > 0) && (s->line < cube->height))
+  {
+    row = cube->counts + (size_t)s->line * cube->width * cube->nbins;
+    for (i = 0; i < s->nphotons; i++)
+    {
+      x = (int)((s->photons[i].time - s->tstart) * cube->width / span);
+      if (x < cube->width)
+      {
+        row[(size_t)x * cube->nbins + s->photons[i].bin]++;
+        s->sorted++;
+      }
+    }
+    s->lines++;
+  }
+  if (s->inline_)
+  {
+    s->line++;
+    if ((s->framebit < 0) && (s->line >= cube->height))
+    {
+      s->line = 0;
+      s->frames++;
+    }
+  }
+  s->inline_ = 0;
+  s->nphotons = 0;
+}
+
+
+static int Event(Scan* s, const TTTREvent* e)
+{
+  LinePhoton* p;
+  int bin;
+
+  if (e->Channel & EVENT_MARKER)
+  {
+    if ((s->framebit >= 0) && ((e->Channel >> s->framebit) & 1))
+    {
+      EndLine(s, e->Time);
+      s->line = 0;
+      s->frames++;
+    }
+    if ((s->endbit >= 0) && ((e->Channel >> s->endbit) & 1))
+    {
+      EndLine(s, e->Time);
+    }
+    if ((e->Channel >> s->linebit) & 1)
+    {
+      if (s->inline_)
+      {
+        EndLine(s, e->Time);
+      }
+      s->inline_ = 1;
+      s->tstart = e->Time;
+    }
+    return 0;
+  }
+  bin = e->DTime >> s->shift;
+  if (!s->inline_ || (e->Channel > 63) || !((s->channels >> e->Channel) & 1) || (bin >= s->cube->nbins))
+  {
+    return 0;
+  }
+  if (s->nphotons == s->room)
+  {
+    p = (LinePhoton*)realloc(s->photons, (s->room ? 2 * s->room : CHUNK) * sizeof(LinePhoton));
+    if (p == NULL)
+    {
+      return -1;
+    }
+    s->photons = p;
+    s->room = s->room ? 2 * s->room : CHUNK;
+  }
+  s->photons[s->nphotons].time = e->Time;
+  s->photons[s->nphotons].bin = bin;
+  s->nphotons++;
+  return 0;
+}
+
+
+static int BuildCube(const char* name, double syncperiod, Scan* s)
+{
+  TTTRDecoder dec;
+  FILE* fp;
+  uint64_t records = 0;
+  double t0 = RtNow();
+  int mode = MODE_T3, n, m, i, ret = 0;
+
+  fp = (CodecIsCompressed(name) == 1) ? CodecOpenRead(name, 2, &mode, NULL) : fopen(name, "rb");
+  if (fp == NULL)
+  {
+    printf("\ncannot open %s\n", name);
+    return -1;
+  }
+  if (mode != MODE_T3)
+  {
+    printf("\n%s is not a T3 recording\n", name);
+    fclose(fp);
+    return -1;
+  }
+  DecoderInit(&dec, MODE_T3, 0, syncperiod);
+  while ((ret == 0) && ((n = (int)fread(buffer, 4, CHUNK, fp)) > 0))
+  {
+    records += n;
+    m = DecodeT3(&dec, buffer, n, events);
+    for (i = 0; (ret == 0) && (i < m); i++)
+    {
+      ret = Event(s, &events[i]);
+    }
+  }
+  if (ferror(fp))
+  {
+    printf("\nfile read error or corrupt data\n");
+    ret = -1;
+  }
+  else if (ret < 0)
+  {
+    printf("\nout of memory\n");
+  }
+  fclose(fp);
+  free(s->photons);  // of a line without its end, dropped
+  printf("\n%llu records, %llu lines, %llu frames, %llu photons in the cube, %.2f s",
+    (unsigned long long)records, (unsigned long long)s->lines, (unsigned long long)s->frames,
+    (unsigned long long)s->sorted, RtNow() - t0);
+  return ret;
+}
+
+
+static int IsCube(const char* name)
+{
+  FILE* fp;
+  uint32_t magic = 0;
+
+  fp = fopen(name, "rb");
+  if (fp == NULL)
+  {
+    return 0;
+  }
+  if (fread(&magic, 4, 1, fp) != 1)
+  {
+    magic = 0;
+  }
+  fclose(fp);
+  return magic == FLIM_CUBEMAGIC;
+}
+
+
+static double* LoadIrf(const char* name, int nbins)
+{
+  FILE* fp;
+  double* irf;
+  double v, sum = 0;
+  int i = 0;
+
+  fp = fopen(name, "r");
+  if (fp == NULL)
+  {
+    printf("\ncannot open %s\n", name);
+    return NULL;
+  }
+  irf = (double*)calloc(nbins, sizeof(double));
+  if (irf == NULL)
+  {
+    fclose(fp);
+    return NULL;
+  }
+  while ((i < nbins) && (fscanf(fp, "%lf", &v) == 1))
+  {
+    irf[i++] = (v > 0) ? v : 0;
+    sum += irf[i - 1];
+  }
+  fclose(fp);
+  if (sum <= 0)
+  {
+    printf("\nthe IRF in %s is empty\n", name);
+    free(irf);
+    return NULL;
+  }
+  for (i = 0; i < nbins; i++)
+  {
+    irf[i] /= sum;
+  }
+  return irf;
+}
+
+
+int main(int argc, char* argv[])
+{
+  FlimCube cube;
+  FlimOptions fo;
+  FlimResult res;
+  FlimStats st;
+  Scan scan;
+  double* irf = NULL;
+  double resolution = 5, syncperiod = 0;
+  const char* irfname = NULL;
+  const char* cubename = NULL;
+  int width = 256, height = 256, nbins = 256, opt, ret = 1;
+
+  FlimDefaults(&fo);
+  memset(&scan, 0, sizeof(scan));
+  scan.shift = 4;
+  scan.channels = ~0ULL;
+  scan.linebit = 0;
+  scan.endbit = -1;
+  scan.framebit = -1;
+  while ((opt = getopt(argc, argv, "x:y:l:e:f:c:s:n:r:g:k:m:t:i:p:j:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'x':
+      width = atoi(optarg);
+      break;
+    case 'y':
+      height = atoi(optarg);
+      break;
+    case 'l':
+      scan.linebit = atoi(optarg) - 1;
+      break;
+    case 'e':
+      scan.endbit = atoi(optarg) - 1;
+      break;
+    case 'f':
+      scan.framebit = atoi(optarg) - 1;
+      break;
+    case 'c':
+      scan.channels = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      scan.shift = atoi(optarg);
+      break;
+    case 'n':
+      nbins = atoi(optarg);
+      break;
+    case 'r':
+      resolution = atof(optarg);
+      break;
+    case 'g':
+      syncperiod = atof(optarg);
+      break;
+    case 'k':
+      cubename = optarg;
+      break;
+    case 'm':
+      fo.model = atoi(optarg);
+      break;
+    case 't':
+      if (sscanf(optarg, "%d,%d", &fo.first, &fo.last) != 2)
+      {
+        optind = argc + 1;
+      }
+      break;
+    case 'i':
+      irfname = optarg;
+      break;
+    case 'p':
+      fo.mincounts = atoi(optarg);
+      break;
+    case 'j':
+      fo.threads = atoi(optarg);
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ((optind != argc - 2) || (width < 1) || (height < 1) || (nbins < 1) || (nbins > FLIM_MAXBINS)
+    || (scan.shift < 0) || (scan.shift > 15) || (scan.linebit < 0) || (scan.linebit > 3) || (scan.endbit > 3)
+    || (scan.framebit > 3) || ((fo.model != FLIM_MONO) && (fo.model != FLIM_BI)))
+  {
+    printf("usage: %s [-x width] [-y height] [-l bit] [-e bit] [-f bit] [-c channels] [-s shift]\n", argv[0]);
+    printf("       [-n bins] [-r ps] [-g ps] [-k cube] [-m 1|2] [-t first,last] [-i irf] [-p counts] [-j threads]\n");
+    printf("       infile result\n");
+    return 1;
+  }
+
+  if (IsCube(argv[optind]))
+  {
+    if (FlimCubeRead(argv[optind], &cube) < 0)
+    {
+      printf("\ncannot read the cube %s\n", argv[optind]);
+      return 1;
+    }
+    printf("\nCube of %d x %d pixels, %d bins of %.0f ps", cube.width, cube.height, cube.nbins, cube.binwidth);
+  }
+  else
+  {
+    if (FlimCubeAlloc(&cube, width, height, nbins) < 0)
+    {
+      printf("\nout of memory\n");
+      return 1;
+    }
+    cube.binwidth = resolution * (1 << scan.shift);
+    scan.cube = &cube;
+    if (BuildCube(argv[optind], syncperiod, &scan) < 0)
+    {
+      goto ex;
+    }
+    if (cubename && (FlimCubeWrite(cubename, &cube) < 0))
+    {
+      printf("\ncannot write %s\n", cubename);
+      goto ex;
+    }
+  }
+
+  if (irfname)
+  {
+    irf = LoadIrf(irfname, cube.nbins);
+    if (irf == NULL)
+    {
+      goto ex;
+    }
+    fo.irf = irf;
+  }
+  if (FlimResultAlloc(&res, cube.width, cube.height) < 0)
+  {
+    printf("\nout of memory\n");
+    goto ex;
+  }
+  if (FlimFit(&cube, &fo, &res, &st) < 0)
+  {
+    printf("\nthe fit options do not fit the cube\n");
+    FlimResultFree(&res);
+    goto ex;
+  }
+  printf("\nFitted %lld pixels, %lld below %d counts, %lld failed",
+    (long long)st.fitted, (long long)st.skipped, fo.mincounts, (long long)st.failed);
+  printf("\n%.2f s on %d threads, %.0f pixels/s, %.1f iterations per pixel, %lld steals", st.seconds,
+    st.threads, (st.fitted + st.skipped + st.failed) / (st.seconds > 0 ? st.seconds : 1e-9),
+    st.fitted ? (double)st.iterations / st.fitted : 0.0, (long long)st.steals);
+  if (FlimResultWrite(argv[optind + 1], &res, fo.model, cube.binwidth) < 0)
+  {
+    printf("\ncannot write %s\n", argv[optind + 1]);
+  }
+  else
+  {
+    ret = 0;
+  }
+  FlimResultFree(&res);
+
+ex:
+  free(irf);
+  FlimCubeFree(&cube);
+  printf("\n");
+  return ret;
+}
@@ -1,8 +1,23 @@
 /************************************************************************
 
   Demo access to MultiHarp 150/160 hardware via MHLIB v 3.0
-  The program performs a measurement based on hardcoded settings.
-  The resulting histogram is stored in an ASCII output file.
+  The program performs a measurement based on the settings given in a
+  configuration file and/or on the command line, see ../common/mhconfig.h.
+  Without any arguments it uses the same defaults as before.
+  The resulting histogram is stored in an ASCII output file, or with
+  HistFormat set in a binary one, see ../common/histfile.h.
+  The histograms are read in one call and summarized in one pass,
+  see ../common/histstats.h; BulkReadout = 0 reads them channel by
+  channel for comparison. Both report the readout time.
+  With KineticFrames set it runs that many acquisitions back to back
+  without interaction and writes every frame, see ../common/histseries.h.
+  With Accumulate set it runs that many the same way and writes only
+  their 64 bit sum, leaving out those with AccumReject flags, see
+  ../common/histaccum.h.
+  Analysis = 1 adds centroid, FWHM, background and lifetime per channel,
+  see ../common/histanalysis.h. Correction = 1 corrects the histograms
+  for pile-up and dead-time losses before they are analyzed and written,
+  see ../common/histcorrect.h.
 
   Michael Wahl, PicoQuant GmbH, March 2021
 
@@ -38,16 +53,351 @@
 #include "mhdefin.h"
 #include "mhlib.h"
 #include "errorcodes.h"
+#include "mhconfig.h"
+#include "mhrt.h"
+#include "histstats.h"
+#include "histanalysis.h"
+#include "histcorrect.h"
+#include "histaccum.h"
+#include "histseries.h"
+#include "histfile.h"
+
+
+HistBlock hist; //the histograms of all channels, see histstats.h
+HistAnalysis analysis[MAXINPCHAN]; //see histanalysis.h
+HistCorrector corrector; //factors kept while the settings stay, see histcorrect.h
+HistCorrection correction[MAXINPCHAN];
+
+typedef struct
+{
+  FILE* fp;
+  const MeasConfig* cfg;
+  double resolution;
+  int syncrate;
+  HistAnalysis analysis[MAXINPCHAN];
+  HistCorrector corrector;
+  HistCorrection correction[MAXINPCHAN];
+  HistAccum accum;
+  double taccum;                //s spent adding
+} SeriesOutput;
+
+
+static void CorrectFrame(SeriesOutput* out, HistFrame* f)
+{
+  CorrSettings cs;
+
+  cs.resolution = out->resolution;
+  cs.histlen = f->hist.histlen;
+  cs.syncrate = out->syncrate;
+  cs.syncdivider = out->cfg->SyncDivider;
+  cs.syncdeadtime = out->cfg->SyncDeadTime;
+  cs.inputdeadtime = out->cfg->InputDeadTime;
+  if((CorrectorSetup(&out->corrector, &cs) < 0)
+    || (HistCorrect(&out->corrector, &f->hist, out->cfg->ChannelMask, f->elapsed, out->correction) < 0))
+  {
+    memset(out->correction, 0, sizeof(out->correction)); //left uncorrected
+  }
+}
+
+
+// on the worker thread of the series, while the next frame is acquired
+static int WriteFrame(void* user, HistFrame* f)
+{
+  SeriesOutput* out = (SeriesOutput*)user;
+  HistFileHeader hdr;
+  int i, j;
+
+  HistStats(&f->hist, out->cfg->ChannelMask, out->cfg->StopOverflow ? out->cfg->StopCount : 0xFFFFFFFF);
+  if(out->cfg->Correction) //after the statistics, which see the overflows of the raw counts
+  {
+    CorrectFrame(out, f);
+  }
+  if(out->cfg->HistFormat)
+  {
+    HistFileInit(&hdr, out->cfg->HistFormat, f->hist.numchannels, f->hist.histlen);
+    HistFileSettings(&hdr, out->cfg);
+    hdr.syncrate = out->syncrate;
+    hdr.resolution = out->resolution;
+    hdr.elapsed = f->elapsed;
+    hdr.frame = f->index;
+    hdr.start = f->start;
+    return HistFileWrite(fileno(out->fp), &hdr, f->hist.counts, f->hist.histlen);
+  }
+  fprintf(out->fp, "Frame %lld  Start %.3f ms  Measured %.3f ms  Dead %.3f ms\n", (long long)f->index,
+    f->start * 1e3, f->elapsed, f->dead * 1e3);
+  fprintf(out->fp, "Integral ");
+  for(i = 0; i < f->hist.numchannels; i++)
+  {
+    fprintf(out->fp, " %llu%s", (unsigned long long)f->hist.stats[i].integral, f->hist.stats[i].overflow ? "*" : "");
+  }
+  fprintf(out->fp, "\n");
+  if(out->cfg->Correction)
+  {
+    fprintf(out->fp, "Corrected");
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, " %.0f%s", out->correction[i].corrected, out->correction[i].saturated ? "*" : "");
+    }
+    fprintf(out->fp, "\n");
+  }
+  if(out->cfg->Analysis) //in ps, background in counts per bin
+  {
+    HistAnalyze(&f->hist, out->cfg->ChannelMask, out->cfg->AnalysisBackground, out->analysis);
+    fprintf(out->fp, "Centroid ");
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, " %.1f", out->analysis[i].centroid * out->resolution);
+    }
+    fprintf(out->fp, "\nFWHM     ");
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, " %.1f", out->analysis[i].fwhm * out->resolution);
+    }
+    fprintf(out->fp, "\nBackground");
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, " %.2f", out->analysis[i].background);
+    }
+    fprintf(out->fp, "\nLifetime ");
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, " %.1f", out->analysis[i].lifetime * out->resolution);
+    }
+    fprintf(out->fp, "\n");
+  }
+  for(j = 0; j < f->hist.histlen; j++)
+  {
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->fp, "%5d ", HistChannel(&f->hist, i)[j]);
+    }
+    fprintf(out->fp, "\n");
+  }
+  return ferror(out->fp) ? -1 : 0;
+}
+
+
+// on the worker thread as well, with Accumulate instead of WriteFrame
+static int AccumFrame(void* user, HistFrame* f)
+{
+  SeriesOutput* out = (SeriesOutput*)user;
+  double t;
+  int ret;
+
+  HistStats(&f->hist, out->cfg->ChannelMask, out->cfg->StopOverflow ? out->cfg->StopCount : 0xFFFFFFFF);
+  if(out->cfg->Correction) //each acquisition over its own measured time
+  {
+    CorrectFrame(out, f);
+    HistStats(&f->hist, out->cfg->ChannelMask, 0xFFFFFFFF); //the peaks bound the sums, see histaccum.h
+  }
+  t = RtNow();
+  ret = AccumAdd(&out->accum, &f->hist, f->flags, f->elapsed);
+  out->taccum += RtNow() - t;
+  return (ret < 0) ? -1 : 0;
+}
+
+
+// the sum of an accumulating series as the one output frame
+static int WriteTotals(SeriesOutput* out)
+{
+  HistAccum* a = &out->accum;
+  HistFileHeader hdr;
+  const uint64_t* totals[MAXINPCHAN];
+  const float* average;
+  double sum, total;
+  int i, j;
+
+  for(i = 0; i < a->numchannels; i++)
+  {
+    totals[i] = AccumTotals(a, i);
+  }
+  printf("\n  %lld acquisitions summed, %lld rejected, %.3f ms measured, adding %.3f ms each",
+    (long long)a->added, (long long)a->rejected, a->elapsed, a->added ? out->taccum * 1e3 / a->added : 0.0);
+  for(i = 0; a->average && (a->added > 0) && (i < a->numchannels); i++)
+  {
+    if((average = AccumAverage(a, i)) == NULL)
+    {
+      continue;
+    }
+    sum = total = 0;
+    for(j = 0; j < a->histlen; j++)
+    {
+      sum += average[j];
+      total += (double)totals[i][j];
+    }
+    total /= a->added;
+    printf("\n  Channel[%1d] moving average %.1lf counts, mean %.1lf per acquisition (%+.2lf%%)", i, sum, total,
+      (total > 0) ? 100.0 * (sum / total - 1) : 0.0);
+  }
+  printf("\n");
 
+  if(out->cfg->HistFormat) //64 bit whatever the format, see histfile.h
+  {
+    HistFileInit(&hdr, HISTFILE_RAW64, a->numchannels, a->histlen);
+    HistFileSettings(&hdr, out->cfg);
+    hdr.syncrate = out->syncrate;
+    hdr.resolution = out->resolution;
+    hdr.elapsed = a->elapsed;
+    hdr.acquisitions = (uint32_t)a->added;
+    return HistFileWrite64(fileno(out->fp), &hdr, totals);
+  }
+  fprintf(out->fp, "Accumulated %lld  Rejected %lld  Measured %.3f ms\n", (long long)a->added,
+    (long long)a->rejected, a->elapsed);
+  for(j = 0; j < a->histlen; j++)
+  {
+    for(i = 0; i < a->numchannels; i++)
+    {
+      fprintf(out->fp, "%5llu ", totals[i] ? (unsigned long long)totals[i][j] : 0ULL);
+    }
+    fprintf(out->fp, "\n");
+  }
+  return ferror(out->fp) ? -1 : 0;
+}
 
-unsigned int counts[MAXINPCHAN][MAXHISTLEN];
+
+// back to back acquisitions, only the device calls between the frames
+static int RunSeries(int devidx, const MeasConfig* cfg, int numchannels, int histlen, double resolution,
+  int syncrate, FILE* fpout)
+{
+  HistSeries* series;
+  HistFrame* f;
+  SeriesOutput out;
+  char Errorstring[40];
+  int retcode, ctcstatus, n, ret = -1;
+  int frames = cfg->Accumulate ? cfg->Accumulate : cfg->KineticFrames;
+
+  out.fp = fpout;
+  out.cfg = cfg;
+  out.resolution = resolution;
+  out.syncrate = syncrate;
+  out.taccum = 0;
+  CorrectorInit(&out.corrector);
+  if(cfg->Accumulate && (AccumInit(&out.accum, numchannels, histlen, cfg->ChannelMask, cfg->AccumAverage,
+    cfg->AccumReject, cfg->LowLatency) < 0))
+  {
+    printf("\nOut of memory. Aborted.\n");
+    return -1;
+  }
+  series = SeriesCreate(cfg->KineticRing, numchannels, histlen, cfg->LowLatency,
+    cfg->Accumulate ? AccumFrame : WriteFrame, &out);
+  if(series == NULL)
+  {
+    printf("\nCannot set up the kinetic series. Aborted.\n");
+    if(cfg->Accumulate)
+    {
+      AccumFree(&out.accum);
+    }
+    return -1;
+  }
+  if(cfg->Accumulate)
+  {
+    printf("\n\nAccumulating %d acquisitions of %d milliseconds...", frames, cfg->Tacq);
+  }
+  else
+  {
+    printf("\n\nKinetic series of %d frames of %d milliseconds...", frames, cfg->Tacq);
+  }
+  fflush(stdout);
+
+  for(n = 0; n < frames; n++)
+  {
+    f = SeriesAcquire(series);
+
+    retcode = MH_ClearHistMem(devidx);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    retcode = MH_StartMeas(devidx, cfg->Tacq);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+    f->start = SeriesTime(series);
+
+    ctcstatus = 0;
+    while(ctcstatus == 0)
+    {
+      retcode = MH_CTCStatus(devidx, &ctcstatus);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+        goto ex;
+      }
+    }
+    f->end = SeriesTime(series);
+
+    retcode = MH_GetElapsedMeasTime(devidx, &f->elapsed);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetElapsedMeasTime error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    retcode = MH_StopMeas(devidx);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    f->flags = 0;
+    if(cfg->Accumulate && cfg->AccumReject) //only needed to reject
+    {
+      retcode = MH_GetFlags(devidx, &f->flags);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+        goto ex;
+      }
+    }
+
+    retcode = MH_GetAllHistograms(devidx, f->hist.counts);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetAllHistograms error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    SeriesSubmit(series, f); //processed and written while the next frame runs
+  }
+  ret = 0;
+
+ex:
+  if(SeriesFinish(series, stdout) > 0)
+  {
+    printf("\nfile write error\n");
+    ret = -1;
+  }
+  if(cfg->Accumulate)
+  {
+    if(WriteTotals(&out) < 0)
+    {
+      printf("\nfile write error\n");
+      ret = -1;
+    }
+    AccumFree(&out.accum);
+  }
+  CorrectorFree(&out.corrector);
+  return ret;
+}
 
 
 int main(int argc, char* argv[])
 {
   int dev[MAXDEVNUM];
   int found=0;
-  FILE *fpout;
+  FILE *fpout = NULL;
   int retcode;
   int ctcstatus;
   char LIB_Version[8];
@@ -58,26 +408,32 @@ int main(int argc, char* argv[])
   char Errorstring[40];
   int NumChannels;
   int HistLen;
-  int Binning=0; //you can change this
-  int Offset=0; 
-  int Tacq=1000; //Measurement time in millisec, you can change this
-  int SyncDivider = 1; //you can change this
-
-  int SyncTiggerEdge = 0; //you can change this
-  int SyncTriggerLevel = -50; //you can change this
-  int InputTriggerEdge = 0; //you can change this
-  int InputTriggerLevel = -50; //you can change this
+  int maxlen; //HistLen of HistLenCode, which is not scanned
+  MeasConfig base; //settings as loaded, see mhconfig.h
+  MeasConfig cfg;  //settings of the current run of a scan
+  char cfgerror[200];
+  int run;
+  int failed = 0; //exit status for batch scripts
  
   double Resolution; 
   int Syncrate;
   int Countrate;
-  double Integralcount; 
+  double treadout, tstats, tanalysis, tcorrect;
+  CorrSettings cs;
+  double elapsed;
+  HistFileHeader hfhdr; //see histfile.h
   int i,j;
   int flags;
   int warnings;
   char warningstext[16384]; //must have 16384 bytest text buffer
   char cmd=0;
 
+  //defaults, you can change these or override them by file or command line
+  ConfigDefaults(&base, MODE_HIST, "histomode.out");
+  base.Tacq = 1000; //Measurement time in millisec
+  base.StopOverflow = 0; //for example only
+  base.StopCount = 10000;
+
   memset(Errorstring, 0x00, sizeof(Errorstring));
   memset(warningstext, 0x00, sizeof(warningstext));
 
@@ -90,10 +446,26 @@ int main(int argc, char* argv[])
     printf("\nWarning: The application was built for version %s.", LIB_VERSION);
   }
 
-  if((fpout = fopen("histomode.out", "w")) == NULL)
+  if(ConfigParseArgs(&base, argc, argv) < 0)
   {
-    printf("\ncannot open output file\n"); 
-    goto ex;
+    return 1;
+  }
+
+  //check everything before the first device call
+  if(base.Mode != MODE_HIST)
+  {
+    printf("\nMode must be %d (histogramming). Aborted.\n", MODE_HIST);
+    return 1;
+  }
+  if(ConfigValidate(&base, cfgerror, sizeof(cfgerror)) < 0)
+  {
+    printf("\nInvalid settings: %s. Aborted.\n", cfgerror);
+    return 1;
+  }
+
+  if (base.LowLatency)
+  {
+    RtEnterMeasured(base.RtPriority, base.RtCpu, stdout);
   }
 
   printf("\nSearching for MultiHarp devices...");
@@ -132,23 +504,20 @@ int main(int argc, char* argv[])
   if(found < 1)
   {
     printf("\nNo device available.");
+    failed = 1;
     goto ex; 
   }
 
   printf("\nUsing device #%1d", dev[0]);
 
-  fprintf(fpout, "Binning           : %d\n", Binning);
-  fprintf(fpout, "Offset            : %d\n", Offset);
-  fprintf(fpout, "AcquisitionTime   : %d\n", Tacq);
-  fprintf(fpout, "SyncDivider       : %d\n", SyncDivider);
-
   printf("\nInitializing the device...");
 
-  retcode = MH_Initialize(dev[0], MODE_HIST, 0);  //Histo mode with internal clock
+  retcode = MH_Initialize(dev[0], MODE_HIST, base.RefSource);  //Histo mode, internal clock by default
   if(retcode < 0)
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_Initialize error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
 
@@ -157,6 +526,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetHardwareInfo error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -164,13 +534,10 @@ int main(int argc, char* argv[])
     printf("\nFound Model %s Part no %s Version %s",HW_Model, HW_Partno, HW_Version);
   }
 
-  if (strstr(HW_Model, "MultiHarp") != NULL)
-  {
-    fprintf(fpout, "Hardware model %s \n", HW_Model);
-  }
-  else
+  if (strstr(HW_Model, "MultiHarp") == NULL)
   {
     printf("\nUnknown hardware model %s. Aborted.\n", HW_Model);
+    failed = 1;
     goto ex;
   }
   
@@ -179,6 +546,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetNumOfInputChannels error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -186,162 +554,182 @@ int main(int argc, char* argv[])
     printf("\nDevice has %i input channels.", NumChannels);
   }
 
-  retcode = MH_SetSyncDiv(dev[0], SyncDivider);
-  if(retcode < 0)
+  //the block is laid out and written per input of the device, as
+  //MH_GetAllHistograms fills it
+  maxlen = 1024 << base.HistLenCode;
+  if(HistAlloc(&hist, NumChannels, maxlen, base.LowLatency) < 0)
   {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
+    printf("\nOut of memory. Aborted.\n");
+    failed = 1;
     goto ex;
   }
 
-  retcode = MH_SetSyncEdgeTrg(dev[0], SyncTriggerLevel, SyncTiggerEdge);
-  if (retcode < 0)
+  //all runs of a scan use the same open device, only the settings change
+  for(run = 0; run < ConfigNumRuns(&base); run++)
   {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    ConfigForRun(&base, run, &cfg);
 
-  retcode = MH_SetSyncChannelOffset(dev[0], 0);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-
-  for(i = 0; i < NumChannels; i++) // we use the same input offset for all channels
-  {
-    retcode = MH_SetInputEdgeTrg(dev[0], i, InputTriggerLevel, InputTriggerEdge);
-    if (retcode < 0)
+    if((fpout = fopen(cfg.OutFile, cfg.HistFormat ? "wb" : "w")) == NULL)
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\ncannot open output file %s\n", cfg.OutFile);
+      failed = 1;
       goto ex;
     }
 
-    retcode = MH_SetInputChannelOffset(dev[0], i, 0);
+    if(cfg.NumScan > 0)
+    {
+      printf("\n\nRun %d of %d, %s = %lld", run + 1, cfg.NumScan, cfg.ScanParam, cfg.ScanValues[run]);
+    }
+
+    if(!cfg.HistFormat) //the binary header is written with the counts
+    {
+      fprintf(fpout, "Binning           : %d\n", cfg.Binning);
+      fprintf(fpout, "Offset            : %d\n", cfg.Offset);
+      fprintf(fpout, "AcquisitionTime   : %d\n", cfg.Tacq);
+      fprintf(fpout, "SyncDivider       : %d\n", cfg.SyncDivider);
+      if(cfg.SyncDeadTime || cfg.InputDeadTime || cfg.Correction)
+      {
+        fprintf(fpout, "SyncDeadTime      : %d\n", cfg.SyncDeadTime);
+        fprintf(fpout, "InputDeadTime     : %d\n", cfg.InputDeadTime);
+        fprintf(fpout, "Corrected         : %d\n", cfg.Correction);
+      }
+      fprintf(fpout, "Hardware model %s \n", HW_Model);
+    }
+
+    retcode = MH_SetSyncDiv(dev[0], cfg.SyncDivider);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    retcode = MH_SetInputChannelEnable(dev[0], i, 1);
+    retcode = MH_SetSyncEdgeTrg(dev[0], cfg.SyncTriggerLevel, cfg.SyncTriggerEdge);
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-  }
-
-  retcode = MH_SetHistoLen(dev[0], MAXLENCODE, &HistLen);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetHistoLen error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nHistogram length is %d", HistLen);
-
-  retcode = MH_SetBinning(dev[0], Binning);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetBinning error %d (%s). Aborted.\n",retcode,Errorstring);
-    goto ex;
-  }
 
-  retcode = MH_SetOffset(dev[0], Offset);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
- 
-  retcode = MH_GetResolution(dev[0], &Resolution);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    retcode = MH_SetSyncChannelOffset(dev[0], cfg.SyncChannelOffset);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
 
-  printf("\nResolution is %1.0lfps\n", Resolution);
+    retcode = MH_SetSyncDeadTime(dev[0], cfg.SyncDeadTime > 0, cfg.SyncDeadTime);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetSyncDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
 
+    for(i = 0; i < NumChannels; i++) // we use the same input offset for all channels
+    {
+      retcode = MH_SetInputEdgeTrg(dev[0], i, cfg.InputTriggerLevel, cfg.InputTriggerEdge);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
-  // After Init allow 150 ms for valid  count rate readings
-  // Subsequently you get new values after every 100ms
-  Sleep(150);
+      retcode = MH_SetInputChannelOffset(dev[0], i, cfg.InputChannelOffset);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
+      retcode = MH_SetInputDeadTime(dev[0], i, cfg.InputDeadTime > 0, cfg.InputDeadTime);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
-  retcode = MH_GetSyncRate(dev[0], &Syncrate);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nSyncrate=%1d/s", Syncrate);
+      retcode = MH_SetInputChannelEnable(dev[0], i, (int)((cfg.ChannelMask >> i) & 1));
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+    }
 
-  for(i = 0; i < NumChannels; i++) // for all channels
-  {
-    retcode = MH_GetCountRate(dev[0], i, &Countrate);
+    retcode = MH_SetHistoLen(dev[0], cfg.HistLenCode, &HistLen);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetHistoLen error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-    printf("\nCountrate[%1d]=%1d/s", i, Countrate);
-  }
-
-  printf("\n");
-
-  //after getting the count rates you can check for warnings
-  retcode = MH_GetWarnings(dev[0], &warnings);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-
-  if(warnings)
-  {
-    MH_GetWarningsText(dev[0], warningstext, warnings);
-    printf("\n\n%s", warningstext);
-  }
+    printf("\nHistogram length is %d", HistLen);
+    if(HistLen > maxlen)
+    {
+      printf("\nHistogram length %d is longer than the %d of HistLenCode. Aborted.\n", HistLen, maxlen);
+      failed = 1;
+      goto ex;
+    }
+    hist.numchannels = NumChannels;
+    hist.histlen = HistLen; //MH_GetAllHistograms packs the channels at this length
 
-  retcode = MH_SetStopOverflow(dev[0], 0, 10000); //for example only
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetStopOverflow error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    retcode = MH_SetBinning(dev[0], cfg.Binning);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetBinning error %d (%s). Aborted.\n",retcode,Errorstring);
+      failed = 1;
+      goto ex;
+    }
 
-  while(cmd != 'q')
-  {
-    MH_ClearHistMem(dev[0]);
+    retcode = MH_SetOffset(dev[0], cfg.Offset);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+ 
+    retcode = MH_GetResolution(dev[0], &Resolution);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    printf("\npress RETURN to start measurement");
-    getchar();
+    printf("\nResolution is %1.0lfps\n", Resolution);
+
+
+    // After Init allow 150 ms for valid  count rate readings
+    // Subsequently you get new values after every 100ms
+    Sleep(150);
+
 
     retcode = MH_GetSyncRate(dev[0], &Syncrate);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
       printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
     printf("\nSyncrate=%1d/s", Syncrate);
@@ -353,92 +741,285 @@ int main(int argc, char* argv[])
       {
         MH_GetErrorString(Errorstring, retcode);
         printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
       printf("\nCountrate[%1d]=%1d/s", i, Countrate);
     }
 
-    //here you could check for warnings again
-        
-    retcode = MH_StartMeas(dev[0], Tacq); 
+    printf("\n");
+
+    //after getting the count rates you can check for warnings
+    retcode = MH_GetWarnings(dev[0], &warnings);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-         
-    printf("\n\nMeasuring for %1d milliseconds...", Tacq);
-        
-    ctcstatus = 0;
-    while(ctcstatus == 0)
+
+    if(warnings)
     {
-      retcode = MH_CTCStatus(dev[0], &ctcstatus);
-      if(retcode < 0)
-      {
-        MH_GetErrorString(Errorstring, retcode);
-        printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
-        goto ex;
-      }
+      MH_GetWarningsText(dev[0], warningstext, warnings);
+      printf("\n\n%s", warningstext);
     }
 
-    retcode = MH_StopMeas(dev[0]);
+    retcode = MH_SetStopOverflow(dev[0], cfg.StopOverflow, cfg.StopCount);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetStopOverflow error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    printf("\n");
-    for(i = 0; i< NumChannels; i++) // for all channels
+    if((cfg.KineticFrames > 0) || (cfg.Accumulate > 0))
+    {
+      if(RunSeries(dev[0], &cfg, NumChannels, HistLen, Resolution, Syncrate, fpout) < 0)
+      {
+        failed = 1;
+        goto ex;
+      }
+      if(fclose(fpout) != 0)
+      {
+        printf("\nfile write error\n");
+        failed = 1;
+      }
+      fpout = NULL;
+      continue;
+    }
+
+    cmd = 0;
+    while(cmd != 'q')
     {
-      retcode = MH_GetHistogram(dev[0], counts[i], i);
+      MH_ClearHistMem(dev[0]);
       if(retcode < 0)
       {
         MH_GetErrorString(Errorstring, retcode);
-        printf("\nMH_GetHistogram error %d (%s). Aborted.\n", retcode, Errorstring);
+        printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
 
-      Integralcount = 0;
-      for(j = 0; j < HistLen; j++)
+      if(!cfg.Batch)
       {
-        Integralcount += counts[i][j];
+        printf("\npress RETURN to start measurement");
+        getchar();
       }
 
+      retcode = MH_GetSyncRate(dev[0], &Syncrate);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+      printf("\nSyncrate=%1d/s", Syncrate);
 
-      printf("\n  Integralcount[%1d]=%1.0lf", i, Integralcount);
+      for(i = 0; i < NumChannels; i++) // for all channels
+      {
+        retcode = MH_GetCountRate(dev[0], i, &Countrate);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+        printf("\nCountrate[%1d]=%1d/s", i, Countrate);
+      }
+
+      //here you could check for warnings again
+        
+      retcode = MH_StartMeas(dev[0], cfg.Tacq); 
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+         
+      printf("\n\nMeasuring for %1d milliseconds...", cfg.Tacq);
+        
+      ctcstatus = 0;
+      while(ctcstatus == 0)
+      {
+        retcode = MH_CTCStatus(dev[0], &ctcstatus);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+      }
+
+      retcode = MH_StopMeas(dev[0]);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode = MH_GetElapsedMeasTime(dev[0], &elapsed);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetElapsedMeasTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
+      printf("\n");
+      treadout = RtNow();
+      if(cfg.BulkReadout)
+      {
+        retcode = MH_GetAllHistograms(dev[0], hist.counts);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetAllHistograms error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+      }
+      else
+      {
+        for(i = 0; i < NumChannels; i++) // for all channels
+        {
+          retcode = MH_GetHistogram(dev[0], HistChannel(&hist, i), i);
+          if(retcode < 0)
+          {
+            MH_GetErrorString(Errorstring, retcode);
+            printf("\nMH_GetHistogram error %d (%s). Aborted.\n", retcode, Errorstring);
+            failed = 1;
+            goto ex;
+          }
+        }
+      }
+      tstats = RtNow();
+      HistStats(&hist, cfg.ChannelMask, cfg.StopOverflow ? cfg.StopCount : 0xFFFFFFFF);
+      treadout = RtNow() - treadout;
+      tstats = RtNow() - tstats;
+
+      for(i = 0; i < NumChannels; i++) // for all channels
+      {
+        printf("\n  Integralcount[%1d]=%1.0lf  peak %u at bin %d%s", i, (double)hist.stats[i].integral,
+          hist.stats[i].peak, hist.stats[i].peakbin, hist.stats[i].overflow ? "  overflow" : "");
+      }
+      printf("\n\n  Readout %.3f ms (%s, statistics %.3f ms)", treadout * 1e3,
+        cfg.BulkReadout ? "MH_GetAllHistograms" : "MH_GetHistogram per channel", tstats * 1e3);
+      printf("\n");
+
+      if(cfg.Correction) //the analysis and the output get the corrected counts
+      {
+        cs.resolution = Resolution;
+        cs.histlen = HistLen;
+        cs.syncrate = Syncrate;
+        cs.syncdivider = cfg.SyncDivider;
+        cs.syncdeadtime = cfg.SyncDeadTime;
+        cs.inputdeadtime = cfg.InputDeadTime;
+        tcorrect = RtNow();
+        if((CorrectorSetup(&corrector, &cs) < 0)
+          || (HistCorrect(&corrector, &hist, cfg.ChannelMask, elapsed, correction) < 0))
+        {
+          printf("\n  No correction without sync rate and elapsed time");
+        }
+        else
+        {
+          tcorrect = RtNow() - tcorrect;
+          for(i = 0; i < NumChannels; i++)
+          {
+            if(correction[i].measured)
+            {
+              printf("\n  Channel[%1d] corrected %.0lf (%+.2lf%%)%s", i, correction[i].corrected,
+                100.0 * (correction[i].corrected / correction[i].measured - 1),
+                correction[i].saturated ? "  saturated bins left as measured" : "");
+            }
+          }
+          printf("\n\n  Correction %.3f ms", tcorrect * 1e3);
+        }
+        printf("\n");
+      }
+
+      if(cfg.Analysis)
+      {
+        tanalysis = RtNow();
+        HistAnalyze(&hist, cfg.ChannelMask, cfg.AnalysisBackground, analysis);
+        tanalysis = RtNow() - tanalysis;
+        for(i = 0; i < NumChannels; i++)
+        {
+          printf("\n  Channel[%1d] centroid %.1lf ps  FWHM %.1lf ps  background %.2lf/bin  lifetime %.1lf ps", i,
+            analysis[i].centroid * Resolution, analysis[i].fwhm * Resolution, analysis[i].background,
+            analysis[i].lifetime * Resolution);
+        }
+        printf("\n\n  Analysis %.3f ms", tanalysis * 1e3);
+        printf("\n");
+      }
+
+      retcode = MH_GetFlags(dev[0], &flags);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      if(flags & FLAG_OVERFLOW)
+      {
+        printf("\n  Overflow.");
+      }
+
+      if(cfg.Batch)
+      {
+        cmd = 'q'; //one measurement per run
+      }
+      else
+      {
+        printf("\nEnter c to continue or q to quit and save the count data.");
+        cmd = getchar();
+        getchar();
+      }
     }
-    printf("\n");
 
-    retcode = MH_GetFlags(dev[0], &flags);
-    if(retcode < 0)
+    if(cfg.HistFormat)
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto ex;
+      HistFileInit(&hfhdr, cfg.HistFormat, NumChannels, HistLen);
+      HistFileSettings(&hfhdr, &cfg);
+      hfhdr.syncrate = Syncrate;
+      hfhdr.resolution = Resolution;
+      hfhdr.elapsed = elapsed;
+      if(HistFileWrite(fileno(fpout), &hfhdr, hist.counts, HistLen) < 0)
+      {
+        printf("\nfile write error\n");
+        failed = 1;
+      }
     }
-
-    if(flags & FLAG_OVERFLOW)
+    else
     {
-      printf("\n  Overflow.");
+      for(j = 0; j < HistLen; j++)
+      {
+        for(i = 0; i < NumChannels; i++)
+        {
+          fprintf(fpout, "%5d ", HistChannel(&hist, i)[j]);
+        }
+        fprintf(fpout, "\n");
+      }
     }
 
-    printf("\nEnter c to continue or q to quit and save the count data.");
-    cmd = getchar();
-    getchar();
-  }
-
-  for(j = 0; j < HistLen; j++)
-  {
-    for(i = 0; i < NumChannels; i++)
+    if(fclose(fpout) != 0)
     {
-      fprintf(fpout, "%5d ", counts[i][j]);
+      printf("\nfile write error\n");
+      failed = 1;
     }
-    fprintf(fpout, "\n");
-  }
+    fpout = NULL;
+  } //end of runs
 
   ex:
   for(i = 0; i < MAXDEVNUM; i++) //no harm to close all
@@ -449,10 +1030,15 @@ int main(int argc, char* argv[])
   {
     fclose(fpout);
   }
-  printf("\npress RETURN to exit");
-  getchar();
+  HistFree(&hist);
+  CorrectorFree(&corrector);
+  if(!base.Batch)
+  {
+    printf("\npress RETURN to exit");
+    getchar();
+  }
 
-  return 0;
+  return failed;
 }
 
 
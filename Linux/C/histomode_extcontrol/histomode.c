@@ -3,10 +3,23 @@
   Demo access to MultiHarp 150/160 hardware via MHLIB v 3.0
 
   THIS IS AN ADVANCED DEMO. DO NOT USE FOR YOUR FIRST EXPERIMENTS.
-  Look at the variable meascontrol down below to see what it does.
-
-  The program performs a measurement based on hardcoded settings.
-  The resulting histogram is stored in an ASCII output file.
+  Look at the setting MeasControl down below to see what it does.
+
+  The program performs a measurement based on the settings given in a
+  configuration file and/or on the command line, see ../common/mhconfig.h.
+  Without any arguments it uses the same defaults as before.
+  The resulting histogram is stored in an ASCII output file, or with
+  HistFormat set in a binary one, see ../common/histfile.h.
+
+  With Triggers set the demo runs that many externally triggered
+  acquisitions unattended. The next acquisition is armed right after
+  each readout, a worker thread sums the histograms of TriggerGroup
+  triggers per output frame in 64 bits (see ../common/histaccum.h) and
+  writes them, binary as HISTFILE_RAW64, and TriggerLog records
+  every trigger with its times and overflow flags. With Correction = 1
+  the histograms are corrected for pile-up and dead-time losses before
+  they are written, those of a trigger group over the time measured in
+  all its triggers, see ../common/histcorrect.h.
 
   Michael Wahl, PicoQuant GmbH, March 2021
 
@@ -43,16 +56,414 @@
 #include "mhdefin.h"
 #include "mhlib.h"
 #include "errorcodes.h"
+#include "mhconfig.h"
+#include "mhrt.h"
+#include "histfile.h"
+#include "histstats.h"
+#include "histcorrect.h"
+#include "histaccum.h"
+#include "histseries.h"
+
+
+unsigned int (*counts)[MAXHISTLEN] = NULL; //MAXINPCHAN histograms, see RtAlloc
+HistCorrector corrector; //factors kept while the settings stay, see histcorrect.h
+
+typedef struct
+{
+  FILE* fp;
+  FILE* log;                    //per trigger, or NULL
+  const MeasConfig* cfg;
+  double resolution;
+  int syncrate;
+  HistAccum sum;                //the triggers of the current group, in 64 bits
+  int insum;                    //triggers in it
+  int64_t first;                //index of its first trigger
+  double start;                 //s, start of its first trigger
+  double elapsed;               //ms, measured in it
+  int64_t frames;               //groups written
+  int64_t overflows;            //triggers with FLAG_OVERFLOW
+  HistCorrector corrector;
+  HistCorrection correction[MAXINPCHAN];
+  uint64_t* corrected;          //the sums of a group corrected, with Correction
+} TriggerOutput;
+
+
+static int SetupCorrector(TriggerOutput* out, int histlen)
+{
+  CorrSettings cs;
+
+  cs.resolution = out->resolution;
+  cs.histlen = histlen;
+  cs.syncrate = out->syncrate;
+  cs.syncdivider = out->cfg->SyncDivider;
+  cs.syncdeadtime = out->cfg->SyncDeadTime;
+  cs.inputdeadtime = out->cfg->InputDeadTime;
+  return CorrectorSetup(&out->corrector, &cs);
+}
+
+
+static void PrintCorrection(TriggerOutput* out, int numchannels)
+{
+  int i;
+
+  fprintf(out->fp, "Corrected");
+  for(i = 0; i < numchannels; i++)
+  {
+    fprintf(out->fp, " %.0f%s", out->correction[i].corrected, out->correction[i].saturated ? "*" : "");
+  }
+  fprintf(out->fp, "\n");
+}
+
+
+// a single trigger as one frame of the output file, blk with its statistics
+static int WriteTrigger(TriggerOutput* out, HistBlock* blk)
+{
+  HistFileHeader hdr;
+  int i, j;
+
+  if(out->cfg->Correction)
+  {
+    if((SetupCorrector(out, blk->histlen) < 0)
+      || (HistCorrect(&out->corrector, blk, out->cfg->ChannelMask, out->elapsed, out->correction) < 0))
+    {
+      memset(out->correction, 0, sizeof(out->correction)); //left uncorrected
+    }
+  }
+  if(out->cfg->HistFormat)
+  {
+    HistFileInit(&hdr, out->cfg->HistFormat, blk->numchannels, blk->histlen);
+    HistFileSettings(&hdr, out->cfg);
+    hdr.syncrate = out->syncrate;
+    hdr.resolution = out->resolution;
+    hdr.elapsed = out->elapsed;
+    hdr.frame = out->frames++;
+    hdr.start = out->start;
+    return HistFileWrite(fileno(out->fp), &hdr, blk->counts, blk->histlen);
+  }
+  fprintf(out->fp, "Frame %lld  Triggers %lld..%lld  Start %.3f ms  Measured %.3f ms\n",
+    (long long)out->frames++, (long long)out->first, (long long)out->first, out->start * 1e3, out->elapsed);
+  fprintf(out->fp, "Integral ");
+  for(i = 0; i < blk->numchannels; i++)
+  {
+    fprintf(out->fp, " %llu", (unsigned long long)blk->stats[i].integral);
+  }
+  fprintf(out->fp, "\n");
+  if(out->cfg->Correction)
+  {
+    PrintCorrection(out, blk->numchannels);
+  }
+  for(j = 0; j < blk->histlen; j++)
+  {
+    for(i = 0; i < blk->numchannels; i++)
+    {
+      fprintf(out->fp, "%5d ", HistChannel(blk, i)[j]);
+    }
+    fprintf(out->fp, "\n");
+  }
+  return ferror(out->fp) ? -1 : 0;
+}
+
+
+// a group of triggers as one frame of the output file, from the 64 bit sums
+static int WriteGroup(TriggerOutput* out)
+{
+  HistAccum* a = &out->sum;
+  HistFileHeader hdr;
+  const uint64_t* totals[MAXINPCHAN];
+  uint64_t integral[MAXINPCHAN];
+  int i, j;
+
+  for(i = 0; i < a->numchannels; i++)
+  {
+    totals[i] = AccumTotals(a, i);
+    integral[i] = 0;
+    for(j = 0; totals[i] && (j < a->histlen); j++)
+    {
+      integral[i] += totals[i][j];
+    }
+  }
+  if(out->cfg->Correction) //the sum, not each trigger, over the time measured in all of them
+  {
+    memset(out->correction, 0, sizeof(out->correction));
+    for(i = 0; (SetupCorrector(out, a->histlen) == 0) && (i < a->numchannels); i++)
+    {
+      if(totals[i])
+      {
+        memcpy(out->corrected + (size_t)i * a->histlen, totals[i], a->histlen * sizeof(uint64_t));
+        if(HistCorrectOne64(&out->corrector, out->corrected + (size_t)i * a->histlen,
+          out->corrector.cyclerate * out->elapsed * 1e-3, &out->correction[i]) == 0)
+        {
+          totals[i] = out->corrected + (size_t)i * a->histlen; //else left uncorrected
+        }
+      }
+    }
+  }
+  if(out->cfg->HistFormat) //64 bit whatever the format, see histfile.h
+  {
+    HistFileInit(&hdr, HISTFILE_RAW64, a->numchannels, a->histlen);
+    HistFileSettings(&hdr, out->cfg);
+    hdr.syncrate = out->syncrate;
+    hdr.resolution = out->resolution;
+    hdr.elapsed = out->elapsed;
+    hdr.frame = out->frames++;
+    hdr.start = out->start;
+    hdr.acquisitions = (uint32_t)a->added;
+    return HistFileWrite64(fileno(out->fp), &hdr, totals);
+  }
+  fprintf(out->fp, "Frame %lld  Triggers %lld..%lld  Start %.3f ms  Measured %.3f ms\n",
+    (long long)out->frames++, (long long)out->first, (long long)(out->first + a->added - 1), out->start * 1e3,
+    out->elapsed);
+  fprintf(out->fp, "Integral ");
+  for(i = 0; i < a->numchannels; i++)
+  {
+    fprintf(out->fp, " %llu", (unsigned long long)integral[i]);
+  }
+  fprintf(out->fp, "\n");
+  if(out->cfg->Correction)
+  {
+    PrintCorrection(out, a->numchannels);
+  }
+  for(j = 0; j < a->histlen; j++)
+  {
+    for(i = 0; i < a->numchannels; i++)
+    {
+      fprintf(out->fp, "%5llu ", totals[i] ? (unsigned long long)totals[i][j] : 0ULL);
+    }
+    fprintf(out->fp, "\n");
+  }
+  return ferror(out->fp) ? -1 : 0;
+}
+
+
+// on the worker thread, while the next trigger is awaited
+static int TriggerFrame(void* user, HistFrame* f)
+{
+  TriggerOutput* out = (TriggerOutput*)user;
+  int i, group = out->cfg->TriggerGroup;
+
+  HistStats(&f->hist, out->cfg->ChannelMask, out->cfg->StopOverflow ? out->cfg->StopCount : 0xFFFFFFFF);
+  if(f->flags & FLAG_OVERFLOW)
+  {
+    out->overflows++;
+  }
+  if(out->log)
+  {
+    fprintf(out->log, "%8lld %12.3f %10.3f %8.3f %d ", (long long)f->index, f->start * 1e3, f->elapsed,
+      f->dead * 1e3, (f->flags & FLAG_OVERFLOW) ? 1 : 0);
+    for(i = 0; i < f->hist.numchannels; i++)
+    {
+      fprintf(out->log, " %llu%s", (unsigned long long)f->hist.stats[i].integral, f->hist.stats[i].overflow ? "*" : "");
+    }
+    fprintf(out->log, "\n");
+  }
+
+  if(out->insum == 0)
+  {
+    out->first = f->index;
+    out->start = f->start;
+    out->elapsed = 0;
+    AccumClear(&out->sum);
+  }
+  out->elapsed += f->elapsed;
+  if(group == 1)
+  {
+    return WriteTrigger(out, &f->hist); //nothing to sum
+  }
+  if(AccumAdd(&out->sum, &f->hist, 0, f->elapsed) < 0)
+  {
+    return -1;
+  }
+  out->insum++;
+  if(out->insum == group)
+  {
+    out->insum = 0;
+    return WriteGroup(out);
+  }
+  return 0;
+}
+
+
+// externally triggered acquisitions, rearmed right after each readout
+static int RunTriggered(int devidx, const MeasConfig* cfg, int numchannels, int histlen, double resolution,
+  int syncrate, FILE* fpout)
+{
+  HistSeries* series = NULL;
+  HistFrame* f;
+  TriggerOutput out;
+  char Errorstring[40];
+  double armed;
+  int retcode, ctcstatus, n, ret = -1;
+
+  memset(&out, 0, sizeof(out));
+  out.fp = fpout;
+  out.cfg = cfg;
+  out.resolution = resolution;
+  out.syncrate = syncrate;
+  CorrectorInit(&out.corrector);
+  if(cfg->Correction)
+  {
+    out.corrected = (uint64_t*)RtAlloc((size_t)numchannels * histlen * sizeof(uint64_t), cfg->LowLatency);
+  }
+  if((AccumInit(&out.sum, numchannels, histlen, cfg->ChannelMask, 0, 0, cfg->LowLatency) < 0)
+    || (cfg->Correction && (out.corrected == NULL)))
+  {
+    printf("\nOut of memory. Aborted.\n");
+    goto ex;
+  }
+  if(cfg->TriggerLog[0])
+  {
+    if((out.log = fopen(cfg->TriggerLog, "w")) == NULL)
+    {
+      printf("\ncannot open trigger log %s\n", cfg->TriggerLog);
+      goto ex;
+    }
+    fprintf(out.log, "# trigger   start/ms  measured/ms  dead/ms overflow  integral per channel, * = peak at limit\n");
+  }
+  series = SeriesCreate(cfg->KineticRing, numchannels, histlen, cfg->LowLatency, TriggerFrame, &out);
+  if(series == NULL)
+  {
+    printf("\nCannot set up the trigger ring. Aborted.\n");
+    goto ex;
+  }
+  if(cfg->TriggerGroup > 0)
+  {
+    printf("\n\nWaiting for %d triggers, %d per output frame...", cfg->Triggers, cfg->TriggerGroup);
+  }
+  else
+  {
+    printf("\n\nWaiting for %d triggers, all summed in one output frame...", cfg->Triggers);
+  }
+  fflush(stdout);
+
+  for(n = 0; n < cfg->Triggers; n++)
+  {
+    f = SeriesAcquire(series);
+
+    retcode = MH_ClearHistMem(devidx);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    retcode = MH_StartMeas(devidx, cfg->Tacq);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+    armed = SeriesTime(series);
+    f->start = armed; //the dead time is the gap in which a trigger would be missed
+
+    if(cfg->MeasControl != MEASCTRL_SINGLESHOT_CTC) //wait for the hardware start on C1
+    {
+      ctcstatus = 1;
+      while(ctcstatus == 1)
+      {
+        retcode = MH_CTCStatus(devidx, &ctcstatus);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+          goto ex;
+        }
+        if(cfg->TriggerTimeout && (SeriesTime(series) - armed) * 1e3 > cfg->TriggerTimeout)
+        {
+          MH_StopMeas(devidx);
+          printf("\nNo trigger within %d ms, ending the run after %d triggers.", cfg->TriggerTimeout, n);
+          ret = 0;
+          goto ex;
+        }
+      }
+    }
+
+    ctcstatus = 0;
+    while(ctcstatus == 0)
+    {
+      retcode = MH_CTCStatus(devidx, &ctcstatus);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+        goto ex;
+      }
+    }
+    f->end = SeriesTime(series);
+
+    retcode = MH_GetElapsedMeasTime(devidx, &f->elapsed);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetElapsedMeasTime error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    retcode = MH_StopMeas(devidx);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
 
+    retcode = MH_GetFlags(devidx, &f->flags);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
 
-unsigned int counts[MAXINPCHAN][MAXHISTLEN];
+    retcode = MH_GetAllHistograms(devidx, f->hist.counts);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetAllHistograms error %d (%s). Aborted.\n", retcode, Errorstring);
+      goto ex;
+    }
+
+    SeriesSubmit(series, f); //summed and written while the next trigger is awaited
+  }
+  ret = 0;
+
+ex:
+  if(series)
+  {
+    if(SeriesFinish(series, stdout) > 0)
+    {
+      printf("\nfile write error\n");
+      ret = -1;
+    }
+    if(out.insum > 0) //the last group is short
+    {
+      if(WriteGroup(&out) < 0)
+      {
+        printf("\nfile write error\n");
+        ret = -1;
+      }
+    }
+    printf("\n  %lld triggers with overflow, %lld frames written\n", (long long)out.overflows,
+      (long long)out.frames);
+  }
+  if(out.log && (fclose(out.log) != 0))
+  {
+    printf("\ntrigger log write error\n");
+    ret = -1;
+  }
+  AccumFree(&out.sum);
+  RtFree(out.corrected, (size_t)numchannels * histlen * sizeof(uint64_t));
+  CorrectorFree(&out.corrector);
+  return ret;
+}
 
 
 int main(int argc, char* argv[])
 {
   int dev[MAXDEVNUM];
   int found=0;
-  FILE *fpout;
+  FILE *fpout = NULL;
   int retcode;
   int ctcstatus;
   char LIB_Version[8];
@@ -63,35 +474,42 @@ int main(int argc, char* argv[])
   char Errorstring[40];
   int NumChannels;
   int HistLen;
-  int Binning=0; //you can change this
-  int Offset=0; 
-  int Tacq=100; //Measurement time in millisec, you can change this
-  int SyncDivider = 1; //you can change this
-
-  int SyncTiggerEdge = 0; //you can change this
-  int SyncTriggerLevel = -100; //you can change this
-  int InputTriggerEdge = 0; //you can change this
-  int InputTriggerLevel = -100; //you can change this
+  MeasConfig base; //settings as loaded, see mhconfig.h
+  MeasConfig cfg;  //settings of the current run of a scan
+  char cfgerror[200];
+  int run;
+  int failed = 0; //exit status for batch scripts
  
+  HistFileHeader hfhdr; //see histfile.h
   double Resolution; 
   int Syncrate;
   int Countrate;
   double Integralcount; 
   double elapsed;
+  CorrSettings cs;
+  HistCorrection correction;
   int i,j;
   int flags;
   int warnings;
   char warningstext[16384]; //must have 16384 bytest text buffer
   char cmd=0;
 
-  int meascontrol 
+
+
+  //defaults, you can change these or override them by file or command line
+  ConfigDefaults(&base, MODE_HIST, "histomode.out");
+  base.Tacq = 100; //Measurement time in millisec
+  base.SyncTriggerLevel = -100;
+  base.InputTriggerLevel = -100;
+  base.StopOverflow = 0; //for example only
+  base.StopCount = 10000;
+  base.MeasControl
     = MEASCTRL_SINGLESHOT_CTC;    // start by software and stop when CTC expires (default)
  // = MEASCTRL_C1_GATED;           // measure while C1 is active		1
  // = MEASCTRL_C1_START_CTC_STOP; // start with C1 and stop when CTC expires 
  // = MEASCTRL_C1_START_C2_STOP;  // start with C1 and stop with C2
-  int edge1 = EDGE_RISING;  //Edge of C1 to start (if applicable in chosen mode)
-  int edge2 = EDGE_FALLING; //Edge of C2 to stop (if applicable in chosen mode)
-
+  base.StartEdge = EDGE_RISING;  //Edge of C1 to start (if applicable in chosen mode)
+  base.StopEdge = EDGE_FALLING; //Edge of C2 to stop (if applicable in chosen mode)
 
   memset(Errorstring, 0x00, sizeof(Errorstring));
   memset(warningstext, 0x00, sizeof(warningstext));
@@ -105,10 +523,32 @@ int main(int argc, char* argv[])
     printf("\nWarning: The application was built for version %s.", LIB_VERSION);
   }
 
-  if((fpout = fopen("histomode.out", "w")) == NULL)
+  if(ConfigParseArgs(&base, argc, argv) < 0)
   {
-    printf("\ncannot open output file\n"); 
-    goto ex;
+    return 1;
+  }
+
+  //check everything before the first device call
+  if(base.Mode != MODE_HIST)
+  {
+    printf("\nMode must be %d (histogramming). Aborted.\n", MODE_HIST);
+    return 1;
+  }
+  if(ConfigValidate(&base, cfgerror, sizeof(cfgerror)) < 0)
+  {
+    printf("\nInvalid settings: %s. Aborted.\n", cfgerror);
+    return 1;
+  }
+
+  counts = (unsigned int (*)[MAXHISTLEN])RtAlloc(sizeof(unsigned int) * MAXINPCHAN * MAXHISTLEN, base.LowLatency);
+  if (counts == NULL)
+  {
+    printf("\nOut of memory. Aborted.\n");
+    return 1;
+  }
+  if (base.LowLatency)
+  {
+    RtEnterMeasured(base.RtPriority, base.RtCpu, stdout);
   }
 
   printf("\nSearching for MultiHarp devices...");
@@ -147,23 +587,20 @@ int main(int argc, char* argv[])
   if(found < 1)
   {
     printf("\nNo device available.");
+    failed = 1;
     goto ex; 
   }
 
   printf("\nUsing device #%1d", dev[0]);
 
-  fprintf(fpout, "Binning           : %d\n", Binning);
-  fprintf(fpout, "Offset            : %d\n", Offset);
-  fprintf(fpout, "AcquisitionTime   : %d\n", Tacq);
-  fprintf(fpout, "SyncDivider       : %d\n", SyncDivider);
-
   printf("\nInitializing the device...");
 
-  retcode = MH_Initialize(dev[0], MODE_HIST, 0);  //Histo mode with internal clock
+  retcode = MH_Initialize(dev[0], MODE_HIST, base.RefSource);  //Histo mode, internal clock by default
   if(retcode < 0)
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_Initialize error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
 
@@ -172,6 +609,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetHardwareInfo error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -184,6 +622,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetNumOfInputChannels error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -191,170 +630,163 @@ int main(int argc, char* argv[])
     printf("\nDevice has %i input channels.", NumChannels);
   }
 
-  retcode = MH_SetSyncDiv(dev[0], SyncDivider);
-  if(retcode < 0)
+  //all runs of a scan use the same open device, only the settings change
+  for(run = 0; run < ConfigNumRuns(&base); run++)
   {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    ConfigForRun(&base, run, &cfg);
 
-  retcode = MH_SetSyncEdgeTrg(dev[0], SyncTriggerLevel, SyncTiggerEdge);
-  if (retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    if((fpout = fopen(cfg.OutFile, cfg.HistFormat ? "wb" : "w")) == NULL)
+    {
+      printf("\ncannot open output file %s\n", cfg.OutFile);
+      failed = 1;
+      goto ex;
+    }
 
-  retcode = MH_SetSyncChannelOffset(dev[0], 0);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    if(cfg.NumScan > 0)
+    {
+      printf("\n\nRun %d of %d, %s = %lld", run + 1, cfg.NumScan, cfg.ScanParam, cfg.ScanValues[run]);
+    }
 
-  for(i = 0; i < NumChannels; i++) // we use the same input offset for all channels
-  {
-    retcode = MH_SetInputEdgeTrg(dev[0], i, InputTriggerLevel, InputTriggerEdge);
-    if (retcode < 0)
+    if(!cfg.HistFormat) //the binary header is written with the counts
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto ex;
+      fprintf(fpout, "Binning           : %d\n", cfg.Binning);
+      fprintf(fpout, "Offset            : %d\n", cfg.Offset);
+      fprintf(fpout, "AcquisitionTime   : %d\n", cfg.Tacq);
+      fprintf(fpout, "SyncDivider       : %d\n", cfg.SyncDivider);
+      if(cfg.SyncDeadTime || cfg.InputDeadTime || cfg.Correction)
+      {
+        fprintf(fpout, "SyncDeadTime      : %d\n", cfg.SyncDeadTime);
+        fprintf(fpout, "InputDeadTime     : %d\n", cfg.InputDeadTime);
+        fprintf(fpout, "Corrected         : %d\n", cfg.Correction);
+      }
     }
 
-    retcode = MH_SetInputChannelOffset(dev[0], i, 0);
+    retcode = MH_SetSyncDiv(dev[0], cfg.SyncDivider);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    retcode = MH_SetInputChannelEnable(dev[0], i, 1);
+    retcode = MH_SetSyncEdgeTrg(dev[0], cfg.SyncTriggerLevel, cfg.SyncTriggerEdge);
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-  }
-
-  retcode = MH_SetHistoLen(dev[0], MAXLENCODE, &HistLen);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetHistoLen error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nHistogram length is %d", HistLen);
-
-  retcode = MH_SetBinning(dev[0], Binning);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetBinning error %d (%s). Aborted.\n",retcode,Errorstring);
-    goto ex;
-  }
-
-  retcode = MH_SetOffset(dev[0], Offset);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
- 
-  retcode = MH_GetResolution(dev[0], &Resolution);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
 
-  printf("\nResolution is %1.0lfps\n", Resolution);
-
-
-  // After Init allow 150 ms for valid  count rate readings
-  // Subsequently you get new values after every 100ms
-  Sleep(150);
-
-
-  retcode = MH_GetSyncRate(dev[0], &Syncrate);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nSyncrate=%1d/s", Syncrate);
+    retcode = MH_SetSyncChannelOffset(dev[0], cfg.SyncChannelOffset);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
 
-  for(i = 0; i < NumChannels; i++) // for all channels
-  {
-    retcode = MH_GetCountRate(dev[0], i, &Countrate);
+    retcode = MH_SetSyncDeadTime(dev[0], cfg.SyncDeadTime > 0, cfg.SyncDeadTime);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-    printf("\nCountrate[%1d]=%1d/s", i, Countrate);
-  }
 
-  printf("\n");
+    for(i = 0; i < NumChannels; i++) // we use the same input offset for all channels
+    {
+      retcode = MH_SetInputEdgeTrg(dev[0], i, cfg.InputTriggerLevel, cfg.InputTriggerEdge);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
-  //after getting the count rates you can check for warnings
-  retcode = MH_GetWarnings(dev[0], &warnings);
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+      retcode = MH_SetInputChannelOffset(dev[0], i, cfg.InputChannelOffset);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
-  if(warnings)
-  {
-    MH_GetWarningsText(dev[0], warningstext, warnings);
-    printf("\n\n%s", warningstext);
-  }
+      retcode = MH_SetInputDeadTime(dev[0], i, cfg.InputDeadTime > 0, cfg.InputDeadTime);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
 
-  retcode = MH_SetStopOverflow(dev[0], 0, 10000); //for example only
-  if(retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetStopOverflow error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+      retcode = MH_SetInputChannelEnable(dev[0], i, (int)((cfg.ChannelMask >> i) & 1));
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+    }
 
-  retcode = MH_SetMeasControl(dev[0], meascontrol , edge1, edge2);
-  if(retcode<0)
-  {
-    printf("\nMH_SetMeasControl error %d. Aborted.\n",retcode);
-    goto ex;
-  }
+    retcode = MH_SetHistoLen(dev[0], cfg.HistLenCode, &HistLen);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetHistoLen error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+    printf("\nHistogram length is %d", HistLen);
 
+    retcode = MH_SetBinning(dev[0], cfg.Binning);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetBinning error %d (%s). Aborted.\n",retcode,Errorstring);
+      failed = 1;
+      goto ex;
+    }
 
-  while(cmd != 'q')
-  {
-    MH_ClearHistMem(dev[0]);
+    retcode = MH_SetOffset(dev[0], cfg.Offset);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+ 
+    retcode = MH_GetResolution(dev[0], &Resolution);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    printf("\npress RETURN to start measurement");
-    getchar();
+    printf("\nResolution is %1.0lfps\n", Resolution);
+
+
+    // After Init allow 150 ms for valid  count rate readings
+    // Subsequently you get new values after every 100ms
+    Sleep(150);
+
 
     retcode = MH_GetSyncRate(dev[0], &Syncrate);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
       printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
     printf("\nSyncrate=%1d/s", Syncrate);
@@ -366,122 +798,276 @@ int main(int argc, char* argv[])
       {
         MH_GetErrorString(Errorstring, retcode);
         printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
       printf("\nCountrate[%1d]=%1d/s", i, Countrate);
     }
-        
-    retcode = MH_StartMeas(dev[0], Tacq); 
+
+    printf("\n");
+
+    //after getting the count rates you can check for warnings
+    retcode = MH_GetWarnings(dev[0], &warnings);
     if(retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-         
-    if( meascontrol != MEASCTRL_SINGLESHOT_CTC )
+
+    if(warnings)
+    {
+      MH_GetWarningsText(dev[0], warningstext, warnings);
+      printf("\n\n%s", warningstext);
+    }
+
+    retcode = MH_SetStopOverflow(dev[0], cfg.StopOverflow, cfg.StopCount);
+    if(retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetStopOverflow error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+
+    retcode = MH_SetMeasControl(dev[0], cfg.MeasControl, cfg.StartEdge, cfg.StopEdge);
+    if(retcode<0)
     {
-      printf("\nwaiting for hardware start on C1...");
-	  fflush(stdout);
-      ctcstatus=1;
-      while(ctcstatus==1)
+      printf("\nMH_SetMeasControl error %d. Aborted.\n",retcode);
+      failed = 1;
+      goto ex;
+    }
+
+
+    if(cfg.Triggers > 0)
+    {
+      if(RunTriggered(dev[0], &cfg, NumChannels, HistLen, Resolution, Syncrate, fpout) < 0)
       {
-        retcode = MH_CTCStatus(dev[0], &ctcstatus);
-        if(retcode<0)
+        failed = 1;
+        goto ex;
+      }
+      if(fclose(fpout) != 0)
+      {
+        printf("\nfile write error\n");
+        failed = 1;
+      }
+      fpout = NULL;
+      continue;
+    }
+
+    cmd = 0;
+    while(cmd != 'q')
+    {
+      MH_ClearHistMem(dev[0]);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_ClearHistMem error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      if(!cfg.Batch)
+      {
+        printf("\npress RETURN to start measurement");
+        getchar();
+      }
+
+      retcode = MH_GetSyncRate(dev[0], &Syncrate);
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetSyncRate error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+      printf("\nSyncrate=%1d/s", Syncrate);
+
+      for(i = 0; i < NumChannels; i++) // for all channels
+      {
+        retcode = MH_GetCountRate(dev[0], i, &Countrate);
+        if(retcode < 0)
         {
-          printf("\nMH_CTCStatus error %d. Aborted.\n",retcode);
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
           goto ex;
         }
+        printf("\nCountrate[%1d]=%1d/s", i, Countrate);
+      }
+        
+      retcode = MH_StartMeas(dev[0], cfg.Tacq); 
+      if(retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+         
+      if( cfg.MeasControl != MEASCTRL_SINGLESHOT_CTC )
+      {
+        printf("\nwaiting for hardware start on C1...");
+        fflush(stdout);
+        ctcstatus=1;
+        while(ctcstatus==1)
+        {
+          retcode = MH_CTCStatus(dev[0], &ctcstatus);
+          if(retcode<0)
+          {
+            printf("\nMH_CTCStatus error %d. Aborted.\n",retcode);
+            failed = 1;
+            goto ex;
+          }
+        }
       }
-    }
 
-    if((meascontrol==MEASCTRL_SINGLESHOT_CTC)||meascontrol==MEASCTRL_C1_START_CTC_STOP)
-      printf("\n\nMeasuring for %1d milliseconds...",Tacq);
+      if((cfg.MeasControl==MEASCTRL_SINGLESHOT_CTC)||cfg.MeasControl==MEASCTRL_C1_START_CTC_STOP)
+        printf("\n\nMeasuring for %1d milliseconds...",cfg.Tacq);
 
-    if(meascontrol==MEASCTRL_C1_GATED)
-      printf("\n\nMeasuring, waiting for other C1 edge to stop...");
+      if(cfg.MeasControl==MEASCTRL_C1_GATED)
+        printf("\n\nMeasuring, waiting for other C1 edge to stop...");
 
-    if(meascontrol==MEASCTRL_C1_START_C2_STOP)
-      printf("\n\nMeasuring, waiting for C2 to stop...");
+      if(cfg.MeasControl==MEASCTRL_C1_START_C2_STOP)
+        printf("\n\nMeasuring, waiting for C2 to stop...");
 
-	fflush(stdout);
+      fflush(stdout);
         
-    ctcstatus = 0;
+      ctcstatus = 0;
 
-    while(ctcstatus == 0)
-    {
-      retcode = MH_CTCStatus(dev[0], &ctcstatus);
+      while(ctcstatus == 0)
+      {
+        retcode = MH_CTCStatus(dev[0], &ctcstatus);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+      }
+
+      retcode = MH_StopMeas(dev[0]);
       if(retcode < 0)
       {
         MH_GetErrorString(Errorstring, retcode);
-        printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+        printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
-    }
 
-    retcode = MH_StopMeas(dev[0]);
-    if(retcode < 0)
-    {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto ex;
-    }
+      retcode = MH_GetElapsedMeasTime(dev[0], &elapsed);
+      if(retcode<0)
+      {
+        printf("\nTH260_GetElapsedMeasTime error %1d. Aborted.\n",retcode);
+        failed = 1;
+        goto ex;
+      }
+      printf("\n  Elapsed measurement time was %1.0lf ms", elapsed);
 
-    retcode = MH_GetElapsedMeasTime(dev[0], &elapsed);
-    if(retcode<0)
-    {
-      printf("\nTH260_GetElapsedMeasTime error %1d. Aborted.\n",retcode);
-      goto ex;
-    }
-    printf("\n  Elapsed measurement time was %1.0lf ms", elapsed);
+      printf("\n");
+      for(i = 0; i< NumChannels; i++) // for all channels
+      {
+        retcode = MH_GetHistogram(dev[0], counts[i], i);
+        if(retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetHistogram error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
 
-    printf("\n");
-    for(i = 0; i< NumChannels; i++) // for all channels
-    {
-      retcode = MH_GetHistogram(dev[0], counts[i], i);
+        Integralcount = 0;
+        for(j = 0; j < HistLen; j++)
+        {
+          Integralcount += counts[i][j];
+        }
+
+        printf("\n  Integralcount[%1d]=%1.0lf", i, Integralcount);
+      }
+      printf("\n");
+
+      if(cfg.Correction) //the saved histograms are the corrected ones
+      {
+        cs.resolution = Resolution;
+        cs.histlen = HistLen;
+        cs.syncrate = Syncrate;
+        cs.syncdivider = cfg.SyncDivider;
+        cs.syncdeadtime = cfg.SyncDeadTime;
+        cs.inputdeadtime = cfg.InputDeadTime;
+        for(i = 0; i < NumChannels; i++)
+        {
+          if((CorrectorSetup(&corrector, &cs) < 0)
+            || (HistCorrectOne(&corrector, counts[i], corrector.cyclerate * elapsed * 1e-3, &correction) < 0))
+          {
+            printf("\n  No correction without sync rate and elapsed time");
+            break;
+          }
+          printf("\n  Corrected[%1d]=%1.0lf%s", i, correction.corrected,
+            correction.saturated ? "  saturated bins left as measured" : "");
+        }
+        printf("\n");
+      }
+
+      retcode = MH_GetFlags(dev[0], &flags);
       if(retcode < 0)
       {
         MH_GetErrorString(Errorstring, retcode);
-        printf("\nMH_GetHistogram error %d (%s). Aborted.\n", retcode, Errorstring);
+        printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
 
-      Integralcount = 0;
-      for(j = 0; j < HistLen; j++)
+      if(flags & FLAG_OVERFLOW)
       {
-        Integralcount += counts[i][j];
+        printf("\n  Overflow.");
       }
 
-      printf("\n  Integralcount[%1d]=%1.0lf", i, Integralcount);
+      if(cfg.Batch)
+      {
+        cmd = 'q'; //one measurement per run
+      }
+      else
+      {
+        printf("\nEnter c to continue or q to quit and save the count data.");
+        cmd = getchar();
+        getchar();
+      }
     }
-    printf("\n");
 
-    retcode = MH_GetFlags(dev[0], &flags);
-    if(retcode < 0)
+    if(cfg.HistFormat)
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto ex;
+      HistFileInit(&hfhdr, cfg.HistFormat, NumChannels, HistLen);
+      HistFileSettings(&hfhdr, &cfg);
+      hfhdr.syncrate = Syncrate;
+      hfhdr.resolution = Resolution;
+      hfhdr.elapsed = elapsed;
+      if(HistFileWrite(fileno(fpout), &hfhdr, counts[0], MAXHISTLEN) < 0)
+      {
+        printf("\nfile write error\n");
+        failed = 1;
+      }
     }
-
-    if(flags & FLAG_OVERFLOW)
+    else
     {
-      printf("\n  Overflow.");
+      for(j = 0; j < HistLen; j++)
+      {
+        for(i = 0; i < NumChannels; i++)
+        {
+          fprintf(fpout, "%5d ", counts[i][j]);
+        }
+        fprintf(fpout, "\n");
+      }
     }
 
-    printf("\nEnter c to continue or q to quit and save the count data.");
-    cmd = getchar();
-    getchar();
-  }
-
-  for(j = 0; j < HistLen; j++)
-  {
-    for(i = 0; i < NumChannels; i++)
+    if(fclose(fpout) != 0)
     {
-      fprintf(fpout, "%5d ", counts[i][j]);
+      printf("\nfile write error\n");
+      failed = 1;
     }
-    fprintf(fpout, "\n");
-  }
+    fpout = NULL;
+  } //end of runs
 
   ex:
   for(i = 0; i < MAXDEVNUM; i++) //no harm to close all
@@ -492,10 +1078,15 @@ int main(int argc, char* argv[])
   {
     fclose(fpout);
   }
-  printf("\npress RETURN to exit");
-  getchar();
+  RtFree(counts, sizeof(unsigned int) * MAXINPCHAN * MAXHISTLEN);
+  CorrectorFree(&corrector);
+  if(!base.Batch)
+  {
+    printf("\npress RETURN to exit");
+    getchar();
+  }
 
-  return 0;
+  return failed;
 }
 
 
@@ -0,0 +1,259 @@
+/************************************************************************
+
+Random access to recorded MultiHarp T2/T3 files through their index
+
+tttrmode writes an index next to the output file with IndexInterval set
+(see ../common/tttrindex.h). This tool uses it to jump to a time or a
+marker and decodes only the requested range, from raw or compressed
+files alike.
+
+Usage: mhseek [-i index] [-t start,end] [-m first,count] [-e] file
+
+  -i index        default is file with .idx appended
+  -t start,end    the events from start to end, in s
+  -m first,count  the events from marker first (0-based) up to marker
+                  first + count, default count 1
+  -e              list the events, time in ps, channel, dtime
+
+Without -t or -m it prints what the index says about the file.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "tttrcodec.h"
+#include "tttrindex.h"
+#include "mhrt.h"
+
+
+#define CHUNK  65536
+
+static unsigned int buffer[CHUNK];
+static TTTREvent events[CHUNK];
+static uint64_t counts[MAXINPCHAN + 2];
+
+
+static double Ps(const IndexHeader* hdr, const TTTREvent* e)
+{
+  if (hdr->mode == MODE_T2)
+  {
+    return e->Time * hdr->resolution;
+  }
+  return e->Time * hdr->syncperiod + e->DTime * hdr->resolution;
+}
+
+
+static void Summary(const TTTRIndex* idx)
+{
+  const IndexHeader* h = &idx->hdr;
+  const IndexEntry* last = IndexGet(idx, idx->n - 1);
+  const uint64_t* c = IndexCounts(idx, idx->n - 1);
+  double unit = (h->mode == MODE_T2) ? h->resolution : h->syncperiod;
+  int64_t i, markers = 0;
+  uint32_t k;
+
+  for (i = 0; i < idx->n; i++)
+  {
+    markers += (IndexGet(idx, i)->flags & INDEX_MARKER) != 0;
+  }
+  printf("\nMode T%d, resolution %.1f ps", (h->mode == MODE_T2) ? 2 : 3, h->resolution);
+  if (h->mode == MODE_T3)
+  {
+    printf(", sync period %.1f ps", h->syncperiod);
+  }
+  printf("\n%lld entries, %lld at markers, every %u records%s", (long long)idx->n, (long long)markers,
+    h->interval, (last->flags & INDEX_END) ? "" : " (incomplete, the recording did not end cleanly)");
+  printf("\n%llu records, last event at %.6f s", (unsigned long long)last->record, last->time * unit * 1e-12);
+  for (k = 0; k + 1 < h->ncounts; k++)
+  {
+    if (c[k])
+    {
+      printf("\n  %s %2u %12llu", k ? "input" : "sync ", k, (unsigned long long)c[k]);
+    }
+  }
+  printf("\n  markers  %12llu\n", (unsigned long long)c[h->ncounts - 1]);
+}
+
+
+int main(int argc, char* argv[])
+{
+  TTTRIndex* idx;
+  TTTRDecoder dec;
+  FILE* fp;
+  char idxname[1024] = "";
+  double start = -1, end = -1, unit, t0, ps;
+  long long first = -1, count = 1;
+  int list = 0, mode;
+  int64_t entry;
+  uint64_t tstart = 0, tend = UINT64_MAX, marker = 0, records = 0, found = 0;
+  int opt, n, nev, i, inwindow, done = 0;
+  unsigned k;
+
+  while ((opt = getopt(argc, argv, "i:t:m:e")) != -1)
+  {
+    switch (opt)
+    {
+    case 'i':
+      snprintf(idxname, sizeof(idxname), "%s", optarg);
+      break;
+    case 't':
+      if (sscanf(optarg, "%lf,%lf", &start, &end) != 2)
+      {
+        optind = argc + 1;
+      }
+      break;
+    case 'm':
+      if (sscanf(optarg, "%lld,%lld", &first, &count) < 1)
+      {
+        optind = argc + 1;
+      }
+      break;
+    case 'e':
+      list = 1;
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ((optind != argc - 1) || ((start >= 0) && (first >= 0)))
+  {
+    printf("usage: %s [-i index] [-t start,end | -m first,count] [-e] file\n", argv[0]);
+    return 1;
+  }
+  if (idxname[0] == 0)
+  {
+    snprintf(idxname, sizeof(idxname), "%s%s", argv[optind], INDEX_SUFFIX);
+  }
+
+  idx = IndexLoad(idxname);
+  if (idx == NULL)
+  {
+    printf("\ncannot read index %s\n", idxname);
+    return 1;
+  }
+  if ((start < 0) && (first < 0))
+  {
+    Summary(idx);
+    IndexFree(idx);
+    return 0;
+  }
+
+  fp = (CodecIsCompressed(argv[optind]) == 1) ? CodecOpenRead(argv[optind], 2, &mode, NULL)
+    : fopen(argv[optind], "rb");
+  if (fp == NULL)
+  {
+    printf("\ncannot open %s\n", argv[optind]);
+    IndexFree(idx);
+    return 1;
+  }
+
+  t0 = RtNow();
+  unit = (idx->hdr.mode == MODE_T2) ? idx->hdr.resolution : idx->hdr.syncperiod;
+  if (start >= 0)
+  {
+    if (unit <= 0)
+    {
+      printf("\nthe index has no time unit, use -m\n");
+      fclose(fp);
+      IndexFree(idx);
+      return 1;
+    }
+    tstart = (uint64_t)(start * 1e12 / unit);
+    tend = (uint64_t)(end * 1e12 / unit);
+    entry = IndexFindTime(idx, tstart);
+  }
+  else
+  {
+    entry = IndexFindMarker(idx, (uint64_t)first);
+    marker = IndexCounts(idx, entry)[idx->hdr.ncounts - 1];  // markers before the entry
+  }
+  if (IndexSeek(idx, entry, fp, &dec) < 0)
+  {
+    printf("\ncannot seek in %s\n", argv[optind]);
+    fclose(fp);
+    IndexFree(idx);
+    return 1;
+  }
+  printf("\nStarting at entry %lld, record %llu", (long long)entry,
+    (unsigned long long)IndexGet(idx, entry)->record);
+
+  inwindow = 0;
+  while (!done && ((n = (int)fread(buffer, 4, CHUNK, fp)) > 0))
+  {
+    records += n;
+    nev = (idx->hdr.mode == MODE_T2) ? DecodeT2(&dec, buffer, n, events) : DecodeT3(&dec, buffer, n, events);
+    for (i = 0; (i < nev) && !done; i++)
+    {
+      if (first >= 0)
+      {
+        if (events[i].Channel & EVENT_MARKER)
+        {
+          if (marker == (uint64_t)first)
+          {
+            inwindow = 1;
+          }
+          if (marker == (uint64_t)(first + count))
+          {
+            done = 1;
+            break;
+          }
+          marker++;
+        }
+      }
+      else
+      {
+        if (events[i].Time >= tend)
+        {
+          done = 1;  // times only grow
+          break;
+        }
+        inwindow = (events[i].Time >= tstart);
+      }
+      if (!inwindow)
+      {
+        continue;
+      }
+      found++;
+      counts[(events[i].Channel & EVENT_MARKER) ? idx->hdr.ncounts - 1 : events[i].Channel]++;
+      if (list)
+      {
+        ps = Ps(&idx->hdr, &events[i]);
+        if (events[i].Channel & EVENT_MARKER)
+        {
+          printf("\n%.0f marker %d", ps, events[i].Channel & ~EVENT_MARKER);
+        }
+        else
+        {
+          printf("\n%.0f %d %d", ps, events[i].Channel, events[i].DTime);
+        }
+      }
+    }
+  }
+  if (ferror(fp))
+  {
+    printf("\nfile read error or corrupt data");
+  }
+
+  printf("\n\n%llu events in the range, %llu records decoded of %llu, %.3f s", (unsigned long long)found,
+    (unsigned long long)records, (unsigned long long)IndexGet(idx, idx->n - 1)->record, RtNow() - t0);
+  for (k = 0; k + 1 < idx->hdr.ncounts; k++)
+  {
+    if (counts[k])
+    {
+      printf("\n  %s %2u %12llu", k ? "input" : "sync ", k, (unsigned long long)counts[k]);
+    }
+  }
+  printf("\n  markers  %12llu\n", (unsigned long long)counts[idx->hdr.ncounts - 1]);
+
+  fclose(fp);
+  IndexFree(idx);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/************************************************************************
+
+  Replay of recorded raw TTTR files for the simulated MHLib
+
+  See mhreplay.h. The record layout follows the MultiHarp T2 and T3
+  formats as decoded in the tttrmode_instant_processing demo.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "mhreplay.h"
+
+
+struct ReplayState
+{
+  const unsigned int* rec;
+  uint64_t nrec;
+  size_t maplen;
+  int mode;
+  double unit;        // ps per time tag (T2) or per sync period (T3)
+
+  uint64_t scan;      // records that have arrived
+  uint64_t read;      // records that have been read
+  uint64_t ofl;       // overflow correction at the scan cursor
+  double tlast;       // ps, time of the record before the scan cursor
+  int ended;
+};
+
+
+ReplayState* ReplayOpen(const char* path, int mode, double unit)
+{
+  ReplayState* r;
+  struct stat st;
+  void* map = NULL;
+  int fd;
+
+  if ((mode != MODE_T2) && (mode != MODE_T3))
+  {
+    printf("\nreplay: %s can only be replayed in T2 or T3 mode", path);
+    return NULL;
+  }
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    printf("\nreplay: cannot open %s", path);
+    return NULL;
+  }
+  if ((fstat(fd, &st) < 0) || (st.st_size < 4))
+  {
+    printf("\nreplay: %s is empty", path);
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    printf("\nreplay: cannot map %s", path);
+    return NULL;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  r = (ReplayState*)calloc(1, sizeof(ReplayState));
+  if (r == NULL)
+  {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  r->rec = (const unsigned int*)map;
+  r->nrec = st.st_size / 4;
+  r->maplen = st.st_size;
+  r->mode = mode;
+  r->unit = unit;
+  return r;
+}
+
+
+void ReplayClose(ReplayState* r)
+{
+  if (r)
+  {
+    munmap((void*)r->rec, r->maplen);
+    free(r);
+  }
+}
+
+
+void ReplayRewind(ReplayState* r)
+{
+  r->scan = 0;
+  r->read = 0;
+  r->ofl = 0;
+  r->tlast = 0;
+  r->ended = 0;
+}
+
+
+void ReplayAdvance(ReplayState* r, double tnow, double tend, uint64_t maxlevel)
+{
+  uint64_t stop = r->read + maxlevel;
+  uint64_t scan = r->scan;
+  uint64_t ofl = r->ofl;
+  unsigned int rec;
+  double t;
+
+  if (stop > r->nrec)
+  {
+    stop = r->nrec;
+  }
+  while (scan < stop)
+  {
+    rec = r->rec[scan];
+    if (r->mode == MODE_T2)
+    {
+      if ((rec >> 25) == 0x7F) // special, channel 0x3F: overflow
+      {
+        ofl += (uint64_t)T2WRAPAROUND * (rec & 0x1FFFFFF); // as tttrdecode, a count of 0 adds none
+        t = ofl * r->unit;
+      }
+      else
+      {
+        t = (ofl + (rec & 0x1FFFFFF)) * r->unit;
+      }
+    }
+    else
+    {
+      if ((rec >> 25) == 0x7F)
+      {
+        ofl += (uint64_t)T3WRAPAROUND * (rec & 0x3FF);
+        t = ofl * r->unit;
+      }
+      else
+      {
+        t = (ofl + (rec & 0x3FF)) * r->unit;
+      }
+    }
+    if (t > tend)
+    {
+      r->ended = 1;
+      break;
+    }
+    if (t > tnow)
+    {
+      break;
+    }
+    r->ofl = ofl;   // the overflow only counts once the record has arrived
+    r->tlast = t;
+    scan++;
+  }
+  r->scan = scan;
+  if (scan == r->nrec)
+  {
+    r->ended = 1;
+  }
+}
+
+
+uint64_t ReplayLevel(const ReplayState* r)
+{
+  return r->scan - r->read;
+}
+
+
+int ReplayRead(ReplayState* r, unsigned int* buffer, int maxrec)
+{
+  uint64_t n = r->scan - r->read;
+
+  if (n > (uint64_t)maxrec)
+  {
+    n = maxrec;
+  }
+  memcpy(buffer, r->rec + r->read, n * 4);
+  r->read += n;
+  return (int)n;
+}
+
+
+int ReplayEnded(const ReplayState* r)
+{
+  return r->ended;
+}
+
+
+double ReplayTime(const ReplayState* r)
+{
+  return r->tlast;
+}
+
+
+uint64_t ReplayRecords(const ReplayState* r)
+{
+  return r->nrec;
+}
@@ -0,0 +1,55 @@
+/************************************************************************
+
+  Replay of recorded raw TTTR files for the simulated MHLib
+
+  A replay serves the records of a file written by the tttrmode demo
+  through MH_ReadFiFo instead of generated ones. The file is mapped
+  into memory and scanned with overflow correction, so that records
+  can be released in step with their own time stamps.
+
+  Two cursors are kept: the scan cursor marks how far records have
+  "arrived" in the FIFO, the read cursor how far they have been read
+  out. The difference is the FIFO level.
+
+************************************************************************/
+
+#ifndef MHREPLAY_H
+#define MHREPLAY_H
+
+#include <stdint.h>
+
+#define PACE_MAX  0   // as fast as the reader can take the records
+
+typedef struct ReplayState ReplayState;
+
+
+// Maps the file for replay in MODE_T2 or MODE_T3. For T2 the time unit is
+// the resolution in ps, for T3 the sync period in ps. Returns NULL and
+// prints a message if the file cannot be used.
+ReplayState* ReplayOpen(const char* path, int mode, double unit);
+void ReplayClose(ReplayState* r);
+
+// Rewinds both cursors to the start of the file.
+void ReplayRewind(ReplayState* r);
+
+// Lets records arrive up to time tnow (ps since the start), but not past
+// tend, where the measurement ends, and never more than maxlevel records
+// ahead of the read cursor.
+void ReplayAdvance(ReplayState* r, double tnow, double tend, uint64_t maxlevel);
+
+// Number of records that have arrived and not been read.
+uint64_t ReplayLevel(const ReplayState* r);
+
+// Copies up to maxrec arrived records to buffer, returns their number.
+int ReplayRead(ReplayState* r, unsigned int* buffer, int maxrec);
+
+// True once the end of the file or tend has been reached.
+int ReplayEnded(const ReplayState* r);
+
+// Time in ps of the last record that has arrived.
+double ReplayTime(const ReplayState* r);
+
+// Total number of records in the file.
+uint64_t ReplayRecords(const ReplayState* r);
+
+#endif
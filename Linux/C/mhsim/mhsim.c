@@ -0,0 +1,1170 @@
+/************************************************************************
+
+  Simulated MHLib for MultiHarp 150/160
+
+  Builds a drop-in replacement for mhlib.so that exports the MHLib API
+  of mhlib.h but talks to no hardware. Event records are produced by the
+  synthetic generator in ../common/tttrgen.c at the wall clock pace of
+  the measurement, so the demos behave as with a real device:
+
+    make
+    cd ../tttrmode && make LPATH=../mhsim/ && ./tttrmode -b
+
+  The simulated FIFO fills at the expected record rate and is drained
+  by MH_ReadFiFo. If the consumer falls behind by more than the FIFO
+  size, FLAG_FIFOFULL is raised and the measurement stops, as on the
+  real device. The device clock stands still while MH_ReadFiFo
+  generates records, so at rates beyond the generator (some Mrec/s) a
+  run takes longer than Tacq, but an overrun still only means that the
+  reader fell behind.
+
+  The model is configured through environment variables, read on
+  MH_Initialize:
+
+    MHSIM_DEVICES     number of devices that can be opened       (1)
+    MHSIM_CHANNELS    input channels per device                  (8)
+    MHSIM_SOURCE      poisson, pulsed or correlated              (pulsed)
+    MHSIM_SYNCRATE    sync (laser) rate in Hz                    (1e6)
+    MHSIM_RATE        photon rate per channel in cps             (1e5)
+    MHSIM_LIFETIME    decay time in ps, pulsed source            (2000)
+    MHSIM_IRF         IRF width (sigma) in ps                    (50)
+    MHSIM_CORRDELAY   pair delay in ps, correlated source        (0)
+    MHSIM_MARKERRATE  marker rate in Hz when markers enabled     (0)
+    MHSIM_FIFOSIZE    FIFO capacity in records                   (67108864)
+    MHSIM_STALL       ms MH_ReadFiFo stalls after every second of
+                      measurement it ran, a reader that overruns (0)
+    MHSIM_SEED        random seed                                (fixed)
+
+  Instead of generating records, a raw file written by the tttrmode demo
+  can be replayed in T2 or T3 mode:
+
+    MHSIM_REPLAY      file to replay, a %d in the name is replaced by
+                      the device index for per-device files
+    MHSIM_PACE        realtime, max, or a factor of real time    (realtime)
+
+  With pacing, records become available when the measurement time
+  reaches their overflow corrected time stamp (T3 uses the sync period
+  from MHSIM_SYNCRATE and the sync divider), and the FIFO can overrun
+  as with generated data. With max, each MH_ReadFiFo returns a full
+  chunk of TTREADMAX records until the file or Tacq is exhausted.
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhsim.h"
+#include "tttrgen.h"
+#include "mhreplay.h"
+
+
+#define SIM_BASERES     5.0       // ps
+#define SIM_FIFOSIZE    67108864  // records
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  int open;
+  int initialized;
+  int mode;
+  int refsource;
+  GenParams gp;
+  GenState* gen;
+  double fifosize;
+  double stall;           // s the reader stalls after every second
+  double nextstall;       // measurement time of the next stall
+  double recordrate;      // records/s expected in the current setup
+  char replayfile[256];   // empty if records are generated
+  double pace;            // replay speed relative to real time, PACE_MAX
+  ReplayState* replay;
+
+  int syncdiv;
+  int binning;
+  int offset;             // ns
+  int lencode;
+  int histlen;
+  int markerenable;
+  int stopovfl;
+  unsigned int stopcount;
+  int meascontrol;
+
+  int running;            // between MH_StartMeas and MH_StopMeas
+  int ctcdone;
+  double tstart;          // monotonic s
+  double tgen;            // s spent generating records, the device clock stands still
+  double tacq;            // s
+  double tfull;           // measurement time at which the FIFO overran
+  int flags;              // sticky flags
+  unsigned int starttime[3];
+
+  unsigned int* hist;     // MAXINPCHAN x MAXHISTLEN
+  int histused;           // bins per channel written since the last clear
+  double histtime;        // measurement time already in hist, s
+} SimDevice;
+
+static SimDevice simdev[MAXDEVNUM];
+static pthread_once_t siminit = PTHREAD_ONCE_INIT;
+
+
+static void SimInit(void)
+{
+  int i;
+  for (i = 0; i < MAXDEVNUM; i++)
+  {
+    memset(&simdev[i], 0, sizeof(SimDevice));
+    pthread_mutex_init(&simdev[i].lock, NULL);
+  }
+}
+
+
+static double Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static double EnvDouble(const char* name, double def)
+{
+  const char* s = getenv(name);
+  return (s && *s) ? atof(s) : def;
+}
+
+
+static int NumDevices(void)
+{
+  int n = (int)EnvDouble("MHSIM_DEVICES", 1);
+  return (n < 0) ? 0 : (n > MAXDEVNUM) ? MAXDEVNUM : n;
+}
+
+
+// locks and returns the device or NULL, with the error code in *err
+static SimDevice* GetDevice(int devidx, int needinit, int* err)
+{
+  SimDevice* d;
+
+  pthread_once(&siminit, SimInit);
+  if ((devidx < 0) || (devidx >= MAXDEVNUM))
+  {
+    *err = MH_ERROR_INVALID_ARGUMENT;
+    return NULL;
+  }
+  d = &simdev[devidx];
+  pthread_mutex_lock(&d->lock);
+  if (!d->open)
+  {
+    pthread_mutex_unlock(&d->lock);
+    *err = MH_ERROR_DEVICE_NOT_OPEN;
+    return NULL;
+  }
+  if (needinit && !d->initialized)
+  {
+    pthread_mutex_unlock(&d->lock);
+    *err = MH_ERROR_NOT_INITIALIZED;
+    return NULL;
+  }
+  *err = MH_ERROR_NONE;
+  return d;
+}
+
+#define DEVICE(needinit) \
+  int err; \
+  SimDevice* d = GetDevice(devidx, needinit, &err); \
+  if (d == NULL) return err
+
+#define RETURN(code) \
+  do { pthread_mutex_unlock(&d->lock); return (code); } while (0)
+
+
+static int ValidChannel(SimDevice* d, int channel)
+{
+  return (channel >= 0) && (channel < d->gp.NumChannels);
+}
+
+
+// measurement time in s that has passed, limited by CTC and FIFO overrun
+static double MeasTime(SimDevice* d)
+{
+  double t;
+  if (!d->running)
+  {
+    return d->histtime;
+  }
+  t = Now() - d->tstart - d->tgen;
+  if (d->replay)
+  {
+    // replay ends with the data, not with the wall clock
+    t = (d->pace == PACE_MAX) ? ReplayTime(d->replay) * 1e-12 : t * d->pace;
+    return (t > d->tacq) ? d->tacq : t;
+  }
+  if (t >= d->tacq)
+  {
+    t = d->tacq;
+    d->ctcdone = 1;
+  }
+  if ((d->tfull > 0) && (t > d->tfull))
+  {
+    t = d->tfull;
+  }
+  return t;
+}
+
+
+// same as FiFoLevel below for a replay
+static double ReplayFiFoLevel(SimDevice* d)
+{
+  double level;
+
+  if (d->running && (d->tfull == 0))
+  {
+    if (d->pace == PACE_MAX)
+    {
+      ReplayAdvance(d->replay, 1e300, d->tacq * 1e12, TTREADMAX);
+    }
+    else
+    {
+      ReplayAdvance(d->replay, MeasTime(d) * 1e12, d->tacq * 1e12, (uint64_t)d->fifosize + 1);
+    }
+    if (ReplayEnded(d->replay))
+    {
+      d->ctcdone = 1;
+    }
+  }
+  level = (double)ReplayLevel(d->replay);
+  if ((level > d->fifosize) && (d->tfull == 0) && d->running)
+  {
+    d->flags |= FLAG_FIFOFULL;
+    d->tfull = MeasTime(d);
+    d->ctcdone = 1;
+  }
+  return level;
+}
+
+
+// brings the FIFO model up to date, raises FLAG_FIFOFULL on overrun
+static double FiFoLevel(SimDevice* d)
+{
+  double t, level;
+
+  if (d->replay)
+  {
+    return ReplayFiFoLevel(d);
+  }
+  if ((d->gen == NULL) || (d->mode == MODE_HIST))
+  {
+    return 0;
+  }
+  t = MeasTime(d);
+  level = (t - GenTime(d->gen) * 1e-12) * d->recordrate;
+  if ((level > d->fifosize) && (d->tfull == 0) && d->running)
+  {
+    // the hardware stops filling when the FIFO is full
+    d->flags |= FLAG_FIFOFULL;
+    d->tfull = GenTime(d->gen) * 1e-12 + d->fifosize / d->recordrate;
+    d->ctcdone = 1;
+    level = d->fifosize;
+  }
+  return (level < 0) ? 0 : level;
+}
+
+
+// adds the histogram counts for the measurement time not yet accounted for
+static void FoldHistogram(SimDevice* d)
+{
+  double t = MeasTime(d);
+  int i, j;
+
+  if ((d->mode != MODE_HIST) || (d->gen == NULL) || (t <= d->histtime))
+  {
+    return;
+  }
+  for (i = 0; i < d->gp.NumChannels; i++)
+  {
+    GenHistogram(d->gen, i, t - d->histtime, d->offset, d->hist + (size_t)i * MAXHISTLEN, d->histlen);
+  }
+  d->histtime = t;
+  d->histused = (d->histlen > d->histused) ? d->histlen : d->histused;
+
+  if (d->stopovfl)
+  {
+    for (i = 0; i < d->gp.NumChannels; i++)
+    {
+      for (j = 0; j < d->histlen; j++)
+      {
+        if (d->hist[(size_t)i * MAXHISTLEN + j] >= d->stopcount)
+        {
+          d->flags |= FLAG_OVERFLOW;
+          d->ctcdone = 1;
+        }
+      }
+    }
+  }
+}
+
+
+// replaces a %d in the replay file name with the device index
+static void ReplayFileName(char* name, int len, const char* pattern, int devidx)
+{
+  const char* p = strstr(pattern, "%d");
+
+  if (p == NULL)
+  {
+    snprintf(name, len, "%s", pattern);
+  }
+  else
+  {
+    snprintf(name, len, "%.*s%d%s", (int)(p - pattern), pattern, devidx, p + 2);
+  }
+}
+
+
+static int Rebuild(SimDevice* d)
+{
+  GenFree(d->gen);
+  d->gp.Mode = (d->mode == MODE_HIST) ? MODE_T3 : d->mode;
+  d->gp.SyncDivider = d->syncdiv;
+  d->gp.Binning = (d->mode == MODE_T2) ? 0 : d->binning;
+  d->gp.MarkerMask = d->markerenable;
+  d->gen = GenCreate(&d->gp);
+  d->recordrate = GenRecordRate(&d->gp);
+  return (d->gen == NULL) ? MH_ERROR_INVALID_MEMORY : MH_ERROR_NONE;
+}
+
+
+/* ------------------------------------------------------------------ */
+
+int _stdcall MH_GetLibraryVersion(char* vers)
+{
+  strcpy(vers, LIB_VERSION);
+  return MH_ERROR_NONE;
+}
+
+
+int _stdcall MH_GetErrorString(char* errstring, int errcode)
+{
+  static const struct { int code; const char* text; } errtab[] =
+  {
+    { MH_ERROR_NONE,              "NONE" },
+    { MH_ERROR_DEVICE_OPEN_FAIL,  "DEVICE_OPEN_FAIL" },
+    { MH_ERROR_DEVICE_BUSY,       "DEVICE_BUSY" },
+    { MH_ERROR_DEVICE_NOT_OPEN,   "DEVICE_NOT_OPEN" },
+    { MH_ERROR_INSTANCE_RUNNING,  "INSTANCE_RUNNING" },
+    { MH_ERROR_INVALID_ARGUMENT,  "INVALID_ARGUMENT" },
+    { MH_ERROR_INVALID_MODE,      "INVALID_MODE" },
+    { MH_ERROR_INVALID_OPTION,    "INVALID_OPTION" },
+    { MH_ERROR_INVALID_MEMORY,    "INVALID_MEMORY" },
+    { MH_ERROR_NOT_INITIALIZED,   "NOT_INITIALIZED" },
+  };
+  int i;
+
+  for (i = 0; i < (int)(sizeof(errtab) / sizeof(errtab[0])); i++)
+  {
+    if (errtab[i].code == errcode)
+    {
+      strcpy(errstring, errtab[i].text);
+      return MH_ERROR_NONE;
+    }
+  }
+  sprintf(errstring, "ERROR %d", errcode);
+  return MH_ERROR_NONE;
+}
+
+
+int _stdcall MH_OpenDevice(int devidx, char* serial)
+{
+  SimDevice* d;
+
+  pthread_once(&siminit, SimInit);
+  serial[0] = 0;
+  if ((devidx < 0) || (devidx >= MAXDEVNUM))
+  {
+    return MH_ERROR_INVALID_ARGUMENT;
+  }
+  if (devidx >= NumDevices())
+  {
+    return MH_ERROR_DEVICE_OPEN_FAIL;
+  }
+  d = &simdev[devidx];
+  pthread_mutex_lock(&d->lock);
+  if (d->open)
+  {
+    pthread_mutex_unlock(&d->lock);
+    return MH_ERROR_DEVICE_BUSY;
+  }
+  d->open = 1;
+  d->initialized = 0;
+  sprintf(serial, "SIM%04d", devidx);
+  pthread_mutex_unlock(&d->lock);
+  return MH_ERROR_NONE;
+}
+
+
+int _stdcall MH_CloseDevice(int devidx)
+{
+  DEVICE(0);
+  GenFree(d->gen);
+  d->gen = NULL;
+  ReplayClose(d->replay);
+  d->replay = NULL;
+  free(d->hist);
+  d->hist = NULL;
+  d->open = 0;
+  d->initialized = 0;
+  d->running = 0;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_Initialize(int devidx, int mode, int refsource)
+{
+  const char* src;
+  DEVICE(0);
+
+  if ((mode != MODE_HIST) && (mode != MODE_T2) && (mode != MODE_T3))
+  {
+    RETURN(MH_ERROR_INVALID_MODE);
+  }
+  if ((refsource < REFSRC_INTERNAL) || (refsource > REFSRC_WR_GRANDM_MHARP))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+
+  GenDefaults(&d->gp);
+  d->gp.NumChannels = (int)EnvDouble("MHSIM_CHANNELS", 8);
+  if ((d->gp.NumChannels < 1) || (d->gp.NumChannels > MAXINPCHAN))
+  {
+    d->gp.NumChannels = 8;
+  }
+  d->gp.BaseResolution = SIM_BASERES;
+  d->gp.SyncRate = EnvDouble("MHSIM_SYNCRATE", d->gp.SyncRate);
+  d->gp.CountRate = EnvDouble("MHSIM_RATE", d->gp.CountRate);
+  d->gp.Lifetime = EnvDouble("MHSIM_LIFETIME", d->gp.Lifetime);
+  d->gp.IrfWidth = EnvDouble("MHSIM_IRF", d->gp.IrfWidth);
+  d->gp.CorrDelay = EnvDouble("MHSIM_CORRDELAY", d->gp.CorrDelay);
+  d->gp.MarkerRate = EnvDouble("MHSIM_MARKERRATE", d->gp.MarkerRate);
+  d->gp.Seed = (uint64_t)EnvDouble("MHSIM_SEED", (double)d->gp.Seed) + devidx;
+  src = getenv("MHSIM_SOURCE");
+  if (src && (strcasecmp(src, "poisson") == 0))
+  {
+    d->gp.Source = GEN_POISSON;
+  }
+  else if (src && (strcasecmp(src, "correlated") == 0))
+  {
+    d->gp.Source = GEN_CORRELATED;
+  }
+  else
+  {
+    d->gp.Source = GEN_PULSED;
+  }
+  d->fifosize = EnvDouble("MHSIM_FIFOSIZE", SIM_FIFOSIZE);
+  d->stall = EnvDouble("MHSIM_STALL", 0) * 1e-3;
+  d->replayfile[0] = 0;
+  src = getenv("MHSIM_REPLAY");
+  if (src && *src)
+  {
+    ReplayFileName(d->replayfile, sizeof(d->replayfile), src, devidx);
+  }
+  src = getenv("MHSIM_PACE");
+  if (src && (strcasecmp(src, "max") == 0))
+  {
+    d->pace = PACE_MAX;
+  }
+  else if (src && (atof(src) > 0))
+  {
+    d->pace = atof(src);
+  }
+  else
+  {
+    d->pace = 1.0;
+  }
+  ReplayClose(d->replay);
+  d->replay = NULL;
+
+  if (d->hist == NULL)
+  {
+    d->hist = (unsigned int*)calloc((size_t)MAXINPCHAN * MAXHISTLEN, sizeof(unsigned int));
+    if (d->hist == NULL)
+    {
+      RETURN(MH_ERROR_INVALID_MEMORY);
+    }
+  }
+
+  d->mode = mode;
+  d->refsource = refsource;
+  d->syncdiv = 1;
+  d->binning = 0;
+  d->offset = 0;
+  d->lencode = MAXLENCODE;
+  d->histlen = MAXHISTLEN;
+  d->markerenable = 0;
+  d->stopovfl = 1;
+  d->stopcount = STOPCNTMAX;
+  d->meascontrol = MEASCTRL_SINGLESHOT_CTC;
+  d->running = 0;
+  d->ctcdone = 1;
+  d->flags = 0;
+  d->histtime = 0;
+  d->histused = 0;
+  memset(d->hist, 0, (size_t)MAXINPCHAN * MAXHISTLEN * sizeof(unsigned int));
+  d->initialized = 1;
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MH_GetHardwareInfo(int devidx, char* model, char* partno, char* version)
+{
+  DEVICE(1);
+  sprintf(model, "MultiHarp 150 %dP", d->gp.NumChannels);
+  strcpy(partno, "SIM");
+  strcpy(version, "1.0");
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetSerialNumber(int devidx, char* serial)
+{
+  DEVICE(1);
+  sprintf(serial, "SIM%04d", devidx);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetFeatures(int devidx, int* features)
+{
+  DEVICE(1);
+  *features = FEATURE_DLL | FEATURE_TTTR | FEATURE_MARKERS | FEATURE_LOWRES
+    | FEATURE_TRIGOUT | FEATURE_PROG_TD;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetBaseResolution(int devidx, double* resolution, int* binsteps)
+{
+  DEVICE(1);
+  *resolution = d->gp.BaseResolution;
+  *binsteps = BINSTEPSMAX;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetNumOfInputChannels(int devidx, int* nchannels)
+{
+  DEVICE(1);
+  *nchannels = d->gp.NumChannels;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetSyncDiv(int devidx, int div)
+{
+  DEVICE(1);
+  if ((div < SYNCDIVMIN) || (div > SYNCDIVMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->syncdiv = div;
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MH_SetSyncEdgeTrg(int devidx, int level, int edge)
+{
+  DEVICE(1);
+  if ((level < TRGLVLMIN) || (level > TRGLVLMAX) || (edge < 0) || (edge > 1))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetSyncChannelOffset(int devidx, int value)
+{
+  DEVICE(1);
+  if ((value < CHANOFFSMIN) || (value > CHANOFFSMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetSyncDeadTime(int devidx, int on, int deadtime)
+{
+  DEVICE(1);
+  if (on && ((deadtime < EXTDEADMIN) || (deadtime > EXTDEADMAX)))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetInputEdgeTrg(int devidx, int channel, int level, int edge)
+{
+  DEVICE(1);
+  if (!ValidChannel(d, channel) || (level < TRGLVLMIN) || (level > TRGLVLMAX)
+    || (edge < 0) || (edge > 1))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetInputChannelOffset(int devidx, int channel, int value)
+{
+  DEVICE(1);
+  if (!ValidChannel(d, channel) || (value < CHANOFFSMIN) || (value > CHANOFFSMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetInputDeadTime(int devidx, int channel, int on, int deadtime)
+{
+  DEVICE(1);
+  if (!ValidChannel(d, channel) || (on && ((deadtime < EXTDEADMIN) || (deadtime > EXTDEADMAX))))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetInputHysteresis(int devidx, int hystcode)
+{
+  DEVICE(1);
+  if ((hystcode < HYSTCODEMIN) || (hystcode > HYSTCODEMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetInputChannelEnable(int devidx, int channel, int enable)
+{
+  DEVICE(1);
+  if (!ValidChannel(d, channel))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  if (enable)
+  {
+    d->gp.ChannelMask |= 1ULL << channel;
+  }
+  else
+  {
+    d->gp.ChannelMask &= ~(1ULL << channel);
+  }
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MH_SetStopOverflow(int devidx, int stop_ovfl, unsigned int stopcount)
+{
+  DEVICE(1);
+  if (stopcount < STOPCNTMIN)
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->stopovfl = stop_ovfl;
+  d->stopcount = stopcount;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetBinning(int devidx, int binning)
+{
+  DEVICE(1);
+  if ((binning < 0) || (binning >= BINSTEPSMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->binning = binning;
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MH_SetOffset(int devidx, int offset)
+{
+  DEVICE(1);
+  if ((offset < OFFSETMIN) || (offset > OFFSETMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->offset = offset;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetHistoLen(int devidx, int lencode, int* actuallen)
+{
+  DEVICE(1);
+  if ((lencode < MINLENCODE) || (lencode > MAXLENCODE))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->lencode = lencode;
+  d->histlen = 1024 << lencode;
+  *actuallen = d->histlen;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetMeasControl(int devidx, int control, int startedge, int stopedge)
+{
+  DEVICE(1);
+  if ((control < MEASCTRL_SINGLESHOT_CTC) || (control > MEASCTRL_WR_S2M))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  // without external signals, all modes start immediately like singleshot
+  d->meascontrol = control;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetTriggerOutput(int devidx, int period)
+{
+  DEVICE(1);
+  if ((period < TRIGOUTMIN) || (period > TRIGOUTMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_ClearHistMem(int devidx)
+{
+  int i;
+  DEVICE(1);
+  if (d->running)
+  {
+    RETURN(MH_ERROR_INSTANCE_RUNNING);
+  }
+  for (i = 0; i < d->gp.NumChannels; i++) //only what was written, not the whole 16 MB
+  {
+    memset(d->hist + (size_t)i * MAXHISTLEN, 0, d->histused * sizeof(unsigned int));
+  }
+  d->histused = 0;
+  d->histtime = 0;
+  d->flags &= ~FLAG_OVERFLOW;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_StartMeas(int devidx, int tacq)
+{
+  struct timespec ts;
+  unsigned __int128 ps;
+  int ret;
+  DEVICE(1);
+
+  if ((tacq < ACQTMIN) || (tacq > ACQTMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  if (d->mode != MODE_HIST)
+  {
+    ret = Rebuild(d);  // fresh time base and empty FIFO
+    if (ret < 0)
+    {
+      RETURN(ret);
+    }
+  }
+  ReplayClose(d->replay);
+  d->replay = NULL;
+  if (d->replayfile[0] && (d->mode != MODE_HIST))
+  {
+    d->replay = ReplayOpen(d->replayfile, d->mode, (d->mode == MODE_T2)
+      ? d->gp.BaseResolution : 1e12 * d->syncdiv / d->gp.SyncRate);
+    if (d->replay == NULL)
+    {
+      RETURN(MH_ERROR_DEVICE_OPEN_FAIL);
+    }
+  }
+  d->running = 1;
+  d->ctcdone = 0;
+  d->flags &= ~FLAG_FIFOFULL;
+  d->tfull = 0;
+  d->tacq = tacq * 1e-3;
+  d->tstart = Now();
+  d->tgen = 0;
+  d->nextstall = 0.5;
+  if (d->mode == MODE_HIST)
+  {
+    d->histtime = 0;  // the histogram memory keeps its counts until cleared
+  }
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ps = (unsigned __int128)ts.tv_sec * 1000000000000ULL + (unsigned __int128)ts.tv_nsec * 1000;
+  d->starttime[0] = (unsigned int)ps;
+  d->starttime[1] = (unsigned int)(ps >> 32);
+  d->starttime[2] = (unsigned int)(ps >> 64);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_StopMeas(int devidx)
+{
+  DEVICE(1);
+  if (d->running)
+  {
+    FoldHistogram(d);
+    d->histtime = MeasTime(d);
+    d->tacq = d->histtime;  // further reads see the end of the data
+    d->ctcdone = 1;
+  }
+  d->running = 0;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_CTCStatus(int devidx, int* ctcstatus)
+{
+  DEVICE(1);
+  if (d->running && (d->replay == NULL))
+  {
+    MeasTime(d);
+    FiFoLevel(d);
+  }
+  // a replay only ends in MH_ReadFiFo, so that a reader that checks
+  // the CTC after an empty read gets every record of the file
+  *ctcstatus = d->ctcdone;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetHistogram(int devidx, unsigned int* chcount, int channel)
+{
+  DEVICE(1);
+  if (d->mode != MODE_HIST)
+  {
+    RETURN(MH_ERROR_INVALID_MODE);
+  }
+  if (!ValidChannel(d, channel) || (d->lencode < 2))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  FoldHistogram(d);
+  memcpy(chcount, d->hist + (size_t)channel * MAXHISTLEN, d->histlen * sizeof(unsigned int));
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetAllHistograms(int devidx, unsigned int* chcount)
+{
+  int i;
+  DEVICE(1);
+  if (d->mode != MODE_HIST)
+  {
+    RETURN(MH_ERROR_INVALID_MODE);
+  }
+  FoldHistogram(d);
+  for (i = 0; i < d->gp.NumChannels; i++)
+  {
+    memcpy(chcount + (size_t)i * d->histlen, d->hist + (size_t)i * MAXHISTLEN,
+      d->histlen * sizeof(unsigned int));
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetResolution(int devidx, double* resolution)
+{
+  DEVICE(1);
+  *resolution = (d->mode == MODE_T2) ? d->gp.BaseResolution
+    : d->gp.BaseResolution * (1 << d->binning);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetSyncPeriod(int devidx, double* period)
+{
+  DEVICE(1);
+  *period = (d->gp.SyncRate > 0) ? 1.0 / d->gp.SyncRate : 0;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetSyncRate(int devidx, int* syncrate)
+{
+  DEVICE(1);
+  *syncrate = (int)d->gp.SyncRate;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetCountRate(int devidx, int channel, int* cntrate)
+{
+  DEVICE(1);
+  if (!ValidChannel(d, channel))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  *cntrate = ((d->gp.ChannelMask >> channel) & 1) ? (int)d->gp.CountRate : 0;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetAllCountRates(int devidx, int* syncrate, int* cntrates)
+{
+  int i;
+  DEVICE(1);
+  *syncrate = (int)d->gp.SyncRate;
+  for (i = 0; i < d->gp.NumChannels; i++)
+  {
+    cntrates[i] = ((d->gp.ChannelMask >> i) & 1) ? (int)d->gp.CountRate : 0;
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetFlags(int devidx, int* flags)
+{
+  DEVICE(1);
+  if (d->running)
+  {
+    FiFoLevel(d);
+    if (d->mode == MODE_HIST)
+    {
+      FoldHistogram(d);
+    }
+  }
+  *flags = d->flags;
+  if (d->running && !d->ctcdone)
+  {
+    *flags |= FLAG_ACTIVE;
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetElapsedMeasTime(int devidx, double* elapsed)
+{
+  DEVICE(1);
+  *elapsed = MeasTime(d) * 1e3;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetStartTime(int devidx, unsigned int* timedw2, unsigned int* timedw1, unsigned int* timedw0)
+{
+  DEVICE(1);
+  *timedw2 = d->starttime[2];
+  *timedw1 = d->starttime[1];
+  *timedw0 = d->starttime[0];
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetWarnings(int devidx, int* warnings)
+{
+  DEVICE(1);
+  *warnings = 0;
+  if (d->gp.SyncRate == 0)
+  {
+    *warnings |= WARNING_SYNC_RATE_ZERO;
+  }
+  if (d->gp.CountRate == 0)
+  {
+    *warnings |= WARNING_INPT_RATE_ZERO;
+  }
+  if ((d->mode == MODE_T2) && (d->syncdiv > 1))
+  {
+    *warnings |= WARNING_DIVIDER_GREATER_ONE;
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetWarningsText(int devidx, char* text, int warnings)
+{
+  DEVICE(1);
+  text[0] = 0;
+  if (warnings & WARNING_SYNC_RATE_ZERO)
+  {
+    strcat(text, "WARNING:\nThe sync rate is zero.\n\n");
+  }
+  if (warnings & WARNING_INPT_RATE_ZERO)
+  {
+    strcat(text, "WARNING:\nThe input rate is zero.\n\n");
+  }
+  if (warnings & WARNING_DIVIDER_GREATER_ONE)
+  {
+    strcat(text, "WARNING:\nIn T2 mode the sync divider should be 1.\n\n");
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetMarkerHoldoffTime(int devidx, int holdofftime)
+{
+  DEVICE(1);
+  if ((holdofftime < HOLDOFFMIN) || (holdofftime > HOLDOFFMAX))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetMarkerEdges(int devidx, int me1, int me2, int me3, int me4)
+{
+  DEVICE(1);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_SetMarkerEnable(int devidx, int en1, int en2, int en3, int en4)
+{
+  DEVICE(1);
+  d->markerenable = (en1 ? 1 : 0) | (en2 ? 2 : 0) | (en3 ? 4 : 0) | (en4 ? 8 : 0);
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MH_ReadFiFo(int devidx, unsigned int* buffer, int* nactual)
+{
+  double t, t0;
+  DEVICE(1);
+
+  *nactual = 0;
+  if (d->mode == MODE_HIST)
+  {
+    RETURN(MH_ERROR_INVALID_MODE);
+  }
+  if ((d->stall > 0) && d->running && (MeasTime(d) >= d->nextstall))
+  {
+    usleep((useconds_t)(d->stall * 1e6));  // the reader's time, so the FIFO fills
+    d->nextstall = MeasTime(d) + 1.0;
+  }
+  if (d->replay)
+  {
+    FiFoLevel(d);
+    *nactual = ReplayRead(d->replay, buffer, TTREADMAX);
+    RETURN(MH_ERROR_NONE);
+  }
+  if (d->gen == NULL)
+  {
+    RETURN(MH_ERROR_NONE);
+  }
+  FiFoLevel(d);
+  t = MeasTime(d);
+  t0 = Now();
+  *nactual = GenRead(d->gen, t * 1e12, buffer, TTREADMAX);
+  if (d->running)
+  {
+    d->tgen += Now() - t0;  // not the consumer's delay, so it does not fill the FIFO
+  }
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetDebugInfo(int devidx, char* debuginfo)
+{
+  DEVICE(0);
+  sprintf(debuginfo, "simulated device %d, FIFO level %.0f of %.0f records\n",
+    devidx, FiFoLevel(d), d->fifosize);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetNumOfModules(int devidx, int* nummod)
+{
+  DEVICE(1);
+  *nummod = 1 + (d->gp.NumChannels + 7) / 8;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MH_GetModuleInfo(int devidx, int modidx, int* modelcode, int* versioncode)
+{
+  DEVICE(1);
+  if ((modidx < 0) || (modidx >= 1 + (d->gp.NumChannels + 7) / 8))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  *modelcode = 0;
+  *versioncode = 0;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+/* White Rabbit and external FPGA are not simulated */
+
+int _stdcall MH_WRabbitGetMAC(int devidx, char* mac_addr) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitSetMAC(int devidx, char* mac_addr) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitGetInitScript(int devidx, char* initscript) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitSetInitScript(int devidx, char* initscript) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitGetSFPData(int devidx, char* sfpnames, int* dTxs, int* dRxs, int* alphas) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitSetSFPData(int devidx, char* sfpnames, int* dTxs, int* dRxs, int* alphas) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitInitLink(int devidx, int link_on) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitSetMode(int devidx, int bootfromscript, int reinit_with_mode, int mode) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitSetTime(int devidx, unsigned int timehidw, unsigned int timelodw) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitGetTime(int devidx, unsigned int* timehidw, unsigned int* timelodw, unsigned int* subsec16ns) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_WRabbitGetStatus(int devidx, int* wrstatus) { DEVICE(1); *wrstatus = 0; RETURN(MH_ERROR_NONE); }
+int _stdcall MH_WRabbitGetTermOutput(int devidx, char* buffer, int* nchar) { DEVICE(1); *nchar = 0; RETURN(MH_ERROR_NONE); }
+
+int _stdcall MH_ExtFPGAInitLink(int devidx, int linknumber, int on) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_ExtFPGAGetLinkStatus(int devidx, int linknumber, unsigned int* status) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_ExtFPGASetMode(int devidx, int mode, int loopback) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_ExtFPGAResetStreamFifos(int devidx) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+int _stdcall MH_ExtFPGAUserCommand(int devidx, int write, unsigned int addr, unsigned int* data) { DEVICE(1); RETURN(MH_ERROR_INVALID_OPTION); }
+
+
+/* ------------------------------------------------------------------ */
+/* simulator extensions, see mhsim.h                                  */
+
+int _stdcall MHSim_GetFiFoLevel(int devidx, double* records)
+{
+  DEVICE(1);
+  *records = FiFoLevel(d);
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MHSim_GetFiFoSize(int devidx, double* records)
+{
+  DEVICE(1);
+  *records = d->fifosize;
+  RETURN(MH_ERROR_NONE);
+}
+
+
+int _stdcall MHSim_SetCountRate(int devidx, double cps)
+{
+  DEVICE(1);
+  if (cps < 0)
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->gp.CountRate = cps;
+  RETURN(Rebuild(d));
+}
+
+
+int _stdcall MHSim_SetSource(int devidx, int source)
+{
+  DEVICE(1);
+  if ((source < GEN_POISSON) || (source > GEN_CORRELATED))
+  {
+    RETURN(MH_ERROR_INVALID_ARGUMENT);
+  }
+  d->gp.Source = source;
+  RETURN(Rebuild(d));
+}
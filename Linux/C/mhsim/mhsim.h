@@ -0,0 +1,28 @@
+/*
+    Simulated MHLib for MultiHarp 150/160, extensions
+
+    The simulator exports everything declared in mhlib.h. The functions
+    below are not part of MHLib, they only exist in the simulator and
+    give test tools access to the model behind the API.
+*/
+
+#ifndef MHSIM_H
+#define MHSIM_H
+
+#ifndef _WIN32
+#define _stdcall
+#endif
+
+// current number of records waiting in the simulated FIFO
+extern int _stdcall MHSim_GetFiFoLevel(int devidx, double* records);
+
+// capacity of the simulated FIFO in records
+extern int _stdcall MHSim_GetFiFoSize(int devidx, double* records);
+
+// changes the photon rate per channel, takes effect with the next MH_StartMeas
+extern int _stdcall MHSim_SetCountRate(int devidx, double cps);
+
+// changes the source model (GEN_xxx in tttrgen.h), takes effect as above
+extern int _stdcall MHSim_SetSource(int devidx, int source);
+
+#endif
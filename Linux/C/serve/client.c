@@ -0,0 +1,230 @@
+/************************************************************************
+
+Test client of the live TTTR stream server
+
+Connects to mhserve (see ../common/mhstream.h), subscribes to the
+chosen streams and reports once per second what arrived: frames and
+MB/s per stream, the last count rates and the peak of each histogram.
+It is also the throughput test of the server, e.g. with mhshmbench
+as the producer:
+
+  ../shm/mhshmbench -c 0 -t 10 /mhbench &  ./mhserve /mhbench &  ./mhclient -s raw
+
+Usage: mhclient [-a address] [-s streams] [-m mask] [-d n] [-p ms]
+                [-b bins] [-t seconds]
+
+  -a address   unix:/path or tcp:port              (unix:/tmp/mhserve.sock)
+  -s streams   comma separated raw,events,rates,histo,analysis  (rates)
+               and corrected, for histo and analysis corrected for
+               pile-up and dead-time losses
+  -m mask      input channels for events, histo and analysis (0xFFFFFFFFFFFFFFFF)
+  -d n         send only every n-th event          (1)
+  -p ms        period of rates and histograms      (1000)
+  -b bins      bins per histogram                  (1024)
+  -t seconds   stop after this time, 0 = never     (0)
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "mhstream.h"
+#include "tttrdecode.h"
+#include "mhrt.h"
+
+
+static unsigned int payload[STREAM_MAXPAYLOAD / sizeof(unsigned int)];
+
+
+static uint32_t ParseStreams(char* text)
+{
+  uint32_t streams = 0;
+  char* tok;
+
+  for (tok = strtok(text, ","); tok; tok = strtok(NULL, ","))
+  {
+    if (strcmp(tok, "raw") == 0)
+    {
+      streams |= STREAM_WANT_RAW;
+    }
+    else if (strcmp(tok, "events") == 0)
+    {
+      streams |= STREAM_WANT_EVENTS;
+    }
+    else if (strcmp(tok, "rates") == 0)
+    {
+      streams |= STREAM_WANT_RATES;
+    }
+    else if (strcmp(tok, "histo") == 0)
+    {
+      streams |= STREAM_WANT_HISTO;
+    }
+    else if (strcmp(tok, "analysis") == 0)
+    {
+      streams |= STREAM_WANT_ANALYSIS;
+    }
+    else if (strcmp(tok, "corrected") == 0)
+    {
+      streams |= STREAM_WANT_CORRECTED;
+    }
+    else
+    {
+      return 0;
+    }
+  }
+  return streams;
+}
+
+
+int main(int argc, char* argv[])
+{
+  const char* address = STREAM_DEFAULTADDR;
+  char streams[64] = "rates";
+  StreamSubscribe sub;
+  StreamHeader hdr;
+  StreamHello* hello = (StreamHello*)payload;
+  StreamRates* rates = (StreamRates*)payload;
+  StreamHisto* histo = (StreamHisto*)payload;
+  StreamAnalysis* analysis = (StreamAnalysis*)payload;
+  StreamLost* lost = (StreamLost*)payload;
+  unsigned int* counts;
+  double seconds = 0, t0, last, now;
+  uint64_t frames[9] = { 0 }, bytes[9] = { 0 }, totalbytes = 0;
+  uint64_t events = 0;
+  unsigned int peak, peakbin;
+  int fd, opt, len, i;
+
+  memset(&sub, 0, sizeof(sub));
+  sub.channelmask = ~0ULL;
+  sub.decimate = 1;
+  sub.period = 1000;
+  sub.histbins = 1024;
+  while ((opt = getopt(argc, argv, "a:s:m:d:p:b:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'a':
+      address = optarg;
+      break;
+    case 's':
+      strncpy(streams, optarg, sizeof(streams) - 1);
+      break;
+    case 'm':
+      sub.channelmask = strtoull(optarg, NULL, 0);
+      break;
+    case 'd':
+      sub.decimate = atoi(optarg);
+      break;
+    case 'p':
+      sub.period = atoi(optarg);
+      break;
+    case 'b':
+      sub.histbins = atoi(optarg);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      printf("usage: %s [-a address] [-s raw,events,rates,histo,analysis] [-m mask] [-d n] [-p ms] [-b bins] [-t seconds]\n",
+        argv[0]);
+      return 1;
+    }
+  }
+  sub.streams = ParseStreams(streams);
+  if (sub.streams == 0)
+  {
+    printf("\nunknown stream in %s\n", streams);
+    return 1;
+  }
+
+  fd = StreamConnect(address);
+  if (fd < 0)
+  {
+    printf("\ncannot connect to %s (%s)\n", address, strerror(errno));
+    return 1;
+  }
+  if (StreamSend(fd, STREAM_SUBSCRIBE, &sub, sizeof(sub)) < 0)
+  {
+    printf("\ncannot subscribe (%s)\n", strerror(errno));
+    close(fd);
+    return 1;
+  }
+  printf("\nConnected to %s", address);
+
+  t0 = last = RtNow();
+  while ((len = StreamRecv(fd, &hdr, payload, sizeof(payload))) >= 0)
+  {
+    if (hdr.type < 9)
+    {
+      frames[hdr.type]++;
+      bytes[hdr.type] += len;
+      totalbytes += len + sizeof(hdr);
+    }
+    switch (hdr.type)
+    {
+    case STREAM_HELLO:
+      printf("\nRun %u, mode T%d, resolution %.0f ps", hello->run, (hello->mode == MODE_T2) ? 2 : 3,
+        hello->resolution);
+      break;
+    case STREAM_EVENTS:
+      events += len / sizeof(TTTREvent);
+      break;
+    case STREAM_RATES:
+      printf("\n  rates after %.1f s:", rates->elapsed);
+      for (i = 0; i < (int)rates->nrates; i++)
+      {
+        printf(" %s%.0f", i ? "" : "sync ", rates->rate[i]);
+      }
+      break;
+    case STREAM_HISTO:
+      counts = (unsigned int*)(histo + 1);
+      peak = peakbin = 0;
+      for (i = 0; i < (int)histo->nbins; i++)
+      {
+        if (counts[i] > peak)
+        {
+          peak = counts[i];
+          peakbin = i;
+        }
+      }
+      printf("\n  histogram input %u: %u bins of %u, peak %u at bin %u", histo->channel, histo->nbins,
+        histo->binwidth, peak, peakbin);
+      break;
+    case STREAM_ANALYSIS:
+      printf("\n  analysis input %u: %llu counts, peak at %u, centroid %.1f ps, FWHM %.1f ps, background %.2f,"
+        " lifetime %.1f ps", analysis->channel, (unsigned long long)analysis->total, analysis->peakbin,
+        analysis->centroid, analysis->fwhm, analysis->background, analysis->lifetime);
+      break;
+    case STREAM_LOST:
+      printf("\n  lost: %llu records in the ring, %llu frames for this client",
+        (unsigned long long)lost->records, (unsigned long long)lost->frames);
+      break;
+    }
+
+    now = RtNow();
+    if (now - last >= 1.0)
+    {
+      printf("\n%8.1f s  %9.1f MB/s  raw %llu frames  events %llu", now - t0, totalbytes / (now - last) * 1e-6,
+        (unsigned long long)frames[STREAM_RAW], (unsigned long long)events);
+      fflush(stdout);
+      totalbytes = 0;
+      last = now;
+    }
+    if ((seconds > 0) && (now - t0 >= seconds))
+    {
+      break;
+    }
+  }
+
+  now = RtNow();
+  printf("\n\nreceived %.1f MB raw, %.1f MB events in %.1f s\n", bytes[STREAM_RAW] * 1e-6,
+    bytes[STREAM_EVENTS] * 1e-6, now - t0);
+  close(fd);
+  return 0;
+}
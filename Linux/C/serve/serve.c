@@ -0,0 +1,627 @@
+/************************************************************************
+
+Live TTTR stream server
+
+Attaches to the shared memory ring that the tttrmode demo publishes
+with ShmName set (../common/mhshm.h) and serves the live data to local
+clients, such as GUIs, over a Unix domain socket or a loopback TCP
+port: the raw records, decoded events, count rates, T3 histogram
+snapshots and their analysis (../common/histanalysis.h), in the frames
+described in ../common/mhstream.h. Clients may ask for the histograms
+corrected for pile-up and dead-time losses (../common/histcorrect.h),
+for which the server must be told the input dead time of the producer.
+
+The acquisition itself never waits for the server, and the server
+never waits for a client. Each client has a send queue; a client that
+cannot keep up loses whole frames, and is told how many. Raw records
+go straight from the read buffer to the socket when the client's queue
+is empty, so fast clients cost one copy out of the ring.
+
+When the producer ends, the server waits for the next one, so it can
+run as a daemon next to repeated acquisitions.
+
+Usage: mhserve [-a address] [-q MB] [-d ps] name
+
+  -a address   unix:/path or tcp:port          (unix:/tmp/mhserve.sock)
+  -q MB        send queue per client           (64)
+  -d ps        input dead time, as InputDeadTime of the demo (0 = intrinsic)
+  name         shared memory object, as ShmName of the demo
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "mhdefin.h"
+#include "mhshm.h"
+#include "mhstream.h"
+#include "tttrdecode.h"
+#include "histanalysis.h"
+#include "histcorrect.h"
+#include "mhrt.h"
+
+
+#define MAXCLIENTS  32
+#define NCOUNTS     (MAXINPCHAN + 1)   // sync, then the inputs
+
+typedef struct
+{
+  int fd;
+  StreamSubscribe sub;
+  char* queue;                  // frames not yet sent, queue[head..tail)
+  size_t head, tail;
+  char in[sizeof(StreamHeader) + sizeof(StreamSubscribe)];
+  size_t inlen;
+  uint32_t skip;                // for the decimation of events
+  uint64_t dropped;             // frames
+  uint64_t reportedlost, reporteddropped;
+  double lastperiod;
+  uint64_t lastcounts[NCOUNTS];
+} Client;
+
+static unsigned int buffer[TTREADMAX];
+static TTTREvent events[TTREADMAX];
+static TTTREvent selected[TTREADMAX];
+static unsigned int histogram[NCOUNTS][T3HISTBINS];
+static unsigned int histout[T3HISTBINS];
+static unsigned int corrected[T3HISTBINS];
+static uint64_t counts[NCOUNTS];
+static uint64_t nsync;                 // sync periods in the run, the last event's
+static HistCorrector corrector;
+static int inputdeadtime;
+
+static Client clients[MAXCLIENTS];
+static size_t queuesize = 64 * 1024 * 1024;
+static StreamHello hello;
+static double runstart;
+static uint64_t ringlost;
+
+
+static void Drop(Client* c)
+{
+  close(c->fd);
+  free(c->queue);
+  memset(c, 0, sizeof(Client));
+  c->fd = -1;
+}
+
+
+// sends what is queued, as far as the socket takes it
+static void Flush(Client* c)
+{
+  ssize_t done;
+
+  while (c->tail > c->head)
+  {
+    done = send(c->fd, c->queue + c->head, c->tail - c->head, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (done < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      {
+        Drop(c);
+      }
+      return;
+    }
+    c->head += done;
+  }
+  c->head = c->tail = 0;
+}
+
+
+// queues a frame of up to two payload parts, sending directly if possible
+static void Enqueue(Client* c, uint32_t type, const void* p1, size_t n1, const void* p2, size_t n2)
+{
+  StreamHeader hdr;
+  struct iovec iov[3];
+  struct msghdr msg;
+  size_t need = sizeof(hdr) + n1 + n2;
+  ssize_t done = 0;
+  int i;
+
+  if (c->fd < 0)
+  {
+    return;
+  }
+  hdr.length = (uint32_t)(n1 + n2);
+  hdr.type = type;
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = (void*)p1;
+  iov[1].iov_len = n1;
+  iov[2].iov_base = (void*)p2;
+  iov[2].iov_len = n2;
+
+  if (c->tail == c->head)
+  {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    done = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (done < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      {
+        Drop(c);
+        return;
+      }
+      done = 0;
+    }
+    if ((size_t)done == need)
+    {
+      return;
+    }
+  }
+  else if (c->tail + need > queuesize)
+  {
+    memmove(c->queue, c->queue + c->head, c->tail - c->head);  // compact
+    c->tail -= c->head;
+    c->head = 0;
+  }
+
+  // a frame that was partly sent must be completed, others may be dropped
+  if ((done == 0) && (c->tail + need > queuesize))
+  {
+    c->dropped++;
+    return;
+  }
+  for (i = 0; i < 3; i++)
+  {
+    if ((size_t)done >= iov[i].iov_len)
+    {
+      done -= iov[i].iov_len;
+      continue;
+    }
+    memcpy(c->queue + c->tail, (char*)iov[i].iov_base + done, iov[i].iov_len - done);
+    c->tail += iov[i].iov_len - done;
+    done = 0;
+  }
+}
+
+
+static void Accept(int listenfd)
+{
+  Client* c = NULL;
+  int fd, i;
+  int size = 8 * 1024 * 1024;
+
+  fd = accept(listenfd, NULL, NULL);
+  if (fd < 0)
+  {
+    return;
+  }
+  for (i = 0; i < MAXCLIENTS; i++)
+  {
+    if (clients[i].fd < 0)
+    {
+      c = &clients[i];
+      break;
+    }
+  }
+  // the rest of a partly sent frame is always queued, so leave room for one
+  if ((c == NULL) || ((c->queue = (char*)malloc(queuesize + sizeof(StreamHeader) + sizeof(events))) == NULL))
+  {
+    close(fd);
+    return;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  c->fd = fd;
+  c->lastperiod = RtNow();
+  printf("\nclient %d connected", i);
+  fflush(stdout);
+  if (hello.run)
+  {
+    Enqueue(c, STREAM_HELLO, &hello, sizeof(hello), NULL, 0);
+  }
+}
+
+
+// reads subscriptions, anything else from a client is a protocol error
+static void Receive(Client* c)
+{
+  StreamHeader* hdr = (StreamHeader*)c->in;
+  ssize_t got;
+
+  while (1)
+  {
+    got = read(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen);
+    if (got <= 0)
+    {
+      if ((got == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+      {
+        printf("\nclient %d disconnected", (int)(c - clients));
+        fflush(stdout);
+        Drop(c);
+      }
+      return;
+    }
+    c->inlen += got;
+    if ((c->inlen >= sizeof(StreamHeader))
+      && ((hdr->type != STREAM_SUBSCRIBE) || (hdr->length != sizeof(StreamSubscribe))))
+    {
+      printf("\nclient %d: protocol error", (int)(c - clients));
+      Drop(c);
+      return;
+    }
+    if (c->inlen == sizeof(c->in))
+    {
+      memcpy(&c->sub, c->in + sizeof(StreamHeader), sizeof(StreamSubscribe));
+      if ((c->sub.histbins == 0) || (c->sub.histbins > T3HISTBINS) || (c->sub.histbins & (c->sub.histbins - 1)))
+      {
+        c->sub.histbins = T3HISTBINS;
+      }
+      memcpy(c->lastcounts, counts, sizeof(counts));
+      c->inlen = 0;
+    }
+  }
+}
+
+
+// mode and resolution are those of the newest run, the same unless
+// the server lags a whole run behind
+static void NewRun(ShmRing* ring, uint32_t run)
+{
+  int i;
+
+  memset(&hello, 0, sizeof(hello));
+  hello.version = STREAM_VERSION;
+  ShmRun(ring, &hello.mode, &hello.resolution);
+  hello.run = run;
+  memset(histogram, 0, sizeof(histogram));
+  memset(counts, 0, sizeof(counts));
+  nsync = 0;
+  runstart = RtNow();
+  for (i = 0; i < MAXCLIENTS; i++)
+  {
+    if (clients[i].fd >= 0)
+    {
+      memset(clients[i].lastcounts, 0, sizeof(counts));
+      Enqueue(&clients[i], STREAM_HELLO, &hello, sizeof(hello), NULL, 0);
+    }
+  }
+}
+
+
+static void SendEvents(Client* c, int nev)
+{
+  uint32_t dec = (c->sub.decimate > 1) ? c->sub.decimate : 1;
+  int i, n = 0, ch;
+
+  for (i = 0; i < nev; i++)
+  {
+    ch = events[i].Channel;
+    if ((ch > 0) && !(ch & EVENT_MARKER) && !((c->sub.channelmask >> (ch - 1)) & 1))
+    {
+      continue;
+    }
+    if (++c->skip >= dec)
+    {
+      selected[n++] = events[i];
+      c->skip = 0;
+    }
+  }
+  if (n > 0)
+  {
+    Enqueue(c, STREAM_EVENTS, selected, n * sizeof(TTTREvent), NULL, 0);
+  }
+}
+
+
+// the corrector for the sync periods counted in the run so far; their
+// rate tells the period, the window before bin 0 reaches back into, and
+// already includes any divider
+static int SetupCorrector(double now)
+{
+  CorrSettings cs;
+
+  if ((nsync == 0) || (now <= runstart))
+  {
+    return -1;
+  }
+  memset(&cs, 0, sizeof(cs));
+  cs.resolution = hello.resolution;
+  cs.histlen = T3HISTBINS;
+  cs.syncrate = (int)(nsync / (now - runstart) + 0.5);
+  cs.inputdeadtime = inputdeadtime;
+  return CorrectorSetup(&corrector, &cs);
+}
+
+
+// the histogram of input ch as the client wants it
+static const unsigned int* Histogram(Client* c, int ch, double now)
+{
+  HistCorrection r;
+
+  if (!(c->sub.streams & STREAM_WANT_CORRECTED))
+  {
+    return histogram[ch];
+  }
+  memcpy(corrected, histogram[ch], sizeof(corrected));
+  if ((SetupCorrector(now) < 0) || (HistCorrectOne(&corrector, corrected, (double)nsync, &r) < 0))
+  {
+    return histogram[ch];  // no resolution or no sync period yet
+  }
+  return corrected;
+}
+
+
+static void SendPeriodic(Client* c, double now)
+{
+  StreamRates rates;
+  StreamHisto h;
+  StreamAnalysis sa;
+  HistAnalysis a;
+  const unsigned int* hist;
+  double dt = now - c->lastperiod;
+  int i, ch, nrates = 1;
+
+  if ((c->sub.period == 0) || (dt * 1e3 < c->sub.period))
+  {
+    return;
+  }
+  c->lastperiod = now;
+
+  if (c->sub.streams & STREAM_WANT_RATES)
+  {
+    memset(&rates, 0, sizeof(rates));
+    rates.elapsed = now - runstart;
+    for (ch = 0; ch < NCOUNTS; ch++)
+    {
+      rates.rate[ch] = (counts[ch] - c->lastcounts[ch]) / dt;
+      if (counts[ch])
+      {
+        nrates = ch + 1;
+      }
+    }
+    rates.nrates = nrates;
+    Enqueue(c, STREAM_RATES, &rates, sizeof(rates) - (NCOUNTS - nrates) * sizeof(double), NULL, 0);
+  }
+  memcpy(c->lastcounts, counts, sizeof(counts));
+
+  if ((c->sub.streams & STREAM_WANT_HISTO) && (hello.mode == MODE_T3))
+  {
+    h.nbins = c->sub.histbins;
+    h.binwidth = T3HISTBINS / h.nbins;
+    h.reserved = 0;
+    for (ch = 1; ch < NCOUNTS; ch++)
+    {
+      if (!((c->sub.channelmask >> (ch - 1)) & 1) || (counts[ch] == 0))
+      {
+        continue;
+      }
+      h.channel = ch;
+      hist = Histogram(c, ch, now);
+      memset(histout, 0, h.nbins * sizeof(unsigned int));
+      for (i = 0; i < T3HISTBINS; i++)
+      {
+        histout[i / h.binwidth] += hist[i];
+      }
+      Enqueue(c, STREAM_HISTO, &h, sizeof(h), histout, h.nbins * sizeof(unsigned int));
+    }
+  }
+
+  if ((c->sub.streams & STREAM_WANT_ANALYSIS) && (hello.mode == MODE_T3))
+  {
+    for (ch = 1; ch < NCOUNTS; ch++)
+    {
+      if (!((c->sub.channelmask >> (ch - 1)) & 1) || (counts[ch] == 0))
+      {
+        continue;
+      }
+      HistAnalyzeOne(Histogram(c, ch, now), T3HISTBINS, 0, &a);
+      sa.channel = ch;
+      sa.peakbin = a.peakbin;
+      sa.total = a.total;
+      sa.background = a.background;
+      sa.centroid = a.centroid * hello.resolution;
+      sa.fwhm = a.fwhm * hello.resolution;
+      sa.lifetime = a.lifetime * hello.resolution;
+      Enqueue(c, STREAM_ANALYSIS, &sa, sizeof(sa), NULL, 0);
+    }
+  }
+}
+
+
+static void SendLost(Client* c)
+{
+  StreamLost lost;
+
+  if ((ringlost != c->reportedlost) || (c->dropped != c->reporteddropped))
+  {
+    lost.records = ringlost;
+    lost.frames = c->dropped;
+    c->reportedlost = ringlost;
+    c->reporteddropped = c->dropped;
+    Enqueue(c, STREAM_LOST, &lost, sizeof(lost), NULL, 0);
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  const char* address = STREAM_DEFAULTADDR;
+  const char* name;
+  struct pollfd pfd[MAXCLIENTS + 1];
+  ShmRing* ring = NULL;
+  TTTRDecoder dec;
+  uint32_t run = 0, readrun;
+  int listenfd, opt, i, n, nev, np, want, ch;
+  double now;
+
+  while ((opt = getopt(argc, argv, "a:q:d:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'a':
+      address = optarg;
+      break;
+    case 'q':
+      queuesize = (size_t)atoi(optarg) * 1024 * 1024;
+      break;
+    case 'd':
+      inputdeadtime = atoi(optarg);
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ((optind != argc - 1) || (queuesize == 0) || (inputdeadtime < 0))
+  {
+    printf("usage: %s [-a address] [-q MB] [-d ps] name\n", argv[0]);
+    return 1;
+  }
+  name = argv[optind];
+
+  signal(SIGPIPE, SIG_IGN);
+  listenfd = StreamListen(address);
+  if (listenfd < 0)
+  {
+    printf("\ncannot listen on %s (%s)\n", address, strerror(errno));
+    return 1;
+  }
+  for (i = 0; i < MAXCLIENTS; i++)
+  {
+    clients[i].fd = -1;
+  }
+  memset(&dec, 0, sizeof(dec));
+  printf("\nServing %s on %s", name, address);
+  fflush(stdout);
+
+  while (1)
+  {
+    // the set of streams some client wants
+    want = 0;
+    for (i = 0; i < MAXCLIENTS; i++)
+    {
+      if (clients[i].fd >= 0)
+      {
+        want |= clients[i].sub.streams;
+      }
+    }
+
+    n = 0;
+    if (ring == NULL)
+    {
+      ring = ShmAttach(name);
+      if (ring)
+      {
+        printf("\nattached to %s", name);
+        fflush(stdout);
+        run = 0;
+        ringlost = 0;
+      }
+    }
+    else
+    {
+      n = ShmReadRun(ring, buffer, TTREADMAX, &ringlost, &readrun);
+      if (n < 0)
+      {
+        printf("\nthe producer has ended, waiting for the next");
+        fflush(stdout);
+        ShmDetach(ring);
+        ring = NULL;
+        n = 0;
+      }
+      else if (readrun != run)
+      {
+        run = readrun;  // the records read are all of it
+        NewRun(ring, run);
+        DecoderInit(&dec, hello.mode, hello.resolution, 0); // T3: no sync period, one wraparound per segment
+      }
+    }
+
+    if (n > 0)
+    {
+      for (i = 0; i < MAXCLIENTS; i++)
+      {
+        if ((clients[i].fd >= 0) && (clients[i].sub.streams & STREAM_WANT_RAW))
+        {
+          Enqueue(&clients[i], STREAM_RAW, buffer, n * sizeof(unsigned int), NULL, 0);
+        }
+      }
+      if (want & (STREAM_WANT_EVENTS | STREAM_WANT_RATES | STREAM_WANT_HISTO | STREAM_WANT_ANALYSIS))
+      {
+        nev = (hello.mode == MODE_T2) ? DecodeT2(&dec, buffer, n, events) : DecodeT3(&dec, buffer, n, events);
+        for (i = 0; i < nev; i++)
+        {
+          ch = events[i].Channel;
+          if (!(ch & EVENT_MARKER))
+          {
+            counts[ch]++;
+            histogram[ch][events[i].DTime]++;
+          }
+        }
+        if ((hello.mode == MODE_T3) && (nev > 0))
+        {
+          nsync = events[nev - 1].Time;
+        }
+        for (i = 0; i < MAXCLIENTS; i++)
+        {
+          if ((clients[i].fd >= 0) && (clients[i].sub.streams & STREAM_WANT_EVENTS))
+          {
+            SendEvents(&clients[i], nev);
+          }
+        }
+      }
+    }
+
+    now = RtNow();
+    for (i = 0; i < MAXCLIENTS; i++)
+    {
+      if (clients[i].fd >= 0)
+      {
+        SendPeriodic(&clients[i], now);
+      }
+      if (clients[i].fd >= 0)
+      {
+        SendLost(&clients[i]);
+      }
+    }
+
+    // wait only if there was nothing to read
+    np = 0;
+    pfd[np].fd = listenfd;
+    pfd[np].events = POLLIN;
+    np++;
+    for (i = 0; i < MAXCLIENTS; i++)
+    {
+      if (clients[i].fd >= 0)
+      {
+        pfd[np].fd = clients[i].fd;
+        pfd[np].events = POLLIN | ((clients[i].tail > clients[i].head) ? POLLOUT : 0);
+        np++;
+      }
+    }
+    if (poll(pfd, np, (n > 0) ? 0 : (ring ? 1 : 1000)) <= 0)
+    {
+      continue;
+    }
+    if (pfd[0].revents & POLLIN)
+    {
+      Accept(listenfd);
+    }
+    for (i = 0; i < MAXCLIENTS; i++)
+    {
+      if (clients[i].fd >= 0)
+      {
+        Receive(&clients[i]);
+      }
+      if ((clients[i].fd >= 0) && (clients[i].tail > clients[i].head))
+      {
+        Flush(&clients[i]);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,216 @@
+/************************************************************************
+
+Throughput benchmark of the shared memory record ring
+
+Creates a ring (../common/mhshm.h), forks consumer processes that
+attach to it and publishes batches of records as fast as possible, or
+at a given rate, for a fixed time. Every record holds the low 32 bits
+of its position in the stream, so each consumer verifies that what it
+got is intact and in order. Optionally one consumer is slowed down, to
+show that it loses records while the producer and the other consumers
+are not affected.
+
+Usage: mhshmbench [-c consumers] [-t seconds] [-b batch] [-n records]
+                  [-r records/s] [-s us] [name]
+
+  -c consumers   number of consumer processes               (2)
+  -t seconds     duration                                   (5)
+  -b batch       records per publish                        (65536)
+  -n records     ring size                                  (16777216)
+  -r records/s   publish rate, 0 = as fast as possible      (0)
+  -s us          sleep of consumer 0 after every read       (0)
+  name           shared memory object                       (/mhshmbench)
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mhdefin.h"
+#include "mhshm.h"
+#include "mhrt.h"
+
+
+#define MAXCONSUMERS  SHM_MAXCONSUMERS
+
+static unsigned int buffer[TTREADMAX];
+
+
+static int Consumer(const char* name, int index, int slow, int ready)
+{
+  ShmRing* ring;
+  uint64_t lost = 0, records = 0, corrupt = 0, pos;
+  double t0 = 0, t1;
+  int n, i;
+
+  ring = ShmAttach(name);
+  if (ring == NULL)
+  {
+    printf("\nconsumer %d cannot attach (%s)", index, strerror(errno));
+    return 1;
+  }
+  if (write(ready, "r", 1) != 1)
+  {
+    ShmDetach(ring);
+    return 1;
+  }
+  while ((n = ShmRead(ring, buffer, TTREADMAX, &lost)) >= 0)
+  {
+    if (n == 0)
+    {
+      usleep(100);
+      continue;
+    }
+    if (records == 0)
+    {
+      t0 = RtNow();
+    }
+    pos = ShmTail(ring) - n;
+    for (i = 0; i < n; i++)
+    {
+      if (buffer[i] != (unsigned int)(pos + i))
+      {
+        corrupt++;
+      }
+    }
+    records += n;
+    if (slow)
+    {
+      usleep(slow);
+    }
+  }
+  t1 = RtNow();
+  printf("\nconsumer %d%s  %12llu records  %12llu lost  %llu corrupt  %8.1f Mrecords/s", index,
+    slow ? " (slow)" : "       ", (unsigned long long)records, (unsigned long long)lost,
+    (unsigned long long)corrupt, (t1 > t0) ? records / (t1 - t0) * 1e-6 : 0.0);
+  fflush(stdout);
+  ShmDetach(ring);
+  return corrupt ? 2 : 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  const char* name = "/mhshmbench";
+  int consumers = 2, batch = 65536, slow = 0;
+  double seconds = 5, rate = 0, ringsize = 16777216;
+  ShmRing* ring;
+  pid_t pid[MAXCONSUMERS];
+  int ready[2];
+  char c;
+  double t0, t;
+  uint64_t pos = 0;
+  int opt, i, status, failed = 0;
+
+  while ((opt = getopt(argc, argv, "c:t:b:n:r:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      consumers = atoi(optarg);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 'b':
+      batch = atoi(optarg);
+      break;
+    case 'n':
+      ringsize = atof(optarg);
+      break;
+    case 'r':
+      rate = atof(optarg);
+      break;
+    case 's':
+      slow = atoi(optarg);
+      break;
+    default:
+      printf("usage: %s [-c consumers] [-t seconds] [-b batch] [-n records] [-r records/s] [-s us] [name]\n",
+        argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    name = argv[optind];
+  }
+  if ((consumers < 0) || (consumers > MAXCONSUMERS) || (batch < 1) || (batch > TTREADMAX)
+    || (seconds <= 0) || (ringsize < 1) || (rate < 0))
+  {
+    printf("\ninvalid arguments\n");
+    return 1;
+  }
+
+  ring = ShmCreate(name, (uint64_t)ringsize);
+  if (ring == NULL)
+  {
+    printf("\ncannot create %s (%s)\n", name, strerror(errno));
+    return 1;
+  }
+  ShmNewRun(ring, MODE_T2, 5.0);
+  printf("\nShared memory ring benchmark, %d consumers, batches of %d records", consumers, batch);
+
+  if (pipe(ready) != 0)
+  {
+    ShmClose(ring);
+    return 1;
+  }
+  fflush(stdout);
+  for (i = 0; i < consumers; i++)
+  {
+    pid[i] = fork();
+    if (pid[i] == 0)
+    {
+      close(ready[0]);
+      exit(Consumer(name, i, (i == 0) ? slow : 0, ready[1]));
+    }
+  }
+  close(ready[1]);
+  for (i = 0; i < consumers; i++)
+  {
+    if (read(ready[0], &c, 1) != 1)
+    {
+      printf("\na consumer failed to start");
+      failed = 1;
+      break;
+    }
+  }
+  close(ready[0]);
+
+  t0 = RtNow();
+  while (!failed && ((t = RtNow() - t0) < seconds))
+  {
+    if ((rate > 0) && (pos > rate * t))
+    {
+      usleep(100);
+      continue;
+    }
+    for (i = 0; i < batch; i++)
+    {
+      buffer[i] = (unsigned int)(pos + i);
+    }
+    ShmPublish(ring, buffer, batch);
+    pos += batch;
+  }
+  t = RtNow() - t0;
+  printf("\nproducer             %12llu records  %8.1f Mrecords/s  %6.2f GB/s", (unsigned long long)pos,
+    pos / t * 1e-6, pos * 4.0 / t * 1e-9);
+  ShmPrintStats(ring, stdout);
+  ShmClose(ring);
+
+  for (i = 0; i < consumers; i++)
+  {
+    if ((waitpid(pid[i], &status, 0) < 0) || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+      failed = 1;
+    }
+  }
+  printf("\n");
+  return failed;
+}
@@ -0,0 +1,170 @@
+/************************************************************************
+
+Consumer of the live TTTR record stream in shared memory
+
+Attaches to the ring the tttrmode demo publishes with ShmName set (see
+../common/mhshm.h) and, once per second, reports the record rate and
+the records lost because this consumer fell behind. It can record the
+stream to a file and count the events per channel, and is meant as a
+starting point for live displays and other consumers.
+
+Usage: mhshmcat [-o file] [-d] [-t seconds] name
+
+  -o file     write the raw records to file, as tttrmode does
+  -d          decode and count events per channel (T2 or T3, as
+              announced by the producer for the current run)
+  -t seconds  stop after this time, default is until the producer ends
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "mhshm.h"
+#include "tttrdecode.h"
+#include "mhrt.h"
+
+
+static unsigned int buffer[TTREADMAX];
+static TTTREvent events[TTREADMAX];
+static uint64_t counts[MAXINPCHAN + 1];
+static uint64_t markers;
+
+
+int main(int argc, char* argv[])
+{
+  ShmRing* ring;
+  TTTRDecoder dec;
+  FILE* fpout = NULL;
+  const char* outname = NULL;
+  int decode = 0;
+  double seconds = 0, t0, now, lastreport, resolution;
+  uint64_t lost = 0, records = 0, lastrecords = 0, lastlost = 0;
+  uint32_t run, lastrun = 0;
+  int mode = 0;
+  int opt, n, nev, i;
+
+  while ((opt = getopt(argc, argv, "o:dt:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      outname = optarg;
+      break;
+    case 'd':
+      decode = 1;
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    printf("usage: %s [-o file] [-d] [-t seconds] name\n", argv[0]);
+    return 1;
+  }
+
+  ring = ShmAttach(argv[optind]);
+  if (ring == NULL)
+  {
+    printf("\ncannot attach to %s (%s)\n", argv[optind], strerror(errno));
+    return 1;
+  }
+  if (outname && ((fpout = fopen(outname, "wb")) == NULL))
+  {
+    printf("\ncannot open output file %s\n", outname);
+    ShmDetach(ring);
+    return 1;
+  }
+  printf("\nAttached to %s", argv[optind]);
+  memset(&dec, 0, sizeof(dec));
+
+  t0 = lastreport = RtNow();
+  while (1)
+  {
+    n = ShmReadRun(ring, buffer, TTREADMAX, &lost, &run);
+    if (n < 0)
+    {
+      printf("\nThe producer has ended the stream.");
+      break;
+    }
+    now = RtNow();
+    if ((seconds > 0) && (now - t0 >= seconds))
+    {
+      break;
+    }
+    if (now - lastreport >= 1.0)
+    {
+      printf("\n%8.1f s  %12.0f records/s  %12llu lost", now - t0,
+        (records - lastrecords) / (now - lastreport), (unsigned long long)(lost - lastlost));
+      fflush(stdout);
+      lastreport = now;
+      lastrecords = records;
+      lastlost = lost;
+    }
+    if (n == 0)
+    {
+      usleep(1000);
+      continue;
+    }
+    records += n;
+
+    if (run != lastrun)
+    {
+      ShmRun(ring, &mode, &resolution);
+      printf("\nRun %u, mode T%d", run, (mode == MODE_T2) ? 2 : 3);
+      DecoderInit(&dec, mode, resolution, 0);
+      lastrun = run;
+    }
+    if (fpout && (fwrite(buffer, 4, n, fpout) != (unsigned)n))
+    {
+      printf("\nfile write error\n");
+      break;
+    }
+    if (decode)
+    {
+      nev = (mode == MODE_T2) ? DecodeT2(&dec, buffer, n, events) : DecodeT3(&dec, buffer, n, events);
+      for (i = 0; i < nev; i++)
+      {
+        if (events[i].Channel & EVENT_MARKER)
+        {
+          markers++;
+        }
+        else
+        {
+          counts[events[i].Channel]++;
+        }
+      }
+    }
+  }
+
+  printf("\n\n%llu records received, %llu lost", (unsigned long long)records, (unsigned long long)lost);
+  if (decode)
+  {
+    for (i = 0; i <= MAXINPCHAN; i++)
+    {
+      if (counts[i])
+      {
+        printf("\n  %s %2d %12llu", i ? "input" : "sync ", i, (unsigned long long)counts[i]);
+      }
+    }
+    printf("\n  markers  %12llu", (unsigned long long)markers);
+  }
+  printf("\n");
+  if (fpout)
+  {
+    fclose(fpout);
+  }
+  ShmDetach(ring);
+  return 0;
+}
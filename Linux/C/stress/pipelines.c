@@ -0,0 +1,431 @@
+/************************************************************************
+
+End-to-end check of the tttrmode pipeline configurations
+
+mhstress models the consumer with its own simplified loops. This runs
+the real tttrmode binary against the simulated MHLib (../mhsim) in the
+configurations its main loop wires differently, and checks what comes
+out of each run:
+
+  plain      Polling=0, blocking reads
+  polling    Polling=1
+  compress   Compress=1 with CompressThreads=2
+  inline     Compress=1 with CompressThreads=0, coding in the reader
+  index      IndexInterval, the index agrees with the file
+  shm        ShmName, every record written is published
+  throttle   Throttle=1 with LiveCounts=1
+  recovery   OverrunRecovery=1 with a reader that stalls long enough
+             to overrun at the simulator's default rates, the file
+             holds one segment block per reported segment
+  all        all of the above at once
+
+Every run must exit with status 0, report no FIFO overrun (except with
+recovery) and leave a file that decodes without errors and with
+increasing times. Where there is an index, its totals must match the
+decoded counts, and decoding from a seek to its middle entry must give
+the rest of them.
+
+Usage: mhpipelines [options] [configuration...]
+
+  -t path        tttrmode binary                      (../tttrmode/tttrmode)
+  -m 2|3         T2 or T3 mode                        (2)
+  -T ms          acquisition time per run             (3000)
+  -r cps         simulated count rate per channel     (simulator default)
+  -w file        output file of the runs              (mhpipelines.tmp)
+
+Without names all configurations are run. The exit status is the
+number of configurations that failed. LD_LIBRARY_PATH defaults to
+../mhsim.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mhdefin.h"
+#include "tttrdecode.h"
+#include "tttrcodec.h"
+#include "tttrindex.h"
+
+
+#define CHUNK        65536   // records decoded at a time
+#define STALL        "1500"    // ms the reader stalls after every second with recovery
+#define STALLFIFO    "1048576" // records, the least tttrmode accepts
+
+typedef struct
+{
+  const char* name;
+  const char* settings;
+  int compress;
+  int index;
+  int shm;
+  int throttle;
+  int recovery;
+} Config;
+
+typedef struct
+{
+  uint64_t records;
+  uint64_t counts[MAXINPCHAN + 2];  // as in the index: sync, inputs, markers
+  uint32_t segments;
+  uint64_t firsttime;
+  int errors;
+} Decoded;
+
+static const Config configs[] =
+{
+  { "plain",    "Polling=0",                                0, 0, 0, 0, 0 },
+  { "polling",  "Polling=1",                                0, 0, 0, 0, 0 },
+  { "compress", "Compress=1 CompressThreads=2",             1, 0, 0, 0, 0 },
+  { "inline",   "Compress=1 CompressThreads=0",             1, 0, 0, 0, 0 },
+  { "index",    "IndexInterval=65536",                      0, 1, 0, 0, 0 },
+  { "shm",      "ShmName=/mhpipelines",                     0, 0, 1, 0, 0 },
+  { "throttle", "Throttle=1 LiveCounts=1",                  0, 0, 0, 1, 0 },
+  { "recovery", "OverrunRecovery=1 FifoSize=" STALLFIFO,    0, 0, 0, 0, 1 },
+  { "all",      "Polling=1 Compress=1 CompressThreads=2 IndexInterval=65536 "
+                "ShmName=/mhpipelines Throttle=1 LiveCounts=1 "
+                "OverrunRecovery=1 FifoSize=" STALLFIFO,    1, 1, 1, 1, 1 },
+};
+
+static unsigned int buffer[CHUNK];
+static TTTREvent events[CHUNK];
+static char output[65536];
+
+static const char* tttrmode = "../tttrmode/tttrmode";
+static int mode = MODE_T2;
+static int tacq = 3000;
+static const char* rate = NULL;
+static const char* outname = "mhpipelines.tmp";
+
+
+static void GotSegment(void* user, const SegmentInfo* segment)
+{
+  ((Decoded*)user)->segments++;
+}
+
+
+static FILE* OpenOutput(int* compressed, CodecStats* stats)
+{
+  int m;
+
+  *compressed = CodecIsCompressed(outname);
+  if (*compressed < 0)
+  {
+    return NULL;
+  }
+  return *compressed ? CodecOpenRead(outname, 0, &m, stats) : fopen(outname, "rb");
+}
+
+
+// decodes fp to the end with dec, counting as the index does
+static void DecodeRest(FILE* fp, TTTRDecoder* dec, int ncounts, Decoded* out)
+{
+  uint64_t last = 0;
+  size_t n;
+  int i, nev, first = 1;
+
+  dec->GotSegment = GotSegment;
+  dec->User = out;
+  while ((n = fread(buffer, 4, CHUNK, fp)) > 0)
+  {
+    out->records += n;
+    nev = (mode == MODE_T2) ? DecodeT2(dec, buffer, (int)n, events) : DecodeT3(dec, buffer, (int)n, events);
+    for (i = 0; i < nev; i++)
+    {
+      if (first)
+      {
+        out->firsttime = events[i].Time;
+        first = 0;
+      }
+      else if (events[i].Time < last)
+      {
+        out->errors++;
+      }
+      last = events[i].Time;
+      if (events[i].Channel & EVENT_MARKER)
+      {
+        out->counts[ncounts - 1]++;
+      }
+      else if (events[i].Channel < ncounts - 1)
+      {
+        out->counts[events[i].Channel]++;
+      }
+    }
+  }
+}
+
+
+static int Fail(const Config* c, const char* what)
+{
+  printf("\n  %s: %s", c->name, what);
+  return 1;
+}
+
+
+static int CheckIndex(const Config* c, const Decoded* all)
+{
+  const IndexEntry* end;
+  const IndexEntry* e;
+  const uint64_t* counts;
+  TTTRIndex* idx;
+  TTTRDecoder dec;
+  CodecStats stats;
+  Decoded rest;
+  char idxname[1024];
+  FILE* fp;
+  int64_t mid;
+  int i, compressed, failed = 0;
+
+  snprintf(idxname, sizeof(idxname), "%s%s", outname, INDEX_SUFFIX);
+  idx = IndexLoad(idxname);
+  if (idx == NULL)
+  {
+    return Fail(c, "cannot load the index");
+  }
+  end = IndexGet(idx, idx->n - 1);
+  counts = IndexCounts(idx, idx->n - 1);
+  if (!(end->flags & INDEX_END) || (end->record != all->records))
+  {
+    failed = Fail(c, "the index does not end at the last record");
+  }
+  for (i = 0; i < (int)idx->hdr.ncounts; i++)
+  {
+    if (counts[i] != all->counts[(i < (int)idx->hdr.ncounts - 1) ? i : MAXINPCHAN + 1])
+    {
+      failed = Fail(c, "the index totals differ from the decoded counts");
+      break;
+    }
+  }
+  if (idx->n < 3)
+  {
+    failed = Fail(c, "the index has no interval entries");
+  }
+
+  // from the middle entry on, the events must be the rest of the totals
+  mid = idx->n / 2;
+  e = IndexGet(idx, mid);
+  memset(&rest, 0, sizeof(rest));
+  fp = OpenOutput(&compressed, &stats);
+  if ((fp == NULL) || (IndexSeek(idx, mid, fp, &dec) != 0))
+  {
+    failed = Fail(c, "cannot seek to the middle index entry");
+  }
+  else
+  {
+    DecodeRest(fp, &dec, idx->hdr.ncounts, &rest);
+    if ((rest.records != all->records - e->record) || (rest.firsttime < e->time) || rest.errors)
+    {
+      failed = Fail(c, "decoding from the middle index entry goes wrong");
+    }
+    counts = IndexCounts(idx, mid);
+    for (i = 0; i < (int)idx->hdr.ncounts; i++)
+    {
+      if (counts[i] + rest.counts[i] != all->counts[(i < (int)idx->hdr.ncounts - 1) ? i : MAXINPCHAN + 1])
+      {
+        failed = Fail(c, "the counts from the middle index entry do not add up");
+        break;
+      }
+    }
+  }
+  if (fp)
+  {
+    fclose(fp);
+  }
+  IndexFree(idx);
+  return failed;
+}
+
+
+static int RunConfig(const Config* c)
+{
+  char cmd[2048];
+  const char* p;
+  unsigned long long published = 0, segments = 0;
+  CodecStats stats;
+  TTTRDecoder dec;
+  Decoded all;
+  FILE* fp;
+  size_t len = 0, n;
+  int status, compressed, failed = 0;
+
+  if (c->recovery)
+  {
+    setenv("MHSIM_STALL", STALL, 1);
+    setenv("MHSIM_FIFOSIZE", STALLFIFO, 1);
+  }
+  else
+  {
+    unsetenv("MHSIM_STALL");
+    unsetenv("MHSIM_FIFOSIZE");
+  }
+  unlink(outname);  // a failed run must not leave the last file to check
+  snprintf(cmd, sizeof(cmd), "%s -b Mode=%d Tacq=%d OutFile=%s %s 2>&1",
+    tttrmode, mode, tacq, outname, c->settings);
+  fp = popen(cmd, "r");
+  if (fp == NULL)
+  {
+    return Fail(c, "cannot run tttrmode");
+  }
+  while ((len < sizeof(output) - 1) && ((n = fread(output + len, 1, sizeof(output) - 1 - len, fp)) > 0))
+  {
+    len += n;
+  }
+  output[len] = 0;
+  while (fread(cmd, 1, sizeof(cmd), fp) > 0)  // drain what does not fit
+  {
+  }
+  status = pclose(fp);
+
+  if ((status == -1) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+  {
+    failed = Fail(c, "tttrmode failed");
+  }
+  if (!c->recovery && strstr(output, "FiFo Overrun"))
+  {
+    failed = Fail(c, "FIFO overrun");
+  }
+  if (c->throttle && !strstr(output, "Throttle:"))
+  {
+    failed = Fail(c, "no throttle report");
+  }
+
+  memset(&all, 0, sizeof(all));
+  memset(&stats, 0, sizeof(stats));
+  fp = OpenOutput(&compressed, &stats);
+  if (fp == NULL)
+  {
+    failed = Fail(c, "cannot open the output");
+  }
+  else
+  {
+    DecoderInit(&dec, mode, 0, 0);
+    DecodeRest(fp, &dec, MAXINPCHAN + 2, &all);
+    fclose(fp);
+    if (compressed != c->compress)
+    {
+      failed = Fail(c, c->compress ? "the output is not compressed" : "the output is compressed");
+    }
+    if (stats.errors)
+    {
+      failed = Fail(c, "compressed blocks fail to decode");
+    }
+    if (all.errors)
+    {
+      failed = Fail(c, "times go backwards");
+    }
+    if (all.records == 0)
+    {
+      failed = Fail(c, "no records");
+    }
+  }
+
+  if (c->shm)
+  {
+    p = strstr(output, "\nShared memory ");
+    p = p ? strchr(p, ':') : NULL;
+    if ((p == NULL) || (sscanf(p + 1, "%llu", &published) != 1) || (published != all.records))
+    {
+      failed = Fail(c, "shared memory did not publish every record");
+    }
+  }
+  if (c->recovery)
+  {
+    p = strstr(output, "Overrun recovery:");
+    if ((p == NULL) || (sscanf(p, "Overrun recovery: %*d overruns, %llu segments", &segments) != 1))
+    {
+      failed = Fail(c, "no recovery report");
+    }
+    else if ((segments < 2) || (segments != all.segments))
+    {
+      failed = Fail(c, "segment blocks do not match the recovery report");
+    }
+  }
+  if (c->index && (fp != NULL))
+  {
+    failed |= CheckIndex(c, &all);
+  }
+
+  printf("\n%-10s %s  %llu records", c->name, failed ? "FAILED" : "ok    ",
+    (unsigned long long)all.records);
+  if (c->recovery)
+  {
+    printf(", %u segments", all.segments);
+  }
+  if (failed)
+  {
+    printf("\n---- tttrmode output ----\n%s\n-------------------------", output);
+  }
+  fflush(stdout);
+  return failed;
+}
+
+
+int main(int argc, char* argv[])
+{
+  char idxname[1024];
+  int opt, i, j, found;
+  int failed = 0;
+
+  while ((opt = getopt(argc, argv, "t:m:T:r:w:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      tttrmode = optarg;
+      break;
+    case 'm':
+      mode = (atoi(optarg) == 3) ? MODE_T3 : MODE_T2;
+      break;
+    case 'T':
+      tacq = atoi(optarg);
+      break;
+    case 'r':
+      rate = optarg;
+      break;
+    case 'w':
+      outname = optarg;
+      break;
+    default:
+      printf("usage: %s [-t tttrmode] [-m 2|3] [-T ms] [-r cps] [-w outfile] [configuration...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if ((tacq < ACQTMIN) || (tacq > ACQTMAX))
+  {
+    printf("\ninvalid arguments\n");
+    return 1;
+  }
+  if (rate)
+  {
+    setenv("MHSIM_RATE", rate, 1);
+  }
+  setenv("LD_LIBRARY_PATH", "../mhsim", 0);
+
+  printf("\nMultiHarp tttrmode pipeline check");
+  printf("\n~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
+  printf("\nT%d mode, %d ms per run\n", (mode == MODE_T2) ? 2 : 3, tacq);
+
+  for (i = 0; i < (int)(sizeof(configs) / sizeof(configs[0])); i++)
+  {
+    found = (optind == argc);
+    for (j = optind; j < argc; j++)
+    {
+      found |= (strcmp(argv[j], configs[i].name) == 0);
+    }
+    if (found)
+    {
+      failed += RunConfig(&configs[i]);
+    }
+  }
+  snprintf(idxname, sizeof(idxname), "%s%s", outname, INDEX_SUFFIX);
+  unlink(outname);
+  unlink(idxname);
+
+  printf("\n\n%s\n", failed ? "FAILED" : "all configurations ok");
+  return failed;
+}
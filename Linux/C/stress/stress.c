@@ -0,0 +1,454 @@
+/************************************************************************
+
+FIFO headroom and overrun stress test for MultiHarp acquisition loops
+
+Runs the acquisition loop of the tttrmode demo against the simulated
+MHLib (../mhsim) and injects consumer stalls, such as slow disk writes
+or analysis spikes. For each processing pipeline it searches the
+highest count rate that runs the full acquisition time without
+FLAG_FIFOFULL, and reports the peak FIFO fill seen at that rate.
+
+Usage: mhstress [options] [pipeline...]
+
+  -m 2|3         T2 or T3 mode                                  (2)
+  -T ms          acquisition time per trial                     (2000)
+  -l cps         lowest count rate per channel to try           (1e4)
+  -h cps         highest count rate per channel to try          (1e7)
+  -i n           bisection steps                                (8)
+  -F records     simulated FIFO size                            (4194304)
+  -s ms          stall duration, 0 = none                       (0)
+  -p ms          mean interval between stalls                   (1000)
+  -r             random (exponential) stall intervals instead of periodic
+  -o file        write the FIFO fill trajectories as CSV
+  -w file        output file of the write pipelines             (mhstress.tmp)
+
+Pipelines: read (discard), write (as tttrmode), decode, histo (T3
+only, decode and histogram) and full (decode, histogram and write).
+Without names all pipelines that apply to the mode are tested. They
+are simplified models of the consumer for finding the headroom;
+mhpipelines (pipelines.c) runs tttrmode itself in its configurations
+and checks the files it writes.
+
+The simulator generates records when they are read, so the generator
+time is part of the consumer time here. To exclude it, replay a
+recording with MHSIM_REPLAY=file and MHSIM_PACE=realtime.
+
+Note: This is a console application
+
+************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "mhdefin.h"
+#include "mhlib.h"
+#include "errorcodes.h"
+#include "mhsim.h"
+#include "tttrdecode.h"
+#include "mhrt.h"
+
+
+#define MAXSAMPLES   100000
+#define SAMPLEPERIOD 0.01    // s between trajectory samples
+
+typedef struct
+{
+  const char* name;
+  int write;
+  int decode;
+  int histo;
+} Pipeline;
+
+typedef struct
+{
+  int overrun;
+  double peakfill;       // fraction of the FIFO size
+  double recordrate;     // records/s actually read
+  double seconds;        // until done or overrun
+  int nsamples;
+} Trial;
+
+static const Pipeline pipelines[] =
+{
+  { "read",   0, 0, 0 },
+  { "write",  1, 0, 0 },
+  { "decode", 0, 1, 0 },
+  { "histo",  0, 1, 1 },
+  { "full",   1, 1, 1 },
+};
+
+static unsigned int buffer[TTREADMAX];
+static TTTREvent events[TTREADMAX];
+static unsigned int histogram[MAXINPCHAN + 1][T3HISTBINS];
+
+static float sampletime[MAXSAMPLES];
+static float samplefill[MAXSAMPLES];
+
+static int dev = -1;
+static int mode = MODE_T2;
+static int tacq = 2000;
+static double fifosize = 4194304;
+static double stall = 0;         // s
+static double stallinterval = 1; // s
+static int stallrandom = 0;
+static const char* outname = "mhstress.tmp";
+
+
+static double NextStall(void)
+{
+  if (stallrandom)
+  {
+    return -stallinterval * log(1.0 - rand() / (RAND_MAX + 1.0));
+  }
+  return stallinterval;
+}
+
+
+// one acquisition at the given count rate per channel
+static int RunTrial(const Pipeline* pl, double rate, Trial* tr)
+{
+  TTTRDecoder dec = { 0 };
+  FILE* fpout = NULL;
+  double t0, t, nextsample, nextstall, level, records = 0;
+  int retcode, flags, nRecords, ctcstatus, nev, j;
+  char Errorstring[40];
+
+  memset(tr, 0, sizeof(Trial));
+  if (pl->write)
+  {
+    fpout = fopen(outname, "wb");
+    if (fpout == NULL)
+    {
+      printf("\ncannot open output file %s\n", outname);
+      return -1;
+    }
+  }
+
+  retcode = MHSim_SetCountRate(dev, rate);
+  if (retcode == MH_ERROR_NONE)
+  {
+    retcode = MH_StartMeas(dev, tacq);
+  }
+  if (retcode < 0)
+  {
+    MH_GetErrorString(Errorstring, retcode);
+    printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+    if (fpout)
+    {
+      fclose(fpout);
+    }
+    return -1;
+  }
+
+  t0 = RtNow();
+  nextsample = 0;
+  nextstall = (stall > 0) ? NextStall() : 1e30;
+  while (1)
+  {
+    t = RtNow() - t0;
+    MHSim_GetFiFoLevel(dev, &level);
+    if (level / fifosize > tr->peakfill)
+    {
+      tr->peakfill = level / fifosize;
+    }
+    if ((t >= nextsample) && (tr->nsamples < MAXSAMPLES))
+    {
+      sampletime[tr->nsamples] = (float)t;
+      samplefill[tr->nsamples] = (float)(level / fifosize);
+      tr->nsamples++;
+      nextsample = t + SAMPLEPERIOD;
+    }
+
+    retcode = MH_GetFlags(dev, &flags);
+    if (retcode < 0)
+    {
+      break;
+    }
+    if (flags & FLAG_FIFOFULL)
+    {
+      tr->overrun = 1;
+      break;
+    }
+
+    retcode = MH_ReadFiFo(dev, buffer, &nRecords);
+    if (retcode < 0)
+    {
+      break;
+    }
+
+    if (nRecords)
+    {
+      records += nRecords;
+      if (pl->decode)
+      {
+        nev = (mode == MODE_T2) ? DecodeT2(&dec, buffer, nRecords, events)
+          : DecodeT3(&dec, buffer, nRecords, events);
+        if (pl->histo)
+        {
+          for (j = 0; j < nev; j++)
+          {
+            if (!(events[j].Channel & EVENT_MARKER))
+            {
+              histogram[events[j].Channel][events[j].DTime]++;
+            }
+          }
+        }
+      }
+      if (fpout && (fwrite(buffer, 4, nRecords, fpout) != (unsigned)nRecords))
+      {
+        printf("\nfile write error\n");
+        retcode = -1;
+        break;
+      }
+    }
+    else
+    {
+      retcode = MH_CTCStatus(dev, &ctcstatus);
+      if ((retcode < 0) || ctcstatus)
+      {
+        break;
+      }
+    }
+
+    if (RtNow() - t0 >= nextstall)
+    {
+      usleep((useconds_t)(stall * 1e6));
+      nextstall = RtNow() - t0 + NextStall();
+    }
+  }
+  tr->seconds = RtNow() - t0;
+  tr->recordrate = records / tr->seconds;
+
+  MH_StopMeas(dev);
+  if (fpout)
+  {
+    fclose(fpout);
+    unlink(outname);
+  }
+  if (retcode < 0)
+  {
+    MH_GetErrorString(Errorstring, retcode);
+    printf("\nacquisition error %d (%s). Aborted.\n", retcode, Errorstring);
+    return -1;
+  }
+  return 0;
+}
+
+
+static void WriteTrajectory(FILE* fp, const Pipeline* pl, double rate, const Trial* tr)
+{
+  int i;
+
+  if (fp == NULL)
+  {
+    return;
+  }
+  for (i = 0; i < tr->nsamples; i++)
+  {
+    fprintf(fp, "%s,%.0f,%.3f,%.6f\n", pl->name, rate, sampletime[i], samplefill[i]);
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  double ratelo = 1e4, ratehi = 1e7, lo, hi, rate;
+  int steps = 8;
+  const char* trajname = NULL;
+  FILE* fptraj = NULL;
+  char fifoenv[32];
+  char HW_Serial[9];
+  char Errorstring[40];
+  Trial tr, best;
+  double bestrate;
+  int opt, retcode, p, s, i;
+  int failed = 0;
+
+  while ((opt = getopt(argc, argv, "m:T:l:h:i:F:s:p:ro:w:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'm':
+      mode = (atoi(optarg) == 3) ? MODE_T3 : MODE_T2;
+      break;
+    case 'T':
+      tacq = atoi(optarg);
+      break;
+    case 'l':
+      ratelo = atof(optarg);
+      break;
+    case 'h':
+      ratehi = atof(optarg);
+      break;
+    case 'i':
+      steps = atoi(optarg);
+      break;
+    case 'F':
+      fifosize = atof(optarg);
+      break;
+    case 's':
+      stall = atof(optarg) * 1e-3;
+      break;
+    case 'p':
+      stallinterval = atof(optarg) * 1e-3;
+      break;
+    case 'r':
+      stallrandom = 1;
+      break;
+    case 'o':
+      trajname = optarg;
+      break;
+    case 'w':
+      outname = optarg;
+      break;
+    default:
+      printf("usage: %s [-m 2|3] [-T ms] [-l cps] [-h cps] [-i steps] [-F records]\n"
+        "       [-s stall_ms] [-p interval_ms] [-r] [-o trajectory.csv] [-w outfile] [pipeline...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if ((tacq < ACQTMIN) || (tacq > ACQTMAX) || (ratelo <= 0) || (ratehi < ratelo)
+    || (steps < 0) || (fifosize < 1) || (stallinterval <= 0))
+  {
+    printf("\ninvalid arguments\n");
+    return 1;
+  }
+
+  // the simulator takes its FIFO size from the environment on MH_Initialize
+  sprintf(fifoenv, "%.0f", fifosize);
+  setenv("MHSIM_FIFOSIZE", fifoenv, 1);
+
+  printf("\nMultiHarp FIFO headroom stress test");
+  printf("\n~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
+
+  for (i = 0; i < MAXDEVNUM; i++)
+  {
+    if (MH_OpenDevice(i, HW_Serial) == 0)
+    {
+      dev = i;
+      break;
+    }
+  }
+  if (dev < 0)
+  {
+    printf("\nNo device available.\n");
+    return 1;
+  }
+  retcode = MH_Initialize(dev, mode, 0);
+  if (retcode < 0)
+  {
+    MH_GetErrorString(Errorstring, retcode);
+    printf("\nMH_Initialize error %d (%s). Aborted.\n", retcode, Errorstring);
+    MH_CloseDevice(dev);
+    return 1;
+  }
+
+  if (trajname)
+  {
+    fptraj = fopen(trajname, "w");
+    if (fptraj == NULL)
+    {
+      printf("\ncannot open %s\n", trajname);
+      MH_CloseDevice(dev);
+      return 1;
+    }
+    fprintf(fptraj, "pipeline,rate,time,fill\n");
+  }
+
+  printf("\nMode T%d, Tacq %d ms, FIFO %.0f records", (mode == MODE_T2) ? 2 : 3, tacq, fifosize);
+  if (stall > 0)
+  {
+    printf(", stalls of %.0f ms every %s%.0f ms", stall * 1e3, stallrandom ? "~" : "", stallinterval * 1e3);
+  }
+  printf("\n\n%-8s %14s %14s %10s %14s", "pipeline", "max cps/ch", "records/s", "peak fill", "first overrun");
+
+  for (p = 0; p < (int)(sizeof(pipelines) / sizeof(pipelines[0])); p++)
+  {
+    if (pipelines[p].histo && (mode == MODE_T2))
+    {
+      continue;
+    }
+    if (optind < argc)
+    {
+      for (i = optind; i < argc; i++)
+      {
+        if (strcmp(argv[i], pipelines[p].name) == 0)
+        {
+          break;
+        }
+      }
+      if (i == argc)
+      {
+        continue;
+      }
+    }
+
+    // bisection in log space between a passing and a failing rate
+    bestrate = 0;
+    memset(&best, 0, sizeof(best));
+    lo = ratelo;
+    hi = ratehi;
+    for (s = -2; s < steps; s++)
+    {
+      rate = (s == -2) ? ratehi : (s == -1) ? ratelo : sqrt(lo * hi);
+      if (RunTrial(&pipelines[p], rate, &tr) < 0)
+      {
+        failed = 1;
+        goto ex;
+      }
+      WriteTrajectory(fptraj, &pipelines[p], rate, &tr);
+      if (!tr.overrun)
+      {
+        if (rate > bestrate)
+        {
+          bestrate = rate;
+          best = tr;
+        }
+        lo = rate;
+        if (s == -2)
+        {
+          break;  // even the highest rate is sustainable
+        }
+      }
+      else
+      {
+        hi = rate;
+        if (s == -1)
+        {
+          break;  // not even the lowest rate is
+        }
+      }
+    }
+
+    printf("\n%-8s", pipelines[p].name);
+    if (bestrate > 0)
+    {
+      printf(" %14.0f %14.0f %9.1f%%", bestrate, best.recordrate, best.peakfill * 100);
+    }
+    else
+    {
+      printf(" %14s %14s %10s", "none", "-", "-");
+    }
+    if (bestrate < ratehi)
+    {
+      printf(" %14.0f", hi);
+    }
+    else
+    {
+      printf(" %14s", "-");
+    }
+    fflush(stdout);
+  }
+  printf("\n");
+
+ex:
+  if (fptraj)
+  {
+    fclose(fptraj);
+  }
+  MH_CloseDevice(dev);
+  return failed;
+}
@@ -1,7 +1,9 @@
 /************************************************************************
 
 Demo access to MultiHarp 150/160 hardware via MHLIB v.3.0
-The program performs a measurement based on hardcoded settings.
+The program performs a measurement based on the settings given in a
+configuration file and/or on the command line, see ../common/mhconfig.h.
+Without any arguments it uses the same defaults as before.
 The resulting event data is stored in a binary output file.
 
 Michael Wahl, PicoQuant GmbH, March 2021
@@ -13,6 +15,18 @@ where N is the number of input channels the device has.
 
 Note: This demo writes only raw event data to the output file.
 It does not write a file header as regular .ht* files have it.
+With Compress = 1 the records are block compressed, see
+../common/tttrcodec.h, and ../codec/mhzip restores the raw file.
+Each of the CompressThreads codes some 50-240 MB/s, depending on the
+data and the CPU (mhzip reports it); above that the blocks are stored
+uncompressed rather than hold up the FIFO reads.
+With IndexInterval set a time index is written alongside, see
+../common/tttrindex.h and ../index/mhseek.
+With ColumnFile set the decoded events also go to a columnar archive,
+see ../common/tttrcolumns.h and ../columns/mhcolumns.
+With T2HistPairs set in T2 mode, histograms between any reference and
+target channels are formed while measuring and written to T2HistFile
+like those of histomode, see ../common/t2histo.h.
 
 
 Tested with the following compilers:
@@ -42,9 +56,27 @@ Tested with the following compilers:
 #include "mhdefin.h"
 #include "mhlib.h"
 #include "errorcodes.h"
-
-
-unsigned int buffer[TTREADMAX];
+#include "mhconfig.h"
+#include "mhtrace.h"
+#include "mhpoll.h"
+#include "mhrt.h"
+#include "mhrecover.h"
+#include "mhthrottle.h"
+#include "mhshm.h"
+#include "tttrcodec.h"
+#include "tttrindex.h"
+#include "tttrcolumns.h"
+#include "tttrdecode.h"
+#include "t2histo.h"
+#include "histstats.h"
+#include "histfile.h"
+
+
+unsigned int* buffer = NULL; //TTREADMAX records, see RtAlloc
+TTTREvent* events = NULL; //TTREADMAX events for LiveCounts and T2HistPairs
+uint64_t livecounts[MAXINPCHAN + 1]; //sync (T2 only), then the input channels
+uint64_t livemarkers;
+T2Histo t2histo; //see t2histo.h
 
 
 int main(int argc, char* argv[])
@@ -52,7 +84,7 @@ int main(int argc, char* argv[])
 
   int dev[MAXDEVNUM];
   int found = 0;
-  FILE *fpout;
+  FILE *fpout = NULL;
   int retcode;
   int ctcstatus;
   char LIB_Version[8];
@@ -62,16 +94,32 @@ int main(int argc, char* argv[])
   char HW_Version[16];
   char Errorstring[40];
   int NumChannels;
-  int Mode = MODE_T2; //set T2 or T3 here, observe suitable Sync divider and Range!
-  int Binning = 0; //you can change this, meaningful only in T3 mode
-  int Offset = 0;  //you can change this, meaningful only in T3 mode
-  int Tacq = 10000; //Measurement time in millisec, you can change this
-  int SyncDivider = 1; //you can change this, observe Mode! READ MANUAL!
-
-  int SyncTiggerEdge = 0; //you can change this
-  int SyncTriggerLevel = -50; //you can change this
-  int InputTriggerEdge = 0; //you can change this
-  int InputTriggerLevel = -50; //you can change this
+  MeasConfig base; //settings as loaded, see mhconfig.h
+  MeasConfig cfg;  //settings of the current run of a scan
+  char cfgerror[200];
+  int run;
+  int failed = 0;
+  uint64_t t; //trace time stamp, see mhtrace.h
+  PollState poll; //see mhpoll.h
+  RtJitter loopjitter; //see mhrt.h
+  Recovery recovery; //see mhrecover.h
+  Throttle throttle; //see mhthrottle.h
+  int stageread, stagewrite, stagepublish, stagecounts, stagehisto, stagedisplay;
+  ShmRing* ring = NULL; //see mhshm.h
+  CodecStats codecstats; //see tttrcodec.h
+  FILE* indexed; //output stream with the time index stacked on, see tttrindex.h
+  char idxname[CFG_MAXPATH + 8];
+  FILE* columns; //output stream with the columnar archive writer stacked on, see tttrcolumns.h
+  TTTRDecoder livedec; //for LiveCounts
+  TTTRDecoder histdec; //for T2HistPairs
+  T2HistoSettings histset;
+  int histgap; //the stage was shed, events are missing
+  HistFileHeader hfhdr;
+  FILE* fphist;
+  double elapsed;
+  int rates[MAXINPCHAN];
+  double recordrate;
+  int nev, j;
 
   double Resolution;
   int Syncrate;
@@ -84,6 +132,10 @@ int main(int argc, char* argv[])
   unsigned int Progress;
 
 
+  //defaults, you can change these or override them by file or command line
+  ConfigDefaults(&base, MODE_T2, "tttrmode.out"); //observe suitable Sync divider and Range!
+  base.Tacq = 10000; //Measurement time in millisec
+
   printf("\nMultiHarp MHLib Demo Application                      PicoQuant GmbH, 2021");
   printf("\n~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
   MH_GetLibraryVersion(LIB_Version);
@@ -93,10 +145,50 @@ int main(int argc, char* argv[])
     printf("\nWarning: The application was built for version %s.", LIB_VERSION);
   }
 
-  if ((fpout = fopen("tttrmode.out", "wb")) == NULL)
+  if (ConfigParseArgs(&base, argc, argv) < 0)
   {
-    printf("\ncannot open output file\n");
-    goto ex;
+    return 1;
+  }
+
+  //check everything before the first device call
+  if ((base.Mode != MODE_T2) && (base.Mode != MODE_T3))
+  {
+    printf("\nMode must be %d (T2) or %d (T3). Aborted.\n", MODE_T2, MODE_T3);
+    return 1;
+  }
+  if (ConfigValidate(&base, cfgerror, sizeof(cfgerror)) < 0)
+  {
+    printf("\nInvalid settings: %s. Aborted.\n", cfgerror);
+    return 1;
+  }
+  if (base.T2HistPairs[0] && (T2HistoParsePairs(base.T2HistPairs, MAXINPCHAN, &histset) < 0))
+  {
+    printf("\nT2HistPairs must be ref:target,... with channels 0 (sync) to %d. Aborted.\n", MAXINPCHAN);
+    return 1;
+  }
+
+  buffer = (unsigned int*)RtAlloc(TTREADMAX * sizeof(unsigned int), base.LowLatency);
+  if (base.LiveCounts || base.T2HistPairs[0])
+  {
+    events = (TTTREvent*)RtAlloc(TTREADMAX * sizeof(TTTREvent), base.LowLatency);
+  }
+  if ((buffer == NULL) || ((base.LiveCounts || base.T2HistPairs[0]) && (events == NULL)))
+  {
+    printf("\nOut of memory. Aborted.\n");
+    return 1;
+  }
+  if (base.ShmName[0])
+  {
+    ring = ShmCreate(base.ShmName, base.ShmSize);
+    if (ring == NULL)
+    {
+      printf("\ncannot create shared memory %s\n", base.ShmName);
+      return 1;
+    }
+  }
+  if (base.LowLatency)
+  {
+    RtEnterMeasured(base.RtPriority, base.RtCpu, stdout);
   }
 
 
@@ -135,17 +227,19 @@ int main(int argc, char* argv[])
   if (found < 1)
   {
     printf("\nNo device available.");
+    failed = 1;
     goto ex;
   }
   printf("\nUsing device #%1d", dev[0]);
   printf("\nInitializing the device...");
 
 
-  retcode = MH_Initialize(dev[0], Mode, 0);
+  retcode = MH_Initialize(dev[0], base.Mode, base.RefSource);
   if (retcode < 0)
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_Initialize error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
 
@@ -154,6 +248,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetHardwareInfo error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -167,6 +262,7 @@ int main(int argc, char* argv[])
   {
     MH_GetErrorString(Errorstring, retcode);
     printf("\nMH_GetNumOfInputChannels error %d (%s). Aborted.\n", retcode, Errorstring);
+    failed = 1;
     goto ex;
   }
   else
@@ -174,224 +270,653 @@ int main(int argc, char* argv[])
     printf("\nDevice has %i input channels.", NumChannels);
   }
 
-  printf("\n\nUsing the following settings:\n");
-
-  printf("Mode              : %d\n", Mode);
-  printf("Binning           : %d\n", Binning);
-  printf("Offset            : %d\n", Offset);
-  printf("AcquisitionTime   : %d\n", Tacq);
-  printf("SyncDivider       : %d\n", SyncDivider);
-  printf("SyncTiggerEdge    : %d\n", SyncTiggerEdge);
-  printf("SyncTriggerLevel  : %d\n", SyncTriggerLevel);
-  printf("InputTriggerEdge  : %d\n", InputTriggerEdge);
-  printf("InputTriggerLevel : %d\n", InputTriggerLevel);
-
-
-  retcode = MH_SetSyncDiv(dev[0], SyncDivider);
-  if (retcode < 0)
+  //all runs of a scan use the same open device, only the settings change
+  for (run = 0; run < ConfigNumRuns(&base); run++)
   {
-   MH_GetErrorString(Errorstring, retcode);
-    printf("\nPH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    ConfigForRun(&base, run, &cfg);
 
-  retcode =MH_SetSyncEdgeTrg(dev[0], SyncTriggerLevel, SyncTiggerEdge);
-  if (retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    if (cfg.Compress) //compressed by worker threads behind fwrite
+    {
+      fpout = CodecOpenWrite(cfg.OutFile, cfg.Mode, cfg.CompressThreads, 1, &codecstats);
+    }
+    else
+    {
+      fpout = fopen(cfg.OutFile, "wb");
+    }
+    if (fpout == NULL)
+    {
+      printf("\ncannot open output file %s\n", cfg.OutFile);
+      failed = 1;
+      goto ex;
+    }
 
-  retcode = MH_SetSyncChannelOffset(dev[0], 0);
-  if (retcode<0)
-  {
-   MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    if (cfg.NumScan > 0)
+    {
+      printf("\n\nRun %d of %d, %s = %lld", run + 1, cfg.NumScan, cfg.ScanParam, cfg.ScanValues[run]);
+    }
+    printf("\n\nUsing the following settings:\n");
+    ConfigPrint(&cfg, stdout);
 
-  for (i = 0; i < NumChannels; i++) // we use the same input offset for all channels
-  {
-    retcode = MH_SetInputEdgeTrg(dev[0], i, InputTriggerLevel, InputTriggerEdge);
+
+    retcode = MH_SetSyncDiv(dev[0], cfg.SyncDivider);
     if (retcode < 0)
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+     MH_GetErrorString(Errorstring, retcode);
+      printf("\nPH_SetSyncDiv error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    retcode =MH_SetInputChannelOffset(dev[0], i, 0);
+    retcode =MH_SetSyncEdgeTrg(dev[0], cfg.SyncTriggerLevel, cfg.SyncTriggerEdge);
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    retcode = MH_SetInputChannelEnable(dev[0], i, 1);
+    retcode = MH_SetSyncChannelOffset(dev[0], cfg.SyncChannelOffset);
+    if (retcode<0)
+    {
+     MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_SetSyncChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+
+    retcode = MH_SetSyncDeadTime(dev[0], cfg.SyncDeadTime > 0, cfg.SyncDeadTime);
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetSyncDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-  }
 
-  if (Mode != MODE_T2)
-  {
-    retcode = MH_SetBinning(dev[0], Binning);
+    for (i = 0; i < NumChannels; i++) // we use the same input offset for all channels
+    {
+      retcode = MH_SetInputEdgeTrg(dev[0], i, cfg.InputTriggerLevel, cfg.InputTriggerEdge);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputEdgeTrg error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode =MH_SetInputChannelOffset(dev[0], i, cfg.InputChannelOffset);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode = MH_SetInputDeadTime(dev[0], i, cfg.InputDeadTime > 0, cfg.InputDeadTime);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputDeadTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode = MH_SetInputChannelEnable(dev[0], i, (int)((cfg.ChannelMask >> i) & 1));
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetInputChannelEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+    }
+
+    if (cfg.MarkerEnable)
+    {
+      retcode = MH_SetMarkerEdges(dev[0], cfg.MarkerEdges & 1, (cfg.MarkerEdges >> 1) & 1,
+        (cfg.MarkerEdges >> 2) & 1, (cfg.MarkerEdges >> 3) & 1);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetMarkerEdges error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode = MH_SetMarkerHoldoffTime(dev[0], cfg.MarkerHoldoff);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetMarkerHoldoffTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+    }
+
+    retcode = MH_SetMarkerEnable(dev[0], cfg.MarkerEnable & 1, (cfg.MarkerEnable >> 1) & 1,
+      (cfg.MarkerEnable >> 2) & 1, (cfg.MarkerEnable >> 3) & 1);
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetBinning error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_SetMarkerEnable error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    retcode = MH_SetOffset(dev[0], Offset);
+    if (cfg.Mode != MODE_T2)
+    {
+      retcode = MH_SetBinning(dev[0], cfg.Binning);
+      if (retcode < 0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetBinning error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+
+      retcode = MH_SetOffset(dev[0], cfg.Offset);
+      if (retcode<0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+    }
+
+    retcode = MH_GetResolution(dev[0], &Resolution);
     if (retcode<0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_SetOffset error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
-  }
+    printf("\nResolution is %1.0lfps\n", Resolution);
+    if (cfg.T2HistPairs[0]) //the bins in whole time tags
+    {
+      histset.multistop = cfg.T2HistMultistop;
+      histset.binwidth = (cfg.T2HistBinWidth > Resolution) ? (uint64_t)(cfg.T2HistBinWidth / Resolution + 0.5) : 1;
+      histset.offset = (uint64_t)(cfg.T2HistOffset / Resolution + 0.5);
+      histset.histlen = cfg.T2HistLen;
+      histset.holdback = (uint64_t)(T2HISTO_HOLDBACK / Resolution);
+      T2HistoFree(&t2histo);
+      if (T2HistoInit(&t2histo, &histset, cfg.LowLatency) < 0)
+      {
+        printf("\nOut of memory. Aborted.\n");
+        failed = 1;
+        goto ex;
+      }
+      printf("\nT2 histograms of %d pairs, %d bins of %1.0lfps from %1.0lfps, %s\n", histset.numpairs,
+        histset.histlen, histset.binwidth * Resolution, histset.offset * Resolution,
+        histset.multistop ? "multistop" : "start-stop");
+    }
+    if (ring)
+    {
+      ShmNewRun(ring, cfg.Mode, Resolution);
+    }
 
-  retcode = MH_GetResolution(dev[0], &Resolution);
-  if (retcode<0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetResolution error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nResolution is %1.0lfps\n", Resolution);
 
+    printf("\nMeasuring input rates...\n");
 
-  printf("\nMeasuring input rates...\n");
 
+    // After Init allow 150 ms for valid  count rate readings
+    // Subsequently you get new values after every 100ms
+    Sleep(150);
 
-  // After Init allow 150 ms for valid  count rate readings
-  // Subsequently you get new values after every 100ms
-  Sleep(150);
+    retcode = MH_GetSyncRate(dev[0], &Syncrate);
+    if (retcode < 0)
+    {
+      MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetSyncRate error%d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+    printf("\nSyncrate=%1d/s", Syncrate);
 
-  retcode = MH_GetSyncRate(dev[0], &Syncrate);
-  if (retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetSyncRate error%d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  printf("\nSyncrate=%1d/s", Syncrate);
+    if (cfg.IndexInterval > 0) //stacked on the output stream, sees every record written
+    {
+      snprintf(idxname, sizeof(idxname), "%s%s", cfg.OutFile, INDEX_SUFFIX);
+      indexed = IndexOpen(fpout, idxname, cfg.Mode, NumChannels, cfg.IndexInterval, cfg.IndexMarkers,
+        Resolution, (Syncrate > 0) ? 1e12 / Syncrate : 0);
+      if (indexed == NULL)
+      {
+        printf("\ncannot open index file %s\n", idxname);
+        failed = 1;
+        goto ex;
+      }
+      fpout = indexed;
+    }
 
+    if (cfg.ColumnFile[0])
+    {
+      columns = ColumnOpen(fpout, cfg.ColumnFile, cfg.Mode, Resolution, (Syncrate > 0) ? 1e12 / Syncrate : 0);
+      if (columns == NULL)
+      {
+        printf("\ncannot open column file %s\n", cfg.ColumnFile);
+        failed = 1;
+        goto ex;
+      }
+      fpout = columns;
+    }
 
-  for (i = 0; i < NumChannels; i++) // for all channels
-  {
-    retcode = MH_GetCountRate(dev[0], i, &Countrate);
-    if (retcode<0)
+
+    for (i = 0; i < NumChannels; i++) // for all channels
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto ex;
+      retcode = MH_GetCountRate(dev[0], i, &Countrate);
+      if (retcode<0)
+      {
+        MH_GetErrorString(Errorstring, retcode);
+        printf("\nMH_GetCountRate error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
+        goto ex;
+      }
+      printf("\nCountrate[%1d]=%1d/s", i, Countrate);
     }
-    printf("\nCountrate[%1d]=%1d/s", i, Countrate);
-  }
 
-  printf("\n");
+    printf("\n");
 
-  //after getting the count rates you can check for warnings
-  retcode = MH_GetWarnings(dev[0], &warnings);
-  if (retcode<0)
-  {
-   MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
-  if (warnings)
-  {
-    MH_GetWarningsText(dev[0], warningstext, warnings);
-    printf("\n\n%s", warningstext);
-  }
+    //after getting the count rates you can check for warnings
+    retcode = MH_GetWarnings(dev[0], &warnings);
+    if (retcode<0)
+    {
+     MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_GetWarnings error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
+    }
+    if (warnings)
+    {
+      MH_GetWarningsText(dev[0], warningstext, warnings);
+      printf("\n\n%s", warningstext);
+    }
 
 
-  printf("\npress RETURN to start");
-  getchar();
+    if (!cfg.Batch && (run == 0))
+    {
+      printf("\npress RETURN to start");
+      getchar();
+    }
 
-  printf("\nStarting data collection...\n");
+    printf("\nStarting data collection...\n");
 
-  Progress = 0;
-  printf("\nProgress:%12u", Progress);
+    Progress = 0;
+    printf("\nProgress:%12u", Progress);
 
-  retcode = MH_StartMeas(dev[0], Tacq);
-  if (retcode < 0)
-  {
-    MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    TraceEnable(cfg.TraceFile[0] != 0);
 
-  while (1)
-  {
-    retcode = MH_GetFlags(dev[0], &flags);
+    if (cfg.OverrunRecovery) //starts the measurement, the loop then writes the first segment block
+    {
+      retcode = RecoveryStart(&recovery, dev[0], cfg.Mode, cfg.RefSource, cfg.Tacq);
+    }
+    else
+    {
+      retcode = MH_StartMeas(dev[0], cfg.Tacq);
+    }
     if (retcode < 0)
     {
       MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+      printf("\nMH_StartMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
       goto ex;
     }
 
-    if (flags & FLAG_FIFOFULL)
+    PollInit(&poll, cfg.Polling, cfg.PollMaxSleep);
+    RtJitterReset(&loopjitter);
+
+    //the stages of the loop, the optional ones in the order they may be dropped
+    ThrottleInit(&throttle, cfg.FifoSize, cfg.Throttle);
+    stageread = ThrottleAddStage(&throttle, "read", 0);
+    stagewrite = ThrottleAddStage(&throttle, "write", 0);
+    stagepublish = ring ? ThrottleAddStage(&throttle, "publish", 0) : -1;
+    stagecounts = cfg.LiveCounts ? ThrottleAddStage(&throttle, "counts", 1) : -1;
+    stagehisto = cfg.T2HistPairs[0] ? ThrottleAddStage(&throttle, "histograms", 1) : -1;
+    stagedisplay = ThrottleAddStage(&throttle, "display", 1);
+    memset(livecounts, 0, sizeof(livecounts));
+    livemarkers = 0;
+    DecoderInit(&livedec, cfg.Mode, Resolution, (Syncrate > 0) ? 1e12 / Syncrate : 0);
+    DecoderInit(&histdec, MODE_T2, Resolution, 0);
+    histgap = 0;
+    while (1)
     {
-      printf("\nFiFo Overrun!\n");
-      goto stoptttr;
+      RtJitterTick(&loopjitter);
+      if (PollFlagsDue(&poll))
+      {
+        t = TraceStart();
+        retcode = MH_GetFlags(dev[0], &flags);
+        TraceEnd(TRACE_GETFLAGS, t, 0);
+        if (retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetFlags error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+
+        if ((flags & FLAG_FIFOFULL) && cfg.OverrunRecovery)
+        {
+          if (!recovery.draining) //the reads below empty the FIFO, then it restarts
+          {
+            retcode = RecoveryOverrun(&recovery);
+            if (retcode < 0)
+            {
+              MH_GetErrorString(Errorstring, retcode);
+              printf("\nOverrun recovery error %d (%s). Aborted.\n", retcode, Errorstring);
+              failed = 1;
+              goto stoptttr;
+            }
+          }
+        }
+        else if (flags & FLAG_FIFOFULL)
+        {
+          printf("\nFiFo Overrun!\n");
+          failed = 1;
+          goto stoptttr;
+        }
+      }
+
+      if (cfg.Throttle && ThrottleRatesDue(&throttle))
+      {
+        retcode = MH_GetAllCountRates(dev[0], &Syncrate, rates);
+        if (retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_GetAllCountRates error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto stoptttr;
+        }
+        recordrate = (cfg.Mode == MODE_T2) ? Syncrate : 0; //T3 records carry no sync events
+        for (i = 0; i < NumChannels; i++)
+        {
+          recordrate += rates[i];
+        }
+        ThrottleSetRate(&throttle, recordrate);
+      }
+
+      //the block of a new segment goes through the stages ahead of its records
+      nRecords = cfg.OverrunRecovery ? RecoveryTake(&recovery, buffer) : 0;
+      if (nRecords == 0)
+      {
+        t = TraceStart();
+        ThrottleRun(&throttle, stageread, 0);
+        retcode = MH_ReadFiFo(dev[0], buffer, &nRecords);	//may return less!  
+        ThrottleDone(&throttle, stageread, nRecords);
+        TraceEnd(TRACE_READFIFO, t, nRecords);
+        if (retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_ReadFiFo error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto stoptttr;
+        }
+        PollRead(&poll, nRecords);
+        ThrottleRead(&throttle, nRecords);
+
+        if (cfg.OverrunRecovery && recovery.draining) //restarts once the FIFO is empty
+        {
+          retcode = RecoveryDrain(&recovery, nRecords);
+          if (retcode < 0)
+          {
+            MH_GetErrorString(Errorstring, retcode);
+            printf("\nOverrun recovery error %d (%s). Aborted.\n", retcode, Errorstring);
+            failed = 1;
+            goto stoptttr;
+          }
+          if (retcode == 1) //the overrun came too close to the end
+          {
+            printf("\nDone\n");
+            goto stoptttr;
+          }
+          if (!recovery.draining) //restarted, no pairs across the gap
+          {
+            histgap = 1;
+            DecoderReset(&histdec);
+            continue;
+          }
+        }
+      }
+
+      if (nRecords)
+      {
+        t = TraceStart();
+        ThrottleRun(&throttle, stagewrite, nRecords);
+        if (fwrite(buffer, 4, nRecords, fpout) != (unsigned)nRecords)
+        {
+          printf("\nfile write error\n");
+          failed = 1;
+          goto stoptttr;
+        }
+        ThrottleDone(&throttle, stagewrite, nRecords);
+        TraceEnd(TRACE_WRITE, t, nRecords);
+        Progress += nRecords;
+
+        if (ring) //consumers that fall behind skip ahead, this never waits
+        {
+          t = TraceStart();
+          ThrottleRun(&throttle, stagepublish, nRecords);
+          ShmPublish(ring, buffer, nRecords);
+          ThrottleDone(&throttle, stagepublish, nRecords);
+          TraceEnd(TRACE_PUBLISH, t, nRecords);
+        }
+
+        if (cfg.LiveCounts && ThrottleRun(&throttle, stagecounts, nRecords))
+        {
+          t = TraceStart();
+          nev = (cfg.Mode == MODE_T2) ? DecodeT2(&livedec, buffer, nRecords, events)
+            : DecodeT3(&livedec, buffer, nRecords, events);
+          for (j = 0; j < nev; j++)
+          {
+            if (events[j].Channel & EVENT_MARKER)
+            {
+              livemarkers++;
+            }
+            else
+            {
+              livecounts[events[j].Channel]++;
+            }
+          }
+          ThrottleDone(&throttle, stagecounts, nRecords);
+          TraceEnd(TRACE_PROCESS, t, nRecords);
+        }
+
+        if (cfg.T2HistPairs[0])
+        {
+          if (ThrottleRun(&throttle, stagehisto, nRecords))
+          {
+            t = TraceStart();
+            if (histgap) //the times after shed records lack their overflows, only differences count
+            {
+              T2HistoFinish(&t2histo);
+              histgap = 0;
+            }
+            nev = DecodeT2(&histdec, buffer, nRecords, events);
+            if (T2HistoAdd(&t2histo, events, nev) < 0)
+            {
+              printf("\nOut of memory. Aborted.\n");
+              failed = 1;
+              goto stoptttr;
+            }
+            ThrottleDone(&throttle, stagehisto, nRecords);
+            TraceEnd(TRACE_PROCESS, t, nRecords);
+          }
+          else
+          {
+            histgap = 1;
+          }
+        }
+
+        if (ThrottleRun(&throttle, stagedisplay, nRecords))
+        {
+          t = TraceStart();
+          printf("\b\b\b\b\b\b\b\b\b\b\b\b%12u", Progress);
+          fflush(stdout);
+          ThrottleDone(&throttle, stagedisplay, nRecords);
+          TraceEnd(TRACE_PROCESS, t, nRecords);
+        }
+      }
+      else if (PollCtcDue(&poll))
+      {
+        t = TraceStart();
+        retcode = MH_CTCStatus(dev[0], &ctcstatus);
+        TraceEnd(TRACE_CTCSTATUS, t, 0);
+        if (retcode < 0)
+        {
+          MH_GetErrorString(Errorstring, retcode);
+          printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+          failed = 1;
+          goto ex;
+        }
+        if (ctcstatus)
+        {
+          printf("\nDone\n");
+          goto stoptttr;
+        }
+      }
+
+      //within this loop you can also read the count rates if needed.
     }
 
-    retcode = MH_ReadFiFo(dev[0], buffer, &nRecords);	//may return less!  
+stoptttr:
+
+    retcode = MH_StopMeas(dev[0]);
     if (retcode < 0)
     {
-      MH_GetErrorString(Errorstring, retcode);
-      printf("\nMH_ReadFiFo error %d (%s). Aborted.\n", retcode, Errorstring);
-      goto stoptttr;
+     MH_GetErrorString(Errorstring, retcode);
+      printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
+      failed = 1;
+      goto ex;
     }
 
-    if (nRecords)
+    if (fclose(fpout) != 0)
     {
-      if (fwrite(buffer, 4, nRecords, fpout) != (unsigned)nRecords)
+      printf("\nfile write error\n");
+      failed = 1;
+    }
+    fpout = NULL;
+
+    PollPrintStats(&poll, stdout);
+    if (cfg.Compress)
+    {
+      CodecPrintStats(&codecstats, "Compressed", stdout);
+    }
+    if (cfg.OverrunRecovery)
+    {
+      RecoveryPrint(&recovery, stdout);
+    }
+    if (cfg.Throttle)
+    {
+      ThrottlePrint(&throttle, stdout);
+    }
+    if (ring)
+    {
+      ShmPrintStats(ring, stdout);
+    }
+    if (cfg.LiveCounts)
+    {
+      printf("\nLive counts%s:", throttle.stage[stagecounts].skipped ? " (partial, the stage was shed)" : "");
+      for (i = (cfg.Mode == MODE_T2) ? 0 : 1; i <= NumChannels; i++)
       {
-        printf("\nfile write error\n");
-        goto stoptttr;
+        if (i == 0)
+        {
+          printf("\n  sync     %12llu", (unsigned long long)livecounts[0]);
+        }
+        else
+        {
+          printf("\n  input %2d %12llu", i, (unsigned long long)livecounts[i]);
+        }
       }
-      Progress += nRecords;
-      printf("\b\b\b\b\b\b\b\b\b\b\b\b%12u", Progress);
-      fflush(stdout);
+      printf("\n  markers  %12llu\n", (unsigned long long)livemarkers);
     }
-    else
+    if (cfg.T2HistPairs[0])
     {
-      retcode = MH_CTCStatus(dev[0], &ctcstatus);
+      retcode = MH_GetElapsedMeasTime(dev[0], &elapsed);
       if (retcode < 0)
       {
         MH_GetErrorString(Errorstring, retcode);
-        printf("\nMH_CTCStatus error %d (%s). Aborted.\n", retcode, Errorstring);
+        printf("\nMH_GetElapsedMeasTime error %d (%s). Aborted.\n", retcode, Errorstring);
+        failed = 1;
         goto ex;
       }
-      if (ctcstatus)
+      T2HistoFinish(&t2histo);
+      HistStats(&t2histo.hist, ~0ULL, 0xFFFFFFFF);
+      printf("\nT2 histograms%s:", throttle.stage[stagehisto].skipped ? " (partial, the stage was shed)" : "");
+      for (i = 0; i < histset.numpairs; i++)
       {
-        printf("\nDone\n");
-        goto stoptttr;
+        printf("\n  %2d -> %2d  integral %12llu  peak %10u at %9.0lfps", histset.ref[i], histset.target[i],
+          (unsigned long long)t2histo.hist.stats[i].integral, t2histo.hist.stats[i].peak,
+          (t2histo.hist.stats[i].peakbin * histset.binwidth + histset.offset) * Resolution);
       }
-    }
+      printf("\n");
 
-    //within this loop you can also read the count rates if needed.
-  }
-
-stoptttr:
+      fphist = fopen(cfg.T2HistFile, "wb");
+      if (fphist == NULL)
+      {
+        printf("\ncannot open output file %s\n", cfg.T2HistFile);
+        failed = 1;
+        goto ex;
+      }
+      if (cfg.HistFormat) //pair i as channel i
+      {
+        HistFileInit(&hfhdr, cfg.HistFormat, histset.numpairs, histset.histlen);
+        HistFileSettings(&hfhdr, &cfg);
+        hfhdr.binning = 0; //binned in software, by binwidth time tags that need not be a power of 2
+        hfhdr.binwidth = (uint32_t)histset.binwidth;
+        hfhdr.offset = (int32_t)(histset.offset * Resolution / 1000);
+        hfhdr.channelmask = (histset.numpairs < 64) ? (1ULL << histset.numpairs) - 1 : ~0ULL;
+        hfhdr.syncrate = Syncrate;
+        hfhdr.resolution = histset.binwidth * Resolution;
+        hfhdr.elapsed = elapsed;
+        if (HistFileWrite(fileno(fphist), &hfhdr, t2histo.hist.counts, histset.histlen) < 0)
+        {
+          printf("\nfile write error\n");
+          failed = 1;
+        }
+      }
+      else
+      {
+        fprintf(fphist, "Pairs             : %s\n", cfg.T2HistPairs);
+        fprintf(fphist, "Multistop         : %d\n", histset.multistop);
+        fprintf(fphist, "BinWidth          : %1.0lf\n", histset.binwidth * Resolution);
+        fprintf(fphist, "Offset            : %1.0lf\n", histset.offset * Resolution);
+        fprintf(fphist, "AcquisitionTime   : %1.0lf\n", elapsed);
+        for (j = 0; j < histset.histlen; j++)
+        {
+          for (i = 0; i < histset.numpairs; i++)
+          {
+            fprintf(fphist, "%5u ", HistChannel(&t2histo.hist, i)[j]);
+          }
+          fprintf(fphist, "\n");
+        }
+      }
+      if (fclose(fphist) != 0)
+      {
+        printf("\nfile write error\n");
+        failed = 1;
+      }
+    }
+    if (cfg.LowLatency)
+    {
+      RtJitterPrint(&loopjitter, "loop period", stdout);
+      printf("\n");
+    }
+    if (cfg.TraceFile[0])
+    {
+      TraceEnable(0);
+      TracePrintSummary(stdout);
+      if (TraceExport(cfg.TraceFile) < 0)
+      {
+        printf("\ncannot write trace file %s\n", cfg.TraceFile);
+        failed = 1;
+      }
+    }
 
-  retcode = MH_StopMeas(dev[0]);
-  if (retcode < 0)
-  {
-   MH_GetErrorString(Errorstring, retcode);
-    printf("\nMH_StopMeas error %d (%s). Aborted.\n", retcode, Errorstring);
-    goto ex;
-  }
+    if (failed)
+    {
+      goto ex;
+    }
+  } //end of runs
 
 ex:
 
@@ -403,11 +928,18 @@ ex:
   {
     fclose(fpout);
   }
+  RtFree(buffer, TTREADMAX * sizeof(unsigned int));
+  RtFree(events, TTREADMAX * sizeof(TTTREvent));
+  T2HistoFree(&t2histo);
+  ShmClose(ring);
 
-  printf("\npress RETURN to exit");
-  getchar();
+  if (!base.Batch)
+  {
+    printf("\npress RETURN to exit");
+    getchar();
+  }
 
-  return 0;
+  return failed;
 }
 
 
@@ -0,0 +1,176 @@
+function r = mhcolumnsload(filename, tmin, tmax, channels)
+% MHCOLUMNSLOAD  Loads events of a column archive of the MultiHarp C demos
+%
+% r = mhcolumnsload('tttrmode.mhca')
+% r = mhcolumnsload('tttrmode.mhca', 0.5, 1.0, [1 2])
+%
+% Reads the archives tttrmode writes with ColumnFile set, or
+% ../C/columns/mhcolumns converts, the format is described in
+% ../C/common/tttrcolumns.h. Optionally only the events with
+% tmin <= time < tmax (in s) on the given channels (0 = sync, 1.. =
+% inputs, 255 = markers) are returned; [] leaves a limit out. As in
+% ../Python/mhcolumns.py only the row groups whose statistics can match
+% are decoded. Returns a struct with the header fields and the columns
+% time (ps), dtime, channel and markers.
+
+COL_MAGIC         = hex2dec('4143484D');
+COL_VERSION       = 1;
+COL_MARKERCHANNEL = 255;
+COL_DELTA         = 1;
+MODE_T2           = 2;
+MODE_T3           = 3;
+HEADERSIZE        = 32;
+GROUPWORDS        = 26;    % ColGroup in uint64 words
+TRAILERSIZE       = 32;
+
+if (nargin < 2)
+    tmin = [];
+end
+if (nargin < 3)
+    tmax = [];
+end
+if (nargin < 4)
+    channels = [];
+end
+
+fid = fopen(filename, 'r', 'ieee-le');
+if (fid < 0)
+    error('mhcolumnsload: cannot open %s', filename);
+end
+fseek(fid, 0, 'eof');
+filesize = ftell(fid);
+if (filesize < HEADERSIZE + TRAILERSIZE)
+    fclose(fid);
+    error('mhcolumnsload: %s is not a column archive', filename);
+end
+fseek(fid, 0, 'bof');
+magic        = fread(fid, 1, 'uint32');
+version      = fread(fid, 1, 'uint32');
+r.mode       = fread(fid, 1, 'int32');
+r.grouprows  = fread(fid, 1, 'uint32');
+r.resolution = fread(fid, 1, 'double');   % ps
+r.syncperiod = fread(fid, 1, 'double');   % ps, T3 only, 0 if unknown
+fseek(fid, filesize - TRAILERSIZE, 'bof');
+footer  = fread(fid, 1, 'uint64');
+ngroups = fread(fid, 1, 'uint64');
+r.rows  = fread(fid, 1, 'uint64');
+tmagic  = fread(fid, 1, 'uint32');
+if ((magic ~= COL_MAGIC) || (version ~= COL_VERSION) || (tmagic ~= COL_MAGIC) ...
+        || (footer + ngroups * GROUPWORDS * 8 + TRAILERSIZE ~= filesize))
+    fclose(fid);
+    error('mhcolumnsload: %s is not a column archive, or its writer did not finish', filename);
+end
+fseek(fid, footer, 'bof');
+groups = fread(fid, [GROUPWORDS ngroups], 'uint64=>uint64');
+
+if (r.mode == MODE_T2)
+    unit = r.resolution;
+else
+    unit = r.syncperiod;
+end
+lo = uint64(0);
+hi = intmax('uint64');
+if (~isempty(tmin) || ~isempty(tmax))
+    if (unit <= 0)
+        fclose(fid);
+        error('mhcolumnsload: the archive has no time unit');
+    end
+    if (~isempty(tmin))
+        lo = uint64(floor(tmin * 1e12 / unit));
+    end
+    if (~isempty(tmax))
+        hi = uint64(floor(tmax * 1e12 / unit));
+    end
+end
+mask = intmax('uint64');
+if (~isempty(channels))
+    mask = uint64(0);
+    for c = channels(:)'
+        if (c == COL_MARKERCHANNEL)
+            mask = bitset(mask, 64);
+        elseif (c < 63)
+            mask = bitset(mask, c + 1);
+        end
+    end
+end
+
+% the statistics decide which groups need to be read
+tminw = groups(5, :);
+tmaxw = groups(6, :);
+sel = find((tmaxw >= lo) & (tminw < hi) & (bitand(groups(2, :), mask) ~= 0));
+
+time = cell(numel(sel), 1);
+dtime = cell(numel(sel), 1);
+channel = cell(numel(sel), 1);
+markers = cell(numel(sel), 1);
+for i = 1:numel(sel)
+    g = groups(:, sel(i));
+    t = column(fid, g, 1);
+    keep = (t >= lo) & (t < hi);
+    ch = column(fid, g, 3);
+    if (bitand(g(2), bitcmp(mask)) ~= 0)
+        bits = min(double(ch), 62);
+        bits(ch == COL_MARKERCHANNEL) = 63;
+        ok = bitget(mask, bits + 1) ~= 0;
+        ok = ok & ((ch < 63) | (ch == COL_MARKERCHANNEL));
+        keep = keep & ok;
+    end
+    time{i} = t(keep);
+    v = column(fid, g, 2);
+    dtime{i} = uint16(v(keep));
+    channel{i} = uint8(ch(keep));
+    v = column(fid, g, 4);
+    markers{i} = uint8(v(keep));
+end
+fclose(fid);
+
+r.time = double(vertcat(time{:}, zeros(0, 1, 'uint64'))) * unit;
+r.dtime = vertcat(dtime{:}, zeros(0, 1, 'uint16'));
+r.channel = vertcat(channel{:}, zeros(0, 1, 'uint8'));
+r.markers = vertcat(markers{:}, zeros(0, 1, 'uint8'));
+if (r.mode == MODE_T3)
+    r.time = r.time + double(r.dtime) * r.resolution;
+end
+end
+
+
+function v = column(fid, g, k)
+% the values of column k (1 = time .. 4 = markers) of group g
+n = double(g(1));
+c = g(3 + 6 * (k - 1):8 + 6 * (k - 1));   % offset bytes min max base encoding+width
+encoding = double(bitand(c(6), 255));
+width = double(bitand(bitshift(c(6), -8), 255));
+fseek(fid, double(c(1)), 'bof');
+words = fread(fid, double(c(2)) / 8, 'uint64=>uint64');
+v = unpack(words, n, width);
+if (encoding == 1)             % COL_DELTA, zigzag coded differences
+    d = int64(bitshift(v, -1));
+    odd = bitand(v, 1) ~= 0;
+    d(odd) = -d(odd) - 1;
+    d(1) = int64(c(5));
+    v = uint64(cumsum(d));
+else                           % COL_FOR, offsets from the base
+    v = v + c(5);
+end
+end
+
+
+function v = unpack(words, n, width)
+% n values of width bits, packed LSB first into uint64 words
+if (width == 0)
+    v = zeros(n, 1, 'uint64');
+    return;
+end
+w = [words; uint64(0)];
+pos = (0:n-1)' * width;
+idx = floor(pos / 64) + 1;
+sh = mod(pos, 64);
+v = bitshift(w(idx), -sh);
+spill = sh + width > 64;
+if (any(spill))
+    v(spill) = bitor(v(spill), bitshift(w(idx(spill) + 1), 64 - sh(spill)));
+end
+if (width < 64)
+    v = bitand(v, bitshift(uint64(1), width) - 1);
+end
+end
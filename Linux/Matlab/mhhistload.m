@@ -0,0 +1,139 @@
+function frames = mhhistload(filename)
+% MHHISTLOAD  Loads a binary histogram file of the MultiHarp C demos
+%
+% frames = mhhistload('histomode.out')
+%
+% Reads the files histomode writes with HistFormat = 1, 2 or 3, the
+% format is described in ../C/common/histfile.h. Returns a struct array,
+% one element per frame (a kinetic series has several), with the header
+% fields and counts(bin, channel). Raw counts are mapped with
+% memmapfile, varint coded and sparse counts are expanded vectorized.
+% The totals of an accumulation (Accumulate set) come as uint64.
+
+HISTFILE_MAGIC   = hex2dec('3148484D');
+HISTFILE_VERSION = 1;
+HISTFILE_RAW     = 1;
+HISTFILE_VARINT  = 2;
+HISTFILE_SPARSE  = 3;
+HISTFILE_RAW64   = 4;
+HEADERSIZE       = 128;
+
+fid = fopen(filename, 'r', 'ieee-le');
+if (fid < 0)
+    error('mhhistload: cannot open %s', filename);
+end
+fseek(fid, 0, 'eof');
+filesize = ftell(fid);
+
+frames = struct([]);
+pos = 0;
+while (pos < filesize)
+    if (pos + HEADERSIZE > filesize)
+        fclose(fid);
+        error('mhhistload: cut off header at %d', pos);
+    end
+    fseek(fid, pos, 'bof');
+    h.magic       = fread(fid, 1, 'uint32');
+    h.version     = fread(fid, 1, 'uint32');
+    h.encoding    = fread(fid, 1, 'uint32');
+    h.numchannels = fread(fid, 1, 'uint32');
+    h.histlen     = fread(fid, 1, 'uint32');
+    h.binning     = fread(fid, 1, 'int32');
+    h.offset      = fread(fid, 1, 'int32');   % ns
+    h.syncdivider = fread(fid, 1, 'int32');
+    h.syncrate    = fread(fid, 1, 'int32');   % /s
+    h.tacq        = fread(fid, 1, 'int32');   % ms
+    h.channelmask = fread(fid, 1, 'uint64=>uint64');
+    h.frame       = fread(fid, 1, 'uint64');
+    h.databytes   = fread(fid, 1, 'uint64');
+    h.resolution  = fread(fid, 1, 'double');  % ps
+    h.elapsed     = fread(fid, 1, 'double');  % ms
+    h.start       = fread(fid, 1, 'double');  % s, series frames only
+    h.syncdeadtime  = fread(fid, 1, 'int32'); % ps, 0 = off
+    h.inputdeadtime = fread(fid, 1, 'int32'); % ps, 0 = off
+    h.corrected   = fread(fid, 1, 'uint32');  % 1 = pile-up and dead-time corrected
+    h.acquisitions = fread(fid, 1, 'uint32'); % summed into the counts, 0 = one
+    h.binwidth    = fread(fid, 1, 'uint32');  % base steps or T2 time tags per bin, 0 = unknown
+    if ((h.magic ~= HISTFILE_MAGIC) || (h.version ~= HISTFILE_VERSION))
+        fclose(fid);
+        error('mhhistload: %s is not a histogram file', filename);
+    end
+    pos = pos + HEADERSIZE;
+    if (pos + h.databytes > filesize)
+        fclose(fid);
+        error('mhhistload: cut off frame %d', h.frame);
+    end
+
+    if (h.encoding == HISTFILE_RAW)
+        m = memmapfile(filename, 'Offset', pos, 'Repeat', 1, ...
+            'Format', {'uint32', [h.histlen h.numchannels], 'counts'});
+        h.counts = m.Data.counts;
+    elseif (h.encoding == HISTFILE_RAW64)
+        m = memmapfile(filename, 'Offset', pos, 'Repeat', 1, ...
+            'Format', {'uint64', [h.histlen h.numchannels], 'counts'});
+        h.counts = m.Data.counts;
+    elseif (h.encoding == HISTFILE_VARINT)
+        table = fread(fid, h.numchannels + 1, 'uint64');
+        data = fread(fid, table(end), 'uint8=>uint8');
+        h.counts = zeros(h.histlen, h.numchannels, 'uint32');
+        for c = 1:h.numchannels
+            h.counts(:, c) = uint32(undelta(data(table(c)+1:table(c+1)), h.histlen));
+        end
+    elseif (h.encoding == HISTFILE_SPARSE)
+        table = fread(fid, h.numchannels + 1, 'uint64');
+        data = fread(fid, table(end) / 4, 'uint32=>double');
+        h.counts = zeros(h.histlen, h.numchannels, 'uint32');
+        for c = 1:h.numchannels
+            h.counts(:, c) = unsparse(data(table(c)/4+1:table(c+1)/4), h.histlen);
+        end
+    else
+        fclose(fid);
+        error('mhhistload: unknown encoding %d', h.encoding);
+    end
+
+    if (isempty(frames))
+        frames = h;
+    else
+        frames(end+1) = h;
+    end
+    pos = pos + h.databytes;
+end
+fclose(fid);
+end
+
+
+function counts = undelta(b, n)
+% zigzag coded differences as LEB128 varints back to counts
+ends = bitand(b, 128) == 0;
+if (nnz(ends) ~= n)
+    error('mhhistload: corrupt varint data');
+end
+idx = cumsum([1; ends(1:end-1)]);        % value of every byte
+starts = find([true; ends(1:end-1)]);
+shift = (1:numel(b))' - starts(idx);     % 7 bit group within the value
+z = accumarray(idx, double(bitand(b, 127)) .* 2.^(7 * shift));
+d = z / 2;
+odd = mod(z, 2) == 1;
+d(odd) = -(z(odd) + 1) / 2;
+counts = cumsum(d);
+end
+
+
+function counts = unsparse(w, n)
+% one SparseHist block of ../C/common/histsparse.h back to counts
+counts = zeros(n, 1, 'uint32');
+form = w(1);
+nz = w(3);
+nruns = w(4);
+if (form == 0)                 % SPARSE_DENSE
+    counts(:) = w(5:4+n);
+elseif (form == 1)             % SPARSE_RUNS
+    runs = reshape(w(5:4+2*nruns), 2, nruns);
+    first = repelem(runs(1,:) - cumsum(runs(2,:)) + runs(2,:), runs(2,:));
+    counts(first(:) + (0:nz-1)' + 1) = w(5+2*nruns:4+2*nruns+nz);
+elseif (form == 2)             % SPARSE_PAIRS
+    counts(w(5:4+nz) + 1) = w(5+nz:4+2*nz);
+else
+    error('mhhistload: unknown sparse form %d', form);
+end
+end
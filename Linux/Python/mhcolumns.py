@@ -0,0 +1,162 @@
+# Reader for the columnar event archives of MultiHarp T2/T3 files,
+# written by tttrmode with ColumnFile set or by ../C/columns/mhcolumns.
+# The file format is described in ../C/common/tttrcolumns.h.
+#
+# The archive is mapped with numpy.memmap. Only the row groups whose
+# statistics can match the time range and channels are decoded, and of
+# those only the columns asked for.
+#
+#   import mhcolumns
+#   a = mhcolumns.Archive("tttrmode.mhca")
+#   t = a.read(columns=("time", "channel"), tmin=0.5, tmax=1.0, channels=[1, 2])
+#   t["time"], t["channel"]    # numpy arrays, time in ps
+#
+# or from the command line: python mhcolumns.py archive [start end]
+
+import sys
+import numpy as np
+
+# From tttrcolumns.h
+COL_MAGIC = 0x4143484D
+COL_VERSION = 1
+COL_MARKERCHANNEL = 255
+COL_FOR = 0
+COL_DELTA = 1
+MODE_T2 = 2
+MODE_T3 = 3
+COLUMNS = ("time", "dtime", "channel", "markers")
+DTYPES = (np.uint64, np.uint16, np.uint8, np.uint8)
+
+FileHeader = np.dtype([("magic", "<u4"), ("version", "<u4"), ("mode", "<i4"),
+                       ("grouprows", "<u4"), ("resolution", "<f8"),
+                       ("syncperiod", "<f8")])
+Chunk = np.dtype([("offset", "<u8"), ("bytes", "<u8"), ("min", "<u8"),
+                  ("max", "<u8"), ("base", "<u8"), ("encoding", "u1"),
+                  ("width", "u1"), ("reserved", "u1", 6)])
+Group = np.dtype([("rows", "<u8"), ("channels", "<u8"), ("col", Chunk, 4)])
+Trailer = np.dtype([("footer", "<u8"), ("ngroups", "<u8"), ("rows", "<u8"),
+                    ("magic", "<u4"), ("version", "<u4")])
+
+
+def unpack(words, n, width):
+    """n values of width bits, packed LSB first into uint64 words."""
+    if width == 0:
+        return np.zeros(n, np.uint64)
+    w = np.concatenate((words, np.zeros(1, np.uint64)))
+    pos = np.arange(n, dtype=np.uint64) * np.uint64(width)
+    idx = (pos >> np.uint64(6)).astype(np.intp)
+    sh = pos & np.uint64(63)
+    v = w[idx] >> sh
+    spill = sh + np.uint64(width) > np.uint64(64)
+    if spill.any():
+        v[spill] |= w[idx[spill] + 1] << (np.uint64(64) - sh[spill])
+    if width < 64:
+        v &= np.uint64((1 << width) - 1)
+    return v
+
+
+class Archive:
+    def __init__(self, path):
+        self.map = np.memmap(path, dtype=np.uint8, mode="r")
+        if self.map.size < FileHeader.itemsize + Trailer.itemsize:
+            raise ValueError("%s is not a column archive" % path)
+        self.header = self.map[:FileHeader.itemsize].view(FileHeader)[0]
+        trailer = self.map[-Trailer.itemsize:].view(Trailer)[0]
+        footer = int(trailer["footer"])
+        ngroups = int(trailer["ngroups"])
+        if (self.header["magic"] != COL_MAGIC or self.header["version"] != COL_VERSION
+                or trailer["magic"] != COL_MAGIC
+                or footer + ngroups * Group.itemsize + Trailer.itemsize != self.map.size):
+            raise ValueError("%s is not a column archive, or its writer did not finish" % path)
+        self.groups = self.map[footer:footer + ngroups * Group.itemsize].view(Group)
+        self.mode = int(self.header["mode"])
+        self.resolution = float(self.header["resolution"])
+        self.syncperiod = float(self.header["syncperiod"])
+        self.rows = int(trailer["rows"])
+
+    def unit(self):
+        """ps per unit of the time column."""
+        return self.resolution if self.mode == MODE_T2 else self.syncperiod
+
+    def column(self, g, k):
+        grp = self.groups[g]
+        c = grp["col"][k]
+        n = int(grp["rows"])
+        off = int(c["offset"])
+        words = self.map[off:off + int(c["bytes"])].view(np.uint64)
+        v = unpack(words, n, int(c["width"]))
+        if c["encoding"] == COL_DELTA:
+            d = (v >> np.uint64(1)) ^ (np.uint64(0) - (v & np.uint64(1)))
+            d[0] = c["base"]
+            v = np.cumsum(d, dtype=np.uint64)
+        else:
+            v += c["base"]
+        return v
+
+    def read(self, columns=COLUMNS, tmin=None, tmax=None, channels=None):
+        """The wanted columns of the rows with tmin <= time < tmax (in s)
+        on the given channels (0 = sync, 1.. = inputs, 255 = markers).
+        The time column is returned in ps."""
+        lo, hi = 0, 2**64 - 1
+        if tmin is not None or tmax is not None:
+            if self.unit() <= 0:
+                raise ValueError("the archive has no time unit")
+            if tmin is not None:
+                lo = int(tmin * 1e12 / self.unit())
+            if tmax is not None:
+                hi = int(tmax * 1e12 / self.unit())
+        mask = 2**64 - 1
+        if channels is not None:
+            mask = 0
+            for c in channels:
+                mask |= (1 << 63) if c == COL_MARKERCHANNEL else (1 << c) if c < 63 else 0
+
+        # the statistics decide which groups need to be read
+        tcol = self.groups["col"][:, 0]
+        sel = np.nonzero((tcol["max"] >= np.uint64(lo)) & (tcol["min"] < np.uint64(hi))
+                         & (self.groups["channels"] & np.uint64(mask) != 0))[0]
+
+        want = list(columns)
+        if "time" in want and "dtime" not in want and self.mode == MODE_T3:
+            want.append("dtime")  # for the time in ps
+        out = {name: [] for name in want}
+        for g in sel:
+            keep = None
+            if tcol["min"][g] < lo or tcol["max"][g] >= hi:
+                t = self.column(g, 0)
+                keep = (t >= np.uint64(lo)) & (t < np.uint64(hi))
+            if int(self.groups["channels"][g]) & ~mask:
+                ch = self.column(g, 2)
+                bits = np.where(ch == COL_MARKERCHANNEL, np.uint64(63), np.minimum(ch, np.uint64(62)))
+                ok = ((np.uint64(mask) >> bits) & np.uint64(1) != 0) & ((ch < 63) | (ch == COL_MARKERCHANNEL))
+                keep = ok if keep is None else keep & ok
+            for name in want:
+                k = COLUMNS.index(name)
+                v = self.column(g, k).astype(DTYPES[k])
+                out[name].append(v if keep is None else v[keep])
+        res = {}
+        for name in want:
+            k = COLUMNS.index(name)
+            res[name] = np.concatenate(out[name]) if out[name] else np.zeros(0, DTYPES[k])
+        if "time" in res:
+            t = res["time"].astype(np.float64) * self.unit()
+            if self.mode == MODE_T3 and "dtime" in res:
+                t += res["dtime"] * self.resolution
+            res["time"] = t
+        return {name: res[name] for name in columns}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 4):
+        print("usage: python mhcolumns.py archive [start end]")
+        sys.exit(1)
+    a = Archive(sys.argv[1])
+    tmin = float(sys.argv[2]) if len(sys.argv) == 4 else None
+    tmax = float(sys.argv[3]) if len(sys.argv) == 4 else None
+    r = a.read(columns=("channel",), tmin=tmin, tmax=tmax)
+    print("Mode T%d, %d rows in %d groups" % (a.mode, a.rows, len(a.groups)))
+    print("%d rows match" % len(r["channel"]))
+    ch, n = np.unique(r["channel"], return_counts=True)
+    for c, k in zip(ch, n):
+        print("  %s %12d" % ("markers " if c == COL_MARKERCHANNEL else "input %2d" % c
+                             if c else "sync   0", k))
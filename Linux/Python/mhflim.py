@@ -0,0 +1,71 @@
+# Loader for the FLIM files of the MultiHarp C demos (../C/flim/mhflim),
+# the formats are described in ../C/common/flimfit.h.
+#
+# Both are mapped with numpy.memmap, nothing is copied.
+#
+#   import mhflim
+#   hdr, planes = mhflim.load("result.mhf")
+#   tau = planes["tau1"]      # ps, [y, x]
+#   hdr, cube = mhflim.load("cube.mhc")
+#   decay = cube[y, x]        # counts per bin
+#
+# From the command line: python mhflim.py file
+
+import sys
+import numpy as np
+
+# From flimfit.h
+FLIM_CUBEMAGIC = 0x3143484D
+FLIM_RESULTMAGIC = 0x3146484D
+FLIM_VERSION = 1
+FLIM_BI = 2
+
+PLANES = ("counts", "tau1", "amp1", "tau2", "amp2", "background", "chi2", "iter")
+
+Header = np.dtype([("magic", "<u4"), ("version", "<u4"), ("width", "<u4"), ("height", "<u4"),
+                   ("nbins", "<u4"), ("nplanes", "<u4"), ("model", "<u4"), ("reserved0", "<u4"),
+                   ("binwidth", "<f8"), ("reserved", "u1", 24)])
+
+
+def load(path):
+    """(header, cube[y, x, bin]) of a cube, or (header, dict of planes[y, x]) of a result."""
+    m = np.memmap(path, dtype=np.uint8, mode="r")
+    if m.size < Header.itemsize:
+        raise ValueError("%s: cut off header" % path)
+    hdr = m[:Header.itemsize].view(Header)[0]
+    if hdr["version"] != FLIM_VERSION:
+        raise ValueError("%s: unknown version %d" % (path, hdr["version"]))
+    w, h = int(hdr["width"]), int(hdr["height"])
+    data = m[Header.itemsize:]
+    if hdr["magic"] == FLIM_CUBEMAGIC:
+        n = int(hdr["nbins"])
+        if data.size < w * h * n * 4:
+            raise ValueError("%s: cut off cube" % path)
+        return hdr, data[:w * h * n * 4].view("<u4").reshape(h, w, n)
+    if hdr["magic"] == FLIM_RESULTMAGIC:
+        k = int(hdr["nplanes"])
+        if data.size < w * h * k * 4:
+            raise ValueError("%s: cut off result" % path)
+        planes = data[:w * h * k * 4].view("<f4").reshape(k, h, w)
+        return hdr, dict(zip(PLANES, planes))
+    raise ValueError("%s: not a FLIM file" % path)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("usage: python mhflim.py file")
+        sys.exit(1)
+    hdr, data = load(sys.argv[1])
+    if hdr["magic"] == FLIM_CUBEMAGIC:
+        print("Cube of %d x %d pixels, %d bins of %.0f ps, %d counts"
+              % (hdr["width"], hdr["height"], hdr["nbins"], hdr["binwidth"], data.sum(dtype=np.uint64)))
+        sys.exit(0)
+    fitted = data["iter"] > 0
+    print("Result of %d x %d pixels, %s, %d fitted"
+          % (hdr["width"], hdr["height"], "biexponential" if hdr["model"] == FLIM_BI else "monoexponential",
+             np.count_nonzero(fitted)))
+    names = ("tau1", "tau2", "background", "chi2") if hdr["model"] == FLIM_BI else ("tau1", "background", "chi2")
+    for name in names:
+        v = data[name][fitted]
+        if v.size:
+            print("  %-10s median %10.2f  mean %10.2f  std %10.2f" % (name, np.median(v), v.mean(), v.std()))
@@ -0,0 +1,126 @@
+# Loader for the binary histogram files of the MultiHarp C demos
+# (histomode with HistFormat = 1, 2 or 3), the format is described in
+# ../C/common/histfile.h.
+#
+# Raw frames are mapped with numpy.memmap, nothing is copied. Varint
+# coded and sparse frames are expanded with vectorized numpy. The totals
+# of an accumulation (Accumulate set) come as uint64 counts.
+#
+#   import mhhistfile
+#   frames = mhhistfile.load("histomode.out")
+#   hdr, counts = frames[0]   # counts[channel, bin]
+#
+# A kinetic series gives one (header, counts) per frame.
+# From the command line: python mhhistfile.py file
+
+import sys
+import numpy as np
+
+# From histfile.h
+HISTFILE_MAGIC = 0x3148484D
+HISTFILE_VERSION = 1
+HISTFILE_RAW = 1
+HISTFILE_VARINT = 2
+HISTFILE_SPARSE = 3
+HISTFILE_RAW64 = 4
+
+# From histsparse.h
+SPARSE_DENSE = 0
+SPARSE_RUNS = 1
+SPARSE_PAIRS = 2
+
+Header = np.dtype([("magic", "<u4"), ("version", "<u4"), ("encoding", "<u4"),
+                   ("numchannels", "<u4"), ("histlen", "<u4"), ("binning", "<i4"),
+                   ("offset", "<i4"), ("syncdivider", "<i4"), ("syncrate", "<i4"),
+                   ("tacq", "<i4"), ("channelmask", "<u8"), ("frame", "<u8"),
+                   ("databytes", "<u8"), ("resolution", "<f8"), ("elapsed", "<f8"),
+                   ("start", "<f8"), ("syncdeadtime", "<i4"), ("inputdeadtime", "<i4"),
+                   ("corrected", "<u4"), ("acquisitions", "<u4"), ("binwidth", "<u4"),
+                   ("reserved", "u1", 20)])
+
+
+def varints(data, n):
+    """n LEB128 varints from the bytes in data, as uint64."""
+    ends = (data & 0x80) == 0
+    if np.count_nonzero(ends) != n:
+        raise ValueError("corrupt varint data")
+    starts = np.concatenate(([0], np.nonzero(ends)[0][:-1] + 1))
+    first = np.zeros(len(data), np.int64)
+    first[starts] = starts
+    first = np.maximum.accumulate(first)
+    shift = (7 * (np.arange(len(data)) - first)).astype(np.uint64)
+    parts = (data & 0x7F).astype(np.uint64) << shift
+    return np.add.reduceat(parts, starts)
+
+
+def decode(table, data, numchannels, histlen):
+    counts = np.empty((numchannels, histlen), np.uint32)
+    for c in range(numchannels):
+        z = varints(data[table[c]:table[c + 1]], histlen)
+        d = (z >> np.uint64(1)).astype(np.int64) ^ -(z & np.uint64(1)).astype(np.int64)
+        counts[c] = np.cumsum(d)
+    return counts
+
+
+def unsparse(table, data, numchannels, histlen):
+    counts = np.zeros((numchannels, histlen), np.uint32)
+    for c in range(numchannels):
+        w = data[table[c]:table[c + 1]].view("<u4")
+        form, nnz, nruns = int(w[0]), int(w[2]), int(w[3])
+        if form == SPARSE_DENSE:
+            counts[c] = w[4:4 + histlen]
+        elif form == SPARSE_RUNS:
+            runs = w[4:4 + 2 * nruns].reshape(nruns, 2).astype(np.int64)
+            # bin of every count: run start plus the position in the run
+            first = np.repeat(runs[:, 0] - np.cumsum(runs[:, 1]) + runs[:, 1], runs[:, 1])
+            counts[c, first + np.arange(nnz)] = w[4 + 2 * nruns:4 + 2 * nruns + nnz]
+        elif form == SPARSE_PAIRS:
+            counts[c, w[4:4 + nnz]] = w[4 + nnz:4 + 2 * nnz]
+        else:
+            raise ValueError("unknown sparse form %d" % form)
+    return counts
+
+
+def load(path):
+    """All frames of the file as a list of (header, counts)."""
+    m = np.memmap(path, dtype=np.uint8, mode="r")
+    frames = []
+    pos = 0
+    while pos < m.size:
+        if pos + Header.itemsize > m.size:
+            raise ValueError("%s: cut off header at %d" % (path, pos))
+        hdr = m[pos:pos + Header.itemsize].view(Header)[0]
+        if hdr["magic"] != HISTFILE_MAGIC or hdr["version"] != HISTFILE_VERSION:
+            raise ValueError("%s: not a histogram file" % path)
+        pos += Header.itemsize
+        nch, hlen, size = int(hdr["numchannels"]), int(hdr["histlen"]), int(hdr["databytes"])
+        if pos + size > m.size:
+            raise ValueError("%s: cut off frame %d" % (path, hdr["frame"]))
+        if hdr["encoding"] == HISTFILE_RAW:
+            counts = m[pos:pos + size].view("<u4").reshape(nch, hlen)
+        elif hdr["encoding"] == HISTFILE_RAW64:
+            counts = m[pos:pos + size].view("<u8").reshape(nch, hlen)
+        elif hdr["encoding"] == HISTFILE_VARINT:
+            tsize = (nch + 1) * 8
+            table = m[pos:pos + tsize].view("<u8").astype(np.int64)
+            counts = decode(table, m[pos + tsize:pos + size], nch, hlen)
+        elif hdr["encoding"] == HISTFILE_SPARSE:
+            tsize = (nch + 1) * 8
+            table = m[pos:pos + tsize].view("<u8").astype(np.int64)
+            counts = unsparse(table, m[pos + tsize:pos + size], nch, hlen)
+        else:
+            raise ValueError("%s: unknown encoding %d" % (path, hdr["encoding"]))
+        frames.append((hdr, counts))
+        pos += size
+    return frames
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("usage: python mhhistfile.py file")
+        sys.exit(1)
+    for hdr, counts in load(sys.argv[1]):
+        print("Frame %d: %d channels x %d bins, resolution %.0f ps, elapsed %.1f ms"
+              % (hdr["frame"], hdr["numchannels"], hdr["histlen"], hdr["resolution"], hdr["elapsed"]))
+        for c in range(counts.shape[0]):
+            print("  Integralcount[%d]=%d" % (c, counts[c].sum(dtype=np.uint64)))